@@ -0,0 +1,39 @@
+// Fails the run when a hot path that must not allocate allocates anything.
+// Runs in-process without BenchmarkDotNet so it is cheap enough for every build: dotnet run -c Release -- --gate
+
+using TLScope.src.Services;
+
+namespace TLScope.Benchmarks {
+    public static class AllocationGate {
+        private const int Iterations = 10_000;
+
+        public static int Run() {
+            byte[] clientHello = SampleRecords.ClientHello();
+            byte[] serverHello = SampleRecords.ServerHello();
+
+            int failures = 0;
+            failures += Check("TlsParser.TryParse(ClientHello)", () => {
+                TlsParser.TryParse(clientHello, out TlsHello hello);
+                return hello.CipherCount;
+            });
+            failures += Check("TlsParser.TryParse(ServerHello)", () => {
+                TlsParser.TryParse(serverHello, out TlsHello hello);
+                return hello.CipherSuite;
+            });
+            return failures == 0 ? 0 : 1;
+        }
+
+        private static int Check(string name, Func<int> body) {
+            for (int i = 0; i < 100; i++) {
+                body(); // warm up so tiering and static initialisers are not counted
+            }
+            long before = GC.GetAllocatedBytesForCurrentThread();
+            for (int i = 0; i < Iterations; i++) {
+                body();
+            }
+            long allocated = GC.GetAllocatedBytesForCurrentThread() - before;
+            Console.WriteLine($"{name}: {(double)allocated / Iterations:F1} B/op");
+            return allocated == 0 ? 0 : 1;
+        }
+    }
+}
@@ -0,0 +1,24 @@
+// Login cost: one Argon2id verification with the parameters accounts are created with
+
+using BenchmarkDotNet.Attributes;
+using TLScope.src.Utilities;
+
+namespace TLScope.Benchmarks {
+    [MemoryDiagnoser]
+    public class CryptoBenchmarks {
+        private const string Password = "correct horse battery staple";
+
+        private byte[] _hash = [];
+        private byte[] _salt = [];
+
+        [GlobalSetup]
+        public void Setup() {
+            Crypto.CreatePasswordHash(Password, out _hash, out _salt);
+        }
+
+        [Benchmark]
+        public bool VerifyPasswordHash() {
+            return Crypto.VerifyPasswordHash(Password, _hash, _salt);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+// Connection graph updates: a second's worth of flow deltas and a device batch against graphs of different sizes
+
+using BenchmarkDotNet.Attributes;
+using TLScope.src.Data;
+using TLScope.src.Services;
+using TLScope.src.Utilities;
+
+namespace TLScope.Benchmarks {
+    [MemoryDiagnoser]
+    public class GraphBenchmarks {
+        private const int BatchSize = 256;
+
+        private ConnectionGraph _graph = null!;
+        private FlowDelta[] _flows = [];
+        private DeviceDeltaEventArgs _devices = null!;
+
+        [Params(100, 10_000)]
+        public int Edges { get; set; }
+
+        [GlobalSetup]
+        public void Setup() {
+            _graph = new ConnectionGraph();
+            long now = DateTime.UtcNow.Ticks;
+            var opened = new List<FlowDelta>(Edges);
+            for (int i = 0; i < Edges; i++) {
+                opened.Add(new FlowDelta(Flow(i), true, 0, now));
+            }
+            _graph.Apply(opened);
+
+            // Mostly traffic on known edges, with one new session in sixteen
+            _flows = new FlowDelta[BatchSize];
+            for (int i = 0; i < BatchSize; i++) {
+                _flows[i] = i % 16 == 0
+                    ? new FlowDelta(Flow(Edges + i), true, 0, now)
+                    : new FlowDelta(Flow(i * 7919 % Edges), false, 1460, now);
+            }
+
+            var changes = new DeviceChange[64];
+            for (int i = 0; i < changes.Length; i++) {
+                var device = new DeviceRecord(0xC0A80001u + (uint)i, 0x02_00_00_00_00_00ul + (ulong)i,
+                    $"Device_{i + 1}", null, now, 2.0f, DeviceState.Up);
+                changes[i] = new DeviceChange(DeviceChangeKind.Updated, device, DeviceFields.RoundTripTime);
+            }
+            _devices = new DeviceDeltaEventArgs(changes);
+        }
+
+        // Clients are spread over a /24, servers over the rest of the address space
+        private static FlowKey Flow(int index) {
+            return new FlowKey(FlowKey.MapIPv4(0xC0A80001u + (uint)(index % 254)), FlowKey.MapIPv4(0x0B000000u + (uint)index),
+                (ushort)(32768 + index % 28000), 443);
+        }
+
+        [Benchmark]
+        public long ApplyFlowBatch() {
+            _graph.Apply(_flows);
+            return _graph.Snapshot.Version;
+        }
+
+        [Benchmark]
+        public long ApplyDeviceDelta() {
+            _graph.Apply(_devices);
+            return _graph.Snapshot.Version;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+// Graph view layout: one host joining and leaving an already laid out graph, which should only relax its neighbourhood
+
+using BenchmarkDotNet.Attributes;
+using TLScope.src.Data;
+using TLScope.src.Utilities;
+
+namespace TLScope.Benchmarks {
+    [MemoryDiagnoser]
+    public class GraphLayoutBenchmarks {
+        private GraphLayout _layout = null!;
+        private GraphSnapshot _base = null!;
+        private GraphSnapshot _grown = null!;
+
+        [Params(100, 1000)]
+        public int Edges { get; set; }
+
+        [GlobalSetup]
+        public void Setup() {
+            var graph = new ConnectionGraph();
+            long now = DateTime.UtcNow.Ticks;
+            var opened = new List<FlowDelta>(Edges);
+            for (int i = 0; i < Edges; i++) {
+                opened.Add(new FlowDelta(Flow(i), true, 0, now));
+            }
+            graph.Apply(opened);
+            _base = graph.Snapshot;
+            graph.Apply([new FlowDelta(Flow(Edges), true, 0, now)]);
+            _grown = graph.Snapshot;
+
+            _layout = new GraphLayout();
+            _layout.Update(_base);
+        }
+
+        // Clients are spread over a /24, servers over the rest of the address space, as in GraphBenchmarks
+        private static FlowKey Flow(int index) {
+            return new FlowKey(FlowKey.MapIPv4(0xC0A80001u + (uint)(index % 254)), FlowKey.MapIPv4(0x0B000000u + (uint)index),
+                (ushort)(32768 + index % 28000), 443);
+        }
+
+        [Benchmark]
+        public int JoinAndLeave() {
+            _layout.Update(_grown);
+            return _layout.Update(_base).Nodes.Count;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+// Fallback discovery path: parsing arp-scan output and working out the subnet range
+
+using BenchmarkDotNet.Attributes;
+using TLScope.src.Utilities;
+
+namespace TLScope.Benchmarks {
+    [MemoryDiagnoser]
+    public class ArpScanBenchmarks {
+        private string _output = string.Empty;
+
+        [Params(256, 4096, 65536)]
+        public int Hosts { get; set; }
+
+        [GlobalSetup]
+        public void Setup() {
+            _output = SampleRecords.ArpScanOutput(Hosts);
+        }
+
+        [Benchmark]
+        public int ParseArpScan() {
+            return NetData.ParseArpScan(_output).Count;
+        }
+    }
+
+    [MemoryDiagnoser]
+    public class SubnetBenchmarks {
+        [Benchmark]
+        public int GetIPRange() {
+            int length = 0;
+            foreach (string address in NetData.GetIPRange("192.168.1.37", "255.255.255.0")) {
+                length += address.Length;
+            }
+            return length;
+        }
+
+        [Benchmark]
+        public int GetHostAddresses() {
+            return NetData.GetHostAddresses("10.20.30.40", "255.255.240.0").Count;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+// One device tree frame: a delta touching every device, and one removing and re-adding a tenth of them
+
+using BenchmarkDotNet.Attributes;
+using Terminal.Gui;
+using TLScope.src.Data;
+using TLScope.src.Services;
+using TLScope.src.Views;
+
+namespace TLScope.Benchmarks {
+    [MemoryDiagnoser]
+    public class NetViewBenchmarks {
+        private NetView _view = null!;
+        private DeviceDeltaEventArgs _updates = null!;
+        private DeviceDeltaEventArgs _removals = null!;
+        private DeviceDeltaEventArgs _additions = null!;
+
+        [Params(10, 100, 1000)]
+        public int Devices { get; set; }
+
+        [GlobalSetup]
+        public void Setup() {
+            Application.Init(new FakeDriver(), new FakeMainLoop(() => FakeConsole.ReadKey(true)));
+
+            var store = new DeviceStore();
+            long now = DateTime.UtcNow.Ticks;
+            for (int i = 0; i < Devices; i++) {
+                string name = $"Device_{i + 1}";
+                store.Upsert(0x0A000001u + (uint)i, 0x02_00_00_00_00_00ul + (ulong)i, "eth0", now, () => name, false, out _);
+            }
+            _view = new NetView(store);
+
+            var records = new List<DeviceRecord>();
+            store.CopyTo(records);
+            _updates = new DeviceDeltaEventArgs(records
+                .Select(r => new DeviceChange(DeviceChangeKind.Updated, r with { RoundTripTime = 1.5f },
+                    DeviceFields.LastSeen | DeviceFields.RoundTripTime))
+                .ToArray());
+            var churned = records.Take(Math.Max(1, Devices / 10)).ToArray();
+            _removals = new DeviceDeltaEventArgs(churned
+                .Select(r => new DeviceChange(DeviceChangeKind.Removed, r, DeviceFields.None)).ToArray());
+            _additions = new DeviceDeltaEventArgs(churned
+                .Select(r => new DeviceChange(DeviceChangeKind.Added, r, DeviceFields.All)).ToArray());
+        }
+
+        [GlobalCleanup]
+        public void Cleanup() {
+            Application.Shutdown();
+        }
+
+        [Benchmark]
+        public void UpdateAll() {
+            _view.Render(_updates);
+        }
+
+        [Benchmark]
+        public void Churn() {
+            _view.Render(_removals);
+            _view.Render(_additions);
+        }
+    }
+}
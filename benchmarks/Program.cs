@@ -0,0 +1,15 @@
+// Benchmark entry point: dotnet run -c Release -- [--gate | BenchmarkDotNet arguments]
+
+using BenchmarkDotNet.Running;
+
+namespace TLScope.Benchmarks {
+    public static class Program {
+        public static int Main(string[] args) {
+            if (args.Length > 0 && args[0] == "--gate") {
+                return AllocationGate.Run();
+            }
+            BenchmarkSwitcher.FromAssembly(typeof(Program).Assembly).Run(args);
+            return 0;
+        }
+    }
+}
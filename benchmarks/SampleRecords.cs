@@ -0,0 +1,113 @@
+// Synthetic but realistic inputs for the benchmarks: handshake records and arp-scan output
+
+using System.Buffers.Binary;
+
+namespace TLScope.Benchmarks {
+    public static class SampleRecords {
+        /// <summary>
+        /// A browser-like TLS 1.3 ClientHello with GREASE, SNI, ALPN and an X25519 key share.
+        /// </summary>
+        public static byte[] ClientHello(string serverName = "www.example.com") {
+            var body = new List<byte>();
+            AddUInt16(body, 0x0303);
+            body.AddRange(new byte[32]);                   // random
+            body.Add(32);
+            body.AddRange(new byte[32]);                   // session id
+            ushort[] ciphers = [0x4A4A, 0x1301, 0x1302, 0x1303, 0xC02B, 0xC02F, 0xC02C, 0xC030,
+                0xCCA9, 0xCCA8, 0xC013, 0xC014, 0x009C, 0x009D, 0x002F, 0x0035];
+            AddUInt16(body, (ushort)(ciphers.Length * 2));
+            foreach (ushort cipher in ciphers) {
+                AddUInt16(body, cipher);
+            }
+            body.Add(1);
+            body.Add(0);                                   // null compression
+
+            var extensions = new List<byte>();
+            AddExtension(extensions, 0x1A1A, []);
+            byte[] name = System.Text.Encoding.ASCII.GetBytes(serverName);
+            AddExtension(extensions, 0x0000, [.. BE((ushort)(name.Length + 3)), 0, .. BE((ushort)name.Length), .. name]);
+            AddExtension(extensions, 0x0017, []);
+            AddExtension(extensions, 0xFF01, [0]);
+            AddExtension(extensions, 0x000A, [0, 8, 0x2A, 0x2A, 0, 0x1D, 0, 0x17, 0, 0x18]);
+            AddExtension(extensions, 0x000B, [1, 0]);
+            AddExtension(extensions, 0x0023, []);
+            AddExtension(extensions, 0x0010, [0, 12, 2, (byte)'h', (byte)'2', 8, .. "http/1.1"u8.ToArray()]);
+            AddExtension(extensions, 0x0005, [1, 0, 0, 0, 0]);
+            AddExtension(extensions, 0x000D, [0, 16, 4, 3, 8, 4, 4, 1, 5, 3, 8, 5, 5, 1, 8, 6, 6, 1]);
+            AddExtension(extensions, 0x0012, []);
+            AddExtension(extensions, 0x0033, [0, 41, 0x2A, 0x2A, 0, 1, 0, 0, 0x1D, 0, 32, .. new byte[32]]);
+            AddExtension(extensions, 0x002D, [1, 1]);
+            AddExtension(extensions, 0x002B, [6, 0x3A, 0x3A, 3, 4, 3, 3]);
+            AddExtension(extensions, 0x001B, [2, 0, 2]);
+            AddExtension(extensions, 0x4469, [0, 3, 2, (byte)'h', (byte)'2']);
+            AddExtension(extensions, 0x0A0A, [0]);
+            AddUInt16(body, (ushort)extensions.Count);
+            body.AddRange(extensions);
+
+            return Record(1, body);
+        }
+
+        /// <summary>
+        /// A TLS 1.3 ServerHello selecting TLS_AES_128_GCM_SHA256.
+        /// </summary>
+        public static byte[] ServerHello() {
+            var body = new List<byte>();
+            AddUInt16(body, 0x0303);
+            body.AddRange(new byte[32]);
+            body.Add(32);
+            body.AddRange(new byte[32]);
+            AddUInt16(body, 0x1301);
+            body.Add(0);
+
+            var extensions = new List<byte>();
+            AddExtension(extensions, 0x0033, [0, 0x1D, 0, 32, .. new byte[32]]);
+            AddExtension(extensions, 0x002B, [3, 4]);
+            AddUInt16(body, (ushort)extensions.Count);
+            body.AddRange(extensions);
+
+            return Record(2, body);
+        }
+
+        /// <summary>
+        /// arp-scan --localnet output for the given number of hosts, header and footer included.
+        /// </summary>
+        public static string ArpScanOutput(int hosts) {
+            var output = new System.Text.StringBuilder();
+            output.Append("Interface: eth0, type: EN10MB, MAC: 02:42:ac:11:00:02, IPv4: 10.0.0.2\n");
+            output.Append("Starting arp-scan 1.10.0 with 65536 hosts (https://github.com/royhills/arp-scan)\n");
+            for (int i = 0; i < hosts; i++) {
+                output.Append($"10.0.{i >> 8 & 0xFF}.{i & 0xFF}\t02:42:{i >> 24 & 0xFF:x2}:{i >> 16 & 0xFF:x2}:{i >> 8 & 0xFF:x2}:{i & 0xFF:x2}\t(Unknown: locally administered)\n");
+            }
+            output.Append($"\n{hosts} packets received by filter, 0 packets dropped by kernel\n");
+            output.Append($"Ending arp-scan 1.10.0: 65536 hosts scanned in 41.5 seconds (1579.18 hosts/sec). {hosts} responded\n");
+            return output.ToString();
+        }
+
+        private static byte[] Record(byte handshakeType, List<byte> body) {
+            var record = new List<byte> { 22, 3, 1 };
+            AddUInt16(record, (ushort)(body.Count + 4));
+            record.Add(handshakeType);
+            record.Add((byte)(body.Count >> 16));
+            record.Add((byte)(body.Count >> 8));
+            record.Add((byte)body.Count);
+            record.AddRange(body);
+            return [.. record];
+        }
+
+        private static void AddExtension(List<byte> output, ushort type, byte[] data) {
+            AddUInt16(output, type);
+            AddUInt16(output, (ushort)data.Length);
+            output.AddRange(data);
+        }
+
+        private static void AddUInt16(List<byte> output, ushort value) {
+            output.AddRange(BE(value));
+        }
+
+        private static byte[] BE(ushort value) {
+            var bytes = new byte[2];
+            BinaryPrimitives.WriteUInt16BigEndian(bytes, value);
+            return bytes;
+        }
+    }
+}
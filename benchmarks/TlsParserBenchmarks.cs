@@ -0,0 +1,24 @@
+// Throughput and allocations of the passive hello parser; both methods must report 0 B allocated
+
+using BenchmarkDotNet.Attributes;
+using TLScope.src.Services;
+
+namespace TLScope.Benchmarks {
+    [MemoryDiagnoser]
+    public class TlsParserBenchmarks {
+        private readonly byte[] _clientHello = SampleRecords.ClientHello();
+        private readonly byte[] _serverHello = SampleRecords.ServerHello();
+
+        [Benchmark]
+        public ulong ParseClientHello() {
+            TlsParser.TryParse(_clientHello, out TlsHello hello);
+            return hello.Ja4.CipherHash ^ (ulong)hello.ServerName.Length;
+        }
+
+        [Benchmark]
+        public ulong ParseServerHello() {
+            TlsParser.TryParse(_serverHello, out TlsHello hello);
+            return (ulong)hello.Ja3 ^ hello.CipherSuite;
+        }
+    }
+}
@@ -1,10 +1,14 @@
 // Command Line Interface for TLScope, distinguishing behaviour between the application and command-line arguments
 // Arguments can be passed and serve their one time use/purpose
 
+using System.Security.Cryptography;
+using System.Security.Cryptography.X509Certificates;
+
 using TLScope.src.Models;
 using TLScope.src.Utilities;
 using TLScope.src.Data;
 using TLScope.src.Debugging;
+using TLScope.src.Services;
 
 using Microsoft.EntityFrameworkCore;
 
@@ -13,6 +17,14 @@ namespace TLScope.src.Controllers {
     public class CLIController {
         private readonly string[] _args;
         private ApplicationDbContext? _dbContext;
+        private User? _pendingUser;
+        private string? _pendingPassword;
+        private Task<bool>? _verification;
+
+        /// <summary>
+        /// Id of the user who logged in during interactive mode, if any. Sightings are stored under this user.
+        /// </summary>
+        public int? SignedInUserId { get; private set; }
 
         public CLIController(string[] args, ApplicationDbContext? dbContext) {
             _args = args ?? throw new ArgumentNullException(nameof(args));
@@ -35,6 +47,22 @@ namespace TLScope.src.Controllers {
                         CreateAccount();
                         Console.WriteLine("Restart the application to log in.");
                         break;
+                    case "--calibrate":
+                        CalibrateHashing();
+                        System.Environment.Exit(0);
+                        break;
+                    case "--build-oui":
+                        System.Environment.Exit(BuildOuiTable(_args[1..]));
+                        break;
+                    case "--daemon":
+                        System.Environment.Exit(RunDaemon(_args[1..]));
+                        break;
+                    case "--aggregate":
+                        System.Environment.Exit(RunAggregator(_args[1..]));
+                        break;
+                    case "--replay":
+                        System.Environment.Exit(RunReplay(_args[1..]));
+                        break;
                     default:
                         Console.WriteLine("Unknown option: " + _args[0]);
                         break;
@@ -53,6 +81,344 @@ namespace TLScope.src.Controllers {
             Console.WriteLine("  --help       Display this help message");
             Console.WriteLine("  --github     Open the GitHub repository");
             Console.WriteLine("  --register   Register a new user");
+            Console.WriteLine("  --calibrate  Tune password hashing cost to this machine");
+            Console.WriteLine("  --build-oui <csv>...  Compile IEEE OUI registry CSVs (oui.csv, mam.csv, oui36.csv) for vendor lookup");
+            Console.WriteLine("      --sample                 Mark the table as built from a partial extract of the registries");
+            Console.WriteLine("      The bundled vendor table is a partial sample of about 130 common vendors; most devices show");
+            Console.WriteLine("      an unknown vendor until the full registry is compiled with --build-oui.");
+            Console.WriteLine("  --daemon     Run headless, streaming device and connection deltas");
+            Console.WriteLine("      --format ndjson|binary   Encoding of the stream (default ndjson)");
+            Console.WriteLine("      --output <target>        - for stdout (default), a file, tcp://host:port, unix:/path");
+            Console.WriteLine("                               or tls://host:port for an aggregator (always binary)");
+            Console.WriteLine("      --key-file <path>        Username and password lines; sightings are stored under that user");
+            Console.WriteLine($"                               (default {Utilities.Environment.DaemonKeyPath}); one is required");
+            Console.WriteLine("      --no-login               Run without signing in; sightings are not stored");
+            Console.WriteLine("      --agent-name <name>      Site name reported to the aggregator (default the host name)");
+            Console.WriteLine("      --token-file <path>      File whose first line is the agent's token; required for tls://");
+            Console.WriteLine("  --aggregate  Merge the delta streams of many --daemon agents into one view");
+            Console.WriteLine($"      --listen <port>          TLS port agents connect to (default {Settings.AggregatorPort})");
+            Console.WriteLine("      --certificate <pfx>      Server certificate; agents pin it with TLSCOPE_AGGREGATOR_PIN");
+            Console.WriteLine("      --certificate-password-file <path>  Password of the certificate, if it has one");
+            Console.WriteLine("      --agents <path>          \"name token\" lines of the agents allowed to connect");
+            Console.WriteLine($"                               (default {Utilities.Environment.AggregatorAgentsPath})");
+            Console.WriteLine("      --format, --output, --key-file, --no-login  As for --daemon, for the merged stream");
+            Console.WriteLine("  --replay <file>  Run a pcap or pcapng capture through the TLS pipeline and report throughput");
+            Console.WriteLine("      --speed <factor>         Pace by capture timestamps, e.g. 1 for real time (default: unthrottled)");
+            Console.WriteLine("Active TLS probing of devices is off; set TLSCOPE_TLS_PROBE_PORTS (e.g. 443,8443) to turn it on.");
+        }
+
+        private static void CalibrateHashing() {
+            var target = TimeSpan.FromMilliseconds(Settings.HashTargetMilliseconds);
+            Console.WriteLine($"Calibrating Argon2id for about {target.TotalMilliseconds} ms per hash...");
+            Argon2Parameters parameters = Crypto.Calibrate(target);
+            Crypto.SaveParameters(parameters);
+            Console.WriteLine($"New passwords will be hashed with {parameters}.");
+            Console.WriteLine("Existing passwords are rehashed at their next login.");
+        }
+
+        private static int BuildOuiTable(string[] arguments) {
+            bool sample = arguments.Contains("--sample");
+            string[] csvPaths = arguments.Where(argument => argument != "--sample").ToArray();
+            if (csvPaths.Length == 0) {
+                Console.WriteLine("Usage: --build-oui [--sample] <oui.csv> [mam.csv] [oui36.csv]");
+                Console.WriteLine("The CSVs are published at https://standards-oui.ieee.org/.");
+                return 2;
+            }
+            try {
+                int blocks = OuiTable.Compile(csvPaths, Utilities.Environment.OuiTablePath, sample);
+                Console.WriteLine($"Compiled {blocks} registry blocks into {Utilities.Environment.OuiTablePath}.");
+                return 0;
+            } catch (IOException ex) {
+                Logging.Error("Could not build the OUI table.", ex);
+                Console.WriteLine($"Could not build the OUI table: {ex.Message}");
+                return 1;
+            }
+        }
+
+        // Headless mode writes diagnostics to stderr: stdout may be the delta stream
+        private int RunDaemon(string[] options) {
+            var format = ExportFormat.Ndjson;
+            string output = "-";
+            string? keyFile = null;
+            bool noLogin = false;
+            string agentName = System.Environment.MachineName;
+            string? tokenFile = null;
+            for (int i = 0; i < options.Length; i++) {
+                string? value = i + 1 < options.Length ? options[i + 1] : null;
+                switch (options[i]) {
+                    case "--format" when value != null && Enum.TryParse(value, true, out format):
+                        i++;
+                        break;
+                    case "--output" when value != null:
+                        output = value;
+                        i++;
+                        break;
+                    case "--key-file" when value != null:
+                        keyFile = value;
+                        i++;
+                        break;
+                    case "--no-login":
+                        noLogin = true;
+                        break;
+                    case "--agent-name" when !string.IsNullOrWhiteSpace(value):
+                        agentName = value.Trim();
+                        i++;
+                        break;
+                    case "--token-file" when value != null:
+                        tokenFile = value;
+                        i++;
+                        break;
+                    default:
+                        Console.Error.WriteLine($"Invalid daemon option: {options[i]}. Use --help for options.");
+                        return 2;
+                }
+            }
+
+            AgentCredentials? agent = null;
+            if (DeltaExporter.IsAggregator(output)) {
+                if (tokenFile == null || ReadSecretFile(tokenFile) is not [string token, ..] || token.Trim().Length == 0) {
+                    Console.Error.WriteLine("Streaming to an aggregator needs --token-file with the agent's token.");
+                    return 2;
+                }
+                agent = new AgentCredentials(agentName, token.Trim());
+            }
+            if (!LoginForDaemon(keyFile, noLogin)) {
+                return 1;
+            }
+
+            NetworkController networkController;
+            try {
+                networkController = new NetworkController();
+            } catch (InvalidOperationException ex) {
+                Console.Error.WriteLine(ex.Message);
+                return 1;
+            }
+            if (SignedInUserId is int userId) {
+                networkController.EnablePersistence(new WriteBehindStore(ApplicationDbContext.Options, userId));
+            }
+            ConnectionGraph graph = networkController.GetConnectionGraph();
+            networkController.EnableExport(new DeltaExporter(output, format, networkController.GetActiveDevices().CopyTo, agent,
+                edges => edges.AddRange(graph.Snapshot.Edges.Values.Select(edge => (edge, (string?)null)))));
+            Logging.Write($"Daemon exporting {format} to {output}" + (SignedInUserId is int id ? $", persisting as user {id}." : "."));
+            return new DaemonApplication(networkController).Run();
+        }
+
+        private int RunAggregator(string[] options) {
+            var format = ExportFormat.Ndjson;
+            string output = "-";
+            string? keyFile = null;
+            bool noLogin = false;
+            int port = Settings.AggregatorPort;
+            string? certificatePath = null;
+            string? passwordFile = null;
+            string agentsPath = Utilities.Environment.AggregatorAgentsPath;
+            for (int i = 0; i < options.Length; i++) {
+                string? value = i + 1 < options.Length ? options[i + 1] : null;
+                switch (options[i]) {
+                    case "--format" when value != null && Enum.TryParse(value, true, out format):
+                        i++;
+                        break;
+                    case "--output" when value != null && !DeltaExporter.IsAggregator(value):
+                        output = value;
+                        i++;
+                        break;
+                    case "--key-file" when value != null:
+                        keyFile = value;
+                        i++;
+                        break;
+                    case "--no-login":
+                        noLogin = true;
+                        break;
+                    case "--listen" when int.TryParse(value, out port) && port is > 0 and <= ushort.MaxValue:
+                        i++;
+                        break;
+                    case "--certificate" when value != null:
+                        certificatePath = value;
+                        i++;
+                        break;
+                    case "--certificate-password-file" when value != null:
+                        passwordFile = value;
+                        i++;
+                        break;
+                    case "--agents" when value != null:
+                        agentsPath = value;
+                        i++;
+                        break;
+                    default:
+                        Console.Error.WriteLine($"Invalid aggregate option: {options[i]}. Use --help for options.");
+                        return 2;
+                }
+            }
+            if (certificatePath == null) {
+                Console.Error.WriteLine("The aggregator needs --certificate with its TLS server certificate.");
+                return 2;
+            }
+
+            X509Certificate2 certificate;
+            Dictionary<string, byte[]> agents;
+            try {
+                string[]? password = passwordFile != null ? ReadSecretFile(passwordFile) : [];
+                if (password == null) {
+                    Console.Error.WriteLine("Could not read the certificate password; see the log for details.");
+                    return 1;
+                }
+                certificate = new X509Certificate2(certificatePath, password.FirstOrDefault());
+                agents = AggregatorService.LoadAgents(agentsPath);
+            } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException or CryptographicException) {
+                Logging.Error("Could not start the aggregator.", ex);
+                Console.Error.WriteLine($"Could not start the aggregator: {ex.Message}");
+                return 1;
+            }
+            if (!certificate.HasPrivateKey || agents.Count == 0) {
+                Console.Error.WriteLine(agents.Count == 0
+                    ? $"No agents are listed in {agentsPath}."
+                    : "The certificate file holds no private key.");
+                return 1;
+            }
+            Console.Error.WriteLine($"Certificate pin: {certificate.GetCertHashString(HashAlgorithmName.SHA256)}");
+            if (!LoginForDaemon(keyFile, noLogin)) {
+                return 1;
+            }
+
+            var store = new AggregateStore();
+            var aggregator = new AggregatorService(store, certificate, agents);
+            var exporter = new DeltaExporter(output, format, store.CopyTo, edges: store.CopyEdgesTo);
+            store.DeviceListUpdate += (sender, delta) => exporter.Enqueue(delta);
+            store.FlowsReceived += (site, deltas) => exporter.Enqueue(deltas, site);
+            WriteBehindStore? persistence = null;
+            if (SignedInUserId is int userId) {
+                persistence = new WriteBehindStore(ApplicationDbContext.Options, userId);
+                store.DeviceListUpdate += (sender, delta) => persistence.Enqueue(delta);
+                store.FlowsReceived += (site, deltas) => persistence.Enqueue(deltas, site);
+            }
+            Logging.Write($"Aggregator exporting {format} to {output}" + (SignedInUserId is int id ? $", persisting as user {id}." : "."));
+            return new DaemonApplication(async cancTok => {
+                try {
+                    await Task.WhenAll(aggregator.RunAsync(port, cancTok), exporter.RunAsync(cancTok),
+                        persistence?.RunAsync(cancTok) ?? Task.CompletedTask);
+                } catch (OperationCanceledException) {
+                    Logging.Write("Aggregation was canceled.");
+                }
+            }).Run();
+        }
+
+        private static int RunReplay(string[] options) {
+            if (options.Length == 0) {
+                Console.WriteLine("Usage: --replay <file.pcap|file.pcapng> [--speed <factor>]");
+                return 2;
+            }
+            double speed = 0;
+            for (int i = 1; i < options.Length; i++) {
+                string? value = i + 1 < options.Length ? options[i + 1] : null;
+                if (options[i] == "--speed" && double.TryParse(value, System.Globalization.CultureInfo.InvariantCulture, out speed)
+                    && speed >= 0) {
+                    i++;
+                    continue;
+                }
+                Console.Error.WriteLine($"Invalid replay option: {options[i]}. Use --help for options.");
+                return 2;
+            }
+
+            using var cancellation = new CancellationTokenSource();
+            ConsoleCancelEventHandler stop = (sender, e) => {
+                e.Cancel = true; // stop early but still report
+                cancellation.Cancel();
+            };
+            Console.CancelKeyPress += stop;
+            ReplayReport report;
+            try {
+                report = new ReplayService(options[0], speed).RunAsync(cancellation.Token).GetAwaiter().GetResult();
+            } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException or InvalidDataException) {
+                Logging.Error($"Could not replay {options[0]}.", ex);
+                Console.Error.WriteLine($"Could not replay {options[0]}: {ex.Message}");
+                return 1;
+            } finally {
+                Console.CancelKeyPress -= stop;
+            }
+
+            Console.WriteLine($"Replayed {options[0]} ({report.Format}, {report.FileBytes / (1024.0 * 1024.0):F1} MiB) "
+                + $"in {report.Elapsed.TotalSeconds:F3} s, covering {report.CaptureSpan.TotalSeconds:F1} s of capture"
+                + (report.Truncated ? "; stopped at a truncated record" : "") + ".");
+            Console.WriteLine($"  Packets:     {report.Packets,12}  {report.PacketsPerSecond,14:F0}/s"
+                + (report.PacketsSkipped > 0 ? $"  ({report.PacketsSkipped} on non-Ethernet links skipped)" : ""));
+            Console.WriteLine($"  Handshakes:  {report.HandshakeRecords,12}  {report.HandshakesPerSecond,14:F0}/s  (handshake records)");
+            Console.WriteLine($"  Sessions:    {report.Sessions,12}  {report.SessionsPerSecond,14:F0}/s  (ClientHellos reported to the graph)");
+            Console.WriteLine($"  Graph edges: {report.Edges,12}"
+                + (report.DroppedDeltas > 0 ? $"  ({report.DroppedDeltas} session events dropped; the flow table's queue overflowed)" : ""));
+            Console.WriteLine("  Stage        total (ms)   mean (us)  per");
+            Console.WriteLine($"  decode     {report.DispatchTime.TotalMilliseconds,12:F1}  {ReplayReport.PerItem(report.DispatchTime, report.Packets),10:F3}  packet");
+            Console.WriteLine($"  flows      {report.WorkerTime.TotalMilliseconds,12:F1}  {ReplayReport.PerItem(report.WorkerTime, report.Segments),10:F3}  segment ({report.Segments})");
+            Console.WriteLine($"  parse      {report.ParseTime.TotalMilliseconds,12:F1}  {ReplayReport.PerItem(report.ParseTime, report.HandshakeRecords),10:F3}  handshake record");
+            Console.WriteLine($"  graph      {report.GraphTime.TotalMilliseconds,12:F1}  {ReplayReport.PerItem(report.GraphTime, report.GraphBatches),10:F3}  batch ({report.GraphBatches})");
+            return 0;
+        }
+
+        // Headless modes sign in from a key file; running without one has to be asked for with --no-login
+        private bool LoginForDaemon(string? keyFile, bool noLogin) {
+            if (noLogin) {
+                if (keyFile != null) {
+                    Console.Error.WriteLine("--no-login and --key-file cannot be combined.");
+                    return false;
+                }
+                Logging.Write(LogLevel.Warning, "Running without signing in (--no-login): sightings are not stored.");
+                Console.Error.WriteLine("Warning: running without signing in (--no-login); sightings are not stored.");
+                return true;
+            }
+            if (keyFile == null && !File.Exists(Utilities.Environment.DaemonKeyPath)) {
+                Console.Error.WriteLine($"No key file: pass --key-file or create {Utilities.Environment.DaemonKeyPath}, "
+                    + "or run without signing in with --no-login.");
+                return false;
+            }
+            if (!LoginWithKeyFile(keyFile ?? Utilities.Environment.DaemonKeyPath) || !CompleteLogin()) {
+                Console.Error.WriteLine("Daemon login failed; see the log for details.");
+                return false;
+            }
+            return true;
+        }
+
+        // Secrets are refused, like SSH keys, when other users can read them. Returns null after logging why
+        private static string[]? ReadSecretFile(string path) {
+            try {
+                if (!OperatingSystem.IsWindows()
+                    && (File.GetUnixFileMode(path) & (UnixFileMode.GroupRead | UnixFileMode.OtherRead)) != 0) {
+                    Logging.Write(LogLevel.Error, $"{path} is readable by other users; restrict it with chmod 600.");
+                    return null;
+                }
+                return File.ReadAllLines(path);
+            } catch (IOException ex) {
+                Logging.Error($"Could not read {path}.", ex);
+                return null;
+            } catch (UnauthorizedAccessException ex) {
+                Logging.Error($"Could not read {path}.", ex);
+                return null;
+            }
+        }
+
+        /// <summary>
+        /// Non-interactive login from a file holding the username and the password on two lines. Like an SSH key,
+        /// the file must not be readable by other users. CompleteLogin finishes the check.
+        /// </summary>
+        private bool LoginWithKeyFile(string path) {
+            string[]? lines = ReadSecretFile(path);
+            if (lines == null) {
+                return false;
+            }
+            if (lines.Length < 2 || string.IsNullOrWhiteSpace(lines[0]) || string.IsNullOrEmpty(lines[1])) {
+                Logging.Write(LogLevel.Error, $"Key file {path} must hold a username line and a password line.");
+                return false;
+            }
+
+            string username = lines[0].Trim();
+            _dbContext ??= ApplicationDbContext.Shared;
+            var user = _dbContext.Users.SingleOrDefault(u => u.Username == username);
+            if (user == null) {
+                Logging.Write(LogLevel.Error, $"Key file {path} names an unknown user.");
+                return false;
+            }
+            _pendingUser = user;
+            _pendingPassword = lines[1];
+            _verification = Crypto.VerifyPasswordHashAsync(lines[1], user.PasswordHash, user.PasswordSalt);
+            return true;
         }
 
         private void CreateAccount() {
@@ -86,9 +452,7 @@ namespace TLScope.src.Controllers {
                 PasswordSalt = passwordSalt
             };
 
-            _dbContext ??= new ApplicationDbContext(new DbContextOptionsBuilder<ApplicationDbContext>()
-                .UseSqlite("Data Source=tlscope.db")
-                .Options);
+            _dbContext ??= ApplicationDbContext.Shared;
             _dbContext.Users.Add(user);
             _dbContext.SaveChanges();
             Console.ResetColor();
@@ -130,26 +494,45 @@ namespace TLScope.src.Controllers {
                 return false;
             }
 
-            bool isPasswordValid = Crypto.VerifyPasswordHash(password, user.PasswordHash, user.PasswordSalt);
+            // Argon2 takes a good fraction of a second; it runs while the caller builds the rest of the app
+            _pendingUser = user;
+            _pendingPassword = password;
+            _verification = Crypto.VerifyPasswordHashAsync(password, user.PasswordHash, user.PasswordSalt);
+            Console.ResetColor();
+            return true;
+        }
+
+        /// <summary>
+        /// Waits for the password check started in interactive mode and sets SignedInUserId if it passed.
+        /// Hashes made with old parameters are replaced. Returns false on invalid credentials.
+        /// </summary>
+        public bool CompleteLogin() {
+            if (_verification == null || _pendingUser == null) {
+                return true; // no login was started (e.g. first run created an account)
+            }
+            User user = _pendingUser;
+            bool isPasswordValid = _verification.GetAwaiter().GetResult();
+            string password = _pendingPassword!;
+            (_verification, _pendingUser, _pendingPassword) = (null, null, null);
             if (!isPasswordValid) {
-                Console.ResetColor();
                 Console.WriteLine("Invalid Credentials.");
                 return false;
             }
 
-            Console.ResetColor();
+            SignedInUserId = user.Id;
+            if (Crypto.NeedsRehash(user.PasswordHash) && _dbContext != null) {
+                Crypto.CreatePasswordHash(password, out byte[] passwordHash, out byte[] passwordSalt);
+                user.PasswordHash = passwordHash;
+                user.PasswordSalt = passwordSalt;
+                _dbContext.SaveChanges();
+                Logging.Write($"Rehashed password for user {user.Id} with {Crypto.Current}.");
+            }
             return true;
         }
 
         private bool RunInteractiveMode() {
             Console.WriteLine("This not what you expected? Use --help for options.");
-            // Initialize the dbContext if it is null
-            if (_dbContext == null) {
-                var options = new DbContextOptionsBuilder<ApplicationDbContext>()
-                    .UseSqlite("Data Source=tlscope.db")
-                    .Options;
-                _dbContext = new ApplicationDbContext(options);
-            }
+            _dbContext ??= ApplicationDbContext.Shared;
 
             try {
                 VersionInfo.TLScopeVersionCheck();
@@ -1,58 +1,193 @@
 // Network Controller to handle all network operations in the application at a high-level
 // For specific functionality, see NetData.cs in Utilities
 
-using System.Collections.Concurrent;
 using System.Net.NetworkInformation;
+using System.Text;
+using TLScope.src.Data;
 using TLScope.src.Services;
-using TLScope.src.Models;
 using TLScope.src.Debugging;
 using TLScope.src.Utilities;
 
 namespace TLScope.src.Controllers {
     public class NetworkController {
-        private ConcurrentDictionary<string, Device> _activeDevices = new();
+        private readonly DeviceStore _activeDevices = new();
+        private readonly ConnectionGraph _graph = new();
+        private readonly HistoryStore _history = new(Utilities.Environment.HistoryPath);
+        private WriteBehindStore? _store;
+        private DeltaExporter? _exporter;
+        private readonly NameResolver? _names;
+        private readonly TlsProber _prober;
+        private readonly OsFingerprinter _fingerprinter;
 
-        public readonly NetworkInterface? _networkInterface;
+        private readonly List<NetworkInterface> _interfaces;
+
+        /// <summary>
+        /// Interfaces discovery runs on, each with its own scan, probe and capture pipeline.
+        /// </summary>
+        public IReadOnlyList<NetworkInterface> Interfaces => _interfaces;
 
         public NetworkController() {
-            // Initialize the network interface (example: get the first network interface)
-            _networkInterface = NetworkInterface.GetAllNetworkInterfaces().LastOrDefault();
-            if (_networkInterface == null) {
-                throw new InvalidOperationException("Network interface is null");
-            }
-            if (_networkInterface.OperationalStatus.ToString() == "Down") {
+            _interfaces = NetData.SelectInterfaces();
+            if (_interfaces.Count == 0) {
                 throw new InvalidOperationException(
-                    $"Network Interface ({_networkInterface.Name}) is offline. "+
-                    $"Make sure you are connected to the Internet.");
+                    "No usable network interface is up. "
+                    + "Make sure you are connected to a network, or name interfaces in TLSCOPE_INTERFACES.");
             }
-            Logging.Write("NetworkController initialized.");
+            NetworkService.DeviceListUpdate += (sender, delta) => _graph.Apply(delta);
+            NetworkService.DeviceListUpdate += (sender, delta) => _history.Record(delta);
+
+            _names = NameResolver.TryCreate(_interfaces, (ip, name) => NetworkService.RenameDevice(_activeDevices, ip, name));
+            if (_names != null) {
+                NetworkService.DeviceListUpdate += (sender, delta) => RequestNames(_names, delta);
+            }
+            // Verdicts for hosts not discovered yet are applied when they are added
+            _fingerprinter = new OsFingerprinter((mac, verdict) => NetworkService.SetOperatingSystem(_activeDevices, mac, verdict.Name));
+            NetworkService.DeviceListUpdate += (sender, delta) => ApplyCachedVerdicts(delta);
+            _prober = new TlsProber(_activeDevices, deltas => {
+                _exporter?.Enqueue(deltas);
+                _graph.Apply(deltas);
+                _store?.Enqueue(deltas);
+                _history.Record(deltas);
+            });
+            Logging.Write($"NetworkController initialized on {string.Join(", ", _interfaces.Select(ni => ni.Name))}.");
+        }
+
+        /// <summary>
+        /// Persists device sightings and TLS sessions through the given store once discovery starts.
+        /// </summary>
+        public void EnablePersistence(WriteBehindStore store) {
+            _store = store;
+            NetworkService.DeviceListUpdate += (sender, delta) => store.Enqueue(delta);
+        }
+
+        /// <summary>
+        /// Streams device and connection deltas through the exporter once discovery starts.
+        /// </summary>
+        public void EnableExport(DeltaExporter exporter) {
+            _exporter = exporter;
+            NetworkService.DeviceListUpdate += (sender, delta) => exporter.Enqueue(delta);
         }
 
         public async Task DiscoverLocalNetworkAsync(CancellationToken cancTok) {
+            var captures = new List<TlsService>();
             try {
-                if (_networkInterface == null) {
-                    throw new InvalidOperationException("Network interface is null");
+                var tasks = new List<Task>();
+                foreach (NetworkInterface ni in _interfaces) {
+                    Logging.Write(
+                        $"Hosting from Interface {ni.Name}\n" +
+                        $"\tIP Address: {NetData.GetLocalIPAddress(ni)}\n" +
+                        $"\tMAC Address: {NetData.GetLocalMacAddress(ni)}"
+                    );
+
+                    // Each interface sweeps under its own packet budget and probes only the devices it found.
+                    // Passive listening keeps talkative hosts fresh, so sweeps and probes mostly cover silent ones
+                    tasks.Add(NetworkService.ScanNetworkAsync(_activeDevices, ni, cancTok));
+                    tasks.Add(NetworkService.PingDevicesAsync(_activeDevices, ni.Name, cancTok));
+                    tasks.Add(NetworkService.ListenPassiveAsync(_activeDevices, ni, cancTok));
+                    tasks.Add(NetworkService.DiscoverIPv6Async(_activeDevices, ni, cancTok));
+
+                    string name = ni.Name;
+                    TlsService? tls = TlsService.TryCreate(ni,
+                        (in FlowKey flow, long timestampTicks, in TlsHello hello) => OnHello(name, flow, timestampTicks, hello),
+                        _fingerprinter, flow => _prober.IsOwnConnection(flow));
+                    if (tls == null) {
+                        Logging.Write($"Packet capture unavailable on {name} (needs Linux and CAP_NET_RAW); "
+                            + "TLS sessions there will not be shown.");
+                        continue;
+                    }
+                    captures.Add(tls);
+                    tasks.Add(tls.RunAsync(cancTok));
                 }
-                Logging.Write(
-                    $"Hosting from Interface {_networkInterface.Name}\n" +
-                    $"\tIP Address: {NetData.GetLocalIPAddress(_networkInterface)}\n" +
-                    $"\tMAC Address: {NetData.GetLocalMacAddress(_networkInterface)}"
-                );
 
-                var scanTask = NetworkService.ScanNetworkAsync(_activeDevices, cancTok);
-                var pingTask = NetworkService.PingDevicesAsync(_activeDevices, cancTok);
+                tasks.Add(MaintainGraphAsync(captures.Select(tls => tls.Flows).ToArray(), cancTok));
+                tasks.Add(_store?.RunAsync(cancTok) ?? Task.CompletedTask);
+                tasks.Add(_exporter?.RunAsync(cancTok) ?? Task.CompletedTask);
+                tasks.Add(_history.RunAsync(cancTok));
+                tasks.Add(_names?.RunAsync(cancTok) ?? Task.CompletedTask);
+                tasks.Add(_prober.RunAsync(cancTok));
 
-                await Task.WhenAll(scanTask, pingTask);
+                await Task.WhenAll(tasks);
                 Logging.Write("Network discovery completed.");
             } catch (OperationCanceledException) {
                 Logging.Write("Network discovery was canceled.");
             } catch (Exception ex) {
                 Logging.Error("An error occurred during network discovery.", ex);
+            } finally {
+                foreach (TlsService tls in captures) {
+                    tls.Dispose();
+                }
+            }
+        }
+
+        private static void RequestNames(NameResolver names, DeviceDeltaEventArgs delta) {
+            foreach (DeviceChange change in delta.Changes) {
+                if (change.Kind == DeviceChangeKind.Added) {
+                    names.Request(change.Device.IP, change.Device.Interface);
+                }
             }
         }
 
-        public ref ConcurrentDictionary<string, Device> GetActiveDevices() {
-            return ref _activeDevices;
+        private void ApplyCachedVerdicts(DeviceDeltaEventArgs delta) {
+            foreach (DeviceChange change in delta.Changes) {
+                if (change.Kind == DeviceChangeKind.Added && change.Device.OperatingSystem == null
+                    && _fingerprinter.TryGetVerdict(change.Device.MAC, out OsVerdict verdict)) {
+                    NetworkService.SetOperatingSystem(_activeDevices, change.Device.MAC, verdict.Name);
+                }
+            }
+        }
+
+        private void OnHello(string interfaceName, in FlowKey flow, long timestampTicks, in TlsHello hello) {
+            if (hello.Kind == TlsHelloKind.ServerHello) {
+                _prober.ObserveServerHello(flow, timestampTicks);
+            }
+            if (hello.Kind == TlsHelloKind.ClientHello) {
+                Logging.Write(LogLevel.Debug, $"TLS ClientHello {flow} on {interfaceName}: SNI {Encoding.ASCII.GetString(hello.ServerName)}, JA4 {hello.Ja4}");
+            } else {
+                Logging.Write(LogLevel.Debug, $"TLS ServerHello {flow} on {interfaceName}: version 0x{hello.Version:x4}, cipher 0x{hello.CipherSuite:x4}");
+            }
+        }
+
+        // Moves flow table events from every capture into the graph once a second and expires idle flows and edges
+        private async Task MaintainGraphAsync(FlowTable[] flowTables, CancellationToken cancTok) {
+            using var timer = new PeriodicTimer(TimeSpan.FromSeconds(1));
+            var deltas = new List<FlowDelta>();
+            long nextExpiry = 0;
+            try {
+                while (await timer.WaitForNextTickAsync(cancTok)) {
+                    long now = DateTime.UtcNow.Ticks;
+                    if (flowTables.Length > 0) {
+                        deltas.Clear();
+                        foreach (FlowTable flows in flowTables) {
+                            flows.Collect(now - Settings.FlowIdleTimeout.Ticks, deltas);
+                        }
+                        _exporter?.Enqueue(deltas);
+                        _graph.Apply(deltas);
+                        _store?.Enqueue(deltas);
+                        _history.Record(deltas);
+                    }
+                    if (now >= nextExpiry) {
+                        int expired = _graph.ExpireIdle(now - Settings.GraphEdgeIdleTimeout.Ticks);
+                        if (expired > 0) {
+                            Logging.Write($"Expired {expired} idle connection(s) from the graph.");
+                        }
+                        nextExpiry = now + TimeSpan.TicksPerSecond * 10;
+                    }
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            }
+        }
+
+        public DeviceStore GetActiveDevices() {
+            return _activeDevices;
+        }
+
+        public ConnectionGraph GetConnectionGraph() {
+            return _graph;
+        }
+
+        public HistoryStore GetHistory() {
+            return _history;
         }
     }
 }
@@ -0,0 +1,48 @@
+// Headless host for --daemon and --aggregate: a pipeline without Terminal.Gui, run until SIGINT or SIGTERM
+// Deltas leave through the DeltaExporter the pipeline was given; nothing is drawn and stdout carries only data
+
+using System.Runtime.InteropServices;
+using TLScope.src.Controllers;
+using TLScope.src.Debugging;
+
+namespace TLScope.src {
+    public class DaemonApplication {
+        private readonly Func<CancellationToken, Task> _pipeline;
+        private readonly CancellationTokenSource _cancellationTokenSource;
+
+        public DaemonApplication(NetworkController networkController) {
+            ArgumentNullException.ThrowIfNull(networkController);
+            _pipeline = networkController.DiscoverLocalNetworkAsync;
+            _cancellationTokenSource = new CancellationTokenSource();
+        }
+
+        /// <param name="pipeline">Runs until its token is cancelled and returns once its sinks have flushed.</param>
+        public DaemonApplication(Func<CancellationToken, Task> pipeline) {
+            _pipeline = pipeline ?? throw new ArgumentNullException(nameof(pipeline));
+            _cancellationTokenSource = new CancellationTokenSource();
+        }
+
+        /// <summary>
+        /// Runs the pipeline until signalled, then lets the exporter and write-behind store flush. Returns the exit code.
+        /// </summary>
+        public int Run() {
+            using var interrupt = PosixSignalRegistration.Create(PosixSignal.SIGINT, Stop);
+            using var terminate = PosixSignalRegistration.Create(PosixSignal.SIGTERM, Stop);
+            Logging.Write($"Daemon started (pid {System.Environment.ProcessId}).");
+            try {
+                _pipeline(_cancellationTokenSource.Token).GetAwaiter().GetResult();
+            } catch (Exception ex) {
+                Logging.Error("An error occurred in the daemon.", ex, true);
+                return 1;
+            }
+            Logging.Write("Daemon stopped.");
+            return 0;
+        }
+
+        private void Stop(PosixSignalContext context) {
+            context.Cancel = true; // shut down through the pipelines instead of terminating outright
+            Logging.Write($"Received {context.Signal}; stopping.");
+            _cancellationTokenSource.Cancel();
+        }
+    }
+}
@@ -0,0 +1,210 @@
+// Central state for aggregation: one shard per agent site, each with its own device table and connection graph
+// Sites reuse the same private ranges, so shards are keyed by site and only merged in what is published
+
+using TLScope.src.Services;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Data {
+    /// <summary>
+    /// One agent's shard. Only the session currently attached to the site writes to it.
+    /// </summary>
+    public sealed class AggregateSite {
+        public string Name { get; }
+        public DeviceStore Devices { get; } = new();
+        public ConnectionGraph Graph { get; } = new();
+
+        internal long Session; // attached session, 0 while the agent is away
+        internal long DetachedTicks;
+        internal HashSet<uint>? SnapshotIPs; // devices named by the snapshot in progress
+
+        public bool Connected => Interlocked.Read(ref Session) != 0;
+
+        internal AggregateSite(string name) {
+            Name = name;
+        }
+    }
+
+    public sealed class AggregateStore {
+        private readonly object _lock = new();
+        private readonly Dictionary<string, AggregateSite> _sites = new(StringComparer.OrdinalIgnoreCase);
+        private long _nextSession;
+
+        /// <summary>
+        /// Device changes from every site, coalesced per applied batch. Interface is "site/interface", which is
+        /// what tells two sites' 192.168.1.10 apart downstream. Raised on the reporting session's thread.
+        /// </summary>
+        public event EventHandler<DeviceDeltaEventArgs>? DeviceListUpdate;
+
+        /// <summary>
+        /// Session events from every site, raised before they are folded into the site's graph, while the deltas
+        /// still own their interned references. Flows carry only addresses, so the site's name comes with them.
+        /// </summary>
+        public event Action<string, IReadOnlyList<FlowDelta>>? FlowsReceived;
+
+        public IReadOnlyList<AggregateSite> Sites {
+            get {
+                lock (_lock) {
+                    return [.. _sites.Values];
+                }
+            }
+        }
+
+        public int DeviceCount => Sites.Sum(site => site.Devices.Count);
+
+        /// <summary>
+        /// Attaches a session to the named site, creating the shard on first contact. A session that was still
+        /// attached is superseded: its writes are ignored from here on.
+        /// </summary>
+        public AggregateSite Attach(string name, out long session) {
+            lock (_lock) {
+                if (!_sites.TryGetValue(name, out AggregateSite? site)) {
+                    site = new AggregateSite(name);
+                    _sites[name] = site;
+                }
+                session = ++_nextSession;
+                Interlocked.Exchange(ref site.Session, session);
+                site.SnapshotIPs = null;
+                return site;
+            }
+        }
+
+        public void Detach(AggregateSite site, long session) {
+            lock (_lock) {
+                if (Interlocked.CompareExchange(ref site.Session, 0, session) == session) {
+                    site.DetachedTicks = DateTime.UtcNow.Ticks;
+                    site.SnapshotIPs = null;
+                }
+            }
+        }
+
+        public static bool IsCurrent(AggregateSite site, long session) {
+            return Interlocked.Read(ref site.Session) == session;
+        }
+
+        /// <summary>
+        /// Applies one batch of an agent's device changes to its shard and publishes the net effect.
+        /// </summary>
+        public void ApplyDevices(AggregateSite site, IReadOnlyList<DeviceChange> changes) {
+            var applied = new List<DeviceChange>(changes.Count);
+            foreach (DeviceChange change in changes) {
+                DeviceRecord device = change.Device;
+                if (change.Kind == DeviceChangeKind.Removed) {
+                    if (site.Devices.Remove(device.IP, out DeviceRecord removed)) {
+                        applied.Add(new DeviceChange(DeviceChangeKind.Removed, removed, DeviceFields.None));
+                    }
+                    continue;
+                }
+                site.SnapshotIPs?.Add(device.IP);
+                bool added = site.Devices.Put(device, out DeviceRecord stored);
+                applied.Add(added
+                    ? new DeviceChange(DeviceChangeKind.Added, stored, DeviceFields.All)
+                    : new DeviceChange(DeviceChangeKind.Updated, stored, change.Fields));
+            }
+            Publish(site, applied);
+        }
+
+        /// <summary>
+        /// Resync after a reconnect: the agent resends every device it knows and its connection totals between
+        /// BeginSnapshot and EndSnapshot, then streams deltas again. Devices the snapshot left out went away while
+        /// it was gone, and the totals replace the site's edges, which missed the deltas sent meanwhile.
+        /// </summary>
+        public void BeginSnapshot(AggregateSite site) {
+            site.SnapshotIPs = [];
+        }
+
+        public void EndSnapshot(AggregateSite site, IReadOnlyList<ConnectionEdge>? edges) {
+            HashSet<uint>? present = site.SnapshotIPs;
+            site.SnapshotIPs = null;
+            if (present != null) {
+                RemoveDevices(site, ip => !present.Contains(ip));
+            }
+            if (edges != null) {
+                site.Graph.Replace(edges);
+            }
+        }
+
+        public void ApplyFlows(AggregateSite site, IReadOnlyList<FlowDelta> deltas) {
+            if (deltas.Count == 0) {
+                return;
+            }
+            FlowsReceived?.Invoke(site.Name, deltas);
+            site.Graph.Apply(deltas);
+        }
+
+        /// <summary>
+        /// Drops idle edges from every site, and whole sites whose agent has been away since before the given time.
+        /// Returns the number of sites dropped.
+        /// </summary>
+        public int Expire(long edgeIdleBeforeTicks, long siteGoneBeforeTicks) {
+            var gone = new List<AggregateSite>();
+            lock (_lock) {
+                foreach (AggregateSite site in _sites.Values) {
+                    if (!site.Connected && site.DetachedTicks < siteGoneBeforeTicks) {
+                        gone.Add(site);
+                    }
+                }
+                foreach (AggregateSite site in gone) {
+                    _sites.Remove(site.Name);
+                }
+            }
+            foreach (AggregateSite site in Sites) {
+                site.Graph.ExpireIdle(edgeIdleBeforeTicks);
+            }
+            foreach (AggregateSite site in gone) {
+                RemoveDevices(site, _ => true);
+                site.Graph.ExpireIdle(long.MaxValue); // releases the edges' interned references
+            }
+            return gone.Count;
+        }
+
+        /// <summary>
+        /// Every site's connection totals, with the site's name, for the snapshot of the merged stream.
+        /// </summary>
+        public void CopyEdgesTo(List<(ConnectionEdge Edge, string? Site)> output) {
+            foreach (AggregateSite site in Sites) {
+                foreach (ConnectionEdge edge in site.Graph.Snapshot.Edges.Values) {
+                    output.Add((edge, site.Name));
+                }
+            }
+        }
+
+        /// <summary>
+        /// Every site's devices, with Interface qualified by site as in DeviceListUpdate.
+        /// </summary>
+        public void CopyTo(List<DeviceRecord> output) {
+            var devices = new List<DeviceRecord>();
+            foreach (AggregateSite site in Sites) {
+                devices.Clear();
+                site.Devices.CopyTo(devices);
+                foreach (DeviceRecord device in devices) {
+                    output.Add(Qualify(site, device));
+                }
+            }
+        }
+
+        private void RemoveDevices(AggregateSite site, Func<uint, bool> predicate) {
+            var ips = new List<uint>();
+            site.Devices.CopyIPs(ips);
+            var removed = new List<DeviceChange>();
+            foreach (uint ip in ips) {
+                if (predicate(ip) && site.Devices.Remove(ip, out DeviceRecord device)) {
+                    removed.Add(new DeviceChange(DeviceChangeKind.Removed, device, DeviceFields.None));
+                }
+            }
+            Publish(site, removed);
+        }
+
+        private void Publish(AggregateSite site, List<DeviceChange> changes) {
+            if (changes.Count == 0) {
+                return;
+            }
+            site.Graph.Apply(new DeviceDeltaEventArgs(changes));
+            DeviceListUpdate?.Invoke(this, new DeviceDeltaEventArgs(
+                changes.ConvertAll(change => change with { Device = Qualify(site, change.Device) })));
+        }
+
+        private static DeviceRecord Qualify(AggregateSite site, in DeviceRecord device) {
+            return device with { Interface = device.Interface == null ? site.Name : $"{site.Name}/{device.Interface}" };
+        }
+    }
+}
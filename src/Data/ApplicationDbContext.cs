@@ -1,6 +1,7 @@
 // SQLite database context for the application.
 
 using Microsoft.EntityFrameworkCore;
+using Microsoft.EntityFrameworkCore.Design;
 using TLScope.src.Models;
 using TLScope.src.Debugging;
 
@@ -11,31 +12,77 @@ namespace TLScope.src.Data {
     /// <remarks>
     /// The database context is used to interact with the database and represents a session with the database.
     public class ApplicationDbContext : DbContext {
+        private static readonly Lazy<DbContextOptions<ApplicationDbContext>> options = new(() => BuildOptions(true));
+        private static readonly Lazy<ApplicationDbContext> shared = new(CreateShared);
+
         public ApplicationDbContext(DbContextOptions<ApplicationDbContext> options)
             : base(options) {
-            // log the information to the console
-            if (Database.EnsureCreated()) {
+        }
+
+        /// <summary>
+        /// Options for the database at Environment.DatabasePath, with the compiled model when one was generated.
+        /// </summary>
+        public static DbContextOptions<ApplicationDbContext> Options => options.Value;
+
+        /// <summary>
+        /// The context for the main thread, created (and the schema ensured) on first use. Background writers
+        /// build their own from Options, since a context is not thread-safe.
+        /// </summary>
+        public static ApplicationDbContext Shared => shared.Value;
+
+        internal static DbContextOptions<ApplicationDbContext> BuildOptions(bool useCompiledModel) {
+            var builder = new DbContextOptionsBuilder<ApplicationDbContext>()
+                .UseSqlite($"Data Source={Utilities.Environment.DatabasePath}");
+#if EF_COMPILED_MODEL
+            // Generated by `dotnet ef dbcontext optimize`; skips building the model by reflection at startup
+            if (useCompiledModel) {
+                builder.UseModel(CompiledModels.ApplicationDbContextModel.Instance);
+            }
+#endif
+            return builder.Options;
+        }
+
+        private static ApplicationDbContext CreateShared() {
+            // Earlier versions kept the database in the working directory
+            if (!File.Exists(Utilities.Environment.DatabasePath) && File.Exists("tlscope.db")) {
+                File.Copy("tlscope.db", Utilities.Environment.DatabasePath);
+                Logging.Write($"Copied tlscope.db from the working directory to {Utilities.Environment.DatabasePath}.");
+            }
+            var context = new ApplicationDbContext(Options);
+            if (context.Database.EnsureCreated()) {
                 Logging.Write("Database instance created.");
             }
+            return context;
         }
 
         public DbSet<User> Users { get; set; }
         public DbSet<Device> Devices { get; set; }
+        public DbSet<Connection> Connections { get; set; }
 
         protected override void OnModelCreating(ModelBuilder modelBuilder) {
             base.OnModelCreating(modelBuilder);
 
-            //Ignore device properties from the TreeNode base class
-            modelBuilder.Entity<Device>()
-                .Ignore(d => d.Children)
-                .Ignore(d => d.Text)
-                .Ignore(d => d.Tag);
-
             // Configure entity relationships and constraints
             modelBuilder.Entity<User>()
                 .HasMany(u => u.Devices)
                 .WithOne(d => d.User)
                 .HasForeignKey(d => d.UserId);
+
+            // Upsert targets for the write-behind store
+            modelBuilder.Entity<Device>()
+                .HasIndex(d => new { d.UserId, d.MACAddress })
+                .IsUnique();
+            modelBuilder.Entity<Connection>()
+                .HasIndex(c => new { c.Site, c.ClientAddress, c.ServerAddress, c.ServerPort })
+                .IsUnique();
+        }
+    }
+    /// <summary>
+    /// Lets the EF tools (migrations, <c>dbcontext optimize</c>) build the context, always from the reflected model.
+    /// </summary>
+    public class ApplicationDbContextFactory : IDesignTimeDbContextFactory<ApplicationDbContext> {
+        public ApplicationDbContext CreateDbContext(string[] args) {
+            return new ApplicationDbContext(ApplicationDbContext.BuildOptions(false));
         }
     }
 }
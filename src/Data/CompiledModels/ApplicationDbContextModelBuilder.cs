@@ -0,0 +1,28 @@
+// <auto-generated />
+using System;
+using Microsoft.EntityFrameworkCore.Infrastructure;
+using Microsoft.EntityFrameworkCore.Metadata;
+
+#pragma warning disable 219, 612, 618
+#nullable disable
+
+namespace TLScope.src.Data.CompiledModels
+{
+    public partial class ApplicationDbContextModel
+    {
+        partial void Initialize()
+        {
+            var connection = ConnectionEntityType.Create(this);
+            var device = DeviceEntityType.Create(this);
+            var user = UserEntityType.Create(this);
+
+            DeviceEntityType.CreateForeignKey1(device, user);
+
+            ConnectionEntityType.CreateAnnotations(connection);
+            DeviceEntityType.CreateAnnotations(device);
+            UserEntityType.CreateAnnotations(user);
+
+            AddAnnotation("ProductVersion", "8.0.10");
+        }
+    }
+}
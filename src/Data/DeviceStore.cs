@@ -0,0 +1,479 @@
+// In-memory table of live devices, keyed by packed IPv4/MAC with hot fields kept in parallel arrays
+// The UI, persistence and export layers read it through DeviceRecord projections
+
+using TLScope.src.Models;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Data {
+    public enum DeviceState : byte {
+        Free = 0,
+        Up,
+        Suspect
+    }
+
+    /// <summary>
+    /// Immutable copy of one device row.
+    /// </summary>
+    public readonly record struct DeviceRecord(
+        uint IP,
+        ulong MAC,
+        string Name,
+        string? OperatingSystem,
+        long LastSeenTicks,
+        float RoundTripTime,
+        DeviceState State,
+        string? Interface = null,
+        UInt128[]? IPv6 = null,
+        int Certificate = 0) {
+
+        public string IPAddress => NetData.FromUInt32(IP).ToString();
+        public string MACAddress => NetData.FormatMac(MAC);
+        /// <summary>
+        /// NIC vendor registered for the MAC's prefix, when the OUI table is installed.
+        /// </summary>
+        public string? Vendor => OuiTable.GetVendor(MAC);
+        public IEnumerable<string> IPv6Addresses => (IPv6 ?? []).Select(address => NetData.FromUInt128(address).ToString());
+        /// <summary>
+        /// The certificate the device last presented to an active probe, if any.
+        /// </summary>
+        public TlsCertificateInfo? CertificateInfo => Interned.Certificates.TryGet(Certificate, out var info) ? info : null;
+        public DateTime LastSeen => new(LastSeenTicks, DateTimeKind.Utc);
+        public double? RoundTripMs => float.IsNaN(RoundTripTime) ? null : RoundTripTime;
+
+        /// <summary>
+        /// Projection onto the EF entity used for persistence.
+        /// </summary>
+        public Device ToDevice() {
+            return new Device {
+                DeviceName = Name,
+                IPAddress = IPAddress,
+                MACAddress = MACAddress,
+                OperatingSystem = OperatingSystem,
+                LastSeen = LastSeen
+            };
+        }
+    }
+
+    public sealed class DeviceStore {
+        private const int InitialCapacity = 256;
+        private const int MaxIPv6PerDevice = 8; // privacy addresses rotate; keep the newest few
+
+        private readonly object _lock = new();
+        private readonly Dictionary<uint, int> _byIP = [];
+        private readonly Dictionary<ulong, int> _byMac = [];
+        private readonly Dictionary<UInt128, int> _byIPv6 = [];
+        private readonly Stack<int> _freeSlots = new();
+        private int _used; // slots handed out so far; rows live in [0, _used)
+
+        // Row storage, one entry per slot
+        private uint[] _ip = new uint[InitialCapacity];
+        private ulong[] _mac = new ulong[InitialCapacity];
+        private long[] _lastSeen = new long[InitialCapacity];
+        private long[] _heard = new long[InitialCapacity]; // last passive sighting; probes and sweeps leave it alone
+        private float[] _rtt = new float[InitialCapacity];
+        private DeviceState[] _state = new DeviceState[InitialCapacity];
+        private string?[] _name = new string?[InitialCapacity];
+        private string?[] _os = new string?[InitialCapacity];
+        private string?[] _iface = new string?[InitialCapacity];
+        private UInt128[]?[] _ipv6 = new UInt128[]?[InitialCapacity]; // replaced, never mutated, so records can share it
+        private int[] _certificate = new int[InitialCapacity]; // interned, one reference per row
+
+        public int Count {
+            get {
+                lock (_lock) {
+                    return _byIP.Count;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Adds the device or refreshes its last-seen time. Returns true if the IP was not present.
+        /// A MAC that shows up on a new IP carries its name and OS over. The device is tagged with the interface
+        /// it was last seen on. Passive marks a sighting of the device's own traffic rather than a sweep reply.
+        /// </summary>
+        public bool Upsert(uint ip, ulong mac, string? interfaceName, long nowTicks, Func<string> nameFactory,
+            bool passive, out DeviceRecord record) {
+            lock (_lock) {
+                if (_byIP.TryGetValue(ip, out int slot)) {
+                    _lastSeen[slot] = nowTicks;
+                    if (passive) {
+                        _heard[slot] = nowTicks;
+                    }
+                    _state[slot] = DeviceState.Up;
+                    _iface[slot] = interfaceName ?? _iface[slot];
+                    if (mac != 0 && _mac[slot] != mac) {
+                        ClearIPv6(slot); // they belonged to the previous hardware
+                        _byMac.Remove(_mac[slot]);
+                        _mac[slot] = mac;
+                        _byMac[mac] = slot;
+                    }
+                    record = Read(slot);
+                    return false;
+                }
+
+                string? name = null;
+                string? os = null;
+                if (mac != 0 && _byMac.TryGetValue(mac, out int previous)) {
+                    // The old row ages out through probing as usual; the MAC index follows the new address
+                    name = _name[previous];
+                    os = _os[previous];
+                }
+
+                slot = AllocateSlot();
+                _ip[slot] = ip;
+                _mac[slot] = mac;
+                _lastSeen[slot] = nowTicks;
+                _heard[slot] = passive ? nowTicks : 0;
+                _rtt[slot] = float.NaN;
+                _state[slot] = DeviceState.Up;
+                _name[slot] = name ?? nameFactory();
+                _os[slot] = os;
+                _iface[slot] = interfaceName;
+                _ipv6[slot] = null;
+                _certificate[slot] = 0;
+                _byIP[ip] = slot;
+                if (mac != 0) {
+                    _byMac[mac] = slot;
+                }
+                record = Read(slot);
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// Records a successful probe. Returns false if the device is not tracked.
+        /// </summary>
+        public bool Touch(uint ip, long nowTicks, double? rtt, out DeviceRecord record) {
+            lock (_lock) {
+                if (!_byIP.TryGetValue(ip, out int slot)) {
+                    record = default;
+                    return false;
+                }
+                _lastSeen[slot] = nowTicks;
+                _state[slot] = DeviceState.Up;
+                if (rtt is double value) {
+                    _rtt[slot] = (float)value;
+                }
+                record = Read(slot);
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// Records traffic from a MAC whose IPv4 address was not visible (e.g. IPv6 neighbor discovery).
+        /// Returns false if no device has that MAC.
+        /// </summary>
+        public bool TouchMac(ulong mac, long nowTicks, out DeviceRecord record) {
+            lock (_lock) {
+                if (mac == 0 || !_byMac.TryGetValue(mac, out int slot)) {
+                    record = default;
+                    return false;
+                }
+                _lastSeen[slot] = nowTicks;
+                _heard[slot] = nowTicks;
+                _state[slot] = DeviceState.Up;
+                record = Read(slot);
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// Folds an IPv6 address into the device with the given MAC, so a dual-stack host stays one row, and when
+        /// alive is set refreshes its last-seen time and state. Returns false if no device has that MAC; added tells
+        /// whether the address is new to it.
+        /// </summary>
+        public bool AddIPv6(ulong mac, UInt128 address, long nowTicks, bool alive, out bool added, out DeviceRecord record) {
+            lock (_lock) {
+                added = false;
+                if (mac == 0 || !_byMac.TryGetValue(mac, out int slot)) {
+                    record = default;
+                    return false;
+                }
+                if (alive) {
+                    _lastSeen[slot] = nowTicks;
+                    _heard[slot] = nowTicks;
+                    _state[slot] = DeviceState.Up;
+                }
+                if (_byIPv6.TryGetValue(address, out int owner)) {
+                    if (owner == slot) {
+                        record = Read(slot);
+                        return true;
+                    }
+                    DropIPv6(owner, address); // the address moved to another host
+                }
+                UInt128[] current = _ipv6[slot] ?? [];
+                if (current.Length == MaxIPv6PerDevice) {
+                    _byIPv6.Remove(current[0]);
+                    current = current[1..];
+                }
+                _ipv6[slot] = [.. current, address];
+                _byIPv6[address] = slot;
+                added = true;
+                record = Read(slot);
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// Refreshes the device owning an IPv6 address. Returns false if the address is not attached to any.
+        /// </summary>
+        public bool TouchIPv6(UInt128 address, long nowTicks, out DeviceRecord record) {
+            lock (_lock) {
+                if (!_byIPv6.TryGetValue(address, out int slot)) {
+                    record = default;
+                    return false;
+                }
+                _lastSeen[slot] = nowTicks;
+                _heard[slot] = nowTicks;
+                _state[slot] = DeviceState.Up;
+                record = Read(slot);
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// Stores a whole record received from another instance (an aggregated agent), replacing the row for its
+        /// IP. Its certificate is not carried over, since interned IDs only mean something in the process that made
+        /// them. Returns true if the IP was not present.
+        /// </summary>
+        public bool Put(in DeviceRecord device, out DeviceRecord record) {
+            lock (_lock) {
+                bool added = !_byIP.TryGetValue(device.IP, out int slot);
+                if (added) {
+                    slot = AllocateSlot();
+                    _ip[slot] = device.IP;
+                    _mac[slot] = 0;
+                    _heard[slot] = 0;
+                    _certificate[slot] = 0;
+                    _ipv6[slot] = null;
+                    _byIP[device.IP] = slot;
+                }
+                if (_mac[slot] != device.MAC && _byMac.TryGetValue(_mac[slot], out int owner) && owner == slot) {
+                    _byMac.Remove(_mac[slot]);
+                }
+                _mac[slot] = device.MAC;
+                if (device.MAC != 0) {
+                    _byMac[device.MAC] = slot;
+                }
+                _lastSeen[slot] = device.LastSeenTicks;
+                _rtt[slot] = device.RoundTripTime;
+                _state[slot] = device.State == DeviceState.Free ? DeviceState.Up : device.State;
+                _name[slot] = device.Name;
+                _os[slot] = device.OperatingSystem;
+                _iface[slot] = device.Interface;
+                ClearIPv6(slot);
+                _ipv6[slot] = device.IPv6;
+                foreach (UInt128 address in device.IPv6 ?? []) {
+                    _byIPv6[address] = slot;
+                }
+                record = Read(slot);
+                return added;
+            }
+        }
+
+        public bool SetState(uint ip, DeviceState state) {
+            lock (_lock) {
+                if (!_byIP.TryGetValue(ip, out int slot) || state == DeviceState.Free) {
+                    return false;
+                }
+                bool changed = _state[slot] != state;
+                _state[slot] = state;
+                return changed;
+            }
+        }
+
+        public bool SetName(uint ip, string name, out DeviceRecord record) {
+            lock (_lock) {
+                return SetText(_name, ip, name, out record);
+            }
+        }
+
+        /// <summary>
+        /// Points the device at an interned certificate, taking a reference and giving up the previous one.
+        /// </summary>
+        public bool SetCertificate(uint ip, int certificate, out DeviceRecord record) {
+            lock (_lock) {
+                if (!_byIP.TryGetValue(ip, out int slot) || _certificate[slot] == certificate) {
+                    record = default;
+                    return false;
+                }
+                Interned.Certificates.Release(_certificate[slot]);
+                _certificate[slot] = Interned.Certificates.AddRef(certificate);
+                record = Read(slot);
+                return true;
+            }
+        }
+
+        public bool SetOperatingSystem(uint ip, string os, out DeviceRecord record) {
+            lock (_lock) {
+                return SetText(_os, ip, os, out record);
+            }
+        }
+
+        // Callers hold the lock and pass the current column array, which growth may have replaced
+        private bool SetText(string?[] column, uint ip, string value, out DeviceRecord record) {
+            if (!_byIP.TryGetValue(ip, out int slot) || column[slot] == value) {
+                record = default;
+                return false;
+            }
+            column[slot] = value;
+            record = Read(slot);
+            return true;
+        }
+
+        public bool Remove(uint ip, out DeviceRecord record) {
+            lock (_lock) {
+                if (!_byIP.TryGetValue(ip, out int slot)) {
+                    record = default;
+                    return false;
+                }
+                record = Read(slot);
+                RemoveSlot(slot);
+                return true;
+            }
+        }
+
+        public bool TryGet(uint ip, out DeviceRecord record) {
+            lock (_lock) {
+                if (_byIP.TryGetValue(ip, out int slot)) {
+                    record = Read(slot);
+                    return true;
+                }
+                record = default;
+                return false;
+            }
+        }
+
+        public bool TryGetByMac(ulong mac, out DeviceRecord record) {
+            lock (_lock) {
+                if (_byMac.TryGetValue(mac, out int slot)) {
+                    record = Read(slot);
+                    return true;
+                }
+                record = default;
+                return false;
+            }
+        }
+
+        /// <summary>
+        /// Whether the device's own traffic was seen since the given time. Probe replies and sweeps do not count,
+        /// so skipping a probe on this never rests on an earlier probe.
+        /// </summary>
+        public bool HeardSince(uint ip, long sinceTicks) {
+            lock (_lock) {
+                return _byIP.TryGetValue(ip, out int slot) && _heard[slot] >= sinceTicks;
+            }
+        }
+
+        public bool Contains(uint ip) {
+            lock (_lock) {
+                return _byIP.ContainsKey(ip);
+            }
+        }
+
+        /// <summary>
+        /// Appends every tracked IP to output with a linear pass over the IP column, optionally only those
+        /// last seen on one interface.
+        /// </summary>
+        public void CopyIPs(List<uint> output, string? interfaceName = null) {
+            lock (_lock) {
+                for (int slot = 0; slot < _used; slot++) {
+                    if (_state[slot] != DeviceState.Free && (interfaceName == null || _iface[slot] == interfaceName)) {
+                        output.Add(_ip[slot]);
+                    }
+                }
+            }
+        }
+
+        public void CopyTo(List<DeviceRecord> output) {
+            lock (_lock) {
+                for (int slot = 0; slot < _used; slot++) {
+                    if (_state[slot] != DeviceState.Free) {
+                        output.Add(Read(slot));
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Appends the IPs of devices not seen since the given time, e.g. to decide which hosts need active probing.
+        /// </summary>
+        public void CopyStale(long seenBeforeTicks, List<uint> output) {
+            lock (_lock) {
+                var lastSeen = _lastSeen;
+                for (int slot = 0; slot < _used; slot++) {
+                    if (_state[slot] != DeviceState.Free && lastSeen[slot] < seenBeforeTicks) {
+                        output.Add(_ip[slot]);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Adds the IPs of devices seen since the given time, e.g. hosts active sweeps can skip this cycle.
+        /// </summary>
+        public void CopySeenSince(long seenSinceTicks, HashSet<uint> output) {
+            lock (_lock) {
+                var lastSeen = _lastSeen;
+                for (int slot = 0; slot < _used; slot++) {
+                    if (_state[slot] != DeviceState.Free && lastSeen[slot] >= seenSinceTicks) {
+                        output.Add(_ip[slot]);
+                    }
+                }
+            }
+        }
+
+        private DeviceRecord Read(int slot) {
+            return new DeviceRecord(_ip[slot], _mac[slot], _name[slot] ?? string.Empty, _os[slot],
+                _lastSeen[slot], _rtt[slot], _state[slot], _iface[slot], _ipv6[slot], _certificate[slot]);
+        }
+
+        private int AllocateSlot() {
+            if (_freeSlots.TryPop(out int slot)) {
+                return slot;
+            }
+            if (_used == _ip.Length) {
+                int capacity = _ip.Length * 2;
+                Array.Resize(ref _ip, capacity);
+                Array.Resize(ref _mac, capacity);
+                Array.Resize(ref _lastSeen, capacity);
+                Array.Resize(ref _heard, capacity);
+                Array.Resize(ref _rtt, capacity);
+                Array.Resize(ref _state, capacity);
+                Array.Resize(ref _name, capacity);
+                Array.Resize(ref _os, capacity);
+                Array.Resize(ref _iface, capacity);
+                Array.Resize(ref _ipv6, capacity);
+                Array.Resize(ref _certificate, capacity);
+            }
+            return _used++;
+        }
+
+        private void RemoveSlot(int slot) {
+            _byIP.Remove(_ip[slot]);
+            if (_byMac.TryGetValue(_mac[slot], out int owner) && owner == slot) {
+                _byMac.Remove(_mac[slot]);
+            }
+            _state[slot] = DeviceState.Free;
+            _name[slot] = null;
+            _os[slot] = null;
+            _iface[slot] = null;
+            ClearIPv6(slot);
+            Interned.Certificates.Release(_certificate[slot]);
+            _certificate[slot] = 0;
+            _freeSlots.Push(slot);
+        }
+
+        private void ClearIPv6(int slot) {
+            foreach (UInt128 address in _ipv6[slot] ?? []) {
+                _byIPv6.Remove(address);
+            }
+            _ipv6[slot] = null;
+        }
+
+        private void DropIPv6(int slot, UInt128 address) {
+            _ipv6[slot] = _ipv6[slot]?.Where(a => a != address).ToArray();
+            _byIPv6.Remove(address);
+        }
+    }
+}
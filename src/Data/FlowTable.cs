@@ -0,0 +1,411 @@
+// Fixed-budget table of TCP flows for the capture path, sharded by connection hash
+// Slots are preallocated and recycled through an intrusive LRU list, so memory stays flat under connection storms
+
+using System.Buffers;
+using System.Runtime.CompilerServices;
+using TLScope.src.Services;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Data {
+    [Flags]
+    public enum FlowFlags : byte {
+        None = 0,
+        ClientHello = 1 << 0,
+        ServerHello = 1 << 1,
+        HelloRetry = 1 << 2,
+        SourceFin = 1 << 3,      // FIN seen from Key.Source
+        DestinationFin = 1 << 4, // FIN seen from Key.Destination
+        Announced = 1 << 5       // session already reported to the graph
+    }
+
+    [InlineArray(FlowTable.ServerNameCapacity)]
+    public struct ServerNameBuffer {
+        private byte _element;
+    }
+
+    /// <summary>
+    /// Per-connection state. Key is canonical (lower address/port endpoint first) so both directions share a slot.
+    /// </summary>
+    public struct FlowSlot {
+        public FlowKey Key;
+        public long FirstSeenTicks;
+        public long LastSeenTicks;
+        public long Bytes;
+        public long ReportedBytes;
+        public int Packets;
+        public FlowFlags Flags;
+        public bool ClientIsSource; // meaningful once ClientHello is set
+        public ushort Version;
+        public ushort CipherSuite;
+        public UInt128 Ja3;
+        public Ja4Fingerprint Ja4;
+        public ServerNameBuffer ServerName;
+        public byte ServerNameLength;
+
+        // One handshake record split across segments, in one direction at a time
+        public byte[]? Partial;
+        public int PartialLength;
+        public uint PartialNextSequence;
+        public bool PartialForward;
+
+        // Table bookkeeping
+        internal int HashNext;
+        internal int LruPrev;
+        internal int LruNext;
+        internal bool InUse;
+
+        public readonly FlowKey ClientToServer => ClientIsSource || (Flags & FlowFlags.ClientHello) == 0 ? Key : Key.Reverse();
+    }
+
+    public sealed class FlowTable {
+        public const int ServerNameCapacity = 96; // longer names are truncated on display, not on matching
+        private const int MaxPendingPerShard = 4096;
+
+        private readonly Shard[] _shards;
+
+        public int ShardCount => _shards.Length;
+        public int Capacity { get; }
+
+        /// <summary>
+        /// Flow deltas dropped because the graph was not collecting fast enough.
+        /// </summary>
+        public long DroppedDeltas {
+            get {
+                long total = 0;
+                foreach (var shard in _shards) {
+                    total += Interlocked.Read(ref shard.DroppedDeltas);
+                }
+                return total;
+            }
+        }
+
+        public int Count {
+            get {
+                int total = 0;
+                foreach (var shard in _shards) {
+                    lock (shard.Sync) {
+                        total += shard.Count;
+                    }
+                }
+                return total;
+            }
+        }
+
+        public FlowTable(int capacity, int shardCount, long reassemblyBudgetBytes) {
+            shardCount = Math.Max(1, shardCount);
+            int perShard = Math.Max(16, capacity / shardCount);
+            _shards = new Shard[shardCount];
+            for (int i = 0; i < shardCount; i++) {
+                _shards[i] = new Shard(perShard, reassemblyBudgetBytes / shardCount);
+            }
+            Capacity = perShard * shardCount;
+        }
+
+        /// <summary>
+        /// Sizes the table from TLSCOPE_FLOW_TABLE_MB and TLSCOPE_FLOW_REASSEMBLY_MB.
+        /// </summary>
+        public static FlowTable FromSettings(int shardCount) {
+            long budget = (long)Settings.FlowTableMemoryMB * 1024 * 1024;
+            int capacity = (int)Math.Min(int.MaxValue / 2, budget / Unsafe.SizeOf<FlowSlot>());
+            return new FlowTable(capacity, shardCount, (long)Settings.FlowReassemblyMemoryMB * 1024 * 1024);
+        }
+
+        public Shard this[int index] => _shards[index];
+
+        /// <summary>
+        /// The shard that owns a connection, by the same hash the capture dispatcher partitions on.
+        /// </summary>
+        public int ShardOf(in FlowKey flow) {
+            return (int)((uint)flow.ConnectionHash() % (uint)_shards.Length);
+        }
+
+        /// <summary>
+        /// Moves pending session events into output, adds byte counts for active flows and evicts flows idle
+        /// since the given time. Meant to be called periodically by whoever feeds the connection graph.
+        /// </summary>
+        public void Collect(long idleBeforeTicks, List<FlowDelta> output) {
+            foreach (var shard in _shards) {
+                lock (shard.Sync) {
+                    shard.Collect(idleBeforeTicks, output);
+                }
+            }
+        }
+
+        public static FlowKey Canonical(in FlowKey flow, out bool forward) {
+            forward = flow.SourceAddress < flow.DestinationAddress
+                || (flow.SourceAddress == flow.DestinationAddress && flow.SourcePort <= flow.DestinationPort);
+            return forward ? flow : flow.Reverse();
+        }
+
+        /// <summary>
+        /// One partition of the table. Every member except the counters requires holding <see cref="Sync"/>.
+        /// </summary>
+        public sealed class Shard {
+            public readonly object Sync = new();
+            internal long DroppedDeltas;
+
+            private readonly FlowSlot[] _slots;
+            private readonly int[] _buckets; // head slot per bucket, -1 if empty
+            private readonly int _bucketMask;
+            private readonly long _reassemblyBudget;
+            private readonly List<FlowDelta> _pending = [];
+            private int _freeHead; // singly linked through HashNext
+            private int _lruHead = -1; // most recently used
+            private int _lruTail = -1;
+            private long _reassemblyBytes;
+
+            public int Count { get; private set; }
+
+            internal Shard(int capacity, long reassemblyBudget) {
+                _slots = new FlowSlot[capacity];
+                for (int i = 0; i < capacity; i++) {
+                    _slots[i].HashNext = i + 1 < capacity ? i + 1 : -1;
+                }
+                int buckets = (int)System.Numerics.BitOperations.RoundUpToPowerOf2((uint)capacity);
+                _buckets = new int[buckets];
+                Array.Fill(_buckets, -1);
+                _bucketMask = buckets - 1;
+                _reassemblyBudget = reassemblyBudget;
+            }
+
+            public ref FlowSlot this[int index] => ref _slots[index];
+
+            /// <summary>
+            /// Returns the slot index for the connection or -1. forward tells whether flow runs Key.Source to Key.Destination.
+            /// </summary>
+            public int Find(in FlowKey flow, out bool forward) {
+                FlowKey key = Canonical(flow, out forward);
+                for (int i = _buckets[Bucket(key)]; i >= 0; i = _slots[i].HashNext) {
+                    if (_slots[i].Key == key) {
+                        return i;
+                    }
+                }
+                return -1;
+            }
+
+            /// <summary>
+            /// Claims a slot for a connection not yet in the table, evicting the least recently used one when full.
+            /// </summary>
+            public int Add(in FlowKey flow, long nowTicks, out bool forward) {
+                FlowKey key = Canonical(flow, out forward);
+                if (_freeHead < 0) {
+                    Evict(_lruTail);
+                }
+                int index = _freeHead;
+                ref FlowSlot slot = ref _slots[index];
+                _freeHead = slot.HashNext;
+
+                slot = default;
+                slot.Key = key;
+                slot.FirstSeenTicks = nowTicks;
+                slot.LastSeenTicks = nowTicks;
+                slot.InUse = true;
+                int bucket = Bucket(key);
+                slot.HashNext = _buckets[bucket];
+                _buckets[bucket] = index;
+                LinkFront(index);
+                Count++;
+                return index;
+            }
+
+            /// <summary>
+            /// Marks the flow as just used and counts the segment.
+            /// </summary>
+            public void Touch(int index, long nowTicks, int payloadBytes) {
+                ref FlowSlot slot = ref _slots[index];
+                slot.LastSeenTicks = Math.Max(slot.LastSeenTicks, nowTicks);
+                slot.Bytes += payloadBytes;
+                slot.Packets++;
+                if (_lruHead != index) {
+                    Unlink(index);
+                    LinkFront(index);
+                }
+            }
+
+            public ReadOnlySpan<byte> ServerNameOf(int index) {
+                ref FlowSlot slot = ref _slots[index];
+                return ((ReadOnlySpan<byte>)slot.ServerName)[..slot.ServerNameLength];
+            }
+
+            public void SetServerName(int index, ReadOnlySpan<byte> name) {
+                ref FlowSlot slot = ref _slots[index];
+                int length = Math.Min(name.Length, ServerNameCapacity);
+                name[..length].CopyTo(slot.ServerName);
+                slot.ServerNameLength = (byte)length;
+            }
+
+            /// <summary>
+            /// Buffers the start of a split handshake record. Returns false when the shard's reassembly budget is spent.
+            /// </summary>
+            public bool StartPartial(int index, bool forward, uint nextSequence, ReadOnlySpan<byte> data) {
+                ref FlowSlot slot = ref _slots[index];
+                ReleasePartial(ref slot);
+                if (_reassemblyBytes + data.Length > _reassemblyBudget) {
+                    return false;
+                }
+                slot.Partial = ArrayPool<byte>.Shared.Rent(Math.Max(4096, data.Length));
+                _reassemblyBytes += slot.Partial.Length;
+                data.CopyTo(slot.Partial);
+                slot.PartialLength = data.Length;
+                slot.PartialNextSequence = nextSequence;
+                slot.PartialForward = forward;
+                return true;
+            }
+
+            /// <summary>
+            /// Appends the next in-order bytes of the split record. Returns false (and drops it) past the budget.
+            /// </summary>
+            public bool AppendPartial(int index, ReadOnlySpan<byte> data, int maxLength) {
+                ref FlowSlot slot = ref _slots[index];
+                int needed = slot.PartialLength + data.Length;
+                if (slot.Partial == null || needed > maxLength) {
+                    ReleasePartial(ref slot);
+                    return false;
+                }
+                if (needed > slot.Partial.Length) {
+                    int size = Math.Max(slot.Partial.Length * 2, needed);
+                    if (_reassemblyBytes - slot.Partial.Length + size > _reassemblyBudget) {
+                        ReleasePartial(ref slot);
+                        return false;
+                    }
+                    byte[] larger = ArrayPool<byte>.Shared.Rent(size);
+                    slot.Partial.AsSpan(0, slot.PartialLength).CopyTo(larger);
+                    _reassemblyBytes += larger.Length - slot.Partial.Length;
+                    ArrayPool<byte>.Shared.Return(slot.Partial);
+                    slot.Partial = larger;
+                }
+                data.CopyTo(slot.Partial.AsSpan(slot.PartialLength));
+                slot.PartialLength = needed;
+                slot.PartialNextSequence += (uint)data.Length;
+                return true;
+            }
+
+            public void ConsumePartial(int index, int count) {
+                ref FlowSlot slot = ref _slots[index];
+                if (slot.Partial == null) {
+                    return;
+                }
+                if (count >= slot.PartialLength) {
+                    ReleasePartial(ref slot);
+                    return;
+                }
+                slot.Partial.AsSpan(count, slot.PartialLength - count).CopyTo(slot.Partial);
+                slot.PartialLength -= count;
+            }
+
+            public void DropPartial(int index) {
+                ReleasePartial(ref _slots[index]);
+            }
+
+            /// <summary>
+            /// Queues a session event for the next <see cref="FlowTable.Collect"/>.
+            /// </summary>
+            public void Report(in FlowDelta delta) {
+                if (_pending.Count < MaxPendingPerShard) {
+                    _pending.Add(delta);
+                } else {
+                    Interlocked.Increment(ref DroppedDeltas);
+                    Interned.ServerNames.Release(delta.ServerName);
+                    Interned.Ja3.Release(delta.Ja3);
+                    Interned.Ja4.Release(delta.Ja4);
+                }
+            }
+
+            /// <summary>
+            /// Frees the slot, queueing its unreported bytes first.
+            /// </summary>
+            public void Remove(int index) {
+                Evict(index);
+            }
+
+            internal void Collect(long idleBeforeTicks, List<FlowDelta> output) {
+                output.AddRange(_pending);
+                _pending.Clear();
+
+                while (_lruTail >= 0 && _slots[_lruTail].LastSeenTicks < idleBeforeTicks) {
+                    Evict(_lruTail);
+                    output.AddRange(_pending);
+                    _pending.Clear();
+                }
+                for (int i = _lruHead; i >= 0; i = _slots[i].LruNext) {
+                    ref FlowSlot slot = ref _slots[i];
+                    if (slot.Bytes != slot.ReportedBytes && (slot.Flags & FlowFlags.Announced) != 0) {
+                        output.Add(new FlowDelta(slot.ClientToServer, false, slot.Bytes - slot.ReportedBytes, slot.LastSeenTicks));
+                        slot.ReportedBytes = slot.Bytes;
+                    }
+                }
+            }
+
+            private void Evict(int index) {
+                ref FlowSlot slot = ref _slots[index];
+                if (!slot.InUse) {
+                    return;
+                }
+                if ((slot.Flags & FlowFlags.Announced) != 0 && slot.Bytes != slot.ReportedBytes) {
+                    Report(new FlowDelta(slot.ClientToServer, false, slot.Bytes - slot.ReportedBytes, slot.LastSeenTicks));
+                }
+                ReleasePartial(ref slot);
+
+                int bucket = Bucket(slot.Key);
+                if (_buckets[bucket] == index) {
+                    _buckets[bucket] = slot.HashNext;
+                } else {
+                    int previous = _buckets[bucket];
+                    while (_slots[previous].HashNext != index) {
+                        previous = _slots[previous].HashNext;
+                    }
+                    _slots[previous].HashNext = slot.HashNext;
+                }
+                Unlink(index);
+                slot.InUse = false;
+                slot.HashNext = _freeHead;
+                _freeHead = index;
+                Count--;
+            }
+
+            private void ReleasePartial(ref FlowSlot slot) {
+                if (slot.Partial != null) {
+                    _reassemblyBytes -= slot.Partial.Length;
+                    ArrayPool<byte>.Shared.Return(slot.Partial);
+                    slot.Partial = null;
+                }
+                slot.PartialLength = 0;
+            }
+
+            // HashCode is seeded per process, so crafted 4-tuples cannot pile into one chain
+            private int Bucket(in FlowKey key) {
+                return HashCode.Combine(key.SourceAddress, key.DestinationAddress, key.SourcePort, key.DestinationPort)
+                    & _bucketMask;
+            }
+
+            private void LinkFront(int index) {
+                ref FlowSlot slot = ref _slots[index];
+                slot.LruPrev = -1;
+                slot.LruNext = _lruHead;
+                if (_lruHead >= 0) {
+                    _slots[_lruHead].LruPrev = index;
+                }
+                _lruHead = index;
+                if (_lruTail < 0) {
+                    _lruTail = index;
+                }
+            }
+
+            private void Unlink(int index) {
+                ref FlowSlot slot = ref _slots[index];
+                if (slot.LruPrev >= 0) {
+                    _slots[slot.LruPrev].LruNext = slot.LruNext;
+                } else {
+                    _lruHead = slot.LruNext;
+                }
+                if (slot.LruNext >= 0) {
+                    _slots[slot.LruNext].LruPrev = slot.LruPrev;
+                } else {
+                    _lruTail = slot.LruPrev;
+                }
+                slot.LruPrev = -1;
+                slot.LruNext = -1;
+            }
+        }
+    }
+}
@@ -0,0 +1,686 @@
+// Append-only presence and connection history, one segment file per hour of writes
+// A segment is a run of self-describing columnar blocks, read back through memory-mapped views
+
+using System.Buffers;
+using System.Buffers.Binary;
+using System.Globalization;
+using System.IO.MemoryMappedFiles;
+using TLScope.src.Debugging;
+using TLScope.src.Services;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Data {
+    /// <summary>
+    /// One device observation. State is Free for the sample taken when the device dropped off the network.
+    /// </summary>
+    public readonly record struct PresenceSample(long TimestampTicks, ulong MAC, uint IP, float RoundTripTime, DeviceState State) {
+        public DateTime Timestamp => new(TimestampTicks, DateTimeKind.Utc);
+        public bool IsUp => State != DeviceState.Free;
+    }
+
+    /// <summary>
+    /// One batch of TLS session activity between a client and a server port.
+    /// </summary>
+    public readonly record struct EdgeSample(long TimestampTicks, UInt128 Client, UInt128 Server, ushort ServerPort,
+        long Sessions, long Bytes) {
+        public DateTime Timestamp => new(TimestampTicks, DateTimeKind.Utc);
+    }
+
+    /*
+     * Block layout, little endian:
+     *   0  u32 magic            4  u8 kind        5  u8 column count    6  u16 reserved
+     *   8  i32 rows            12  i32 new dictionary entries           16  i32 payload length
+     *  20  u32 reserved        24  i64 min ticks                        32  i64 max ticks
+     *  40  payload: i32 length per column, new dictionary entries, then the columns in order
+     *
+     * Presence columns: timestamp, device id, IPv4 (u32), RTT (f32, NaN when unknown), state (u8)
+     * Edge columns:     timestamp, client id, server id, port (u16), sessions, bytes
+     * Timestamps are zigzag varint deltas from the previous row, the first from min ticks. Ids and counts are varints.
+     * Dictionaries are per segment and per block kind: presence blocks key devices by MAC (u64), edge blocks key
+     * hosts by address (16 bytes). An id is always defined in the block that first uses it or an earlier one.
+     */
+    public sealed class HistoryStore {
+        private const uint BlockMagic = 0x42534C54; // "TLSB"
+        private const int HeaderLength = 40;
+        private const byte PresenceBlock = 1;
+        private const byte EdgeBlock = 2;
+        private const int PresenceColumns = 5;
+        private const int EdgeColumns = 6;
+        private const string HourFormat = "yyyyMMddHH";
+        private const string SegmentExtension = ".seg";
+
+        private readonly string _directory;
+        private readonly object _lock = new();
+        private List<PresenceSample> _presence = [];
+        private List<PresenceSample> _presenceSpare = [];
+        private List<EdgeSample> _edges = [];
+        private List<EdgeSample> _edgesSpare = [];
+        private long _dropped;
+        private volatile bool _disabled; // set once the history directory turned out to be off limits
+
+        // Writer state, touched only by the RunAsync loop
+        private FileStream? _segment;
+        private long _segmentHour = -1;
+        private readonly Dictionary<ulong, int> _deviceIds = [];
+        private readonly Dictionary<UInt128, int> _hostIds = [];
+        private readonly ArrayBufferWriter<byte> _block = new();
+        private readonly ArrayBufferWriter<byte>[] _columns = [new(), new(), new(), new(), new(), new()];
+
+        public HistoryStore(string directory) {
+            _directory = directory;
+            try {
+                Directory.CreateDirectory(directory);
+            } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                Disable($"Could not create the history directory {directory}.", ex);
+            }
+        }
+
+        /// <summary>
+        /// Samples discarded because too many were waiting for the next flush.
+        /// </summary>
+        public long Dropped => Interlocked.Read(ref _dropped);
+
+        /// <summary>
+        /// False once history could not be written for lack of access; samples are discarded from then on.
+        /// </summary>
+        public bool Enabled => !_disabled;
+
+        /// <summary>
+        /// Records a sample for every device whose liveness or RTT changed, and a down sample for every removal.
+        /// </summary>
+        public void Record(DeviceDeltaEventArgs delta) {
+            if (_disabled) {
+                return;
+            }
+            long now = DateTime.UtcNow.Ticks;
+            lock (_lock) {
+                foreach (var change in delta.Changes) {
+                    DeviceRecord device = change.Device;
+                    if (change.Kind == DeviceChangeKind.Updated
+                        && (change.Fields & (DeviceFields.LastSeen | DeviceFields.RoundTripTime | DeviceFields.State)) == 0) {
+                        continue;
+                    }
+                    bool removed = change.Kind == DeviceChangeKind.Removed;
+                    Add(_presence, new PresenceSample(removed ? now : device.LastSeenTicks, device.MAC, device.IP,
+                        removed ? float.NaN : device.RoundTripTime, removed ? DeviceState.Free : device.State));
+                }
+            }
+        }
+
+        public void Record(IReadOnlyList<FlowDelta> deltas) {
+            if (_disabled) {
+                return;
+            }
+            lock (_lock) {
+                for (int i = 0; i < deltas.Count; i++) {
+                    FlowDelta delta = deltas[i];
+                    Add(_edges, new EdgeSample(delta.TimestampTicks, delta.Flow.SourceAddress, delta.Flow.DestinationAddress,
+                        delta.Flow.DestinationPort, delta.Opened ? 1 : 0, delta.Bytes));
+                }
+            }
+        }
+
+        private void Add<T>(List<T> pending, in T sample) {
+            if (pending.Count < Settings.HistoryMaxPendingRows) {
+                pending.Add(sample);
+            } else {
+                _dropped++;
+            }
+        }
+
+        /// <summary>
+        /// Appends pending samples to the current segment every flush interval and enforces retention at each
+        /// segment rollover. Flushes once more when cancelled.
+        /// </summary>
+        public async Task RunAsync(CancellationToken cancTok) {
+            using var timer = new PeriodicTimer(Settings.HistoryFlushInterval);
+            try {
+                EnforceRetention(DateTime.UtcNow.Ticks / TimeSpan.TicksPerHour);
+                while (!_disabled && await timer.WaitForNextTickAsync(cancTok)) {
+                    Flush();
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            }
+            try {
+                Flush();
+            } finally {
+                _segment?.Dispose();
+                _segment = null;
+            }
+        }
+
+        private void Flush() {
+            if (_disabled) {
+                return;
+            }
+            List<PresenceSample> presence;
+            List<EdgeSample> edges;
+            lock (_lock) {
+                if (_presence.Count == 0 && _edges.Count == 0) {
+                    return;
+                }
+                (presence, _presence, _presenceSpare) = (_presence, _presenceSpare, _presence);
+                (edges, _edges, _edgesSpare) = (_edges, _edgesSpare, _edges);
+            }
+            try {
+                long hour = DateTime.UtcNow.Ticks / TimeSpan.TicksPerHour;
+                if (hour != _segmentHour) {
+                    OpenSegment(hour);
+                    EnforceRetention(hour);
+                }
+                if (presence.Count > 0) {
+                    WritePresence(presence);
+                }
+                if (edges.Count > 0) {
+                    WriteEdges(edges);
+                }
+                _segment!.Flush();
+            } catch (IOException ex) {
+                Logging.Error($"Could not append {presence.Count + edges.Count} history sample(s).", ex);
+                _segment?.Dispose();
+                _segment = null;
+                _segmentHour = -1; // reopen, and truncate whatever was half written, on the next flush
+            } catch (UnauthorizedAccessException ex) {
+                Disable($"Could not append {presence.Count + edges.Count} history sample(s).", ex);
+                _segment?.Dispose();
+                _segment = null;
+                _segmentHour = -1;
+            } finally {
+                presence.Clear();
+                edges.Clear();
+            }
+        }
+
+        // Opens (or resumes) the segment for the given hour, reloading its dictionaries and cutting off any torn tail
+        private unsafe void OpenSegment(long hour) {
+            _segment?.Dispose();
+            _segment = null;
+            _deviceIds.Clear();
+            _hostIds.Clear();
+
+            string path = SegmentPath(hour);
+            long valid = 0;
+            using (var view = SegmentView.TryOpen(path)) {
+                if (view != null) {
+                    for (long offset = 0; TryReadHeader(view, offset, out BlockHeader header); offset = header.End) {
+                        byte* entries = view.Pointer + header.DictionaryOffset;
+                        for (int i = 0; i < header.DictionaryCount; i++) {
+                            if (header.Kind == PresenceBlock) {
+                                _deviceIds[ReadUInt64(entries + i * 8)] = _deviceIds.Count;
+                            } else {
+                                _hostIds[ReadUInt128(entries + i * 16)] = _hostIds.Count;
+                            }
+                        }
+                        valid = header.End;
+                    }
+                }
+            }
+
+            _segment = new FileStream(path, FileMode.OpenOrCreate, FileAccess.Write, FileShare.Read | FileShare.Delete);
+            if (_segment.Length != valid) {
+                Logging.Write($"History segment {Path.GetFileName(path)} had a torn tail; truncated to {valid} bytes.");
+                _segment.SetLength(valid);
+            }
+            _segment.Seek(0, SeekOrigin.End);
+            _segmentHour = hour;
+        }
+
+        private void EnforceRetention(long currentHour) {
+            long oldest = currentHour - Settings.HistoryRetentionHours;
+            foreach (var (hour, path) in ListSegments()) {
+                if (hour >= oldest) {
+                    break;
+                }
+                try {
+                    File.Delete(path);
+                    Logging.Write($"History segment {Path.GetFileName(path)} is past retention and was deleted.");
+                } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                    Logging.Error($"Could not delete expired history segment {path}.", ex);
+                }
+            }
+        }
+
+        private void WritePresence(List<PresenceSample> rows) {
+            ResetColumns();
+            int dictionaryStart = _deviceIds.Count;
+            Span<byte> scratch = stackalloc byte[8];
+            long min = long.MaxValue, max = long.MinValue;
+            foreach (var row in rows) {
+                min = Math.Min(min, row.TimestampTicks);
+                max = Math.Max(max, row.TimestampTicks);
+            }
+            long previous = min;
+            foreach (var row in rows) {
+                WriteVarint(_columns[0], ZigZag(row.TimestampTicks - previous));
+                previous = row.TimestampTicks;
+                if (!_deviceIds.TryGetValue(row.MAC, out int id)) {
+                    id = _deviceIds.Count;
+                    _deviceIds.Add(row.MAC, id);
+                }
+                WriteVarint(_columns[1], (ulong)id);
+                BinaryPrimitives.WriteUInt32LittleEndian(scratch, row.IP);
+                _columns[2].Write(scratch[..4]);
+                BinaryPrimitives.WriteSingleLittleEndian(scratch, row.RoundTripTime);
+                _columns[3].Write(scratch[..4]);
+                scratch[0] = (byte)row.State;
+                _columns[4].Write(scratch[..1]);
+            }
+
+            int added = _deviceIds.Count - dictionaryStart;
+            var entries = new byte[added * 8];
+            foreach (var (mac, id) in _deviceIds) {
+                if (id >= dictionaryStart) {
+                    BinaryPrimitives.WriteUInt64LittleEndian(entries.AsSpan((id - dictionaryStart) * 8), mac);
+                }
+            }
+            AppendBlock(PresenceBlock, PresenceColumns, rows.Count, added, entries, min, max);
+        }
+
+        private void WriteEdges(List<EdgeSample> rows) {
+            ResetColumns();
+            int dictionaryStart = _hostIds.Count;
+            Span<byte> scratch = stackalloc byte[2];
+            long min = long.MaxValue, max = long.MinValue;
+            foreach (var row in rows) {
+                min = Math.Min(min, row.TimestampTicks);
+                max = Math.Max(max, row.TimestampTicks);
+            }
+            long previous = min;
+            foreach (var row in rows) {
+                WriteVarint(_columns[0], ZigZag(row.TimestampTicks - previous));
+                previous = row.TimestampTicks;
+                WriteVarint(_columns[1], (ulong)HostId(row.Client));
+                WriteVarint(_columns[2], (ulong)HostId(row.Server));
+                BinaryPrimitives.WriteUInt16LittleEndian(scratch, row.ServerPort);
+                _columns[3].Write(scratch);
+                WriteVarint(_columns[4], (ulong)row.Sessions);
+                WriteVarint(_columns[5], (ulong)row.Bytes);
+            }
+
+            int added = _hostIds.Count - dictionaryStart;
+            var entries = new byte[added * 16];
+            foreach (var (address, id) in _hostIds) {
+                if (id >= dictionaryStart) {
+                    BinaryPrimitives.WriteUInt128LittleEndian(entries.AsSpan((id - dictionaryStart) * 16), address);
+                }
+            }
+            AppendBlock(EdgeBlock, EdgeColumns, rows.Count, added, entries, min, max);
+        }
+
+        private int HostId(UInt128 address) {
+            if (!_hostIds.TryGetValue(address, out int id)) {
+                id = _hostIds.Count;
+                _hostIds.Add(address, id);
+            }
+            return id;
+        }
+
+        private void ResetColumns() {
+            foreach (var column in _columns) {
+                column.Clear();
+            }
+        }
+
+        // The block is assembled in memory and written with one call so a crash can only tear the last block
+        private void AppendBlock(byte kind, int columnCount, int rows, int dictionaryCount, byte[] entries, long min, long max) {
+            int payload = columnCount * 4 + entries.Length;
+            for (int i = 0; i < columnCount; i++) {
+                payload += _columns[i].WrittenCount;
+            }
+
+            _block.Clear();
+            Span<byte> header = _block.GetSpan(HeaderLength + columnCount * 4);
+            header[..(HeaderLength + columnCount * 4)].Clear();
+            BinaryPrimitives.WriteUInt32LittleEndian(header, BlockMagic);
+            header[4] = kind;
+            header[5] = (byte)columnCount;
+            BinaryPrimitives.WriteInt32LittleEndian(header[8..], rows);
+            BinaryPrimitives.WriteInt32LittleEndian(header[12..], dictionaryCount);
+            BinaryPrimitives.WriteInt32LittleEndian(header[16..], payload);
+            BinaryPrimitives.WriteInt64LittleEndian(header[24..], min);
+            BinaryPrimitives.WriteInt64LittleEndian(header[32..], max);
+            for (int i = 0; i < columnCount; i++) {
+                BinaryPrimitives.WriteInt32LittleEndian(header[(HeaderLength + i * 4)..], _columns[i].WrittenCount);
+            }
+            _block.Advance(HeaderLength + columnCount * 4);
+            _block.Write(entries);
+            for (int i = 0; i < columnCount; i++) {
+                _block.Write(_columns[i].WrittenSpan);
+            }
+            _segment!.Write(_block.WrittenSpan);
+        }
+
+        /// <summary>
+        /// Presence samples between two times, oldest first within each segment. With a MAC, only that device's
+        /// samples are returned and segments it never appeared in are skipped after reading their dictionary.
+        /// Samples still waiting for the next flush are not included.
+        /// </summary>
+        public unsafe int QueryPresence(ulong? mac, DateTime from, DateTime to, List<PresenceSample> output) {
+            long fromTicks = from.ToUniversalTime().Ticks, toTicks = to.ToUniversalTime().Ticks;
+            int found = 0;
+            foreach (var path in SegmentsFor(fromTicks, toTicks)) {
+                using var view = SegmentView.TryOpen(path);
+                if (view == null) {
+                    continue;
+                }
+                var macs = new List<ulong>();
+                int target = -1;
+                for (long offset = 0; TryReadHeader(view, offset, out BlockHeader header); offset = header.End) {
+                    if (header.Kind != PresenceBlock) {
+                        continue;
+                    }
+                    byte* entries = view.Pointer + header.DictionaryOffset;
+                    for (int i = 0; i < header.DictionaryCount; i++) {
+                        ulong entry = ReadUInt64(entries + i * 8);
+                        if (entry == mac) {
+                            target = macs.Count;
+                        }
+                        macs.Add(entry);
+                    }
+                    if ((mac != null && target < 0) || header.MaxTicks < fromTicks || header.MinTicks > toTicks) {
+                        continue;
+                    }
+                    found += DecodePresence(view, header, target, macs, fromTicks, toTicks, output);
+                }
+            }
+            return found;
+        }
+
+        /// <summary>
+        /// Session samples between two times. With a host address, only samples where it is either endpoint.
+        /// </summary>
+        public unsafe int QueryEdges(UInt128? host, DateTime from, DateTime to, List<EdgeSample> output) {
+            long fromTicks = from.ToUniversalTime().Ticks, toTicks = to.ToUniversalTime().Ticks;
+            int found = 0;
+            foreach (var path in SegmentsFor(fromTicks, toTicks)) {
+                using var view = SegmentView.TryOpen(path);
+                if (view == null) {
+                    continue;
+                }
+                var hosts = new List<UInt128>();
+                int target = -1;
+                for (long offset = 0; TryReadHeader(view, offset, out BlockHeader header); offset = header.End) {
+                    if (header.Kind != EdgeBlock) {
+                        continue;
+                    }
+                    byte* entries = view.Pointer + header.DictionaryOffset;
+                    for (int i = 0; i < header.DictionaryCount; i++) {
+                        UInt128 entry = ReadUInt128(entries + i * 16);
+                        if (entry == host) {
+                            target = hosts.Count;
+                        }
+                        hosts.Add(entry);
+                    }
+                    if ((host != null && target < 0) || header.MaxTicks < fromTicks || header.MinTicks > toTicks) {
+                        continue;
+                    }
+                    found += DecodeEdges(view, header, target, hosts, fromTicks, toTicks, output);
+                }
+            }
+            return found;
+        }
+
+        private static int DecodePresence(SegmentView view, in BlockHeader header, int target, List<ulong> macs,
+            long fromTicks, long toTicks, List<PresenceSample> output) {
+            if (header.ColumnCount < PresenceColumns) {
+                return 0;
+            }
+            ReadOnlySpan<byte> timestamps = header.Column(view, 0);
+            ReadOnlySpan<byte> ids = header.Column(view, 1);
+            ReadOnlySpan<byte> ips = header.Column(view, 2);
+            ReadOnlySpan<byte> rtts = header.Column(view, 3);
+            ReadOnlySpan<byte> states = header.Column(view, 4);
+            int rows = header.Rows;
+            if (ips.Length < rows * 4 || rtts.Length < rows * 4 || states.Length < rows) {
+                return 0;
+            }
+
+            int found = 0, tsPos = 0, idPos = 0;
+            long ticks = header.MinTicks;
+            for (int row = 0; row < rows; row++) {
+                ticks += UnZigZag(ReadVarint(timestamps, ref tsPos));
+                int id = (int)ReadVarint(ids, ref idPos);
+                if ((target >= 0 && id != target) || ticks < fromTicks || ticks > toTicks || (uint)id >= (uint)macs.Count) {
+                    continue;
+                }
+                output.Add(new PresenceSample(ticks, macs[id],
+                    BinaryPrimitives.ReadUInt32LittleEndian(ips[(row * 4)..]),
+                    BinaryPrimitives.ReadSingleLittleEndian(rtts[(row * 4)..]),
+                    (DeviceState)states[row]));
+                found++;
+            }
+            return found;
+        }
+
+        private static int DecodeEdges(SegmentView view, in BlockHeader header, int target, List<UInt128> hosts,
+            long fromTicks, long toTicks, List<EdgeSample> output) {
+            if (header.ColumnCount < EdgeColumns) {
+                return 0;
+            }
+            ReadOnlySpan<byte> timestamps = header.Column(view, 0);
+            ReadOnlySpan<byte> clients = header.Column(view, 1);
+            ReadOnlySpan<byte> servers = header.Column(view, 2);
+            ReadOnlySpan<byte> ports = header.Column(view, 3);
+            ReadOnlySpan<byte> sessions = header.Column(view, 4);
+            ReadOnlySpan<byte> bytes = header.Column(view, 5);
+            int rows = header.Rows;
+            if (ports.Length < rows * 2) {
+                return 0;
+            }
+
+            int found = 0, tsPos = 0, clientPos = 0, serverPos = 0, sessionPos = 0, bytePos = 0;
+            long ticks = header.MinTicks;
+            for (int row = 0; row < rows; row++) {
+                ticks += UnZigZag(ReadVarint(timestamps, ref tsPos));
+                int client = (int)ReadVarint(clients, ref clientPos);
+                int server = (int)ReadVarint(servers, ref serverPos);
+                long sessionCount = (long)ReadVarint(sessions, ref sessionPos);
+                long byteCount = (long)ReadVarint(bytes, ref bytePos);
+                if ((target >= 0 && client != target && server != target) || ticks < fromTicks || ticks > toTicks
+                    || (uint)client >= (uint)hosts.Count || (uint)server >= (uint)hosts.Count) {
+                    continue;
+                }
+                output.Add(new EdgeSample(ticks, hosts[client], hosts[server],
+                    BinaryPrimitives.ReadUInt16LittleEndian(ports[(row * 2)..]), sessionCount, byteCount));
+                found++;
+            }
+            return found;
+        }
+
+        private readonly struct BlockHeader {
+            public byte Kind { get; init; }
+            public int ColumnCount { get; init; }
+            public int Rows { get; init; }
+            public int DictionaryCount { get; init; }
+            public long MinTicks { get; init; }
+            public long MaxTicks { get; init; }
+            public long Start { get; init; }
+            public long End { get; init; }
+            public long DictionaryOffset => Start + HeaderLength + ColumnCount * 4;
+
+            // Column spans are bounds-checked against the block once here; decoders then stay within them
+            public unsafe ReadOnlySpan<byte> Column(SegmentView view, int index) {
+                long offset = DictionaryOffset + DictionaryCount * (Kind == PresenceBlock ? 8L : 16L);
+                int length = 0;
+                for (int i = 0; i <= index; i++) {
+                    offset += length;
+                    length = BinaryPrimitives.ReadInt32LittleEndian(new ReadOnlySpan<byte>(view.Pointer + Start + HeaderLength + i * 4, 4));
+                    if (length < 0) {
+                        return default;
+                    }
+                }
+                return offset + length <= End ? new ReadOnlySpan<byte>(view.Pointer + offset, length) : default;
+            }
+        }
+
+        private static unsafe bool TryReadHeader(SegmentView view, long offset, out BlockHeader header) {
+            header = default;
+            if (offset + HeaderLength > view.Length) {
+                return false;
+            }
+            var span = new ReadOnlySpan<byte>(view.Pointer + offset, HeaderLength);
+            int columns = span[5];
+            int rows = BinaryPrimitives.ReadInt32LittleEndian(span[8..]);
+            int dictionary = BinaryPrimitives.ReadInt32LittleEndian(span[12..]);
+            int payload = BinaryPrimitives.ReadInt32LittleEndian(span[16..]);
+            byte kind = span[4];
+            if (BinaryPrimitives.ReadUInt32LittleEndian(span) != BlockMagic || (kind != PresenceBlock && kind != EdgeBlock)
+                || rows < 0 || dictionary < 0 || payload < columns * 4 || offset + HeaderLength + payload > view.Length
+                || (long)dictionary * (kind == PresenceBlock ? 8 : 16) > payload - columns * 4) {
+                return false;
+            }
+            header = new BlockHeader {
+                Kind = kind,
+                ColumnCount = columns,
+                Rows = rows,
+                DictionaryCount = dictionary,
+                MinTicks = BinaryPrimitives.ReadInt64LittleEndian(span[24..]),
+                MaxTicks = BinaryPrimitives.ReadInt64LittleEndian(span[32..]),
+                Start = offset,
+                End = offset + HeaderLength + payload
+            };
+            return true;
+        }
+
+        // Segments are named for the hour they were written in; rows can trail that by a few minutes, so the
+        // hour after the range is read too
+        private IEnumerable<string> SegmentsFor(long fromTicks, long toTicks) {
+            long first = fromTicks / TimeSpan.TicksPerHour, last = toTicks / TimeSpan.TicksPerHour + 1;
+            foreach (var (hour, path) in ListSegments()) {
+                if (hour >= first && hour <= last) {
+                    yield return path;
+                }
+            }
+        }
+
+        private List<(long Hour, string Path)> ListSegments() {
+            var segments = new List<(long, string)>();
+            try {
+                foreach (string path in Directory.EnumerateFiles(_directory, "*" + SegmentExtension)) {
+                    if (DateTime.TryParseExact(Path.GetFileNameWithoutExtension(path), HourFormat,
+                            CultureInfo.InvariantCulture, DateTimeStyles.AdjustToUniversal | DateTimeStyles.AssumeUniversal,
+                            out DateTime hour)) {
+                        segments.Add((hour.Ticks / TimeSpan.TicksPerHour, path));
+                    }
+                }
+            } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                Logging.Error($"Could not list history segments in {_directory}.", ex);
+                segments.Clear();
+            }
+            segments.Sort((a, b) => a.Item1.CompareTo(b.Item1));
+            return segments;
+        }
+
+        // Writing stops for good: the directory's permissions will not fix themselves while we run
+        private void Disable(string message, Exception ex) {
+            Logging.Error($"{message} History recording is disabled.", ex);
+            _disabled = true;
+            lock (_lock) {
+                _presence.Clear();
+                _edges.Clear();
+            }
+        }
+
+        private string SegmentPath(long hour) {
+            var start = new DateTime(hour * TimeSpan.TicksPerHour, DateTimeKind.Utc);
+            return Path.Combine(_directory, start.ToString(HourFormat, CultureInfo.InvariantCulture) + SegmentExtension);
+        }
+
+        private static ulong ZigZag(long value) => (ulong)((value << 1) ^ (value >> 63));
+
+        private static long UnZigZag(ulong value) => (long)(value >> 1) ^ -(long)(value & 1);
+
+        private static void WriteVarint(ArrayBufferWriter<byte> output, ulong value) {
+            Span<byte> span = output.GetSpan(10);
+            int length = 0;
+            while (value >= 0x80) {
+                span[length++] = (byte)(value | 0x80);
+                value >>= 7;
+            }
+            span[length++] = (byte)value;
+            output.Advance(length);
+        }
+
+        // A truncated column reads as zeros past its end rather than throwing; the header checks make that unreachable
+        private static ulong ReadVarint(ReadOnlySpan<byte> data, ref int position) {
+            ulong value = 0;
+            for (int shift = 0; shift < 64 && position < data.Length; shift += 7) {
+                byte b = data[position++];
+                value |= (ulong)(b & 0x7F) << shift;
+                if (b < 0x80) {
+                    break;
+                }
+            }
+            return value;
+        }
+
+        private static unsafe ulong ReadUInt64(byte* p) => BinaryPrimitives.ReadUInt64LittleEndian(new ReadOnlySpan<byte>(p, 8));
+
+        private static unsafe UInt128 ReadUInt128(byte* p) => BinaryPrimitives.ReadUInt128LittleEndian(new ReadOnlySpan<byte>(p, 16));
+
+        /// <summary>
+        /// Read-only mapping of a whole segment file. Null for missing or empty files.
+        /// </summary>
+        private sealed unsafe class SegmentView : IDisposable {
+            private readonly MemoryMappedFile _map;
+            private readonly MemoryMappedViewAccessor _accessor;
+            private bool _disposed;
+
+            public byte* Pointer { get; }
+            public long Length { get; }
+
+            private SegmentView(MemoryMappedFile map, MemoryMappedViewAccessor accessor, long length) {
+                _map = map;
+                _accessor = accessor;
+                Length = length;
+                byte* pointer = null;
+                accessor.SafeMemoryMappedViewHandle.AcquirePointer(ref pointer);
+                Pointer = pointer + accessor.PointerOffset;
+            }
+
+            public static SegmentView? TryOpen(string path) {
+                FileStream stream;
+                try {
+                    stream = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.ReadWrite | FileShare.Delete);
+                } catch (FileNotFoundException) {
+                    return null;
+                } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                    Logging.Error($"Could not open history segment {path}.", ex);
+                    return null;
+                }
+                long length = stream.Length;
+                if (length == 0) {
+                    stream.Dispose();
+                    return null;
+                }
+                MemoryMappedFile map;
+                try {
+                    map = MemoryMappedFile.CreateFromFile(stream, null, length, MemoryMappedFileAccess.Read,
+                        HandleInheritability.None, false);
+                } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                    stream.Dispose();
+                    Logging.Error($"Could not map history segment {path}.", ex);
+                    return null;
+                }
+                try {
+                    return new SegmentView(map, map.CreateViewAccessor(0, length, MemoryMappedFileAccess.Read), length);
+                } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                    map.Dispose();
+                    Logging.Error($"Could not map history segment {path}.", ex);
+                    return null;
+                }
+            }
+
+            public void Dispose() {
+                if (_disposed) {
+                    return;
+                }
+                _disposed = true;
+                _accessor.SafeMemoryMappedViewHandle.ReleasePointer();
+                _accessor.Dispose();
+                _map.Dispose();
+            }
+        }
+    }
+}
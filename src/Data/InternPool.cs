@@ -0,0 +1,222 @@
+// Refcounted interning: each distinct value is created and stored once and handed out as a small integer ID
+// Holders (graph edges, device rows, probe state) keep an ID instead of their own copy and release it when done
+
+using System.Text;
+
+namespace TLScope.src.Data {
+    /// <summary>
+    /// Values keyed by TKey, created on first use and evicted when the last reference is released.
+    /// ID 0 is never handed out and stands for "none". Thread-safe.
+    /// </summary>
+    public class InternPool<TKey, TValue> where TKey : notnull {
+        private readonly object _lock = new();
+        private readonly Dictionary<TKey, int> _ids;
+        private readonly Stack<int> _freeIds = new();
+        private readonly Action<TValue>? _evicted;
+        private TKey[] _keys = new TKey[64];
+        private TValue[] _values = new TValue[64];
+        private int[] _refs = new int[64];
+        private int _next = 1;
+        private long _created;
+        private long _hits;
+
+        /// <param name="evicted">Called (under the pool lock) when a value's last reference goes, or when a value
+        /// lost a creation race, e.g. to release IDs the value itself holds in another pool.</param>
+        public InternPool(IEqualityComparer<TKey>? comparer = null, Action<TValue>? evicted = null) {
+            _ids = new Dictionary<TKey, int>(comparer);
+            _evicted = evicted;
+        }
+
+        public int Count {
+            get {
+                lock (_lock) {
+                    return _ids.Count;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Values created so far, and lookups answered from the pool; their ratio is the saving.
+        /// </summary>
+        public long Created => Interlocked.Read(ref _created);
+        public long Hits => Interlocked.Read(ref _hits);
+
+        // For derived pools that keep their own index over the keys; Added and Removed run under this lock
+        private protected object Lock => _lock;
+
+        private protected virtual void Added(int id, TKey key) {
+        }
+
+        private protected virtual void Removed(int id, TKey key) {
+        }
+
+        // Caller holds the lock and has checked that id is live
+        private protected TKey KeyOf(int id) {
+            return _keys[id];
+        }
+
+        private protected void TakeReference(int id) {
+            _refs[id]++;
+            _hits++;
+        }
+
+        /// <summary>
+        /// Returns the ID for key with one reference taken, calling create only if the key is not interned.
+        /// </summary>
+        public int Acquire(TKey key, Func<TKey, TValue> create) {
+            lock (_lock) {
+                if (_ids.TryGetValue(key, out int id)) {
+                    _refs[id]++;
+                    _hits++;
+                    return id;
+                }
+            }
+            // Creation (certificate parsing) runs outside the lock. A racing creator's value is dropped, and evicted
+            // like any other, since it may hold references of its own (a chain on its certificates)
+            TValue value = create(key);
+            lock (_lock) {
+                if (_ids.TryGetValue(key, out int id)) {
+                    _refs[id]++;
+                    _hits++;
+                    _evicted?.Invoke(value);
+                    return id;
+                }
+                id = _freeIds.Count > 0 ? _freeIds.Pop() : _next++;
+                if (id >= _refs.Length) {
+                    int capacity = _refs.Length * 2;
+                    Array.Resize(ref _keys, capacity);
+                    Array.Resize(ref _values, capacity);
+                    Array.Resize(ref _refs, capacity);
+                }
+                _keys[id] = key;
+                _values[id] = value;
+                _refs[id] = 1;
+                _ids[key] = id;
+                _created++;
+                Added(id, key);
+                return id;
+            }
+        }
+
+        /// <summary>
+        /// Takes another reference on a live ID, for a second holder. Returns the ID (0 stays 0).
+        /// </summary>
+        public int AddRef(int id) {
+            if (id == 0) {
+                return 0;
+            }
+            lock (_lock) {
+                if (id >= _next || _refs[id] == 0) {
+                    throw new ArgumentException($"Interned ID {id} is not live.", nameof(id));
+                }
+                _refs[id]++;
+                return id;
+            }
+        }
+
+        public void Release(int id) {
+            if (id == 0) {
+                return;
+            }
+            lock (_lock) {
+                if (id >= _next || _refs[id] == 0) {
+                    return; // already evicted; releasing twice is a holder bug, but not worth crashing for
+                }
+                if (--_refs[id] > 0) {
+                    return;
+                }
+                TValue value = _values[id];
+                _ids.Remove(_keys[id]);
+                Removed(id, _keys[id]);
+                _keys[id] = default!;
+                _values[id] = default!;
+                _freeIds.Push(id);
+                _evicted?.Invoke(value);
+            }
+        }
+
+        /// <summary>
+        /// Looks a value up by ID. False for 0 and for evicted IDs. Freed IDs are reused, so only a holder of a
+        /// reference is guaranteed to get its own value back.
+        /// </summary>
+        public bool TryGet(int id, out TValue value) {
+            lock (_lock) {
+                if (id > 0 && id < _next && _refs[id] > 0) {
+                    value = _values[id];
+                    return true;
+                }
+                value = default!;
+                return false;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Pool whose values are their own keys (strings, fingerprints).
+    /// </summary>
+    public sealed class InternPool<T> : InternPool<T, T> where T : notnull {
+        private static readonly Func<T, T> identity = value => value;
+
+        public InternPool(IEqualityComparer<T>? comparer = null) : base(comparer) {
+        }
+
+        public int Acquire(T value) {
+            return Acquire(value, identity);
+        }
+    }
+
+    /// <summary>
+    /// Case-insensitive string pool that can also be searched by a name's ASCII bytes, so a name already interned
+    /// is found without decoding it into a new string; only a miss allocates.
+    /// </summary>
+    public sealed class AsciiInternPool : InternPool<string, string> {
+        // Case-folded hash of each key to its ID. A key whose hash is taken is just not indexed and takes the
+        // decoding path, which the dictionary in the base pool still answers
+        private readonly Dictionary<ulong, int> _byHash = [];
+
+        public AsciiInternPool() : base(StringComparer.OrdinalIgnoreCase) {
+        }
+
+        public int Acquire(string value) {
+            return Acquire(value, static value => value);
+        }
+
+        public int Acquire(ReadOnlySpan<byte> ascii) {
+            lock (Lock) {
+                if (_byHash.TryGetValue(Hash(ascii), out int id) && Ascii.EqualsIgnoreCase(ascii, KeyOf(id))) {
+                    TakeReference(id);
+                    return id;
+                }
+            }
+            return Acquire(Encoding.ASCII.GetString(ascii));
+        }
+
+        private protected override void Added(int id, string key) {
+            _byHash.TryAdd(Hash(key), id);
+        }
+
+        private protected override void Removed(int id, string key) {
+            ulong hash = Hash(key);
+            if (_byHash.TryGetValue(hash, out int indexed) && indexed == id) {
+                _byHash.Remove(hash);
+            }
+        }
+
+        // FNV-1a over ASCII-lowercased code units; bytes and chars of the same ASCII name hash alike
+        private static ulong Hash(ReadOnlySpan<byte> ascii) {
+            ulong hash = 14695981039346656037;
+            foreach (byte b in ascii) {
+                hash = (hash ^ (uint)(b is >= (byte)'A' and <= (byte)'Z' ? b | 0x20 : b)) * 1099511628211;
+            }
+            return hash;
+        }
+
+        private static ulong Hash(ReadOnlySpan<char> name) {
+            ulong hash = 14695981039346656037;
+            foreach (char c in name) {
+                hash = (hash ^ (uint)(c is >= 'A' and <= 'Z' ? c | 0x20 : c)) * 1099511628211;
+            }
+            return hash;
+        }
+    }
+}
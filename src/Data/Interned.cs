@@ -0,0 +1,32 @@
+// Process-wide intern pools for TLS identity data. On a typical network hundreds of hosts share a handful of
+// certificates, chains, server names and client fingerprints, so each is stored once and referenced by ID
+
+using TLScope.src.Services;
+
+namespace TLScope.src.Data {
+    /// <summary>
+    /// One parsed certificate, created once per SHA-256 thumbprint however many endpoints present it.
+    /// </summary>
+    public sealed record TlsCertificateInfo(string Thumbprint, string Subject, string Issuer, DateTime NotAfter,
+        long FirstSeenTicks);
+
+    public static class Interned {
+        public static readonly InternPool<string, TlsCertificateInfo> Certificates = new(StringComparer.OrdinalIgnoreCase);
+
+        /// <summary>
+        /// Chains as certificate IDs from the leaf up, keyed by their joined thumbprints. A chain holds a
+        /// reference on each of its certificates and gives them up when evicted.
+        /// </summary>
+        public static readonly InternPool<string, int[]> Chains = new(StringComparer.OrdinalIgnoreCase, ReleaseAll);
+
+        public static readonly AsciiInternPool ServerNames = new();
+        public static readonly InternPool<UInt128> Ja3 = new();
+        public static readonly InternPool<Ja4Fingerprint> Ja4 = new();
+
+        private static void ReleaseAll(int[] certificates) {
+            foreach (int id in certificates) {
+                Certificates.Release(id);
+            }
+        }
+    }
+}
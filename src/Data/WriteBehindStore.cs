@@ -0,0 +1,279 @@
+// Write-behind persistence: device and flow deltas are queued without blocking and written to SQLite
+// by one background loop, in batched upsert transactions over its own connection
+
+using System.Data.Common;
+using System.Globalization;
+using System.Threading.Channels;
+using Microsoft.EntityFrameworkCore;
+using TLScope.src.Debugging;
+using TLScope.src.Services;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Data {
+    public sealed class WriteBehindStore {
+        // Matches how EF Core's SQLite provider stores DateTime, so EF reads these rows back unchanged
+        private const string TimestampFormat = "yyyy-MM-dd HH:mm:ss.FFFFFFF";
+
+        // WAL lets the UI's EF reads proceed while a batch commits; NORMAL skips the fsync per transaction.
+        // The Connections table is created here as well because EnsureCreated does nothing on an existing database.
+        // Its unique index needs the Site column, which databases from before aggregation lack; see AddSiteColumn.
+        // Databases from before the write-behind store can hold several rows per device; the first setup keeps the
+        // most recently seen one of each (the highest Id on a tie) so the unique index can be built over them.
+        private const string SetupSql = """
+            PRAGMA journal_mode = WAL;
+            PRAGMA synchronous = NORMAL;
+            PRAGMA busy_timeout = 5000;
+            CREATE TABLE IF NOT EXISTS "Connections" (
+                "Id" INTEGER NOT NULL CONSTRAINT "PK_Connections" PRIMARY KEY AUTOINCREMENT,
+                "Site" TEXT NOT NULL DEFAULT '',
+                "ClientAddress" TEXT NOT NULL,
+                "ServerAddress" TEXT NOT NULL,
+                "ServerPort" INTEGER NOT NULL,
+                "Sessions" INTEGER NOT NULL,
+                "Bytes" INTEGER NOT NULL,
+                "FirstSeen" TEXT NOT NULL,
+                "LastSeen" TEXT NOT NULL);
+            BEGIN;
+            DELETE FROM "Devices"
+            WHERE NOT EXISTS (SELECT 1 FROM sqlite_master WHERE "type" = 'index' AND "name" = 'IX_Devices_UserId_MACAddress')
+                AND "Id" NOT IN (
+                    SELECT "Id" FROM (
+                        SELECT "Id", ROW_NUMBER() OVER (
+                            PARTITION BY "UserId", "MACAddress" ORDER BY "LastSeen" DESC, "Id" DESC) AS "Rank"
+                        FROM "Devices")
+                    WHERE "Rank" = 1);
+            CREATE UNIQUE INDEX IF NOT EXISTS "IX_Devices_UserId_MACAddress" ON "Devices" ("UserId", "MACAddress");
+            COMMIT;
+            """;
+
+        private const string HasSiteColumnSql = """
+            SELECT COUNT(*) FROM pragma_table_info('Connections') WHERE "name" = 'Site';
+            """;
+
+        // Rows already stored were captured locally, which the empty site stands for
+        private const string AddSiteColumnSql = """
+            ALTER TABLE "Connections" ADD COLUMN "Site" TEXT NOT NULL DEFAULT '';
+            DROP INDEX IF EXISTS "IX_Connections_ClientAddress_ServerAddress_ServerPort";
+            """;
+
+        private const string ConnectionIndexSql = """
+            CREATE UNIQUE INDEX IF NOT EXISTS "IX_Connections_Site_ClientAddress_ServerAddress_ServerPort"
+                ON "Connections" ("Site", "ClientAddress", "ServerAddress", "ServerPort");
+            """;
+
+        private const string DeviceUpsertSql = """
+            INSERT INTO "Devices" ("DeviceName", "IPAddress", "MACAddress", "OperatingSystem", "LastSeen", "UserId")
+            VALUES ($name, $ip, $mac, $os, $seen, $user)
+            ON CONFLICT ("UserId", "MACAddress") DO UPDATE SET
+                "DeviceName" = excluded."DeviceName",
+                "IPAddress" = excluded."IPAddress",
+                "OperatingSystem" = COALESCE(excluded."OperatingSystem", "OperatingSystem"),
+                "LastSeen" = MAX("LastSeen", excluded."LastSeen");
+            """;
+
+        private const string ConnectionUpsertSql = """
+            INSERT INTO "Connections" ("Site", "ClientAddress", "ServerAddress", "ServerPort", "Sessions", "Bytes", "FirstSeen", "LastSeen")
+            VALUES ($site, $client, $server, $port, $sessions, $bytes, $first, $last)
+            ON CONFLICT ("Site", "ClientAddress", "ServerAddress", "ServerPort") DO UPDATE SET
+                "Sessions" = "Sessions" + excluded."Sessions",
+                "Bytes" = "Bytes" + excluded."Bytes",
+                "FirstSeen" = MIN("FirstSeen", excluded."FirstSeen"),
+                "LastSeen" = MAX("LastSeen", excluded."LastSeen");
+            """;
+
+        private readonly record struct Pending(bool IsDevice, DeviceRecord Device, FlowDelta Flow, string Site);
+
+        // Site is empty for flows captured on this host; sites reuse private ranges, so it is part of the key
+        private readonly record struct ConnectionKey(string Site, UInt128 Client, UInt128 Server, ushort Port);
+
+        private struct ConnectionTotals {
+            public long Sessions;
+            public long Bytes;
+            public long FirstSeenTicks;
+            public long LastSeenTicks;
+        }
+
+        private readonly DbContextOptions<ApplicationDbContext> _options;
+        private readonly int _userId;
+        private readonly Channel<Pending> _queue;
+        private readonly Dictionary<ulong, DeviceRecord> _deviceBatch = [];
+        private readonly Dictionary<ConnectionKey, ConnectionTotals> _connectionBatch = [];
+        private long _dropped;
+        private long _written;
+
+        /// <summary>
+        /// Devices are stored under the given user. Nothing is written until RunAsync is started.
+        /// </summary>
+        public WriteBehindStore(DbContextOptions<ApplicationDbContext> options, int userId) {
+            _options = options;
+            _userId = userId;
+            _queue = Channel.CreateBounded<Pending>(new BoundedChannelOptions(Settings.PersistQueueCapacity) {
+                SingleReader = true,
+                FullMode = BoundedChannelFullMode.DropWrite
+            });
+        }
+
+        /// <summary>
+        /// Deltas discarded because the queue was full, i.e. the disk fell behind.
+        /// </summary>
+        public long Dropped => Interlocked.Read(ref _dropped);
+
+        /// <summary>
+        /// Queues added and updated devices. Removals are not written: a device row records when it was last seen.
+        /// </summary>
+        public void Enqueue(DeviceDeltaEventArgs delta) {
+            foreach (var change in delta.Changes) {
+                if (change.Kind != DeviceChangeKind.Removed && change.Device.MAC != 0) {
+                    Post(new Pending(true, change.Device, default, string.Empty));
+                }
+            }
+        }
+
+        /// <summary>
+        /// Queues session events; an aggregator passes the site that reported them.
+        /// </summary>
+        public void Enqueue(IReadOnlyList<FlowDelta> deltas, string? site = null) {
+            for (int i = 0; i < deltas.Count; i++) {
+                Post(new Pending(false, default, deltas[i], site ?? string.Empty));
+            }
+        }
+
+        private void Post(in Pending item) {
+            if (!_queue.Writer.TryWrite(item)) {
+                Interlocked.Increment(ref _dropped);
+            }
+        }
+
+        /// <summary>
+        /// Drains the queue until cancelled, then flushes whatever is still queued.
+        /// </summary>
+        public async Task RunAsync(CancellationToken cancTok) {
+            await Task.Yield(); // opening the database is disk I/O too; keep it off the caller's thread
+
+            using var context = new ApplicationDbContext(_options);
+            DbConnection connection = context.Database.GetDbConnection();
+            try {
+                connection.Open();
+                Execute(connection, SetupSql);
+                AddSiteColumn(connection);
+                Execute(connection, ConnectionIndexSql);
+            } catch (DbException ex) {
+                Logging.Error("Could not open the database for write-behind persistence; sightings will not be saved.", ex);
+                return;
+            }
+
+            using DbCommand deviceUpsert = Prepare(connection, DeviceUpsertSql,
+                "$name", "$ip", "$mac", "$os", "$seen", "$user");
+            using DbCommand connectionUpsert = Prepare(connection, ConnectionUpsertSql,
+                "$site", "$client", "$server", "$port", "$sessions", "$bytes", "$first", "$last");
+
+            try {
+                while (await _queue.Reader.WaitToReadAsync(cancTok)) {
+                    // Let the batch fill for a moment so one transaction covers a whole burst
+                    await Task.Delay(Settings.PersistFlushInterval, cancTok);
+                    Flush(connection, deviceUpsert, connectionUpsert);
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            }
+
+            _queue.Writer.TryComplete();
+            Flush(connection, deviceUpsert, connectionUpsert);
+            connection.Close();
+            Logging.Write($"Write-behind store stopped: {_written} row(s) written, {Dropped} delta(s) dropped.");
+        }
+
+        // Writes everything queued so far, at most PersistBatchSize deltas per transaction
+        private void Flush(DbConnection connection, DbCommand deviceUpsert, DbCommand connectionUpsert) {
+            while (Coalesce(Settings.PersistBatchSize)) {
+                try {
+                    using DbTransaction transaction = connection.BeginTransaction();
+                    deviceUpsert.Transaction = transaction;
+                    connectionUpsert.Transaction = transaction;
+
+                    foreach (DeviceRecord device in _deviceBatch.Values) {
+                        Bind(deviceUpsert, device.Name, device.IPAddress, device.MACAddress,
+                            (object?)device.OperatingSystem ?? DBNull.Value, FormatTicks(device.LastSeenTicks), _userId);
+                        deviceUpsert.ExecuteNonQuery();
+                    }
+                    foreach (var (key, totals) in _connectionBatch) {
+                        Bind(connectionUpsert, key.Site, FlowKey.ToIPAddress(key.Client).ToString(),
+                            FlowKey.ToIPAddress(key.Server).ToString(), (int)key.Port, totals.Sessions, totals.Bytes,
+                            FormatTicks(totals.FirstSeenTicks), FormatTicks(totals.LastSeenTicks));
+                        connectionUpsert.ExecuteNonQuery();
+                    }
+
+                    transaction.Commit();
+                    _written += _deviceBatch.Count + _connectionBatch.Count;
+                } catch (DbException ex) {
+                    Logging.Error($"Write-behind batch of {_deviceBatch.Count + _connectionBatch.Count} row(s) failed and was discarded.", ex);
+                } finally {
+                    deviceUpsert.Transaction = null;
+                    connectionUpsert.Transaction = null;
+                }
+            }
+        }
+
+        // Folds up to `limit` queued deltas into one row per device and per connection; false when nothing was queued
+        private bool Coalesce(int limit) {
+            _deviceBatch.Clear();
+            _connectionBatch.Clear();
+            int taken = 0;
+            while (taken < limit && _queue.Reader.TryRead(out Pending item)) {
+                taken++;
+                if (item.IsDevice) {
+                    _deviceBatch[item.Device.MAC] = item.Device; // later changes carry the newer state
+                    continue;
+                }
+                FlowDelta delta = item.Flow;
+                var key = new ConnectionKey(item.Site, delta.Flow.SourceAddress, delta.Flow.DestinationAddress, delta.Flow.DestinationPort);
+                _connectionBatch.TryGetValue(key, out ConnectionTotals totals);
+                totals.Sessions += delta.Opened ? 1 : 0;
+                totals.Bytes += delta.Bytes;
+                totals.FirstSeenTicks = totals.FirstSeenTicks == 0
+                    ? delta.TimestampTicks
+                    : Math.Min(totals.FirstSeenTicks, delta.TimestampTicks);
+                totals.LastSeenTicks = Math.Max(totals.LastSeenTicks, delta.TimestampTicks);
+                _connectionBatch[key] = totals;
+            }
+            return taken > 0;
+        }
+
+        // Upgrades a Connections table created before rows were keyed by site
+        private static void AddSiteColumn(DbConnection connection) {
+            using DbCommand query = connection.CreateCommand();
+            query.CommandText = HasSiteColumnSql;
+            if (Convert.ToInt64(query.ExecuteScalar(), CultureInfo.InvariantCulture) == 0) {
+                Execute(connection, AddSiteColumnSql);
+            }
+        }
+
+        private static void Execute(DbConnection connection, string sql) {
+            using DbCommand command = connection.CreateCommand();
+            command.CommandText = sql;
+            command.ExecuteNonQuery();
+        }
+
+        private static DbCommand Prepare(DbConnection connection, string sql, params string[] names) {
+            DbCommand command = connection.CreateCommand();
+            command.CommandText = sql;
+            foreach (string name in names) {
+                DbParameter parameter = command.CreateParameter();
+                parameter.ParameterName = name;
+                command.Parameters.Add(parameter);
+            }
+            command.Prepare();
+            return command;
+        }
+
+        private static void Bind(DbCommand command, params object[] values) {
+            for (int i = 0; i < values.Length; i++) {
+                command.Parameters[i].Value = values[i];
+            }
+        }
+
+        private static string FormatTicks(long ticks) {
+            return new DateTime(ticks, DateTimeKind.Utc).ToString(TimestampFormat, CultureInfo.InvariantCulture);
+        }
+    }
+}
@@ -1,69 +1,202 @@
 using System;
-using System.Collections.Concurrent;
+using System.Buffers;
+using System.Globalization;
 using System.IO;
 using System.Runtime.CompilerServices;
 using System.Threading;
+using System.Threading.Channels;
 using System.Threading.Tasks;
 
 using TLScope.src.Utilities;
 
 namespace TLScope.src.Debugging {
+    public enum LogLevel {
+        Trace = 0,
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Fatal
+    }
+
     public static class Logging {
-        private static readonly BlockingCollection<string> logQueue = new();
-        private static readonly CancellationTokenSource cts = new();
-        private static readonly Task logTask = Task.Run(ProcessLogQueue, cts.Token);
+        // Queued entries beyond this are dropped below Error level; Error and Fatal wait for room instead
+        private const int QueueCapacity = 8192;
+        private const int BatchSize = 256;
+
+        private static readonly Channel<LogEntry> logQueue = Channel.CreateBounded<LogEntry>(
+            new BoundedChannelOptions(QueueCapacity) {
+                SingleReader = true,
+                FullMode = BoundedChannelFullMode.Wait
+            });
         private static readonly string logFile = Path.Combine(Utilities.Environment.LogPath, "tlscope.log");
-        
+        private static readonly Task logTask = Task.Run(ProcessLogQueue);
+        private static long dropped;
+        private static int stopped;
+
+        /// <summary>
+        /// Least severe level that is written. Set from TLSCOPE_LOG_LEVEL (trace, debug, info, warning, error).
+        /// </summary>
+        public static LogLevel MinimumLevel { get; set; } = ReadLevel();
+
+        /// <summary>
+        /// Entries dropped because the queue was full.
+        /// </summary>
+        public static long Dropped => Interlocked.Read(ref dropped);
+
+        public static int QueueDepth => logQueue.Reader.Count;
+
+        static Logging() {
+            AppDomain.CurrentDomain.ProcessExit += OnProcessExit;
+        }
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        public static bool IsEnabled(LogLevel level) {
+            return level >= MinimumLevel;
+        }
+
         public static void Write(string message) {
-            logQueue.Add($"[{DateTime.Now:HH:mm:ss.fff}] {message}");
+            Write(LogLevel.Info, message);
+        }
+
+        public static void Write(LogLevel level, string message) {
+            if (IsEnabled(level)) {
+                Enqueue(new LogEntry(level, DateTime.UtcNow.Ticks, message, null, 0));
+            }
+        }
+
+        /// <summary>
+        /// Info message. The interpolation is formatted into a pooled buffer, never into a string.
+        /// </summary>
+        public static void Write(ref LogMessageHandler message) {
+            if (message.Enabled) {
+                Enqueue(message.Detach(LogLevel.Info));
+            }
+        }
+
+        /// <summary>
+        /// Message at the given level. Nothing is formatted, and the interpolated values are not even
+        /// converted, unless the level is enabled.
+        /// </summary>
+        public static void Write(LogLevel level, [InterpolatedStringHandlerArgument("level")] ref LogMessageHandler message) {
+            if (message.Enabled) {
+                Enqueue(message.Detach(level));
+            }
         }
 
         public static void Error(string message, Exception ex, bool isFatal = false) {
-            var logMessage = $"[{DateTime.Now:HH:mm:ss.fff}] ERROR: {message}";
+            string logMessage = message;
             logMessage += $"\n\t└> {ex.GetType().Name}: {ex.Message}\n\t└> Stack Trace: {ex.StackTrace}";
             logMessage += ex.InnerException != null ? $"\n\t└> Inner Exception: {ex.InnerException.Message}" : "";
-            logQueue.Add(logMessage);
+            Enqueue(new LogEntry(isFatal ? LogLevel.Fatal : LogLevel.Error, DateTime.UtcNow.Ticks, logMessage, null, 0));
 
             if (isFatal) {
                 Console.ForegroundColor = ConsoleColor.Red;
-                Console.WriteLine(logMessage);
+                Console.WriteLine($"[{DateTime.Now:HH:mm:ss.fff}] ERROR: {logMessage}");
                 Console.WriteLine("\nThis error is fatal. See log file for more details.");
-                logQueue.Add("FATAL: CLOSING APPLICATION");
-                cts.Cancel();
-                try {
-                    logTask.Wait();
-                } catch (AggregateException ae) {
-                    ae.Handle(ex => ex is TaskCanceledException);
-                }
+                Write(LogLevel.Fatal, "FATAL: CLOSING APPLICATION");
                 Console.ResetColor();
                 OnProcessExit(null, EventArgs.Empty);
                 System.Environment.Exit(1);
             }
         }
 
+        private static void Enqueue(in LogEntry entry) {
+            if (Volatile.Read(ref stopped) != 0) {
+                entry.Release();
+                return;
+            }
+            if (logQueue.Writer.TryWrite(entry)) {
+                return;
+            }
+            if (entry.Level >= LogLevel.Error && !logTask.IsCompleted) {
+                // Backpressure rather than loss for errors; the writer drains thousands of lines per flush
+                try {
+                    logQueue.Writer.WriteAsync(entry).AsTask().GetAwaiter().GetResult();
+                    return;
+                } catch (ChannelClosedException) {
+                    // shutting down
+                }
+            }
+            Interlocked.Increment(ref dropped);
+            entry.Release();
+        }
+
+        // Drains whatever is queued, writes it through a buffered writer and flushes once per batch
         private static async Task ProcessLogQueue() {
-            using StreamWriter sw = new(logFile, false) {
-                AutoFlush = true
-            };
+            using StreamWriter sw = new(logFile, false, new System.Text.UTF8Encoding(false), 1 << 16);
             await sw.WriteLineAsync($"======= Logging Session Started. {DateTime.Now:yyyy-MM-dd-HH-mm-ss-fff} =======");
-            foreach (var logMessage in logQueue.GetConsumingEnumerable(cts.Token)) {
-                await sw.WriteLineAsync(logMessage);
+            await sw.FlushAsync();
+            char[] stamp = new char[32];
+            long reportedDrops = 0;
+            while (await logQueue.Reader.WaitToReadAsync()) {
+                int written = 0;
+                while (written < BatchSize && logQueue.Reader.TryRead(out LogEntry entry)) {
+                    WriteEntry(sw, entry, stamp);
+                    entry.Release();
+                    written++;
+                }
+                long drops = Dropped;
+                if (drops != reportedDrops) {
+                    await sw.WriteLineAsync($"[{DateTime.Now:HH:mm:ss.fff}] WARN  {drops - reportedDrops} log entries dropped (queue full).");
+                    reportedDrops = drops;
+                }
+                await sw.FlushAsync();
             }
         }
 
+        private static void WriteEntry(StreamWriter sw, in LogEntry entry, char[] stamp) {
+            DateTime local = new DateTime(entry.Ticks, DateTimeKind.Utc).ToLocalTime();
+            stamp[0] = '[';
+            local.TryFormat(stamp.AsSpan(1), out int length, "HH:mm:ss.fff", CultureInfo.InvariantCulture);
+            stamp[++length] = ']';
+            stamp[++length] = ' ';
+            sw.Write(stamp, 0, length + 1);
+            sw.Write(LevelTag(entry.Level));
+            if (entry.Text != null) {
+                sw.WriteLine(entry.Text);
+            } else {
+                sw.WriteLine(entry.Buffer.AsSpan(0, entry.Length));
+            }
+        }
+
+        private static string LevelTag(LogLevel level) {
+            return level switch {
+                LogLevel.Trace => "TRACE ",
+                LogLevel.Debug => "DEBUG ",
+                LogLevel.Info => "INFO  ",
+                LogLevel.Warning => "WARN  ",
+                LogLevel.Error => "ERROR ",
+                _ => "FATAL "
+            };
+        }
+
+        private static LogLevel ReadLevel() {
+            string? value = System.Environment.GetEnvironmentVariable("TLSCOPE_LOG_LEVEL");
+            return Enum.TryParse(value, true, out LogLevel level) ? level : LogLevel.Info;
+        }
+
         private static void OnProcessExit(object? sender, EventArgs e) {
-            cts.Cancel();
+            if (Interlocked.Exchange(ref stopped, 1) != 0) {
+                return;
+            }
+            logQueue.Writer.TryComplete();
             try {
-                logTask.Wait();
+                logTask.Wait(TimeSpan.FromSeconds(2));
             } catch (AggregateException ae) {
-                ae.Handle(ex => ex is TaskCanceledException);
+                ae.Handle(ex => ex is IOException or UnauthorizedAccessException);
             }
 
-            using StreamWriter sw = new(logFile, true);
-            sw.WriteLine($"======= Logging Session Ended. {DateTime.Now:yyyy-MM-dd-HH-mm-ss-fff} =======");
+            try {
+                using StreamWriter sw = new(logFile, true);
+                sw.WriteLine($"======= Logging Session Ended. {DateTime.Now:yyyy-MM-dd-HH-mm-ss-fff} =======");
+                sw.Close();
 
-            string latestLogFile = Path.Combine(Utilities.Environment.LogPath, $"{DateTime.Now:yyyy-MM-dd-HH-mm-ss-fff}.log");
-            File.Copy(logFile, latestLogFile, true);
+                string latestLogFile = Path.Combine(Utilities.Environment.LogPath, $"{DateTime.Now:yyyy-MM-dd-HH-mm-ss-fff}.log");
+                File.Copy(logFile, latestLogFile, true);
+            } catch (IOException) {
+                // nothing left to report it to
+            }
         }
 
         public static void MakeLogFileWritable() {
@@ -72,4 +205,104 @@ namespace TLScope.src.Debugging {
             }
         }
     }
+
+    /// <summary>
+    /// One queued line. Interpolated messages own a pooled buffer that the writer returns after use.
+    /// </summary>
+    internal readonly record struct LogEntry(LogLevel Level, long Ticks, string? Text, char[]? Buffer, int Length) {
+        public void Release() {
+            if (Buffer != null) {
+                ArrayPool<char>.Shared.Return(Buffer);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Formats log interpolations into a pooled buffer, and skips them entirely when the level is disabled.
+    /// </summary>
+    [InterpolatedStringHandler]
+    public ref struct LogMessageHandler {
+        private char[]? _buffer;
+        private int _length;
+        private readonly bool _enabled;
+
+        public LogMessageHandler(int literalLength, int formattedCount, out bool isEnabled)
+            : this(literalLength, formattedCount, LogLevel.Info, out isEnabled) { }
+
+        public LogMessageHandler(int literalLength, int formattedCount, LogLevel level, out bool isEnabled) {
+            _enabled = isEnabled = Logging.IsEnabled(level);
+            _buffer = isEnabled ? ArrayPool<char>.Shared.Rent(Math.Max(64, literalLength + formattedCount * 16)) : null;
+            _length = 0;
+        }
+
+        public void AppendLiteral(string value) {
+            AppendFormatted(value.AsSpan());
+        }
+
+        public void AppendFormatted(ReadOnlySpan<char> value) {
+            Reserve(value.Length);
+            value.CopyTo(_buffer.AsSpan(_length));
+            _length += value.Length;
+        }
+
+        public void AppendFormatted(string? value) {
+            AppendFormatted(value.AsSpan());
+        }
+
+        public void AppendFormatted<T>(T value) {
+            AppendFormatted(value, null);
+        }
+
+        public void AppendFormatted<T>(T value, string? format) {
+            // Cast at each call rather than into a pattern variable: for a struct T the JIT then calls its method
+            // directly instead of boxing it, as DefaultInterpolatedStringHandler relies on
+            if (value is ISpanFormattable) {
+                int written;
+                while (!((ISpanFormattable)value).TryFormat(_buffer.AsSpan(_length), out written, format, CultureInfo.InvariantCulture)) {
+                    Reserve(_buffer!.Length);
+                }
+                _length += written;
+            } else if (value is IFormattable) {
+                AppendFormatted(((IFormattable)value).ToString(format, CultureInfo.InvariantCulture));
+            } else {
+                AppendFormatted(value?.ToString());
+            }
+        }
+
+        public void AppendFormatted<T>(T value, int alignment, string? format = null) {
+            int start = _length;
+            AppendFormatted(value, format);
+            int padding = Math.Abs(alignment) - (_length - start);
+            if (padding <= 0) {
+                return;
+            }
+            Reserve(padding);
+            Span<char> span = _buffer.AsSpan(start, _length - start + padding);
+            if (alignment > 0) {
+                span[..(_length - start)].CopyTo(span[padding..]);
+                span[..padding].Fill(' ');
+            } else {
+                span[(_length - start)..].Fill(' ');
+            }
+            _length += padding;
+        }
+
+        private void Reserve(int additional) {
+            if (_buffer == null || _length + additional <= _buffer.Length) {
+                return;
+            }
+            char[] larger = ArrayPool<char>.Shared.Rent(Math.Max(_buffer.Length * 2, _length + additional));
+            _buffer.AsSpan(0, _length).CopyTo(larger);
+            ArrayPool<char>.Shared.Return(_buffer);
+            _buffer = larger;
+        }
+
+        internal readonly bool Enabled => _enabled;
+
+        internal LogEntry Detach(LogLevel level) {
+            var entry = new LogEntry(level, DateTime.UtcNow.Ticks, null, _buffer, _length);
+            _buffer = null;
+            return entry;
+        }
+    }
 }
@@ -0,0 +1,287 @@
+// Bridges the TLScope meter to EventCounters (dotnet-counters, PerfView) and to an optional Prometheus text endpoint
+// Both read running totals from one MeterListener, which is only started once one of them is in use
+
+using System.Collections.Concurrent;
+using System.Diagnostics.Metrics;
+using System.Diagnostics.Tracing;
+using System.Globalization;
+using System.Net;
+using System.Runtime.CompilerServices;
+using System.Text;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Debugging {
+    public static class MetricsExporter {
+        private static readonly Lazy<MetricAggregator> aggregator = new(() => new MetricAggregator());
+
+        internal static MetricAggregator Aggregator => aggregator.Value;
+
+        /// <summary>
+        /// Registers the EventCounters source and, when TLSCOPE_METRICS_PORT is set, serves Prometheus text
+        /// on http://localhost:port/metrics. Returns the endpoint to dispose on shutdown, if one was started.
+        /// </summary>
+        public static IDisposable? Start() {
+            _ = TelemetryEventSource.Log;
+            int port = Settings.MetricsPort;
+            if (port <= 0) {
+                return null;
+            }
+
+            var listener = new HttpListener();
+            listener.Prefixes.Add($"http://localhost:{port}/");
+            try {
+                listener.Start();
+            } catch (Exception ex) when (ex is HttpListenerException or PlatformNotSupportedException) {
+                Logging.Error($"Could not serve metrics on port {port}.", ex);
+                return null;
+            }
+            _ = Aggregator;
+            _ = Task.Run(() => ServeAsync(listener));
+            Logging.Write($"Serving Prometheus metrics on http://localhost:{port}/metrics");
+            return listener;
+        }
+
+        private static async Task ServeAsync(HttpListener listener) {
+            while (listener.IsListening) {
+                HttpListenerContext context;
+                try {
+                    context = await listener.GetContextAsync();
+                } catch (Exception ex) when (ex is HttpListenerException or ObjectDisposedException or InvalidOperationException) {
+                    return; // listener closed
+                }
+                try {
+                    HttpListenerResponse response = context.Response;
+                    if (context.Request.Url?.AbsolutePath != "/metrics") {
+                        response.StatusCode = 404;
+                    } else {
+                        byte[] body = Encoding.UTF8.GetBytes(FormatPrometheus(Aggregator));
+                        response.ContentType = "text/plain; version=0.0.4; charset=utf-8";
+                        response.ContentLength64 = body.Length;
+                        await response.OutputStream.WriteAsync(body);
+                    }
+                    response.Close();
+                } catch (Exception ex) when (ex is HttpListenerException or IOException) {
+                    Logging.Write(LogLevel.Debug, $"Metrics request failed: {ex.Message}");
+                }
+            }
+        }
+
+        // Prometheus text exposition: counters as _total, histograms as summaries without quantiles
+        internal static string FormatPrometheus(MetricAggregator source) {
+            source.Collect();
+            var text = new StringBuilder();
+            foreach (var group in source.Snapshot().GroupBy(s => s.Instrument)) {
+                Instrument instrument = group.Key;
+                string name = PrometheusName(instrument);
+                MetricKind kind = MetricAggregator.KindOf(instrument);
+                text.Append("# HELP ").Append(name).Append(' ').Append(instrument.Description).Append('\n');
+                text.Append("# TYPE ").Append(name).Append(kind switch {
+                    MetricKind.Counter => " counter\n",
+                    MetricKind.Histogram => " summary\n",
+                    _ => " gauge\n"
+                });
+                foreach (var series in group) {
+                    var (sum, count, last) = series.Read();
+                    string labels = series.TagKey == null
+                        ? ""
+                        : $"{{{series.TagKey}=\"{Convert.ToString(series.TagValue, CultureInfo.InvariantCulture)}\"}}";
+                    switch (kind) {
+                        case MetricKind.Counter:
+                            text.Append(name).Append("_total").Append(labels).Append(' ').Append(Format(sum)).Append('\n');
+                            break;
+                        case MetricKind.Histogram:
+                            text.Append(name).Append("_sum").Append(labels).Append(' ').Append(Format(sum)).Append('\n');
+                            text.Append(name).Append("_count").Append(labels).Append(' ').Append(count).Append('\n');
+                            break;
+                        default:
+                            text.Append(name).Append(labels).Append(' ').Append(Format(last)).Append('\n');
+                            break;
+                    }
+                }
+            }
+            return text.ToString();
+        }
+
+        private static string PrometheusName(Instrument instrument) {
+            string name = instrument.Name.Replace('.', '_');
+            return instrument.Unit switch {
+                "ms" => name + "_milliseconds",
+                "us" => name + "_microseconds",
+                _ => name
+            };
+        }
+
+        private static string Format(double value) {
+            return value.ToString("R", CultureInfo.InvariantCulture);
+        }
+    }
+
+    internal enum MetricKind {
+        Counter,
+        Histogram,
+        Gauge
+    }
+
+    /// <summary>
+    /// Running totals per instrument, split on the value of the first tag.
+    /// </summary>
+    internal sealed class MetricAggregator {
+        internal sealed class Series {
+            private double _sum;
+            private long _count;
+            private double _last;
+
+            public Instrument Instrument { get; }
+            public string? TagKey { get; }
+            public object? TagValue { get; }
+
+            public Series(Instrument instrument, string? tagKey, object? tagValue) {
+                Instrument = instrument;
+                TagKey = tagKey;
+                TagValue = tagValue;
+            }
+
+            public void Add(double value, bool cumulative) {
+                lock (this) {
+                    // Observable instruments report their current total rather than an increment
+                    _sum = cumulative ? value : _sum + value;
+                    _count = cumulative ? 1 : _count + 1;
+                    _last = value;
+                }
+            }
+
+            public (double Sum, long Count, double Last) Read() {
+                lock (this) {
+                    return (_sum, _count, _last);
+                }
+            }
+        }
+
+        private readonly MeterListener _listener = new();
+        private readonly ConcurrentDictionary<(Instrument, object?), Series> _series = new();
+        private readonly List<Instrument> _instruments = [];
+
+        public MetricAggregator() {
+            _listener.InstrumentPublished = (instrument, listener) => {
+                if (instrument.Meter.Name != Telemetry.MeterName) {
+                    return;
+                }
+                lock (_instruments) {
+                    _instruments.Add(instrument);
+                }
+                listener.EnableMeasurementEvents(instrument);
+            };
+            _listener.SetMeasurementEventCallback<long>((instrument, value, tags, _) => Record(instrument, value, tags));
+            _listener.SetMeasurementEventCallback<int>((instrument, value, tags, _) => Record(instrument, value, tags));
+            _listener.SetMeasurementEventCallback<double>((instrument, value, tags, _) => Record(instrument, value, tags));
+            _listener.Start();
+            RuntimeHelpers.RunClassConstructor(typeof(Telemetry).TypeHandle); // publishes the instruments
+        }
+
+        public IReadOnlyList<Instrument> Instruments {
+            get {
+                lock (_instruments) {
+                    return [.. _instruments];
+                }
+            }
+        }
+
+        public static MetricKind KindOf(Instrument instrument) {
+            Type type = instrument.GetType().GetGenericTypeDefinition();
+            if (type == typeof(Counter<>) || type == typeof(ObservableCounter<>)) {
+                return MetricKind.Counter;
+            }
+            return type == typeof(Histogram<>) ? MetricKind.Histogram : MetricKind.Gauge;
+        }
+
+        /// <summary>
+        /// Polls the observable instruments so their series are current.
+        /// </summary>
+        public void Collect() {
+            _listener.RecordObservableInstruments();
+        }
+
+        public List<Series> Snapshot() {
+            return [.. _series.Values];
+        }
+
+        public (double Sum, long Count, double Last) Totals(Instrument instrument) {
+            double sum = 0, last = 0;
+            long count = 0;
+            foreach (var series in _series.Values) {
+                if (series.Instrument == instrument) {
+                    var values = series.Read();
+                    sum += values.Sum;
+                    count += values.Count;
+                    last = values.Last;
+                }
+            }
+            return (sum, count, last);
+        }
+
+        private void Record(Instrument instrument, double value, ReadOnlySpan<KeyValuePair<string, object?>> tags) {
+            string? tagKey = tags.Length > 0 ? tags[0].Key : null;
+            object? tagValue = tags.Length > 0 ? tags[0].Value : null;
+            if (!_series.TryGetValue((instrument, tagValue), out Series? series)) {
+                series = _series.GetOrAdd((instrument, tagValue), new Series(instrument, tagKey, tagValue));
+            }
+            series.Add(value, instrument.IsObservable);
+        }
+    }
+
+    /// <summary>
+    /// EventCounters view of the meter, e.g. <c>dotnet-counters monitor --counters TLScope -n TLScope</c>.
+    /// Counters are created on the first enable, so nothing is aggregated until a tool attaches.
+    /// </summary>
+    [EventSource(Name = "TLScope")]
+    internal sealed class TelemetryEventSource : EventSource {
+        public static readonly TelemetryEventSource Log = new();
+
+        private readonly List<DiagnosticCounter> _counters = [];
+
+        private TelemetryEventSource() { }
+
+        protected override void OnEventCommand(EventCommandEventArgs command) {
+            if (command.Command != EventCommand.Enable) {
+                return;
+            }
+            lock (_counters) {
+                if (_counters.Count > 0) {
+                    return;
+                }
+                MetricAggregator source = MetricsExporter.Aggregator;
+                foreach (Instrument instrument in source.Instruments) {
+                    _counters.Add(CreateCounter(source, instrument));
+                }
+            }
+        }
+
+        private DiagnosticCounter CreateCounter(MetricAggregator source, Instrument instrument) {
+            string units = instrument.Unit is { } unit && !unit.StartsWith('{') ? unit : "";
+            switch (MetricAggregator.KindOf(instrument)) {
+                case MetricKind.Counter:
+                    return new IncrementingPollingCounter(instrument.Name, this, () => {
+                        source.Collect();
+                        return source.Totals(instrument).Sum;
+                    }) { DisplayName = instrument.Description ?? instrument.Name, DisplayUnits = units };
+
+                case MetricKind.Histogram:
+                    // Mean of the values recorded since the previous poll
+                    double lastSum = 0;
+                    long lastCount = 0;
+                    return new PollingCounter(instrument.Name, this, () => {
+                        var (sum, count, _) = source.Totals(instrument);
+                        double mean = count > lastCount ? (sum - lastSum) / (count - lastCount) : 0;
+                        (lastSum, lastCount) = (sum, count);
+                        return mean;
+                    }) { DisplayName = (instrument.Description ?? instrument.Name) + " (mean)", DisplayUnits = units };
+
+                default:
+                    return new PollingCounter(instrument.Name, this, () => {
+                        source.Collect();
+                        return source.Totals(instrument).Last;
+                    }) { DisplayName = instrument.Description ?? instrument.Name, DisplayUnits = units };
+            }
+        }
+    }
+}
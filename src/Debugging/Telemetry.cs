@@ -0,0 +1,99 @@
+// Runtime metrics for the scan, probe, capture, persistence and UI stages, all on one Meter
+// Recording is a no-op until something listens; see MetricsExporter for the EventCounters and Prometheus bridges
+
+using System.Diagnostics;
+using System.Diagnostics.Metrics;
+
+namespace TLScope.src.Debugging {
+    public static class Telemetry {
+        public const string MeterName = "TLScope";
+
+        private static readonly Meter meter = new(MeterName, typeof(Telemetry).Assembly.GetName().Version?.ToString());
+
+        // Discovery
+        public static readonly Histogram<double> SweepDuration = meter.CreateHistogram<double>(
+            "tlscope.scan.sweep_duration", "ms", "Time taken by one ARP sweep cycle");
+        public static readonly Counter<long> HostsFound = meter.CreateCounter<long>(
+            "tlscope.scan.hosts_found", "{host}", "Hosts that answered a sweep, including known ones");
+        public static readonly Counter<long> HostsAdded = meter.CreateCounter<long>(
+            "tlscope.scan.hosts_added", "{host}", "Hosts seen for the first time");
+
+        // Passive discovery, tagged source=arp, dhcp or ndp
+        public static readonly Counter<long> PassiveSightings = meter.CreateCounter<long>(
+            "tlscope.passive.sightings", "{frame}", "Hosts seen in ARP, DHCP and neighbor discovery traffic");
+        public static readonly Counter<long> ProbesSkipped = meter.CreateCounter<long>(
+            "tlscope.ping.skipped", "{probe}", "Due probes skipped because the host was seen recently");
+        public static readonly Counter<long> IPv6Addresses = meter.CreateCounter<long>(
+            "tlscope.ipv6.addresses", "{address}", "IPv6 addresses attached to known devices, tagged by source");
+
+        // Liveness probing; probes are tagged result=reply or result=timeout
+        public static readonly Histogram<double> PingRoundTrip = meter.CreateHistogram<double>(
+            "tlscope.ping.rtt", "ms", "Round-trip time of answered probes");
+        public static readonly Counter<long> PingProbes = meter.CreateCounter<long>(
+            "tlscope.ping.probes", "{probe}", "Completed probes by result");
+
+        // Name resolution, tagged source=dns, mdns, nbns or none
+        public static readonly Counter<long> NameLookups = meter.CreateCounter<long>(
+            "tlscope.names.lookups", "{lookup}", "Completed hostname lookups by the source that answered");
+
+        // Device change feed
+        public static readonly Counter<long> DeviceUpdates = meter.CreateCounter<long>(
+            "tlscope.devices.updates", "{batch}", "DeviceListUpdate batches published");
+        public static readonly Counter<long> DeviceChanges = meter.CreateCounter<long>(
+            "tlscope.devices.changes", "{change}", "Device changes carried by those batches");
+
+        // UI
+        public static readonly Histogram<double> RenderDuration = meter.CreateHistogram<double>(
+            "tlscope.ui.render_duration", "ms", "Time spent applying queued deltas to the device tree");
+        public static readonly Histogram<double> LayoutDuration = meter.CreateHistogram<double>(
+            "tlscope.ui.layout_duration", "ms", "Time to bring the graph layout up to date with one snapshot");
+        public static readonly Histogram<double> RasterDuration = meter.CreateHistogram<double>(
+            "tlscope.ui.raster_duration", "ms", "Time to redraw the cached graph layout into terminal rows");
+
+        // Capture
+        public static readonly Counter<long> CapturePackets = meter.CreateCounter<long>(
+            "tlscope.capture.packets", "{packet}", "Packets received by the capture ring");
+        public static readonly Counter<long> CaptureDrops = meter.CreateCounter<long>(
+            "tlscope.capture.drops", "{packet}", "Packets the kernel dropped because the ring was full");
+        public static readonly Counter<long> CaptureQueueDrops = meter.CreateCounter<long>(
+            "tlscope.capture.queue_drops", "{segment}", "Segments dropped because a capture worker's queue was full");
+        public static readonly Histogram<double> ParseDuration = meter.CreateHistogram<double>(
+            "tlscope.tls.parse_duration", "us", "Time to parse one TLS handshake record");
+
+        // Active TLS probing; probes are tagged result=handshake, refused, timeout or failed
+        public static readonly Counter<long> TlsProbes = meter.CreateCounter<long>(
+            "tlscope.tls.probes", "{probe}", "Active TLS connection attempts by result");
+        public static readonly Histogram<double> TlsHandshakeDuration = meter.CreateHistogram<double>(
+            "tlscope.tls.handshake_duration", "ms", "Time from ClientHello to a completed handshake on active probes");
+
+        // Headless export; batches are tagged result=written, stalled (waited for the sink) or dropped (no sink)
+        public static readonly Counter<long> ExportBatches = meter.CreateCounter<long>(
+            "tlscope.export.batches", "{batch}", "Delta batches streamed by --daemon by result");
+
+        // Aggregator; sessions are tagged result=accepted, rejected (bad hello or token) or refused (at capacity)
+        public static readonly Counter<long> AggregatorSessions = meter.CreateCounter<long>(
+            "tlscope.aggregator.sessions", "{session}", "Agent connections to --aggregate by result");
+        public static readonly Counter<long> AggregatorFrames = meter.CreateCounter<long>(
+            "tlscope.aggregator.frames", "{frame}", "Delta frames received from agents");
+
+        static Telemetry() {
+            meter.CreateObservableGauge("tlscope.log.queue_depth", () => Logging.QueueDepth, "{entry}",
+                "Log entries waiting to be written");
+            meter.CreateObservableCounter("tlscope.log.dropped", () => Logging.Dropped, "{entry}",
+                "Log entries dropped because the queue was full");
+        }
+
+        public static void RecordProbe(double? roundTripMs) {
+            if (roundTripMs is double rtt) {
+                PingRoundTrip.Record(rtt);
+                PingProbes.Add(1, new KeyValuePair<string, object?>("result", "reply"));
+            } else {
+                PingProbes.Add(1, new KeyValuePair<string, object?>("result", "timeout"));
+            }
+        }
+
+        public static double ElapsedMilliseconds(long startTimestamp) {
+            return Stopwatch.GetElapsedTime(startTimestamp).TotalMilliseconds;
+        }
+    }
+}
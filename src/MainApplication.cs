@@ -12,16 +12,20 @@ namespace TLScope.src {
         private readonly NetworkController _networkController;
         private readonly NetView _networkView;
         private readonly UserView _userView;
+        private readonly GraphView _graphView;
         private readonly CancellationTokenSource _cancellationTokenSource;
 
         public MainApplication(NetworkController networkController) {
             _networkController = networkController ?? throw new ArgumentNullException(nameof(networkController));
             _networkView = new NetView(ref _networkController);
             _userView = new UserView(ref _networkController);
+            _graphView = new GraphView(ref _networkController);
             _cancellationTokenSource = new CancellationTokenSource();
         }
 
         public void Run() {
+            Task? discovery = null;
+            Task? layout = null;
             try {
                 Application.Init();
                 var top = Application.Top;
@@ -45,10 +49,16 @@ namespace TLScope.src {
                 _userView.X = Pos.Right(_networkView);
                 _userView.Y = 1; // Below the menu
                 _userView.Width = Dim.Fill();
-                _userView.Height = Dim.Fill();
+                _userView.Height = Dim.Percent(30);
+
+                _graphView.X = Pos.Right(_networkView);
+                _graphView.Y = Pos.Bottom(_userView);
+                _graphView.Width = Dim.Fill();
+                _graphView.Height = Dim.Fill();
 
                 top.Add(_networkView);
                 top.Add(_userView);
+                top.Add(_graphView);
 
                 // Handle terminal resizing
                 Application.Resized += (args) => {
@@ -56,15 +66,21 @@ namespace TLScope.src {
                     _networkView.Width = Dim.Percent(50);
                     _userView.X = Pos.Right(_networkView);
                     _userView.Width = Dim.Fill();
+                    _graphView.X = Pos.Right(_networkView);
+                    _graphView.Width = Dim.Fill();
                 };
 
-                Task.Run(() => _networkController.DiscoverLocalNetworkAsync(_cancellationTokenSource.Token));
+                discovery = Task.Run(() => _networkController.DiscoverLocalNetworkAsync(_cancellationTokenSource.Token));
+                layout = Task.Run(() => _graphView.RunLayoutAsync(_cancellationTokenSource.Token));
                 Application.Run();
             } catch (Exception ex) {
                 Logging.Error("An error occurred in the main application.", ex, true);
             } finally {
                 _cancellationTokenSource.Cancel();
                 Application.Shutdown();
+                // Give the write-behind store a moment to flush what is still queued
+                discovery?.Wait(TimeSpan.FromSeconds(5));
+                layout?.Wait(TimeSpan.FromSeconds(1));
                 Logging.Write("Main application stopped.");
             }
         }
@@ -3,3 +3,4 @@
 using System.Runtime.CompilerServices;
 
 [assembly: InternalsVisibleTo("TLScope.src.Services")]
+[assembly: InternalsVisibleTo("TLScope.Benchmarks")]
@@ -0,0 +1,24 @@
+using System;
+using System.ComponentModel.DataAnnotations;
+
+namespace TLScope.src.Models {
+    // Persisted TLS session totals, one row per site, client, server and server port. Written by Data.WriteBehindStore.
+    public class Connection {
+        [Key]
+        public int Id { get; set; }
+        // The aggregated site that reported the sessions; empty for sessions captured on this host
+        [Required]
+        public string Site { get; set; } = string.Empty;
+        [Required]
+        [StringLength(45)]
+        public string ClientAddress { get; set; } = string.Empty;
+        [Required]
+        [StringLength(45)]
+        public string ServerAddress { get; set; } = string.Empty;
+        public int ServerPort { get; set; }
+        public long Sessions { get; set; }
+        public long Bytes { get; set; }
+        public DateTime FirstSeen { get; set; } = DateTime.UtcNow;
+        public DateTime LastSeen { get; set; } = DateTime.UtcNow;
+    }
+}
@@ -4,10 +4,11 @@ using System.ComponentModel.DataAnnotations;
 using System.ComponentModel.DataAnnotations.Schema;
 using System.Reflection.Metadata.Ecma335;
 
-using Terminal.Gui.Trees;
+using TLScope.src.Utilities;
 
 namespace TLScope.src.Models {
-    public class Device : TreeNode {
+    // Persisted device row. Live scan state is kept in Data.DeviceStore and projected onto this for storage.
+    public class Device {
         [Key]
         public int Id { get; set; }
         [Required]
@@ -22,32 +23,12 @@ namespace TLScope.src.Models {
         [StringLength(100)]
         public string? OperatingSystem { get; set; }
         public DateTime LastSeen { get; set; } = DateTime.UtcNow;
+        // Derived from the MAC on every read; the vendor table is the source of truth, not the database
+        [NotMapped]
+        public string? Vendor => NetData.TryParseMac(MACAddress, out ulong mac) ? OuiTable.GetVendor(mac) : null;
 
         // Foreign key linking the Device to a User
         public int UserId { get; set; }
         public virtual User? User { get; set; }
-
-
-        //* TreeNode properties and methods onwards
-
-        // Constructor to initialize the TreeNode properties
-        public Device() : base(string.Empty) {
-            UpdateText();
-        }
-
-        // Method to update the Text property based on the DeviceName
-        private void UpdateText() {
-            Text = DeviceName;
-        }
-
-        // Override the Text property to keep it in sync with DeviceName
-        [NotMapped]
-        public override string Text {
-            get => DeviceName ?? IPAddress;
-            set => DeviceName = value ?? throw new ArgumentNullException(nameof(value));
-        }
-
-        [NotMapped]
-        public new object? Tag;
     }
 }
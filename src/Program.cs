@@ -1,5 +1,4 @@
-﻿using Microsoft.EntityFrameworkCore;
-using Microsoft.Extensions.DependencyInjection;
+﻿using Microsoft.Extensions.DependencyInjection;
 using TLScope.src.Data;
 using TLScope.src.Services;
 using TLScope.src.Controllers;
@@ -10,6 +9,7 @@ namespace TLScope.src {
     class Program {
         static void Main(string[] args) {
             Utilities.Environment.SetEnvironmentVariables();
+            using IDisposable? metricsEndpoint = MetricsExporter.Start();
 
             if (args.Length > 0) {
                 var cliController = new CLIController(args, null);
@@ -25,8 +25,16 @@ namespace TLScope.src {
                     ?? throw new InvalidOperationException("CLIController service is null.");
                 cliController.RunCLI();
 
-                var mainApp = new MainApplication(serviceProvider.GetService<NetworkController>()
-                    ?? throw new InvalidOperationException("NetworkController service is null."));
+                var networkController = serviceProvider.GetService<NetworkController>()
+                    ?? throw new InvalidOperationException("NetworkController service is null.");
+                if (!cliController.CompleteLogin()) {
+                    System.Environment.Exit(1);
+                }
+                if (cliController.SignedInUserId is int userId) {
+                    networkController.EnablePersistence(new WriteBehindStore(ApplicationDbContext.Options, userId));
+                }
+
+                var mainApp = new MainApplication(networkController);
                 mainApp.Run();
                 // clean up
                 serviceProvider.Dispose();
@@ -45,8 +53,8 @@ namespace TLScope.src {
 
         private static void ConfigureServices(IServiceCollection services, string[] args) {
             services.AddSingleton(args); // Register string[] args as a singleton service
-            services.AddDbContext<ApplicationDbContext>(options =>
-                options.UseSqlite("Data Source=tlscope.db"));
+            // One context for the process, built only when something first asks for it
+            services.AddSingleton(_ => ApplicationDbContext.Shared);
 
             services.AddTransient<NetworkService>();
             services.AddTransient<NetworkController>();
@@ -0,0 +1,338 @@
+// Aggregator role: accepts TLS streams from agents running --daemon --output tls://..., authenticates them by
+// token, and applies their binary delta frames (layout in DeltaExporter) to the agent's shard of an AggregateStore
+
+using System.Buffers;
+using System.Buffers.Binary;
+using System.Collections.Concurrent;
+using System.Globalization;
+using System.Net;
+using System.Net.Security;
+using System.Net.Sockets;
+using System.Security.Cryptography;
+using System.Security.Cryptography.X509Certificates;
+using System.Text;
+
+using TLScope.src.Data;
+using TLScope.src.Debugging;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Services {
+    public sealed class AggregatorService {
+        private const int MaxFrameLength = 64 * 1024; // well above the largest frame DeltaExporter writes
+        private const int MaxPendingDeltas = 4096; // applied early if an agent's batch is larger than this
+        private static readonly TimeSpan HandshakeTimeout = TimeSpan.FromSeconds(10);
+
+        private readonly AggregateStore _store;
+        private readonly X509Certificate2 _certificate;
+        private readonly IReadOnlyDictionary<string, byte[]> _tokenHashes;
+        private readonly SemaphoreSlim _agentSlots = new(Settings.AggregatorMaxAgents);
+        private readonly ConcurrentDictionary<Task, bool> _sessions = new();
+
+        /// <param name="tokenHashes">SHA-256 of each agent's token by agent name, as read by LoadAgents.</param>
+        public AggregatorService(AggregateStore store, X509Certificate2 certificate, IReadOnlyDictionary<string, byte[]> tokenHashes) {
+            _store = store;
+            _certificate = certificate;
+            _tokenHashes = tokenHashes;
+        }
+
+        /// <summary>
+        /// Reads the agents file: one "name token" pair per line, '#' starting a comment. Only token hashes are kept.
+        /// </summary>
+        public static Dictionary<string, byte[]> LoadAgents(string path) {
+            var agents = new Dictionary<string, byte[]>(StringComparer.OrdinalIgnoreCase);
+            foreach (string line in File.ReadLines(path)) {
+                string entry = line.Split('#', 2)[0].Trim();
+                if (entry.Length == 0) {
+                    continue;
+                }
+                string[] parts = entry.Split((char[]?)null, 2, StringSplitOptions.RemoveEmptyEntries | StringSplitOptions.TrimEntries);
+                if (parts.Length != 2) {
+                    Logging.Write(LogLevel.Warning, $"Ignoring malformed line in agents file {path}.");
+                    continue;
+                }
+                agents[parts[0]] = SHA256.HashData(Encoding.UTF8.GetBytes(parts[1]));
+            }
+            return agents;
+        }
+
+        /// <summary>
+        /// Listens on the port (both address families) until cancelled, serving each agent on its own task, and
+        /// expires idle edges and long-gone sites. Waits for open sessions to finish before returning.
+        /// </summary>
+        public async Task RunAsync(int port, CancellationToken cancTok) {
+            var listener = new TcpListener(IPAddress.IPv6Any, port);
+            listener.Server.DualMode = true;
+            try {
+                listener.Start();
+            } catch (SocketException ex) {
+                Logging.Error($"Aggregator could not listen on port {port}.", ex);
+                return;
+            }
+            Logging.Write($"Aggregator listening on port {port} for {_tokenHashes.Count} agent(s).");
+            Task maintenance = MaintainAsync(cancTok);
+            try {
+                while (true) {
+                    TcpClient client = await listener.AcceptTcpClientAsync(cancTok);
+                    if (!_agentSlots.Wait(0)) {
+                        Logging.Write(LogLevel.Warning, $"Refusing agent connection from {client.Client.RemoteEndPoint}: "
+                            + $"{Settings.AggregatorMaxAgents} sessions already open.");
+                        Telemetry.AggregatorSessions.Add(1, new KeyValuePair<string, object?>("result", "refused"));
+                        client.Dispose();
+                        continue;
+                    }
+                    Task session = ServeAsync(client, cancTok);
+                    _sessions[session] = true;
+                    _ = session.ContinueWith(done => _sessions.TryRemove(done, out _), TaskScheduler.Default);
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            } finally {
+                listener.Stop();
+                await Task.WhenAll(_sessions.Keys);
+                await maintenance;
+                Logging.Write("Aggregator stopped.");
+            }
+        }
+
+        private async Task MaintainAsync(CancellationToken cancTok) {
+            using var timer = new PeriodicTimer(TimeSpan.FromSeconds(10));
+            try {
+                while (await timer.WaitForNextTickAsync(cancTok)) {
+                    long now = DateTime.UtcNow.Ticks;
+                    int gone = _store.Expire(now - Settings.GraphEdgeIdleTimeout.Ticks, now - Settings.AggregatorSiteRetention.Ticks);
+                    if (gone > 0) {
+                        Logging.Write($"Dropped {gone} site(s) whose agents have been away for {Settings.AggregatorSiteRetention}.");
+                    }
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            }
+        }
+
+        private async Task ServeAsync(TcpClient client, CancellationToken cancTok) {
+            await Task.Yield();
+            string peer = client.Client.RemoteEndPoint?.ToString() ?? "unknown";
+            AggregateSite? site = null;
+            long session = 0;
+            byte[] buffer = ArrayPool<byte>.Shared.Rent(MaxFrameLength);
+            try {
+                using (client) {
+                    await using var tls = new SslStream(client.GetStream(), false);
+                    using (var handshake = CancellationTokenSource.CreateLinkedTokenSource(cancTok)) {
+                        handshake.CancelAfter(HandshakeTimeout);
+                        await tls.AuthenticateAsServerAsync(new SslServerAuthenticationOptions {
+                            ServerCertificate = _certificate
+                        }, handshake.Token);
+                        var stream = new BufferedStream(tls, 64 * 1024);
+                        (byte type, int length) = await ReadFrameAsync(stream, buffer, handshake.Token);
+                        if (type != DeltaExporter.HelloFrame || !TryAuthenticate(buffer.AsSpan(0, length), out string agent)) {
+                            Logging.Write(LogLevel.Warning, $"Rejected agent connection from {peer}: bad hello or token.");
+                            Telemetry.AggregatorSessions.Add(1, new KeyValuePair<string, object?>("result", "rejected"));
+                            return;
+                        }
+                        site = _store.Attach(agent, out session);
+                        Telemetry.AggregatorSessions.Add(1, new KeyValuePair<string, object?>("result", "accepted"));
+                        Logging.Write($"Agent {agent} connected from {peer}.");
+                        await ReceiveAsync(stream, buffer, site, session, cancTok);
+                    }
+                }
+            } catch (OperationCanceledException) when (cancTok.IsCancellationRequested) {
+                // shutting down
+            } catch (EndOfStreamException) {
+                // the agent closed the connection
+            } catch (Exception ex) when (ex is IOException or OperationCanceledException or InvalidDataException
+                or System.Security.Authentication.AuthenticationException) {
+                Logging.Write(LogLevel.Warning, $"Agent session from {peer} ended: {ex.Message}");
+            } finally {
+                if (site != null) {
+                    _store.Detach(site, session);
+                    Logging.Write($"Agent {site.Name} disconnected.");
+                }
+                ArrayPool<byte>.Shared.Return(buffer);
+                _agentSlots.Release();
+            }
+        }
+
+        // Frames are buffered per batch and applied at its commit frame, so the shard and graph see the agent's batches
+        private async Task ReceiveAsync(Stream stream, byte[] buffer, AggregateSite site, long session, CancellationToken cancTok) {
+            var devices = new List<DeviceChange>();
+            var flows = new List<FlowDelta>();
+            List<ConnectionEdge>? totals = null; // edge totals of the snapshot in progress
+            void Apply() {
+                if (!AggregateStore.IsCurrent(site, session)) {
+                    releaseAll(flows);
+                    throw new IOException("superseded by a newer session from the same agent");
+                }
+                _store.ApplyDevices(site, devices);
+                _store.ApplyFlows(site, flows);
+                devices.Clear();
+                flows.Clear();
+            }
+            static void releaseAll(List<FlowDelta> pending) {
+                foreach (FlowDelta delta in pending) {
+                    Interned.ServerNames.Release(delta.ServerName);
+                    Interned.Ja3.Release(delta.Ja3);
+                    Interned.Ja4.Release(delta.Ja4);
+                }
+                pending.Clear();
+            }
+
+            try {
+                while (true) {
+                    (byte type, int length) = await ReadFrameAsync(stream, buffer, cancTok);
+                    Telemetry.AggregatorFrames.Add(1);
+                    switch (type) {
+                        case DeltaExporter.DeviceFrame:
+                            devices.Add(ReadDevice(buffer.AsSpan(0, length)));
+                            break;
+                        case DeltaExporter.EdgeFrame:
+                            flows.Add(ReadEdge(buffer.AsSpan(0, length)));
+                            break;
+                        case DeltaExporter.EdgeTotalFrame when totals != null:
+                            totals.Add(ReadEdgeTotal(buffer.AsSpan(0, length)));
+                            break;
+                        case DeltaExporter.SnapshotBeginFrame:
+                            Apply();
+                            _store.BeginSnapshot(site);
+                            totals ??= [];
+                            break;
+                        case DeltaExporter.SnapshotEndFrame:
+                            Apply();
+                            _store.EndSnapshot(site, totals);
+                            totals = null; // the graph took over their references
+                            break;
+                        case DeltaExporter.CommitFrame:
+                            Apply();
+                            break;
+                        default:
+                            throw new InvalidDataException($"unexpected frame type {type}");
+                    }
+                    if (devices.Count + flows.Count >= MaxPendingDeltas) {
+                        Apply();
+                    }
+                }
+            } finally {
+                releaseAll(flows);
+                foreach (ConnectionEdge edge in totals ?? []) {
+                    edge.ReleaseInterned();
+                }
+            }
+        }
+
+        // An agent closing the connection surfaces as EndOfStreamException from the first read
+        private static async Task<(byte Type, int Length)> ReadFrameAsync(Stream stream, byte[] buffer, CancellationToken cancTok) {
+            await stream.ReadExactlyAsync(buffer.AsMemory(0, 5), cancTok);
+            int length = (int)BinaryPrimitives.ReadUInt32LittleEndian(buffer) - 1;
+            byte type = buffer[4];
+            if (length < 0 || length > MaxFrameLength) {
+                throw new InvalidDataException($"frame of {length} bytes");
+            }
+            await stream.ReadExactlyAsync(buffer.AsMemory(0, length), cancTok);
+            return (type, length);
+        }
+
+        private bool TryAuthenticate(ReadOnlySpan<byte> hello, out string agent) {
+            agent = string.Empty;
+            int offset = 1;
+            if (hello.Length < 1 || hello[0] != DeltaExporter.ProtocolVersion
+                || ReadString(hello, ref offset) is not string name
+                || ReadString(hello, ref offset) is not string token
+                || !_tokenHashes.TryGetValue(name, out byte[]? expected)) {
+                return false;
+            }
+            agent = name;
+            return CryptographicOperations.FixedTimeEquals(SHA256.HashData(Encoding.UTF8.GetBytes(token)), expected);
+        }
+
+        private static DeviceChange ReadDevice(ReadOnlySpan<byte> body) {
+            if (body.Length < 28) {
+                throw new InvalidDataException("short device frame");
+            }
+            var kind = (DeviceChangeKind)body[0];
+            var fields = (DeviceFields)BinaryPrimitives.ReadUInt16LittleEndian(body[1..]);
+            long lastSeen = BinaryPrimitives.ReadInt64LittleEndian(body[3..]);
+            uint ip = BinaryPrimitives.ReadUInt32LittleEndian(body[11..]);
+            ulong mac = BinaryPrimitives.ReadUInt64LittleEndian(body[15..]);
+            float rtt = BinaryPrimitives.ReadSingleLittleEndian(body[23..]);
+            var state = (DeviceState)body[27];
+            int offset = 28;
+            string name = ReadString(body, ref offset) ?? string.Empty;
+            string? os = ReadString(body, ref offset);
+            ReadString(body, ref offset); // vendor; derived from the MAC here as well
+            string? interfaceName = ReadString(body, ref offset);
+            if (offset >= body.Length || offset + 1 + (16 * body[offset]) > body.Length
+                || kind > DeviceChangeKind.Removed || state > DeviceState.Suspect) {
+                throw new InvalidDataException("malformed device frame");
+            }
+            UInt128[]? ipv6 = null;
+            if (body[offset] > 0) {
+                ipv6 = new UInt128[body[offset]];
+                for (int i = 0; i < ipv6.Length; i++) {
+                    ipv6[i] = BinaryPrimitives.ReadUInt128BigEndian(body[(offset + 1 + (16 * i))..]);
+                }
+            }
+            var device = new DeviceRecord(ip, mac, name, os, lastSeen, rtt, state, interfaceName, ipv6);
+            return new DeviceChange(kind, device, fields);
+        }
+
+        // Names and fingerprints are interned on arrival; the delta owns the references as if captured here
+        private static FlowDelta ReadEdge(ReadOnlySpan<byte> body) {
+            if (body.Length < 53) {
+                throw new InvalidDataException("short edge frame");
+            }
+            bool opened = body[0] != 0;
+            long timestamp = BinaryPrimitives.ReadInt64LittleEndian(body[1..]);
+            var flow = new FlowKey(BinaryPrimitives.ReadUInt128BigEndian(body[9..]), BinaryPrimitives.ReadUInt128BigEndian(body[25..]),
+                BinaryPrimitives.ReadUInt16LittleEndian(body[41..]), BinaryPrimitives.ReadUInt16LittleEndian(body[43..]));
+            long bytes = BinaryPrimitives.ReadInt64LittleEndian(body[45..]);
+            int offset = 53;
+            // A trailing site (absent from older agents) is ignored: the site is the one this session signed in as
+            var (serverName, ja3, ja4) = ReadIdentity(body, ref offset);
+            return new FlowDelta(flow, opened, bytes, timestamp, serverName, ja3, ja4);
+        }
+
+        private static ConnectionEdge ReadEdgeTotal(ReadOnlySpan<byte> body) {
+            if (body.Length < 64) {
+                throw new InvalidDataException("short edge total frame");
+            }
+            int offset = 64;
+            var (serverName, ja3, ja4) = ReadIdentity(body, ref offset);
+            return new ConnectionEdge(BinaryPrimitives.ReadUInt128BigEndian(body), BinaryPrimitives.ReadUInt128BigEndian(body[16..]),
+                BinaryPrimitives.ReadInt64LittleEndian(body[32..]), BinaryPrimitives.ReadInt64LittleEndian(body[40..]),
+                BinaryPrimitives.ReadInt64LittleEndian(body[48..]), BinaryPrimitives.ReadInt64LittleEndian(body[56..])) {
+                ServerName = serverName,
+                Ja3 = ja3,
+                Ja4 = ja4
+            };
+        }
+
+        // SNI, JA3 and JA4 strings, interned; the caller owns the references
+        private static (int ServerName, int Ja3, int Ja4) ReadIdentity(ReadOnlySpan<byte> body, ref int offset) {
+            string? serverName = ReadString(body, ref offset);
+            string? ja3 = ReadString(body, ref offset);
+            string? ja4 = ReadString(body, ref offset);
+            return (serverName != null ? Interned.ServerNames.Acquire(serverName) : 0,
+                ja3 != null && UInt128.TryParse(ja3, NumberStyles.AllowHexSpecifier, null, out UInt128 hash)
+                    ? Interned.Ja3.Acquire(hash) : 0,
+                ja4 != null && Ja4Fingerprint.TryParse(ja4, out Ja4Fingerprint fingerprint)
+                    ? Interned.Ja4.Acquire(fingerprint) : 0);
+        }
+
+        private static string? ReadString(ReadOnlySpan<byte> body, ref int offset) {
+            if (offset + 2 > body.Length) {
+                throw new InvalidDataException("truncated string");
+            }
+            ushort length = BinaryPrimitives.ReadUInt16LittleEndian(body[offset..]);
+            offset += 2;
+            if (length == DeltaExporter.NoString) {
+                return null;
+            }
+            if (offset + length > body.Length) {
+                throw new InvalidDataException("truncated string");
+            }
+            string value = Encoding.UTF8.GetString(body.Slice(offset, length));
+            offset += length;
+            return value;
+        }
+    }
+}
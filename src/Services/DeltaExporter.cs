@@ -0,0 +1,564 @@
+// Streaming export of device and connection deltas for headless collectors (--daemon)
+// Batches are encoded on the producer's thread and written to stdout, a file, a socket or an aggregator by one
+// background loop
+
+using System.Buffers;
+using System.Buffers.Binary;
+using System.Net.Security;
+using System.Net.Sockets;
+using System.Runtime.InteropServices;
+using System.Security.Cryptography.X509Certificates;
+using System.Text;
+using System.Text.Json;
+using System.Threading.Channels;
+
+using TLScope.src.Data;
+using TLScope.src.Debugging;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Services {
+    public enum ExportFormat {
+        Ndjson,
+        Binary
+    }
+
+    /// <summary>
+    /// How an agent identifies itself to an aggregator (--output tls://host:port).
+    /// </summary>
+    public sealed record AgentCredentials(string Name, string Token);
+
+    /*
+     * NDJSON: one object per change, {"type":"device",...} or {"type":"edge",...} (with "site" null from an agent), and {"type":"snapshot","phase":
+     * "begin"|"end"} around the devices and {"type":"connection",...} edge totals sent when a consumer connects.
+     *
+     * Binary: frames of u32 length (of what follows) and u8 type, little endian. Strings are u16 byte length + UTF-8,
+     * length 0xFFFF for none. Timestamps are UTC ticks.
+     *   1 device: u8 change (0 added, 1 updated, 2 removed), u16 changed fields, i64 last seen, u32 IPv4, u64 MAC,
+     *             f32 RTT (NaN when unknown), u8 state, name, OS, vendor, interface, u8 IPv6 count + 16 bytes each
+     *   2 edge:   u8 opened, i64 timestamp, 16 client address, 16 server address, u16 client port, u16 server port,
+     *             i64 bytes, SNI, JA3, JA4, site (none from an agent; the reporting site in an aggregator's stream)
+     *   3 hello:  u8 protocol version, agent name, token; first on an aggregator connection
+     *   4 snapshot begin, 5 snapshot end: around the devices sent on connect; devices not in it are gone
+     *   6 commit: ends each batch, so a reader can apply frames in the batches they were produced in
+     *   7 edge total: 16 source address, 16 target address, i64 sessions, i64 bytes, i64 first seen, i64 last seen,
+     *             SNI, JA3, JA4, site; only in a snapshot, where the edges sent replace all the consumer has
+     * Addresses are IPv6, IPv4 mapped into ::ffff:0:0/96.
+     */
+    public sealed class DeltaExporter {
+        internal const byte DeviceFrame = 1;
+        internal const byte EdgeFrame = 2;
+        internal const byte HelloFrame = 3;
+        internal const byte SnapshotBeginFrame = 4;
+        internal const byte SnapshotEndFrame = 5;
+        internal const byte CommitFrame = 6;
+        internal const byte EdgeTotalFrame = 7;
+        internal const byte ProtocolVersion = 1;
+        internal const ushort NoString = 0xFFFF;
+        private const int MaxStringChars = 4096; // keeps any UTF-8 encoding under the u16 length
+
+        private readonly string _target;
+        private readonly ExportFormat _format;
+        private readonly Action<List<DeviceRecord>> _snapshot;
+        private readonly Action<List<(ConnectionEdge Edge, string? Site)>>? _edges;
+        private readonly AgentCredentials? _agent;
+        private readonly Channel<ReadOnlyMemory<byte>> _queue;
+        private volatile bool _connected;
+        private CancellationToken _stopping;
+        private long _written;
+        private long _stalled;
+        private long _dropped;
+
+        /// <param name="target">"-" for stdout, tcp://host:port, unix:/path, tls://host:port for an aggregator,
+        /// or a file appended to.</param>
+        /// <param name="snapshot">Fills in the devices sent as a snapshot whenever a consumer (re)connects.</param>
+        /// <param name="agent">Required for tls:// targets, which always use the binary format.</param>
+        /// <param name="edges">Fills in the connection totals sent with the snapshot, so a consumer that missed
+        /// deltas while disconnected starts from the right sessions and bytes.</param>
+        public DeltaExporter(string target, ExportFormat format, Action<List<DeviceRecord>> snapshot,
+            AgentCredentials? agent = null, Action<List<(ConnectionEdge Edge, string? Site)>>? edges = null) {
+            _target = target;
+            _snapshot = snapshot;
+            _edges = edges;
+            _agent = agent;
+            _format = IsAggregator(target) ? ExportFormat.Binary : format;
+            _queue = Channel.CreateBounded<ReadOnlyMemory<byte>>(new BoundedChannelOptions(Settings.ExportQueueBatches) {
+                SingleReader = true,
+                FullMode = BoundedChannelFullMode.Wait
+            });
+        }
+
+        /// <summary>
+        /// Batches that had to wait for the sink, and batches discarded while no sink was connected.
+        /// </summary>
+        public long Stalled => Interlocked.Read(ref _stalled);
+        public long Dropped => Interlocked.Read(ref _dropped);
+
+        public void Enqueue(DeviceDeltaEventArgs delta) {
+            Post(Encode(delta.Changes));
+        }
+
+        /// <summary>
+        /// Call before the deltas are applied to the graph: their interned names are looked up here, while the
+        /// deltas still own their references. An aggregator passes the site that reported them, since sites reuse
+        /// private address ranges.
+        /// </summary>
+        public void Enqueue(IReadOnlyList<FlowDelta> deltas, string? site = null) {
+            if (deltas.Count > 0) {
+                Post(Encode(deltas, site));
+            }
+        }
+
+        // A full queue blocks the producing stage until the sink catches up; upstream coalescing (the device
+        // feed window, the flow table) absorbs the wait. Without a sink there is no one to wait for
+        private void Post(ReadOnlyMemory<byte> batch) {
+            if (!_connected) {
+                Interlocked.Increment(ref _dropped);
+                Telemetry.ExportBatches.Add(1, new KeyValuePair<string, object?>("result", "dropped"));
+                return;
+            }
+            if (_queue.Writer.TryWrite(batch)) {
+                return;
+            }
+            Interlocked.Increment(ref _stalled);
+            Telemetry.ExportBatches.Add(1, new KeyValuePair<string, object?>("result", "stalled"));
+            try {
+                _queue.Writer.WriteAsync(batch, _stopping).AsTask().GetAwaiter().GetResult();
+            } catch (Exception ex) when (ex is OperationCanceledException or ChannelClosedException) {
+                Interlocked.Increment(ref _dropped);
+            }
+        }
+
+        /// <summary>
+        /// Writes queued batches until cancelled, reconnecting socket targets with backoff, then flushes what is
+        /// still queued.
+        /// </summary>
+        public async Task RunAsync(CancellationToken cancTok) {
+            _stopping = cancTok;
+            bool reconnects = IsAggregator(_target)
+                || _target.StartsWith("tcp://", StringComparison.OrdinalIgnoreCase)
+                || _target.StartsWith("unix:", StringComparison.OrdinalIgnoreCase);
+            var backoff = TimeSpan.FromSeconds(1);
+            Stream? stream = null;
+            try {
+                while (!cancTok.IsCancellationRequested) {
+                    if (stream == null) {
+                        stream = await TryOpenAsync(cancTok);
+                        if (stream == null) {
+                            if (!reconnects) {
+                                return;
+                            }
+                            await Task.Delay(backoff, cancTok);
+                            backoff = TimeSpan.FromTicks(Math.Min(backoff.Ticks * 2, TimeSpan.TicksPerSecond * 30));
+                            continue;
+                        }
+                        backoff = TimeSpan.FromSeconds(1);
+                        // Queue from before the snapshot is copied, so no change falls between the copy and the
+                        // deltas; the snapshot is written straight to the stream, ahead of everything queued
+                        _connected = true;
+                        _connected = await SendSnapshotAsync(stream, cancTok);
+                    }
+                    if (!_connected || !await DrainAsync(stream, cancTok)) {
+                        _connected = false;
+                        await stream.DisposeAsync();
+                        stream = null;
+                        DiscardQueued();
+                        if (!reconnects) {
+                            return;
+                        }
+                        await Task.Delay(backoff, cancTok);
+                    }
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            } finally {
+                _connected = false;
+                _queue.Writer.TryComplete();
+                if (stream != null) {
+                    using var timeout = new CancellationTokenSource(Settings.ExportWriteTimeout);
+                    try {
+                        await DrainAsync(stream, timeout.Token);
+                    } catch (OperationCanceledException) {
+                        // the sink did not take the rest in time
+                    }
+                    await stream.DisposeAsync();
+                }
+                Logging.Write($"Delta export to {_target} stopped: {_written} batch(es) written, {Stalled} stalled, {Dropped} dropped.");
+            }
+        }
+
+        // A new consumer starts from every device and connection currently known, then follows the deltas. A batch
+        // queued just before the graph is copied may already be in the totals too; that is at most one batch
+        private async Task<bool> SendSnapshotAsync(Stream stream, CancellationToken cancTok) {
+            var devices = new List<DeviceRecord>();
+            _snapshot(devices);
+            var changes = devices.ConvertAll(device => new DeviceChange(DeviceChangeKind.Added, device, DeviceFields.All));
+            var edges = new List<(ConnectionEdge Edge, string? Site)>();
+            _edges?.Invoke(edges);
+            using var timeout = CancellationTokenSource.CreateLinkedTokenSource(cancTok);
+            timeout.CancelAfter(Settings.ExportWriteTimeout);
+            try {
+                await stream.WriteAsync(Encode(changes, true, edges), timeout.Token);
+                await stream.FlushAsync(timeout.Token);
+                return true;
+            } catch (OperationCanceledException) when (!cancTok.IsCancellationRequested) {
+                Logging.Write(LogLevel.Warning, $"Delta export to {_target} timed out sending the device snapshot.");
+                return false;
+            } catch (IOException ex) {
+                Logging.Write(LogLevel.Warning, $"Delta export to {_target} failed: {ex.Message}");
+                return false;
+            }
+        }
+
+        // Writes whatever is queued, waiting for more once empty. False when the sink failed, or took longer than
+        // the write timeout over one batch
+        private async Task<bool> DrainAsync(Stream stream, CancellationToken cancTok) {
+            var reader = _queue.Reader;
+            using var timeout = CancellationTokenSource.CreateLinkedTokenSource(cancTok);
+            try {
+                while (await reader.WaitToReadAsync(cancTok)) {
+                    while (reader.TryRead(out ReadOnlyMemory<byte> batch)) {
+                        timeout.CancelAfter(Settings.ExportWriteTimeout);
+                        await stream.WriteAsync(batch, timeout.Token);
+                        _written++;
+                        Telemetry.ExportBatches.Add(1, new KeyValuePair<string, object?>("result", "written"));
+                    }
+                    timeout.CancelAfter(Settings.ExportWriteTimeout);
+                    await stream.FlushAsync(timeout.Token);
+                    timeout.CancelAfter(Timeout.InfiniteTimeSpan); // idle while waiting for the next batch
+                }
+            } catch (OperationCanceledException) when (!cancTok.IsCancellationRequested) {
+                Logging.Write(LogLevel.Warning, $"Delta export to {_target} stalled for {Settings.ExportWriteTimeout.TotalSeconds} s; dropping the connection.");
+                return false;
+            } catch (IOException ex) {
+                Logging.Write(LogLevel.Warning, $"Delta export to {_target} failed: {ex.Message}");
+                return false;
+            }
+            return true;
+        }
+
+        private void DiscardQueued() {
+            while (_queue.Reader.TryRead(out _)) {
+                Interlocked.Increment(ref _dropped);
+            }
+        }
+
+        private async Task<Stream?> TryOpenAsync(CancellationToken cancTok) {
+            try {
+                if (_target == "-") {
+                    return Console.OpenStandardOutput();
+                }
+                if (IsAggregator(_target)) {
+                    return await ConnectAggregatorAsync(new Uri(_target), cancTok);
+                }
+                if (_target.StartsWith("tcp://", StringComparison.OrdinalIgnoreCase)) {
+                    var uri = new Uri(_target);
+                    var client = new TcpClient { NoDelay = true };
+                    try {
+                        await client.ConnectAsync(uri.Host, uri.Port, cancTok);
+                    } catch {
+                        client.Dispose();
+                        throw;
+                    }
+                    Logging.Write($"Delta export connected to {_target}.");
+                    return client.GetStream();
+                }
+                if (_target.StartsWith("unix:", StringComparison.OrdinalIgnoreCase)) {
+                    var socket = new Socket(AddressFamily.Unix, SocketType.Stream, ProtocolType.Unspecified);
+                    try {
+                        await socket.ConnectAsync(new UnixDomainSocketEndPoint(_target["unix:".Length..]), cancTok);
+                    } catch {
+                        socket.Dispose();
+                        throw;
+                    }
+                    Logging.Write($"Delta export connected to {_target}.");
+                    return new NetworkStream(socket, true);
+                }
+                return new FileStream(_target, FileMode.Append, FileAccess.Write, FileShare.Read, 65536, true);
+            } catch (Exception ex) when (ex is SocketException or IOException or UnauthorizedAccessException
+                or UriFormatException or System.Security.Authentication.AuthenticationException) {
+                Logging.Write(LogLevel.Warning, $"Delta export target {_target} unavailable: {ex.Message}");
+                return null;
+            }
+        }
+
+        /// <summary>
+        /// Whether the target is an aggregator (tls://host:port), which needs agent credentials.
+        /// </summary>
+        public static bool IsAggregator(string target) {
+            return target.StartsWith("tls://", StringComparison.OrdinalIgnoreCase);
+        }
+
+        // The aggregator's certificate is checked against the system roots, or only against TLSCOPE_AGGREGATOR_PIN
+        // (a SHA-256 thumbprint) when that is set, for self-signed deployments
+        private async Task<Stream> ConnectAggregatorAsync(Uri uri, CancellationToken cancTok) {
+            if (_agent == null) {
+                throw new InvalidOperationException("Aggregator targets need agent credentials.");
+            }
+            var client = new TcpClient { NoDelay = true };
+            try {
+                await client.ConnectAsync(uri.Host, uri.Port, cancTok);
+                var tls = new SslStream(client.GetStream(), false);
+                var options = new SslClientAuthenticationOptions {
+                    TargetHost = uri.Host,
+                    RemoteCertificateValidationCallback = (sender, certificate, chain, errors) =>
+                        Settings.AggregatorPin is string pin
+                            ? certificate is X509Certificate2 presented
+                                && string.Equals(presented.GetCertHashString(System.Security.Cryptography.HashAlgorithmName.SHA256),
+                                    pin.Replace(":", ""), StringComparison.OrdinalIgnoreCase)
+                            : errors == SslPolicyErrors.None
+                };
+                using var timeout = CancellationTokenSource.CreateLinkedTokenSource(cancTok);
+                timeout.CancelAfter(Settings.ExportWriteTimeout);
+                await tls.AuthenticateAsClientAsync(options, timeout.Token);
+
+                var hello = new ArrayBufferWriter<byte>(128);
+                int start = BeginFrame(hello, HelloFrame);
+                hello.GetSpan(1)[0] = ProtocolVersion;
+                hello.Advance(1);
+                WriteString(hello, _agent.Name);
+                WriteString(hello, _agent.Token);
+                EndFrame(hello, start);
+                await tls.WriteAsync(hello.WrittenMemory, timeout.Token);
+                Logging.Write($"Delta export connected to aggregator {uri.Authority} as {_agent.Name}.");
+                return tls;
+            } catch {
+                client.Dispose();
+                throw;
+            }
+        }
+
+        private ReadOnlyMemory<byte> Encode(IReadOnlyList<DeviceChange> changes, bool snapshot = false,
+            List<(ConnectionEdge Edge, string? Site)>? edges = null) {
+            edges ??= [];
+            var buffer = new ArrayBufferWriter<byte>(Math.Max(changes.Count, 1) * 160 + edges.Count * 128);
+            if (_format == ExportFormat.Ndjson) {
+                using var json = new Utf8JsonWriter(buffer);
+                if (snapshot) {
+                    WriteJsonSnapshot(json, buffer, "begin");
+                }
+                foreach (DeviceChange change in changes) {
+                    WriteJson(json, buffer, change);
+                }
+                foreach (var (edge, site) in edges) {
+                    WriteJson(json, buffer, edge, site);
+                }
+                if (snapshot) {
+                    WriteJsonSnapshot(json, buffer, "end");
+                }
+            } else {
+                if (snapshot) {
+                    EndFrame(buffer, BeginFrame(buffer, SnapshotBeginFrame));
+                }
+                foreach (DeviceChange change in changes) {
+                    WriteBinary(buffer, change);
+                }
+                foreach (var (edge, site) in edges) {
+                    WriteBinary(buffer, edge, site);
+                }
+                if (snapshot) {
+                    EndFrame(buffer, BeginFrame(buffer, SnapshotEndFrame));
+                }
+                EndFrame(buffer, BeginFrame(buffer, CommitFrame));
+            }
+            return buffer.WrittenMemory;
+        }
+
+        private ReadOnlyMemory<byte> Encode(IReadOnlyList<FlowDelta> deltas, string? site) {
+            var buffer = new ArrayBufferWriter<byte>(Math.Max(deltas.Count, 1) * 128);
+            if (_format == ExportFormat.Ndjson) {
+                using var json = new Utf8JsonWriter(buffer);
+                for (int i = 0; i < deltas.Count; i++) {
+                    WriteJson(json, buffer, deltas[i], site);
+                }
+            } else {
+                for (int i = 0; i < deltas.Count; i++) {
+                    WriteBinary(buffer, deltas[i], site);
+                }
+                EndFrame(buffer, BeginFrame(buffer, CommitFrame));
+            }
+            return buffer.WrittenMemory;
+        }
+
+        private static void WriteJson(Utf8JsonWriter json, ArrayBufferWriter<byte> buffer, in DeviceChange change) {
+            DeviceRecord device = change.Device;
+            json.WriteStartObject();
+            json.WriteString("type", "device");
+            json.WriteString("change", change.Kind switch {
+                DeviceChangeKind.Added => "added",
+                DeviceChangeKind.Updated => "updated",
+                _ => "removed"
+            });
+            json.WriteNumber("fields", (int)change.Fields);
+            json.WriteString("lastSeen", device.LastSeen);
+            json.WriteString("ip", device.IPAddress);
+            json.WriteString("mac", device.MACAddress);
+            json.WriteString("name", device.Name);
+            json.WriteString("os", device.OperatingSystem);
+            json.WriteString("vendor", device.Vendor);
+            json.WriteString("interface", device.Interface);
+            json.WriteString("state", device.State.ToString());
+            if (device.RoundTripMs is double rtt) {
+                json.WriteNumber("rttMs", Math.Round(rtt, 3));
+            } else {
+                json.WriteNull("rttMs");
+            }
+            json.WriteStartArray("ipv6");
+            foreach (string address in device.IPv6Addresses) {
+                json.WriteStringValue(address);
+            }
+            json.WriteEndArray();
+            json.WriteEndObject();
+            EndLine(json, buffer);
+        }
+
+        private static void WriteJsonSnapshot(Utf8JsonWriter json, ArrayBufferWriter<byte> buffer, string phase) {
+            json.WriteStartObject();
+            json.WriteString("type", "snapshot");
+            json.WriteString("phase", phase);
+            json.WriteEndObject();
+            EndLine(json, buffer);
+        }
+
+        private static void WriteJson(Utf8JsonWriter json, ArrayBufferWriter<byte> buffer, in FlowDelta delta, string? site) {
+            json.WriteStartObject();
+            json.WriteString("type", "edge");
+            json.WriteBoolean("opened", delta.Opened);
+            json.WriteString("timestamp", new DateTime(delta.TimestampTicks, DateTimeKind.Utc));
+            json.WriteString("client", FlowKey.ToIPAddress(delta.Flow.SourceAddress).ToString());
+            json.WriteNumber("clientPort", delta.Flow.SourcePort);
+            json.WriteString("server", FlowKey.ToIPAddress(delta.Flow.DestinationAddress).ToString());
+            json.WriteNumber("serverPort", delta.Flow.DestinationPort);
+            json.WriteNumber("bytes", delta.Bytes);
+            json.WriteString("sni", ServerName(delta.ServerName));
+            json.WriteString("ja3", Ja3(delta.Ja3));
+            json.WriteString("ja4", Ja4(delta.Ja4));
+            json.WriteString("site", site);
+            json.WriteEndObject();
+            EndLine(json, buffer);
+        }
+
+        private static void WriteJson(Utf8JsonWriter json, ArrayBufferWriter<byte> buffer, ConnectionEdge edge, string? site) {
+            json.WriteStartObject();
+            json.WriteString("type", "connection");
+            json.WriteString("source", FlowKey.ToIPAddress(edge.Source).ToString());
+            json.WriteString("target", FlowKey.ToIPAddress(edge.Target).ToString());
+            json.WriteNumber("sessions", edge.Sessions);
+            json.WriteNumber("bytes", edge.Bytes);
+            json.WriteString("firstSeen", new DateTime(edge.FirstSeenTicks, DateTimeKind.Utc));
+            json.WriteString("lastSeen", new DateTime(edge.LastSeenTicks, DateTimeKind.Utc));
+            json.WriteString("sni", ServerName(edge.ServerName));
+            json.WriteString("ja3", Ja3(edge.Ja3));
+            json.WriteString("ja4", Ja4(edge.Ja4));
+            json.WriteString("site", site);
+            json.WriteEndObject();
+            EndLine(json, buffer);
+        }
+
+        // Utf8JsonWriter takes one top-level value; resetting it after each line lets it write the next
+        private static void EndLine(Utf8JsonWriter json, ArrayBufferWriter<byte> buffer) {
+            json.Flush();
+            buffer.Write("\n"u8);
+            json.Reset();
+        }
+
+        private static void WriteBinary(ArrayBufferWriter<byte> buffer, in DeviceChange change) {
+            DeviceRecord device = change.Device;
+            int start = BeginFrame(buffer, DeviceFrame);
+            Span<byte> fixedPart = buffer.GetSpan(32);
+            fixedPart[0] = (byte)change.Kind;
+            BinaryPrimitives.WriteUInt16LittleEndian(fixedPart[1..], (ushort)change.Fields);
+            BinaryPrimitives.WriteInt64LittleEndian(fixedPart[3..], device.LastSeenTicks);
+            BinaryPrimitives.WriteUInt32LittleEndian(fixedPart[11..], device.IP);
+            BinaryPrimitives.WriteUInt64LittleEndian(fixedPart[15..], device.MAC);
+            BinaryPrimitives.WriteSingleLittleEndian(fixedPart[23..], device.RoundTripTime);
+            fixedPart[27] = (byte)device.State;
+            buffer.Advance(28);
+            WriteString(buffer, device.Name);
+            WriteString(buffer, device.OperatingSystem);
+            WriteString(buffer, device.Vendor);
+            WriteString(buffer, device.Interface);
+            UInt128[] ipv6 = device.IPv6 ?? [];
+            Span<byte> addresses = buffer.GetSpan(1 + (16 * ipv6.Length));
+            addresses[0] = (byte)ipv6.Length;
+            for (int i = 0; i < ipv6.Length; i++) {
+                BinaryPrimitives.WriteUInt128BigEndian(addresses[(1 + (16 * i))..], ipv6[i]);
+            }
+            buffer.Advance(1 + (16 * ipv6.Length));
+            EndFrame(buffer, start);
+        }
+
+        private static void WriteBinary(ArrayBufferWriter<byte> buffer, in FlowDelta delta, string? site) {
+            int start = BeginFrame(buffer, EdgeFrame);
+            Span<byte> fixedPart = buffer.GetSpan(53);
+            fixedPart[0] = delta.Opened ? (byte)1 : (byte)0;
+            BinaryPrimitives.WriteInt64LittleEndian(fixedPart[1..], delta.TimestampTicks);
+            BinaryPrimitives.WriteUInt128BigEndian(fixedPart[9..], delta.Flow.SourceAddress);
+            BinaryPrimitives.WriteUInt128BigEndian(fixedPart[25..], delta.Flow.DestinationAddress);
+            BinaryPrimitives.WriteUInt16LittleEndian(fixedPart[41..], delta.Flow.SourcePort);
+            BinaryPrimitives.WriteUInt16LittleEndian(fixedPart[43..], delta.Flow.DestinationPort);
+            BinaryPrimitives.WriteInt64LittleEndian(fixedPart[45..], delta.Bytes);
+            buffer.Advance(53);
+            WriteString(buffer, ServerName(delta.ServerName));
+            WriteString(buffer, Ja3(delta.Ja3));
+            WriteString(buffer, Ja4(delta.Ja4));
+            WriteString(buffer, site);
+            EndFrame(buffer, start);
+        }
+
+        private static void WriteBinary(ArrayBufferWriter<byte> buffer, ConnectionEdge edge, string? site) {
+            int start = BeginFrame(buffer, EdgeTotalFrame);
+            Span<byte> fixedPart = buffer.GetSpan(64);
+            BinaryPrimitives.WriteUInt128BigEndian(fixedPart, edge.Source);
+            BinaryPrimitives.WriteUInt128BigEndian(fixedPart[16..], edge.Target);
+            BinaryPrimitives.WriteInt64LittleEndian(fixedPart[32..], edge.Sessions);
+            BinaryPrimitives.WriteInt64LittleEndian(fixedPart[40..], edge.Bytes);
+            BinaryPrimitives.WriteInt64LittleEndian(fixedPart[48..], edge.FirstSeenTicks);
+            BinaryPrimitives.WriteInt64LittleEndian(fixedPart[56..], edge.LastSeenTicks);
+            buffer.Advance(64);
+            WriteString(buffer, ServerName(edge.ServerName));
+            WriteString(buffer, Ja3(edge.Ja3));
+            WriteString(buffer, Ja4(edge.Ja4));
+            WriteString(buffer, site);
+            EndFrame(buffer, start);
+        }
+
+        // Reserves the length prefix, which EndFrame fills in once the frame's size is known
+        private static int BeginFrame(ArrayBufferWriter<byte> buffer, byte type) {
+            int start = buffer.WrittenCount;
+            Span<byte> header = buffer.GetSpan(5);
+            header[4] = type;
+            buffer.Advance(5);
+            return start;
+        }
+
+        private static void EndFrame(ArrayBufferWriter<byte> buffer, int start) {
+            Span<byte> frame = MemoryMarshal.AsMemory(buffer.WrittenMemory).Span[start..];
+            BinaryPrimitives.WriteUInt32LittleEndian(frame, (uint)(frame.Length - 4));
+        }
+
+        private static void WriteString(ArrayBufferWriter<byte> buffer, string? value) {
+            if (value == null) {
+                BinaryPrimitives.WriteUInt16LittleEndian(buffer.GetSpan(2), NoString);
+                buffer.Advance(2);
+                return;
+            }
+            ReadOnlySpan<char> chars = value.AsSpan(0, Math.Min(value.Length, MaxStringChars));
+            Span<byte> span = buffer.GetSpan(2 + Encoding.UTF8.GetMaxByteCount(chars.Length));
+            int written = Encoding.UTF8.GetBytes(chars, span[2..]);
+            BinaryPrimitives.WriteUInt16LittleEndian(span, (ushort)written);
+            buffer.Advance(2 + written);
+        }
+
+        private static string? ServerName(int id) {
+            return Interned.ServerNames.TryGet(id, out string name) ? name : null;
+        }
+
+        private static string? Ja3(int id) {
+            return Interned.Ja3.TryGet(id, out UInt128 hash) ? hash.ToString("x32") : null;
+        }
+
+        private static string? Ja4(int id) {
+            return Interned.Ja4.TryGet(id, out Ja4Fingerprint fingerprint) ? fingerprint.ToString() : null;
+        }
+    }
+}
@@ -0,0 +1,140 @@
+// Coalescing change feed behind NetworkService.DeviceListUpdate
+// Changes are merged per device (keyed by packed IP) over a short window and published as one typed delta
+
+using TLScope.src.Data;
+using TLScope.src.Debugging;
+
+namespace TLScope.src.Services {
+    [Flags]
+    public enum DeviceFields {
+        None = 0,
+        DeviceName = 1 << 0,
+        IPAddress = 1 << 1,
+        MACAddress = 1 << 2,
+        OperatingSystem = 1 << 3,
+        LastSeen = 1 << 4,
+        RoundTripTime = 1 << 5,
+        State = 1 << 6,
+        IPv6Addresses = 1 << 7,
+        Certificate = 1 << 8,
+        All = DeviceName | IPAddress | MACAddress | OperatingSystem | LastSeen | RoundTripTime | State | IPv6Addresses
+            | Certificate
+    }
+
+    public enum DeviceChangeKind {
+        Added,
+        Updated,
+        Removed
+    }
+
+    public readonly record struct DeviceChange(DeviceChangeKind Kind, DeviceRecord Device, DeviceFields Fields);
+
+    public sealed class DeviceDeltaEventArgs : EventArgs {
+        public IReadOnlyList<DeviceChange> Changes { get; }
+        public int AddedCount { get; }
+        public int UpdatedCount { get; }
+        public int RemovedCount { get; }
+
+        public DeviceDeltaEventArgs(IReadOnlyList<DeviceChange> changes) {
+            Changes = changes;
+            foreach (var change in changes) {
+                switch (change.Kind) {
+                    case DeviceChangeKind.Added: AddedCount++; break;
+                    case DeviceChangeKind.Updated: UpdatedCount++; break;
+                    case DeviceChangeKind.Removed: RemovedCount++; break;
+                }
+            }
+        }
+    }
+
+    public sealed class DeviceChangeFeed : IDisposable {
+        private readonly TimeSpan _window;
+        private readonly object _lock = new();
+        private readonly object _publishLock = new(); // keeps batches in order when Flush races the timer
+        private readonly Timer _timer;
+        private readonly Dictionary<uint, DeviceChange> _pending = [];
+
+        /// <summary>
+        /// Raised on a thread-pool thread at most once per window, only when something changed.
+        /// </summary>
+        public event EventHandler<DeviceDeltaEventArgs>? Published;
+
+        public DeviceChangeFeed(TimeSpan window) {
+            _window = window;
+            _timer = new Timer(_ => Flush(), null, Timeout.Infinite, Timeout.Infinite);
+        }
+
+        public void Added(DeviceRecord device) {
+            Record(device, DeviceChangeKind.Added, DeviceFields.All);
+        }
+
+        public void Updated(DeviceRecord device, DeviceFields fields) {
+            if (fields != DeviceFields.None) {
+                Record(device, DeviceChangeKind.Updated, fields);
+            }
+        }
+
+        public void Removed(DeviceRecord device) {
+            Record(device, DeviceChangeKind.Removed, DeviceFields.None);
+        }
+
+        private void Record(DeviceRecord device, DeviceChangeKind kind, DeviceFields fields) {
+            lock (_lock) {
+                bool wasIdle = _pending.Count == 0;
+                uint key = device.IP;
+                if (_pending.TryGetValue(key, out var previous)) {
+                    var merged = Merge(previous, new DeviceChange(kind, device, fields));
+                    if (merged is DeviceChange change) {
+                        _pending[key] = change;
+                    } else {
+                        _pending.Remove(key);
+                    }
+                } else {
+                    _pending[key] = new DeviceChange(kind, device, fields);
+                }
+
+                // The window opens with the first change after a quiet period
+                if (wasIdle && _pending.Count > 0) {
+                    _timer.Change(_window, Timeout.InfiniteTimeSpan);
+                }
+            }
+        }
+
+        // Net effect of two changes to the same device within one window, as seen by a subscriber
+        // that has only processed the batches published so far. Null means nothing to report.
+        private static DeviceChange? Merge(DeviceChange previous, DeviceChange next) {
+            return (previous.Kind, next.Kind) switch {
+                (DeviceChangeKind.Added, DeviceChangeKind.Removed) => null,
+                (DeviceChangeKind.Added, _) => previous with { Device = next.Device, Fields = DeviceFields.All },
+                (DeviceChangeKind.Removed, DeviceChangeKind.Added) => next with { Kind = DeviceChangeKind.Updated },
+                (DeviceChangeKind.Removed, _) => previous,
+                (DeviceChangeKind.Updated, DeviceChangeKind.Updated) => next with { Fields = previous.Fields | next.Fields },
+                _ => next
+            };
+        }
+
+        /// <summary>
+        /// Publishes whatever is pending right away instead of waiting for the window to close.
+        /// </summary>
+        public void Flush() {
+            lock (_publishLock) {
+                DeviceChange[] changes;
+                lock (_lock) {
+                    if (_pending.Count == 0) {
+                        return;
+                    }
+                    changes = new DeviceChange[_pending.Count];
+                    _pending.Values.CopyTo(changes, 0);
+                    _pending.Clear();
+                }
+                Telemetry.DeviceUpdates.Add(1);
+                Telemetry.DeviceChanges.Add(changes.Length);
+                Published?.Invoke(this, new DeviceDeltaEventArgs(changes));
+            }
+        }
+
+        public void Dispose() {
+            _timer.Dispose();
+        }
+    }
+}
@@ -0,0 +1,267 @@
+// Resolves hostnames for newly discovered devices with reverse DNS, mDNS and NetBIOS node status
+// Requests are gathered into batches, one batch is in flight at a time under a packet budget, and answers
+// (negative ones included) are cached with their TTL so a repeat sweep causes no lookups at all
+
+using System.Net;
+using System.Net.NetworkInformation;
+using System.Net.Sockets;
+using System.Threading.Channels;
+
+using TLScope.src.Debugging;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Services {
+    public sealed class NameResolver : IDisposable {
+        private static readonly IPEndPoint mdnsGroup = new(IPAddress.Parse("224.0.0.251"), NameQuery.MdnsPort);
+
+        private sealed class Lookup {
+            public string? Dns, Mdns, Nbns;
+            public uint Ttl; // lowest TTL among the answers that named the host; 0 when none carried one
+        }
+
+        private readonly record struct CacheEntry(string? Name, long ExpiresTicks);
+
+        private readonly Socket _socket; // one ephemeral UDP port for all three protocols
+        private readonly IPEndPoint? _dnsServer;
+        private readonly Dictionary<string, IPAddress> _interfaceAddresses = [];
+        private readonly Action<uint, string> _resolved;
+        private readonly Channel<(uint IP, string? Interface)> _requests;
+        private readonly TokenBucket _budget = new(Settings.NameQueriesPerSecond);
+        private readonly object _lock = new();
+        private readonly Dictionary<uint, CacheEntry> _cache = [];
+        private readonly HashSet<uint> _queued = [];
+        private readonly Dictionary<uint, Lookup> _inFlight = [];
+
+        private NameResolver(Socket socket, IPEndPoint? dnsServer, IEnumerable<NetworkInterface> interfaces,
+            Action<uint, string> resolved) {
+            _socket = socket;
+            _dnsServer = dnsServer;
+            _resolved = resolved;
+            foreach (var ni in interfaces) {
+                if (NetData.GetLocalIPAddress(ni) is string ip) {
+                    _interfaceAddresses[ni.Name] = IPAddress.Parse(ip);
+                }
+            }
+            _requests = Channel.CreateBounded<(uint, string?)>(new BoundedChannelOptions(Settings.NameQueueCapacity) {
+                SingleReader = true,
+                FullMode = BoundedChannelFullMode.DropWrite
+            });
+        }
+
+        /// <summary>
+        /// Opens the query socket. Reverse DNS goes to the first IPv4 DNS server of the given interfaces; mDNS is
+        /// sent out of the interface each device was seen on. Returns null if no UDP socket can be opened.
+        /// </summary>
+        public static NameResolver? TryCreate(IReadOnlyList<NetworkInterface> interfaces, Action<uint, string> resolved) {
+            Socket socket;
+            try {
+                socket = new Socket(AddressFamily.InterNetwork, SocketType.Dgram, ProtocolType.Udp);
+                socket.Bind(new IPEndPoint(IPAddress.Any, 0));
+            } catch (SocketException ex) {
+                Logging.Write(LogLevel.Warning, $"Name resolution unavailable: {ex.SocketErrorCode}");
+                return null;
+            }
+            IPAddress? dns = interfaces
+                .SelectMany(ni => ni.GetIPProperties().DnsAddresses)
+                .FirstOrDefault(address => address.AddressFamily == AddressFamily.InterNetwork);
+            if (dns == null) {
+                Logging.Write("No IPv4 DNS server configured; names come from mDNS and NetBIOS only.");
+            }
+            return new NameResolver(socket, dns != null ? new IPEndPoint(dns, NameQuery.DnsPort) : null, interfaces, resolved);
+        }
+
+        /// <summary>
+        /// Asks for a device's name. Cached names are reported straight away, cached negatives and requests
+        /// already queued or in flight are ignored.
+        /// </summary>
+        public void Request(uint ip, string? interfaceName) {
+            string? cached = null;
+            lock (_lock) {
+                if (_cache.TryGetValue(ip, out CacheEntry entry) && entry.ExpiresTicks > DateTime.UtcNow.Ticks) {
+                    cached = entry.Name;
+                    if (cached == null) {
+                        return;
+                    }
+                } else if (!_queued.Add(ip)) {
+                    return;
+                } else if (!_requests.Writer.TryWrite((ip, interfaceName))) {
+                    _queued.Remove(ip); // full; a later sighting asks again
+                    return;
+                }
+            }
+            if (cached != null) {
+                _resolved(ip, cached);
+            }
+        }
+
+        public async Task RunAsync(CancellationToken cancellationToken) {
+            Task receiver = ReceiveAsync(cancellationToken);
+            var batch = new List<(uint IP, string? Interface)>(Settings.NameBatchSize);
+            try {
+                while (await _requests.Reader.WaitToReadAsync(cancellationToken)) {
+                    // A sweep reports hosts over a few seconds; give the batch a moment to fill
+                    await Task.Delay(Settings.NameBatchWindow, cancellationToken);
+                    while (true) {
+                        batch.Clear();
+                        while (batch.Count < Settings.NameBatchSize && _requests.Reader.TryRead(out var request)) {
+                            batch.Add(request);
+                        }
+                        if (batch.Count == 0) {
+                            break;
+                        }
+                        await ResolveBatchAsync(batch, cancellationToken);
+                    }
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            } finally {
+                _socket.Close();
+                await receiver;
+                Logging.Write("Name resolution stopped.");
+            }
+        }
+
+        private async Task ResolveBatchAsync(List<(uint IP, string? Interface)> batch, CancellationToken cancellationToken) {
+            lock (_lock) {
+                foreach (var (ip, _) in batch) {
+                    _inFlight[ip] = new Lookup();
+                }
+            }
+
+            byte[] buffer = new byte[64];
+            IPAddress? multicastFrom = null;
+            foreach (var (ip, interfaceName) in batch) {
+                ushort id = (ushort)Random.Shared.Next(ushort.MaxValue + 1);
+                if (_dnsServer != null) {
+                    await _budget.WaitAsync(cancellationToken);
+                    Send(buffer, NameQuery.WritePtrQuery(buffer, id, ip, true), _dnsServer);
+                }
+                if (interfaceName != null && _interfaceAddresses.TryGetValue(interfaceName, out IPAddress? local)) {
+                    if (!local.Equals(multicastFrom) && TrySetMulticastInterface(local)) {
+                        multicastFrom = local;
+                    }
+                    if (local.Equals(multicastFrom)) {
+                        await _budget.WaitAsync(cancellationToken);
+                        Send(buffer, NameQuery.WritePtrQuery(buffer, id, ip, false), mdnsGroup);
+                    }
+                }
+                await _budget.WaitAsync(cancellationToken);
+                Send(buffer, NameQuery.WriteNodeStatusQuery(buffer, id), new IPEndPoint(NetData.FromUInt32(ip), NameQuery.NbnsPort));
+            }
+
+            await Task.Delay(Settings.NameTimeout, cancellationToken);
+
+            var resolved = new List<(uint, string)>();
+            long now = DateTime.UtcNow.Ticks;
+            int negatives = 0;
+            lock (_lock) {
+                foreach (var (ip, _) in batch) {
+                    if (!_inFlight.Remove(ip, out Lookup? lookup)) {
+                        continue;
+                    }
+                    _queued.Remove(ip);
+                    string? name = lookup.Dns ?? lookup.Mdns ?? lookup.Nbns;
+                    TimeSpan ttl = name == null ? Settings.NameNegativeTtl
+                        : lookup.Ttl == 0 ? Settings.NameMinTtl // NetBIOS carries no usable TTL
+                        : TimeSpan.FromSeconds(Math.Clamp(lookup.Ttl, Settings.NameMinTtl.TotalSeconds,
+                            Settings.NameMaxTtl.TotalSeconds));
+                    _cache[ip] = new CacheEntry(name, now + ttl.Ticks);
+                    if (name != null) {
+                        resolved.Add((ip, name));
+                    } else {
+                        negatives++;
+                    }
+                    Telemetry.NameLookups.Add(1, new KeyValuePair<string, object?>("source",
+                        lookup.Dns != null ? "dns" : lookup.Mdns != null ? "mdns" : lookup.Nbns != null ? "nbns" : "none"));
+                }
+                if (_cache.Count > Settings.NameCacheTrimThreshold) {
+                    foreach (var (ip, entry) in _cache) {
+                        if (entry.ExpiresTicks <= now) {
+                            _cache.Remove(ip);
+                        }
+                    }
+                }
+            }
+
+            Logging.Write(LogLevel.Debug, $"Resolved {resolved.Count} of {batch.Count} name(s), {negatives} without a name.");
+            foreach (var (ip, name) in resolved) {
+                _resolved(ip, name);
+            }
+        }
+
+        private async Task ReceiveAsync(CancellationToken cancellationToken) {
+            byte[] buffer = new byte[1500];
+            var from = new SocketAddress(AddressFamily.InterNetwork);
+            while (!cancellationToken.IsCancellationRequested) {
+                int length;
+                try {
+                    length = await _socket.ReceiveFromAsync(buffer, SocketFlags.None, from, cancellationToken);
+                } catch (Exception ex) when (ex is SocketException or ObjectDisposedException or OperationCanceledException) {
+                    if (ex is SocketException { SocketErrorCode: SocketError.ConnectionReset }) {
+                        continue; // ICMP port unreachable from a host without NetBIOS
+                    }
+                    return;
+                }
+                var source = (IPEndPoint)new IPEndPoint(IPAddress.Any, 0).Create(from);
+                HandleResponse(buffer.AsSpan(0, length), source);
+            }
+        }
+
+        private void HandleResponse(ReadOnlySpan<byte> message, IPEndPoint source) {
+            switch (source.Port) {
+                case NameQuery.DnsPort when source.Address.Equals(_dnsServer?.Address):
+                case NameQuery.MdnsPort:
+                    if (!NameQuery.TryReadPtrResponse(message, out NameAnswer answer)) {
+                        return;
+                    }
+                    lock (_lock) {
+                        if (!_inFlight.TryGetValue(answer.IP, out Lookup? lookup)) {
+                            return;
+                        }
+                        if (source.Port == NameQuery.DnsPort) {
+                            lookup.Dns ??= answer.Name;
+                        } else {
+                            lookup.Mdns ??= answer.Name;
+                        }
+                        if (answer.Name != null) {
+                            lookup.Ttl = lookup.Ttl == 0 ? answer.TtlSeconds : Math.Min(lookup.Ttl, answer.TtlSeconds);
+                        }
+                    }
+                    break;
+
+                case NameQuery.NbnsPort:
+                    if (!NameQuery.TryReadNodeStatusResponse(message, out string? name) || name == null) {
+                        return;
+                    }
+                    lock (_lock) {
+                        if (_inFlight.TryGetValue(NetData.ToUInt32(source.Address), out Lookup? lookup)) {
+                            lookup.Nbns ??= name;
+                        }
+                    }
+                    break;
+            }
+        }
+
+        private void Send(byte[] buffer, int length, IPEndPoint target) {
+            try {
+                _socket.SendTo(buffer.AsSpan(0, length), SocketFlags.None, target);
+            } catch (SocketException) {
+                // unreachable targets count as no answer
+            }
+        }
+
+        private bool TrySetMulticastInterface(IPAddress local) {
+            try {
+                _socket.SetSocketOption(SocketOptionLevel.IP, SocketOptionName.MulticastInterface, local.GetAddressBytes());
+                return true;
+            } catch (SocketException ex) {
+                Logging.Write(LogLevel.Debug, $"Cannot send mDNS from {local}: {ex.SocketErrorCode}");
+                return false;
+            }
+        }
+
+        public void Dispose() {
+            _socket.Dispose();
+        }
+    }
+}
@@ -1,88 +1,322 @@
-using System.Collections.Concurrent;
+using System.Diagnostics;
+using System.Net;
 using System.Net.NetworkInformation;
-using TLScope.src.Models;
+using TLScope.src.Data;
 using TLScope.src.Utilities;
 using TLScope.src.Debugging;
 
 namespace TLScope.src.Services {
     public class NetworkService {
-        public static async Task ScanNetworkAsync(ConcurrentDictionary<string, Device> activeDevices,
-            CancellationToken cancellationToken = default) {
-            Logging.Write("Starting network scan...");
-            
+        private static int _firstScanLogged;
+
+        public static async Task ScanNetworkAsync(DeviceStore activeDevices,
+            NetworkInterface networkInterface, CancellationToken cancellationToken = default) {
+            string name = networkInterface.Name;
+            var tag = new KeyValuePair<string, object?>("interface", name);
+            Logging.Write($"Starting network scan on {name}...");
+
+            // Prefer the in-process sweeper; arp-scan is only spawned where raw sockets are unavailable
+            using SweepScheduler? scheduler = SweepScheduler.TryCreate(networkInterface);
+            if (scheduler == null) {
+                Logging.Write($"Raw ARP unavailable on {name}, falling back to arp-scan.");
+            }
+
+            // Sweeps that keep finding nothing new back off; a new host snaps back to the minimum interval.
+            // Ranges that need several cycles for full coverage keep sweeping at the minimum until wrapped.
+            var interval = new AdaptiveInterval();
+            var recent = new HashSet<uint>();
             try {
                 while (!cancellationToken.IsCancellationRequested) {
-                    if (activeDevices.Count > 20) {
-                        Logging.Write("Pausing network scan due to more than 20 active devices.");
-                        await Task.Delay(10000, cancellationToken); // Pause for 10 seconds if there are more than 20 active devices
-                        continue;
-                    }
-
-                    var list = NetData.ARPCommand(5);
-                    for (int i = 0; i < list.Count; i++) {
-                        (string IP, string MACAddress) _dev = list[i];
-                        if (cancellationToken.IsCancellationRequested) {
-                            break;
-                        }
-                        if (!activeDevices.ContainsKey(_dev.IP)) {
-                            activeDevices.AddOrUpdate(
-                                _dev.IP,
-                                new Device {
-                                    DeviceName = $"Device_{list.IndexOf(_dev)}",
-                                    IPAddress = _dev.IP,
-                                    MACAddress = _dev.MACAddress,
-                                    LastSeen = DateTime.UtcNow
-                                },
-                                (key, existingDevice) => {
-                                    existingDevice.LastSeen = DateTime.UtcNow;
-                                    return existingDevice;
+                    int added = 0;
+                    long started = Stopwatch.GetTimestamp();
+                    if (scheduler != null) {
+                        // Hosts heard from recently (passively, or by the prober) need no ARP request this cycle
+                        recent.Clear();
+                        activeDevices.CopySeenSince(DateTime.UtcNow.Ticks - Settings.PassiveFreshness.Ticks, recent);
+                        int found = await scheduler.RunCycleAsync(
+                            (ip, mac) => {
+                                if (AddDevice(activeDevices, ip, mac, name, false)) {
+                                    Interlocked.Increment(ref added); // workers report concurrently
                                 }
-                            );
-                            DeviceListUpdate(null, EventArgs.Empty); // Notify subscribers of the change
-                            Logging.Write($"Added {_dev.IP} to activeDevices list. Total: {activeDevices.Count}");
+                            }, recent, cancellationToken);
+                        Logging.Write($"Sweep cycle on {name} found {found} host(s), {added} new, {recent.Count} skipped as recently seen. "
+                            + $"Total: {activeDevices.Count}");
+                        Telemetry.HostsFound.Add(found, tag);
+                    } else {
+                        foreach (var (ip, mac) in NetData.ARPCommand(name)) {
+                            if (IPAddress.TryParse(ip, out IPAddress? address)
+                                && PhysicalAddress.TryParse(mac.Replace(':', '-'), out PhysicalAddress? physical)) {
+                                added += AddDevice(activeDevices, NetData.ToUInt32(address),
+                                    NetData.PackMac(physical.GetAddressBytes()), name, false) ? 1 : 0;
+                            }
                         }
                     }
-                    await Task.Delay(5000, cancellationToken); // Delay for 5 seconds before next scan
+
+                    Telemetry.SweepDuration.Record(Telemetry.ElapsedMilliseconds(started), tag);
+                    if (Interlocked.Exchange(ref _firstScanLogged, 1) == 0) {
+                        // The start-up figure the FastStart publish profile is tuned for
+                        using Process process = Process.GetCurrentProcess();
+                        TimeSpan sinceStart = DateTime.Now - process.StartTime;
+                        Logging.Write($"First scan cycle finished {sinceStart.TotalMilliseconds:F0} ms after process start.");
+                    }
+                    Telemetry.HostsAdded.Add(added, tag);
+
+                    TimeSpan delay = interval.Observe(added > 0, Settings.ScanMinInterval, Settings.ScanMaxInterval);
+                    if (scheduler != null && scheduler.ShardsPerCycle < scheduler.ShardCount) {
+                        delay = Settings.ScanMinInterval;
+                    }
+                    await Task.Delay(delay, cancellationToken);
                 }
-            } catch (TaskCanceledException) {
-                Logging.Write("Network scan was canceled.");
+            } catch (OperationCanceledException) {
+                Logging.Write($"Network scan on {name} was canceled.");
             } catch (Exception ex) {
-                Logging.Error("An error occurred during network scan.", ex);
+                Logging.Error($"An error occurred during network scan on {name}.", ex);
             } finally {
-                Logging.Write("Network scanning stopped.");
+                Logging.Write($"Network scanning on {name} stopped.");
             }
         }
 
-        public static async Task PingDevicesAsync(ConcurrentDictionary<string, Device> activeDevices,
+        private static int _discoveredCount;
+
+        private static readonly Func<string> NextDeviceName = () => $"Device_{Interlocked.Increment(ref _discoveredCount)}";
+
+        // Returns true when the device was not known before
+        private static bool AddDevice(DeviceStore activeDevices, uint ip, ulong mac, string interfaceName, bool passive) {
+            if (!activeDevices.Upsert(ip, mac, interfaceName, DateTime.UtcNow.Ticks, NextDeviceName, passive,
+                out DeviceRecord device)) {
+                _changes.Updated(device, DeviceFields.LastSeen);
+                return false;
+            }
+            _changes.Added(device); // Notify subscribers of the change
+            Logging.Write(LogLevel.Debug, $"Added {device.IPAddress} on {interfaceName} to activeDevices list. Total: {activeDevices.Count}");
+            return true;
+        }
+
+        /// <summary>
+        /// Listens for ARP, DHCP and neighbor discovery traffic on the interface and updates devices as it arrives.
+        /// Returns straight away when raw sockets are unavailable.
+        /// </summary>
+        public static async Task ListenPassiveAsync(DeviceStore activeDevices, NetworkInterface networkInterface,
             CancellationToken cancellationToken = default) {
+            using PassiveListener? listener = PassiveListener.TryOpen(networkInterface);
+            if (listener == null) {
+                return;
+            }
+            string name = networkInterface.Name;
+            Logging.Write($"Listening passively for ARP, DHCP and neighbor discovery on {name}.");
+
+            void OnSighting(Sighting sighting) {
+                Telemetry.PassiveSightings.Add(1, new KeyValuePair<string, object?>("source", sighting.Source switch {
+                    SightingSource.Arp => "arp",
+                    SightingSource.Dhcp => "dhcp",
+                    _ => "ndp"
+                }));
+                if (sighting.IP != 0) {
+                    AddDevice(activeDevices, sighting.IP, sighting.MAC, name, true);
+                    if (sighting.HostName is { Length: > 0 } hostName) {
+                        RenameDevice(activeDevices, sighting.IP, hostName);
+                    }
+                } else if (sighting.IPv6 != 0) {
+                    AddIPv6(activeDevices, sighting.MAC, sighting.IPv6, true, "ndp");
+                } else if (activeDevices.TouchMac(sighting.MAC, DateTime.UtcNow.Ticks, out DeviceRecord device)) {
+                    _changes.Updated(device, DeviceFields.LastSeen | DeviceFields.State);
+                }
+            }
+
+            try {
+                await Task.Factory.StartNew(() => listener.Run(OnSighting, cancellationToken), CancellationToken.None,
+                    TaskCreationOptions.LongRunning, TaskScheduler.Default);
+            } catch (Exception ex) {
+                Logging.Error($"Passive listener on {name} failed.", ex);
+            } finally {
+                Logging.Write($"Passive listening on {name} stopped.");
+            }
+        }
+
+        /// <summary>
+        /// Finds the IPv6 addresses of devices on the interface without sweeping: each cycle sends one echo to
+        /// all nodes, then reads the neighbor cache, and attaches addresses to devices by MAC. Hosts known only
+        /// over IPv6 are not tracked.
+        /// </summary>
+        public static async Task DiscoverIPv6Async(DeviceStore activeDevices, NetworkInterface networkInterface,
+            CancellationToken cancellationToken = default) {
+            string name = networkInterface.Name;
+            if (!NeighborDiscovery.TryGetInterfaceIndex(networkInterface, out int index)) {
+                return;
+            }
+            using NeighborDiscovery? discovery = NeighborDiscovery.TryOpen(networkInterface);
+            if (discovery == null) {
+                Logging.Write($"All-nodes echo unavailable on {name}; IPv6 addresses come from the neighbor cache only.");
+            }
+
+            var neighbors = new List<(UInt128 Address, ulong Mac, bool Reachable)>();
+            var cached = new HashSet<UInt128>();
+            var echoed = new HashSet<UInt128>();
             try {
                 while (!cancellationToken.IsCancellationRequested) {
-                    var deviceKeys = activeDevices.Keys.ToList(); // Create a separate list of keys
+                    // Replies make the responders resolve this host, which leaves them in the neighbor cache
+                    List<UInt128> responders = discovery != null
+                        ? await discovery.EchoAllNodesAsync(Settings.IPv6EchoWindow, cancellationToken)
+                        : [];
 
-                    await Task.WhenAll(deviceKeys.Select(async ip => {
-                        using (var ping = new Ping()) {
-                            try {
-                                PingReply reply = await ping.SendPingAsync(ip, 3000);
+                    int attached = 0, unmatched = 0;
+                    neighbors.Clear();
+                    cached.Clear();
+                    echoed.Clear();
+                    echoed.UnionWith(responders);
+                    NeighborDiscovery.ReadNeighbors(index, neighbors);
+                    foreach (var (address, mac, reachable) in neighbors) {
+                        cached.Add(address);
+                        // A stale entry still names the host's address, but says nothing about it being there now
+                        if (AddIPv6(activeDevices, mac, address, reachable || echoed.Contains(address), "neighbor")) {
+                            attached++;
+                        } else {
+                            unmatched++;
+                        }
+                    }
+                    foreach (UInt128 address in responders) {
+                        if (cached.Contains(address)) {
+                            continue;
+                        }
+                        if (NeighborDiscovery.TryGetEui64Mac(address, out ulong mac) && AddIPv6(activeDevices, mac, address, true, "eui64")) {
+                            attached++;
+                        } else if (activeDevices.TouchIPv6(address, DateTime.UtcNow.Ticks, out DeviceRecord device)) {
+                            _changes.Updated(device, DeviceFields.LastSeen | DeviceFields.State);
+                            attached++;
+                        } else {
+                            unmatched++;
+                        }
+                    }
+                    Logging.Write(LogLevel.Debug, $"IPv6 discovery on {name}: {responders.Count} echo repl(ies), "
+                        + $"{neighbors.Count} neighbor(s), {attached} matched to devices, {unmatched} without an IPv4 device.");
 
-                                if (reply.Status != IPStatus.Success) {
-                                    if (activeDevices.TryRemove(ip, out _)) {
-                                        Logging.Write($"TIMEOUT: {ip} is inactive. Removed from activeDevices list.");
-                                    }
-                                }
+                    await Task.Delay(Settings.IPv6DiscoveryInterval, cancellationToken);
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            } catch (Exception ex) {
+                Logging.Error($"IPv6 discovery on {name} failed.", ex);
+            } finally {
+                Logging.Write($"IPv6 discovery on {name} stopped.");
+            }
+        }
 
-                                // Update the LastSeen property of the device
-                                if (activeDevices.TryGetValue(ip, out Device? device)) {
-                                    device.LastSeen = DateTime.UtcNow;
-                                }
-                                DeviceListUpdate(null, EventArgs.Empty); // Notify subscribers of the change
-                            } catch (PingException ex) {
-                                Logging.Write($"Ping failed for {ip}: {ex.Message}");
-                            } catch (Exception ex) {
-                                Logging.Write($"Error checking device status for {ip}: {ex.Message}");
-                            }
+        // Returns true when a device with the MAC exists. Only alive sightings refresh the device; a change is
+        // published when it was refreshed or gained the address
+        private static bool AddIPv6(DeviceStore activeDevices, ulong mac, UInt128 address, bool alive, string source) {
+            if (!activeDevices.AddIPv6(mac, address, DateTime.UtcNow.Ticks, alive, out bool added, out DeviceRecord device)) {
+                return false;
+            }
+            if (added) {
+                Telemetry.IPv6Addresses.Add(1, new KeyValuePair<string, object?>("source", source));
+            }
+            DeviceFields fields = (added ? DeviceFields.IPv6Addresses : DeviceFields.None)
+                | (alive ? DeviceFields.LastSeen | DeviceFields.State : DeviceFields.None);
+            if (fields != DeviceFields.None) {
+                _changes.Updated(device, fields);
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// Applies a resolved hostname to a tracked device and publishes the change.
+        /// </summary>
+        public static void RenameDevice(DeviceStore activeDevices, uint ip, string name) {
+            if (activeDevices.SetName(ip, name, out DeviceRecord device)) {
+                _changes.Updated(device, DeviceFields.DeviceName);
+            }
+        }
+
+        /// <summary>
+        /// Applies a fingerprinting verdict to the device with the MAC, if one is tracked, and publishes the change.
+        /// </summary>
+        public static void SetOperatingSystem(DeviceStore activeDevices, ulong mac, string operatingSystem) {
+            if (activeDevices.TryGetByMac(mac, out DeviceRecord device)
+                && activeDevices.SetOperatingSystem(device.IP, operatingSystem, out device)) {
+                _changes.Updated(device, DeviceFields.OperatingSystem);
+            }
+        }
+
+        /// <summary>
+        /// Records the interned certificate a device presented and publishes the change.
+        /// </summary>
+        public static void SetDeviceCertificate(DeviceStore activeDevices, uint ip, int certificate) {
+            if (activeDevices.SetCertificate(ip, certificate, out DeviceRecord device)) {
+                _changes.Updated(device, DeviceFields.Certificate);
+            }
+        }
+
+        /// <summary>
+        /// Probes the devices last seen on the given interface (all devices when null) until cancelled.
+        /// </summary>
+        public static async Task PingDevicesAsync(DeviceStore activeDevices, string? interfaceName = null,
+            CancellationToken cancellationToken = default) {
+            var scheduler = ProbeScheduler.FromSettings();
+
+            void OnProbeCompleted(uint ip, double? rtt) {
+                DeviceRecord device;
+                Telemetry.RecordProbe(rtt);
+                if (rtt == null && interfaceName != null && activeDevices.TryGet(ip, out device)
+                    && device.Interface != interfaceName) {
+                    // Seen on another interface since; that interface's pipeline probes it now
+                    scheduler.Untrack(ip);
+                    return;
+                }
+                switch (scheduler.Report(ip, rtt != null)) {
+                    case ProbeVerdict.Up:
+                        if (activeDevices.Touch(ip, DateTime.UtcNow.Ticks, rtt, out device)) {
+                            _changes.Updated(device, DeviceFields.LastSeen | DeviceFields.RoundTripTime | DeviceFields.State);
+                        }
+                        break;
+                    case ProbeVerdict.Suspect:
+                        if (activeDevices.SetState(ip, DeviceState.Suspect) && activeDevices.TryGet(ip, out device)) {
+                            _changes.Updated(device, DeviceFields.State);
                         }
-                    }));
-                    await Task.Delay(5000, cancellationToken); // Delay for 5 seconds before next ping
+                        break;
+                    case ProbeVerdict.Gone:
+                        if (activeDevices.Remove(ip, out device)) {
+                            Logging.Write($"TIMEOUT: {device.IPAddress} is inactive. Removed from activeDevices list.");
+                            _changes.Removed(device);
+                        }
+                        break;
+                }
+            }
+
+            using IcmpEngine? engine = IcmpEngine.TryOpen(Settings.ProbeTimeout, interfaceName);
+            Action<uint> send;
+            if (engine != null) {
+                engine.Completed += OnProbeCompleted;
+                send = engine.Send;
+            } else {
+                Logging.Write("ICMP sockets unavailable, falling back to per-device Ping.");
+                send = ip => _ = PingOnceAsync(ip, OnProbeCompleted);
+            }
+
+            var due = new List<uint>();
+            var ips = new List<uint>();
+            long nextSync = 0;
+            try {
+                while (!cancellationToken.IsCancellationRequested) {
+                    if (System.Environment.TickCount64 >= nextSync) {
+                        SyncProbeTargets(activeDevices, interfaceName, scheduler, ips);
+                        nextSync = System.Environment.TickCount64 + 1000;
+                    }
+
+                    // Only devices whose own interval has elapsed are probed; replies and timeouts are
+                    // handled as they land, so a slow host never holds up the others
+                    due.Clear();
+                    scheduler.TakeDue(due);
+                    long freshSince = DateTime.UtcNow.Ticks - Settings.PassiveFreshness.Ticks;
+                    foreach (uint ip in due) {
+                        if (activeDevices.HeardSince(ip, freshSince)) {
+                            // Its own traffic was seen lately, which is as good as a reply
+                            scheduler.Report(ip, true);
+                            Telemetry.ProbesSkipped.Add(1);
+                            continue;
+                        }
+                        send(ip);
+                    }
+                    await Task.Delay(250, cancellationToken);
                 }
             } catch (TaskCanceledException) {
                 Logging.Write("Device pinging was canceled.");
@@ -91,7 +325,42 @@ namespace TLScope.src.Services {
             }
         }
 
-        // DeviceListUpdate event to notify subscribers of changes to the activeDevices list
-        public static event EventHandler DeviceListUpdate = delegate { };
+        // Picks up devices added by the sweeper; Track ignores ones already scheduled
+        private static void SyncProbeTargets(DeviceStore activeDevices, string? interfaceName, ProbeScheduler scheduler,
+            List<uint> ips) {
+            ips.Clear();
+            activeDevices.CopyIPs(ips, interfaceName);
+            foreach (uint ip in ips) {
+                scheduler.Track(ip);
+            }
+        }
+
+        private static async Task PingOnceAsync(uint ip, Action<uint, double?> completed) {
+            double? rtt = null;
+            try {
+                using var ping = new Ping();
+                PingReply reply = await ping.SendPingAsync(NetData.FromUInt32(ip), (int)Settings.ProbeTimeout.TotalMilliseconds);
+                if (reply.Status == IPStatus.Success) {
+                    rtt = reply.RoundtripTime;
+                }
+            } catch (PingException ex) {
+                Logging.Write(LogLevel.Debug, $"Ping failed for {NetData.FromUInt32(ip)}: {ex.Message}");
+            } catch (Exception ex) {
+                Logging.Write(LogLevel.Warning, $"Error checking device status for {NetData.FromUInt32(ip)}: {ex.Message}");
+            }
+            completed(ip, rtt);
+        }
+
+        // DeviceListUpdate event to notify subscribers of changes to the activeDevices list.
+        // Fires at most once per Settings.DeviceUpdateWindow with the net added/updated/removed devices.
+        public static event EventHandler<DeviceDeltaEventArgs> DeviceListUpdate = delegate { };
+
+        private static readonly DeviceChangeFeed _changes = CreateChangeFeed();
+
+        private static DeviceChangeFeed CreateChangeFeed() {
+            var feed = new DeviceChangeFeed(Settings.DeviceUpdateWindow);
+            feed.Published += (sender, delta) => DeviceListUpdate(null, delta);
+            return feed;
+        }
     }
 }
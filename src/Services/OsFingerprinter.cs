@@ -0,0 +1,59 @@
+// Passive OS fingerprinting on the capture path: every TCP segment from this link is checked against the
+// per-MAC verdict cache, and only SYNs from hosts without a signature verdict yet are classified
+
+using System.Collections.Concurrent;
+
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Services {
+    public sealed class OsFingerprinter {
+        private readonly ConcurrentDictionary<ulong, OsVerdict> _verdicts = new();
+        private readonly Action<ulong, OsVerdict> _classified;
+
+        /// <param name="classified">Called with the MAC whenever a host gets its first or a better verdict,
+        /// on the capture dispatcher's thread.</param>
+        public OsFingerprinter(Action<ulong, OsVerdict> classified) {
+            _classified = classified;
+        }
+
+        public int Count => _verdicts.Count;
+
+        public bool TryGetVerdict(ulong mac, out OsVerdict verdict) {
+            return _verdicts.TryGetValue(mac, out verdict);
+        }
+
+        /// <summary>
+        /// Looks at one decoded segment of the frame. Constant time: a TTL test and a cache lookup, plus two
+        /// table lookups for an unclassified host's SYN. Safe to call from several capture dispatchers.
+        /// </summary>
+        public void Observe(ReadOnlySpan<byte> frame, in TcpSegment segment) {
+            // Relayed packets carry a decremented TTL and the router's MAC
+            if (!OsSignatures.IsInitialTtl(segment.Ttl) || segment.HeaderOffset == 0) {
+                return;
+            }
+            ulong mac = NetData.PackMac(frame.Slice(6, 6));
+            _verdicts.TryGetValue(mac, out OsVerdict known);
+            if (known.Confidence == OsConfidence.Signature) {
+                return;
+            }
+
+            OsVerdict verdict;
+            if ((segment.Flags & (TcpFlags.Syn | TcpFlags.Ack)) == TcpFlags.Syn) {
+                verdict = OsSignatures.ClassifySyn(frame[segment.HeaderOffset..segment.PayloadOffset], segment.Ttl);
+            } else if (known.Confidence == OsConfidence.None) {
+                verdict = OsSignatures.ClassifyTtl(segment.Ttl); // mid-connection traffic, e.g. a ClientHello
+            } else {
+                return;
+            }
+            if (verdict.Confidence <= known.Confidence) {
+                return;
+            }
+            bool stored = known.Confidence == OsConfidence.None
+                ? _verdicts.TryAdd(mac, verdict)
+                : _verdicts.TryUpdate(mac, verdict, known);
+            if (stored) {
+                _classified(mac, verdict);
+            }
+        }
+    }
+}
@@ -0,0 +1,147 @@
+// Per-device probe scheduling: stable hosts back off towards the maximum interval, hosts that change state
+// are probed at the minimum interval, and a host is only declared gone after N failures out of the last M probes
+
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Services {
+    public enum ProbeVerdict {
+        Up,
+        Suspect, // failed recently, not yet enough failures to evict
+        Gone
+    }
+
+    /// <summary>
+    /// EWMA of how often an observed state flips, mapped onto a probe interval.
+    /// </summary>
+    public struct AdaptiveInterval {
+        private const double Alpha = 0.3;
+
+        public double ChangeRate { get; private set; }
+
+        public AdaptiveInterval() {
+            ChangeRate = 1.0; // new targets start out as if volatile and relax from there
+        }
+
+        public TimeSpan Observe(bool changed, TimeSpan min, TimeSpan max) {
+            ChangeRate = (Alpha * (changed ? 1.0 : 0.0)) + ((1 - Alpha) * ChangeRate);
+            if (changed) {
+                return min;
+            }
+            // Stays near min while the rate is high, approaches max after ~10 quiet observations
+            double stability = Math.Pow(1 - ChangeRate, 8);
+            return min + ((max - min) * stability);
+        }
+    }
+
+    public sealed class ProbeScheduler {
+        private struct ProbeState {
+            public AdaptiveInterval Interval;
+            public uint History;   // one bit per past probe, 1 = failure, newest in bit 0
+            public bool WasUp;
+            public long Due;
+        }
+
+        private readonly Dictionary<uint, ProbeState> _states = [];
+        private readonly PriorityQueue<uint, long> _queue = new();
+        private readonly object _lock = new();
+        private readonly TimeSpan _min;
+        private readonly TimeSpan _max;
+        private readonly int _failureThreshold;
+        private readonly uint _windowMask;
+
+        public int Count {
+            get {
+                lock (_lock) {
+                    return _states.Count;
+                }
+            }
+        }
+
+        public ProbeScheduler(TimeSpan min, TimeSpan max, int failureThreshold, int failureWindow) {
+            if (failureWindow is < 1 or > 32 || failureThreshold < 1 || failureThreshold > failureWindow) {
+                throw new ArgumentOutOfRangeException(nameof(failureThreshold), "Need 1 <= N <= M <= 32.");
+            }
+            _min = min;
+            _max = max;
+            _failureThreshold = failureThreshold;
+            _windowMask = failureWindow == 32 ? uint.MaxValue : (1u << failureWindow) - 1;
+        }
+
+        public static ProbeScheduler FromSettings() {
+            return new ProbeScheduler(Settings.ProbeMinInterval, Settings.ProbeMaxInterval,
+                Settings.ProbeFailureThreshold, Settings.ProbeFailureWindow);
+        }
+
+        /// <summary>
+        /// Starts scheduling a target; it is due immediately. No-op if already tracked.
+        /// </summary>
+        public bool Track(uint ip) {
+            lock (_lock) {
+                if (_states.ContainsKey(ip)) {
+                    return false;
+                }
+                long now = System.Environment.TickCount64;
+                _states[ip] = new ProbeState { Interval = new AdaptiveInterval(), WasUp = true, Due = now };
+                _queue.Enqueue(ip, now);
+                return true;
+            }
+        }
+
+        public void Untrack(uint ip) {
+            lock (_lock) {
+                _states.Remove(ip); // its queue entry is discarded lazily when it comes due
+            }
+        }
+
+        /// <summary>
+        /// Moves every target whose probe is due into output. Due targets are not returned again until reported.
+        /// </summary>
+        public void TakeDue(List<uint> output) {
+            long now = System.Environment.TickCount64;
+            lock (_lock) {
+                while (_queue.TryPeek(out uint ip, out long due) && due <= now) {
+                    _queue.Dequeue();
+                    if (_states.TryGetValue(ip, out var state) && state.Due == due) {
+                        output.Add(ip);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Records a probe outcome, reschedules the target and returns the hysteresis verdict.
+        /// Targets reported as Gone are no longer tracked.
+        /// </summary>
+        public ProbeVerdict Report(uint ip, bool success) {
+            lock (_lock) {
+                if (!_states.TryGetValue(ip, out var state)) {
+                    return ProbeVerdict.Gone;
+                }
+
+                state.History = ((state.History << 1) | (success ? 0u : 1u)) & _windowMask;
+                int failures = System.Numerics.BitOperations.PopCount(state.History);
+
+                ProbeVerdict verdict = success ? ProbeVerdict.Up
+                    : failures >= _failureThreshold ? ProbeVerdict.Gone
+                    : ProbeVerdict.Suspect;
+                if (verdict == ProbeVerdict.Gone) {
+                    _states.Remove(ip);
+                    return verdict;
+                }
+
+                bool changed = success != state.WasUp;
+                state.WasUp = success;
+                TimeSpan interval = state.Interval.Observe(changed, _min, _max);
+                if (!success) {
+                    // Suspect hosts are re-probed quickly so eviction follows soon after they really go away
+                    interval = _min;
+                }
+
+                state.Due = System.Environment.TickCount64 + (long)interval.TotalMilliseconds;
+                _states[ip] = state;
+                _queue.Enqueue(ip, state.Due);
+                return verdict;
+            }
+        }
+    }
+}
@@ -0,0 +1,141 @@
+// Offline replay for --replay: a capture file runs through the same capture workers, flow table and graph stage as
+// live traffic, on the capture's own clock, and the run is summarized so throughput can be compared between builds
+
+using System.Diagnostics;
+using TLScope.src.Data;
+using TLScope.src.Debugging;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Services {
+    /// <summary>
+    /// Counts and per-stage times for one replay. Worker and parse times add up across worker threads.
+    /// </summary>
+    public sealed record ReplayReport(
+        string Format,
+        long FileBytes,
+        long Packets,
+        long PacketsSkipped,
+        bool Truncated,
+        long Segments,
+        long HandshakeRecords,
+        long Sessions,
+        long DroppedDeltas,
+        long GraphBatches,
+        int Edges,
+        TimeSpan Elapsed,
+        TimeSpan CaptureSpan,
+        TimeSpan DispatchTime,
+        TimeSpan WorkerTime,
+        TimeSpan ParseTime,
+        TimeSpan GraphTime) {
+
+        public double PacketsPerSecond => Rate(Packets);
+        public double HandshakesPerSecond => Rate(HandshakeRecords);
+        public double SessionsPerSecond => Rate(Sessions);
+
+        /// <summary>
+        /// Mean time per item in microseconds, 0 when there were none.
+        /// </summary>
+        public static double PerItem(TimeSpan total, long items) {
+            return items > 0 ? total.TotalMicroseconds / items : 0;
+        }
+
+        private double Rate(long count) {
+            return Elapsed.TotalSeconds > 0 ? count / Elapsed.TotalSeconds : 0;
+        }
+    }
+
+    public sealed class ReplayService {
+        private readonly string _path;
+        private readonly double _speed;
+
+        /// <param name="speed">0 for as fast as the pipeline goes, otherwise a multiple of the capture's own pace.</param>
+        public ReplayService(string path, double speed = 0) {
+            _path = path ?? throw new ArgumentNullException(nameof(path));
+            _speed = speed;
+        }
+
+        /// <summary>
+        /// Replays the file to its end, or until cancelled, and reports on what was replayed so far. Throws
+        /// IOException or InvalidDataException when the file cannot be opened as a capture.
+        /// </summary>
+        public async Task<ReplayReport> RunAsync(CancellationToken cancTok) {
+            CaptureFile capture = CaptureFile.Open(_path, _speed);
+            var graph = new ConnectionGraph();
+            var fingerprinter = new OsFingerprinter((mac, verdict) => { });
+            using TlsService tls = TlsService.FromCapture(capture, null, fingerprinter);
+            var stage = new GraphStage(tls.Flows, graph);
+
+            long started = Stopwatch.GetTimestamp();
+            // The graph is fed on the capture's clock, once per captured second as live capture does once per second,
+            // however fast that second replays. The file is held to a second past what has been collected, so full
+            // speed cannot overrun the flow table's event queue; after a quiet gap in the capture, the stage collects
+            // as soon as the pipeline drains and is then granted up to the next frame, however far past the gap that
+            // lies. It runs on its own thread: at full speed the workers keep the pool busy
+            capture.Grant(0);
+            Task capturing = tls.RunAsync(cancTok);
+            await Task.Factory.StartNew(() => {
+                long nextCollect = 0;
+                while (!capturing.IsCompleted) {
+                    capture.WaitForProgress(10);
+                    long clock = capture.ClockTicks;
+                    bool starved = capture.Starved;
+                    if (clock > 0 && (clock >= nextCollect || starved)) {
+                        stage.Collect(clock);
+                        capture.Grant(starved ? Math.Max(clock, capture.WaitingTicks) : clock);
+                        nextCollect = clock + TimeSpan.TicksPerSecond;
+                    }
+                }
+            }, CancellationToken.None, TaskCreationOptions.LongRunning, TaskScheduler.Default);
+            await capturing;
+            stage.Collect(capture.ClockTicks, true);
+            TimeSpan elapsed = Stopwatch.GetElapsedTime(started);
+
+            var report = new ReplayReport(capture.Format, capture.Length, capture.FramesDelivered, capture.FramesSkipped,
+                capture.Truncated, tls.SegmentsDispatched, tls.HandshakeRecords, stage.Sessions, tls.Flows.DroppedDeltas, stage.Batches,
+                graph.Snapshot.Edges.Count, elapsed, TimeSpan.FromTicks(Math.Max(0, capture.ClockTicks - capture.FirstTicks)),
+                tls.DispatchTime, tls.WorkerTime, tls.ParseTime, stage.Time);
+            Logging.Write($"Replayed {report.Packets} packet(s) from {_path} in {elapsed.TotalSeconds:F2} s "
+                + $"({report.PacketsPerSecond:F0} packets/s, {report.HandshakesPerSecond:F0} handshakes/s).");
+            if (capture.Truncated) {
+                Logging.Write(LogLevel.Warning, $"Replay of {_path} stopped at a truncated or malformed record.");
+            }
+            return report;
+        }
+
+        // The graph half of NetworkController.MaintainGraphAsync, driven by capture time instead of a timer
+        private sealed class GraphStage {
+            private readonly FlowTable _flows;
+            private readonly ConnectionGraph _graph;
+            private readonly List<FlowDelta> _deltas = [];
+            private long _ticks;
+            private long _nextExpiry;
+
+            public long Sessions { get; private set; }
+            public long Batches { get; private set; }
+            public TimeSpan Time => Stopwatch.GetElapsedTime(0, _ticks);
+
+            public GraphStage(FlowTable flows, ConnectionGraph graph) {
+                _flows = flows;
+                _graph = graph;
+            }
+
+            /// <param name="final">Evicts every flow, as if the capture had gone quiet for the idle timeout.</param>
+            public void Collect(long nowTicks, bool final = false) {
+                long started = Stopwatch.GetTimestamp();
+                _deltas.Clear();
+                _flows.Collect(final ? nowTicks + 1 : nowTicks - Settings.FlowIdleTimeout.Ticks, _deltas);
+                foreach (FlowDelta delta in _deltas) {
+                    Sessions += delta.Opened ? 1 : 0;
+                }
+                _graph.Apply(_deltas);
+                if (nowTicks >= _nextExpiry) {
+                    _graph.ExpireIdle(nowTicks - Settings.GraphEdgeIdleTimeout.Ticks);
+                    _nextExpiry = nowTicks + TimeSpan.TicksPerSecond * 10;
+                }
+                _ticks += Stopwatch.GetTimestamp() - started;
+                Batches++;
+            }
+        }
+    }
+}
@@ -0,0 +1,118 @@
+// Splits the scanned IPv4 range into shards and sweeps them concurrently under a shared packet budget
+// Progress carries over between cycles, so ranges too large for one cycle are covered round-robin
+
+using System.Net.NetworkInformation;
+
+using TLScope.src.Debugging;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Services {
+    public sealed class SweepScheduler : IDisposable {
+        private readonly List<(uint First, uint Last)> _shards;
+        private readonly ArpScanner[] _scanners;
+        private readonly int _shardsPerCycle;
+        private int _cursor; // index of the next shard to sweep, kept across cycles
+
+        public int ShardCount => _shards.Count;
+        public int ShardsPerCycle => _shardsPerCycle;
+
+        private SweepScheduler(List<(uint First, uint Last)> shards, ArpScanner[] scanners) {
+            _shards = shards;
+            _scanners = scanners;
+
+            // Each shard costs (retries + 1) frames per host; fit as many as the budget allows per cycle
+            int retries = scanners[0].Retries;
+            double framesPerCycle = Settings.ScanPacketsPerSecond * Settings.ScanCycleBudget.TotalSeconds;
+            int affordable = (int)(framesPerCycle / (Settings.ScanShardSize * (retries + 1)));
+            _shardsPerCycle = Math.Clamp(affordable, 1, shards.Count);
+        }
+
+        /// <summary>
+        /// Builds a scheduler over the interface's subnet. Returns null when raw ARP sockets cannot be opened.
+        /// </summary>
+        public static SweepScheduler? TryCreate(NetworkInterface ni) {
+            string? ip = NetData.GetLocalIPAddress(ni);
+            if (ip == null) {
+                return null;
+            }
+            var range = NetData.GetIPRange(ip, NetData.GetSubnetMask(ni, ip)).ToArray();
+            var shards = BuildShards(range[0], range[1], Settings.ScanShardSize);
+
+            var budget = new TokenBucket(Settings.ScanPacketsPerSecond);
+            int workers = Math.Clamp(Settings.ScanConcurrency, 1, shards.Count);
+            var scanners = new ArpScanner[workers];
+            for (int i = 0; i < workers; i++) {
+                var scanner = ArpScanner.TryOpen(ni, budget.WaitAsync);
+                if (scanner == null) {
+                    for (int j = 0; j < i; j++) {
+                        scanners[j].Dispose();
+                    }
+                    return null;
+                }
+                scanners[i] = scanner;
+            }
+
+            Logging.Write($"Sweep scheduler: {range[0]} - {range[1]} in {shards.Count} shard(s), "
+                + $"{workers} worker(s), {Settings.ScanPacketsPerSecond} pps.");
+            return new SweepScheduler(shards, scanners);
+        }
+
+        /// <summary>
+        /// Splits the inclusive range from NetData.GetIPRange into host shards, skipping network and broadcast.
+        /// </summary>
+        public static List<(uint First, uint Last)> BuildShards(string startIP, string endIP, int shardSize) {
+            uint start = NetData.ToUInt32(System.Net.IPAddress.Parse(startIP));
+            uint end = NetData.ToUInt32(System.Net.IPAddress.Parse(endIP));
+            if (end - start >= 2) {
+                start++;
+                end--;
+            }
+
+            var shards = new List<(uint First, uint Last)>();
+            for (ulong first = start; first <= end; first += (ulong)shardSize) {
+                ulong last = Math.Min(end, first + (ulong)shardSize - 1);
+                shards.Add(((uint)first, (uint)last));
+            }
+            return shards;
+        }
+
+        /// <summary>
+        /// Sweeps the next batch of shards and reports every responding host. Returns the number of hosts found.
+        /// Addresses in skip (hosts seen recently by other means) are not probed.
+        /// </summary>
+        public async Task<int> RunCycleAsync(Action<uint, ulong> onFound, IReadOnlySet<uint>? skip = null,
+            CancellationToken cancellationToken = default) {
+            int batchStart = _cursor;
+            int batchSize = _shardsPerCycle;
+            _cursor = (batchStart + batchSize) % _shards.Count;
+
+            int next = -1;
+            int found = 0;
+            var workers = _scanners.Select(scanner => Task.Run(async () => {
+                int i;
+                while ((i = Interlocked.Increment(ref next)) < batchSize) {
+                    var (first, last) = _shards[(batchStart + i) % _shards.Count];
+                    var targets = new List<uint>((int)(last - first + 1));
+                    for (ulong ip = first; ip <= last; ip++) {
+                        if (skip == null || !skip.Contains((uint)ip)) {
+                            targets.Add((uint)ip);
+                        }
+                    }
+                    await foreach (var (ip, mac) in scanner.SweepRawAsync(targets, cancellationToken)) {
+                        Interlocked.Increment(ref found);
+                        onFound(ip, mac);
+                    }
+                }
+            }, cancellationToken));
+
+            await Task.WhenAll(workers);
+            return found;
+        }
+
+        public void Dispose() {
+            foreach (var scanner in _scanners) {
+                scanner.Dispose();
+            }
+        }
+    }
+}
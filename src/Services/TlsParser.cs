@@ -0,0 +1,606 @@
+// Allocation-free ClientHello/ServerHello parsing with JA3/JA3S and JA4 fingerprints
+// Everything returned points back into the record; scratch space comes from the stack or ArrayPool
+
+using System.Buffers;
+using System.Buffers.Binary;
+using System.Globalization;
+using System.Security.Cryptography;
+
+namespace TLScope.src.Services {
+    public enum TlsHelloKind : byte {
+        ClientHello = 1,
+        ServerHello = 2
+    }
+
+    public enum TlsParseStatus {
+        Ok,
+        NotHello,   // a handshake record carrying some other message
+        Incomplete, // the hello continues in a later record
+        Malformed
+    }
+
+    /// <summary>
+    /// JA4 client fingerprint kept as its parts; formatted to the usual "t13d1516h2_8daf6616d1cb_e5627efa2ab1" on demand.
+    /// </summary>
+    public readonly record struct Ja4Fingerprint(ushort Version, bool HasServerName, byte CipherCount, byte ExtensionCount,
+        char AlpnFirst, char AlpnLast, ulong CipherHash, ulong ExtensionHash) {
+
+        public const int Length = 36;
+
+        public bool TryFormat(Span<char> destination, out int written) {
+            written = 0;
+            if (destination.Length < Length) {
+                return false;
+            }
+            destination[0] = 't'; // passive capture only sees TCP
+            (destination[1], destination[2]) = Version switch {
+                0x0304 => ('1', '3'),
+                0x0303 => ('1', '2'),
+                0x0302 => ('1', '1'),
+                0x0301 => ('1', '0'),
+                0x0300 => ('s', '3'),
+                _ => ('0', '0')
+            };
+            destination[3] = HasServerName ? 'd' : 'i';
+            WriteTwoDigits(destination[4..], CipherCount);
+            WriteTwoDigits(destination[6..], ExtensionCount);
+            destination[8] = AlpnFirst;
+            destination[9] = AlpnLast;
+            destination[10] = '_';
+            WriteHash(destination[11..], CipherHash);
+            destination[23] = '_';
+            WriteHash(destination[24..], ExtensionHash);
+            written = Length;
+            return true;
+        }
+
+        public override string ToString() {
+            return string.Create(Length, this, (span, fingerprint) => fingerprint.TryFormat(span, out _));
+        }
+
+        /// <summary>
+        /// Reads the form TryFormat writes, e.g. from another instance's export.
+        /// </summary>
+        public static bool TryParse(ReadOnlySpan<char> text, out Ja4Fingerprint fingerprint) {
+            fingerprint = default;
+            if (text.Length != Length || text[0] != 't' || text[10] != '_' || text[23] != '_'
+                || !byte.TryParse(text[4..6], NumberStyles.None, null, out byte ciphers)
+                || !byte.TryParse(text[6..8], NumberStyles.None, null, out byte extensions)
+                || !ulong.TryParse(text[11..23], NumberStyles.AllowHexSpecifier, null, out ulong cipherHash)
+                || !ulong.TryParse(text[24..], NumberStyles.AllowHexSpecifier, null, out ulong extensionHash)) {
+                return false;
+            }
+            ushort version = (text[1], text[2]) switch {
+                ('1', '3') => 0x0304,
+                ('1', '2') => 0x0303,
+                ('1', '1') => 0x0302,
+                ('1', '0') => 0x0301,
+                ('s', '3') => 0x0300,
+                _ => 0
+            };
+            fingerprint = new Ja4Fingerprint(version, text[3] == 'd', ciphers, extensions, text[8], text[9],
+                cipherHash, extensionHash);
+            return true;
+        }
+
+        private static void WriteTwoDigits(Span<char> destination, byte value) {
+            destination[0] = (char)('0' + (value / 10));
+            destination[1] = (char)('0' + (value % 10));
+        }
+
+        // 48-bit truncated SHA-256 as 12 lowercase hex digits
+        private static void WriteHash(Span<char> destination, ulong hash) {
+            for (int i = 11; i >= 0; i--) {
+                destination[i] = "0123456789abcdef"[(int)(hash & 0xF)];
+                hash >>= 4;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Parsed hello. Spans point into the record passed to <see cref="TlsParser.TryParse(ReadOnlySpan{byte}, out TlsHello)"/>.
+    /// </summary>
+    public ref struct TlsHello {
+        public TlsHelloKind Kind { get; internal set; }
+        public ushort LegacyVersion { get; internal set; }
+        // Highest offered version for a ClientHello, the negotiated one for a ServerHello
+        public ushort Version { get; internal set; }
+        // Negotiated suite; ServerHello only
+        public ushort CipherSuite { get; internal set; }
+        public bool IsHelloRetryRequest { get; internal set; }
+        public int CipherCount { get; internal set; }
+        public int ExtensionCount { get; internal set; }
+        public ReadOnlySpan<byte> ServerName { get; internal set; }
+        // First offered (client) or selected (server) protocol
+        public ReadOnlySpan<byte> Alpn { get; internal set; }
+        // Raw big-endian suite list; ClientHello only
+        public ReadOnlySpan<byte> CipherSuites { get; internal set; }
+        // Raw extensions block, each entry type(2) length(2) data
+        public ReadOnlySpan<byte> Extensions { get; internal set; }
+        // MD5 of the JA3 string for a ClientHello, of the JA3S string for a ServerHello
+        public UInt128 Ja3 { get; internal set; }
+        public Ja4Fingerprint Ja4 { get; internal set; }
+    }
+
+    public static class TlsParser {
+        private const int HandshakeHeaderLength = 4;
+        private const int RandomLength = 32;
+        private const int StackLimit = 1024;
+
+        private const ushort ExtServerName = 0x0000;
+        private const ushort ExtSupportedGroups = 0x000A;
+        private const ushort ExtPointFormats = 0x000B;
+        private const ushort ExtSignatureAlgorithms = 0x000D;
+        private const ushort ExtAlpn = 0x0010;
+        private const ushort ExtSupportedVersions = 0x002B;
+
+        // SHA-256("HelloRetryRequest"), sent in place of the ServerHello random (RFC 8446 4.1.3)
+        private static ReadOnlySpan<byte> HelloRetryRandom => [
+            0xCF, 0x21, 0xAD, 0x74, 0xE5, 0x9A, 0x61, 0x11, 0xBE, 0x1D, 0x8C, 0x02, 0x1E, 0x65, 0xB8, 0x91,
+            0xC2, 0xA2, 0x11, 0x16, 0x7A, 0xBB, 0x8C, 0x5E, 0x07, 0x9E, 0x09, 0xE2, 0xC8, 0xA8, 0x33, 0x9C
+        ];
+
+        /// <summary>
+        /// Parses a hello from a record that may be split across buffers. Multi-segment input is copied into
+        /// scratch first and the result points into scratch, so it must outlive the result.
+        /// </summary>
+        public static TlsParseStatus TryParse(in ReadOnlySequence<byte> record, Span<byte> scratch, out TlsHello hello) {
+            if (record.IsSingleSegment) {
+                return TryParse(record.FirstSpan, out hello);
+            }
+            if (record.Length > scratch.Length) {
+                hello = default;
+                return TlsParseStatus.Incomplete;
+            }
+            Span<byte> flat = scratch[..(int)record.Length];
+            record.CopyTo(flat);
+            return TryParse(flat, out hello);
+        }
+
+        /// <summary>
+        /// Parses the first handshake message of a TLS record (5-byte record header included).
+        /// </summary>
+        public static TlsParseStatus TryParse(ReadOnlySpan<byte> record, out TlsHello hello) {
+            hello = default;
+            if (record.Length < TlsService.RecordHeaderLength + HandshakeHeaderLength
+                || record[0] != TlsService.ContentHandshake) {
+                return TlsParseStatus.Malformed;
+            }
+            ReadOnlySpan<byte> message = record[TlsService.RecordHeaderLength..];
+            byte type = message[0];
+            if (type is not ((byte)TlsHelloKind.ClientHello or (byte)TlsHelloKind.ServerHello)) {
+                return TlsParseStatus.NotHello;
+            }
+            int length = (message[1] << 16) | (message[2] << 8) | message[3];
+            if (message.Length - HandshakeHeaderLength < length) {
+                return TlsParseStatus.Incomplete;
+            }
+
+            ReadOnlySpan<byte> body = message.Slice(HandshakeHeaderLength, length);
+            return type == (byte)TlsHelloKind.ClientHello
+                ? ParseClientHello(body, out hello)
+                : ParseServerHello(body, out hello);
+        }
+
+        private static TlsParseStatus ParseClientHello(ReadOnlySpan<byte> body, out TlsHello hello) {
+            hello = new TlsHello { Kind = TlsHelloKind.ClientHello };
+            var reader = new Reader(body);
+            if (!reader.TryReadUInt16(out ushort legacyVersion)
+                || !reader.TrySkip(RandomLength)
+                || !reader.TryReadVector8(out _)
+                || !reader.TryReadVector16(out ReadOnlySpan<byte> ciphers)
+                || !reader.TryReadVector8(out _)
+                || (ciphers.Length & 1) != 0) {
+                return TlsParseStatus.Malformed;
+            }
+            hello.LegacyVersion = legacyVersion;
+            hello.Version = legacyVersion;
+            hello.CipherSuites = ciphers;
+
+            ReadOnlySpan<byte> extensions = default;
+            if (!reader.IsEmpty && !reader.TryReadVector16(out extensions)) {
+                return TlsParseStatus.Malformed;
+            }
+            hello.Extensions = extensions;
+
+            // First pass: field extraction and the counts that size the fingerprint buffers
+            ReadOnlySpan<byte> groups = default, pointFormats = default, signatureAlgorithms = default;
+            int extensionCount = 0;
+            var walker = new Reader(extensions);
+            while (!walker.IsEmpty) {
+                if (!walker.TryReadUInt16(out ushort extType) || !walker.TryReadVector16(out ReadOnlySpan<byte> data)) {
+                    return TlsParseStatus.Malformed;
+                }
+                if (IsGrease(extType)) {
+                    continue;
+                }
+                extensionCount++;
+                var ext = new Reader(data);
+                switch (extType) {
+                    case ExtServerName:
+                        // server_name_list: name_type(1) = host_name(0), then a 16-bit length-prefixed name
+                        if (ext.TryReadVector16(out ReadOnlySpan<byte> list) && list.Length > 3 && list[0] == 0) {
+                            var names = new Reader(list[1..]);
+                            if (names.TryReadVector16(out ReadOnlySpan<byte> name)) {
+                                hello.ServerName = name;
+                            }
+                        }
+                        break;
+                    case ExtAlpn:
+                        if (ext.TryReadVector16(out ReadOnlySpan<byte> protocols)) {
+                            var alpn = new Reader(protocols);
+                            if (alpn.TryReadVector8(out ReadOnlySpan<byte> first)) {
+                                hello.Alpn = first;
+                            }
+                        }
+                        break;
+                    case ExtSupportedVersions:
+                        // Supersedes legacy_version when present
+                        if (ext.TryReadVector8(out ReadOnlySpan<byte> versions)) {
+                            ushort highest = 0;
+                            for (int i = 0; i + 1 < versions.Length; i += 2) {
+                                ushort version = BinaryPrimitives.ReadUInt16BigEndian(versions[i..]);
+                                if (!IsGrease(version) && version > highest) {
+                                    highest = version;
+                                }
+                            }
+                            if (highest != 0) {
+                                hello.Version = highest;
+                            }
+                        }
+                        break;
+                    case ExtSupportedGroups:
+                        ext.TryReadVector16(out groups);
+                        break;
+                    case ExtPointFormats:
+                        ext.TryReadVector8(out pointFormats);
+                        break;
+                    case ExtSignatureAlgorithms:
+                        ext.TryReadVector16(out signatureAlgorithms);
+                        break;
+                }
+            }
+
+            int cipherCount = CountNonGrease(ciphers);
+            hello.CipherCount = cipherCount;
+            hello.ExtensionCount = extensionCount;
+            hello.Ja3 = ComputeJa3(legacyVersion, ciphers, extensions, groups, pointFormats);
+
+            (char alpnFirst, char alpnLast) = AlpnChars(hello.Alpn);
+            hello.Ja4 = new Ja4Fingerprint(hello.Version, !hello.ServerName.IsEmpty,
+                (byte)Math.Min(cipherCount, 99), (byte)Math.Min(extensionCount, 99), alpnFirst, alpnLast,
+                HashSortedCiphers(ciphers, cipherCount),
+                HashSortedExtensions(extensions, extensionCount, signatureAlgorithms));
+            return TlsParseStatus.Ok;
+        }
+
+        private static TlsParseStatus ParseServerHello(ReadOnlySpan<byte> body, out TlsHello hello) {
+            hello = new TlsHello { Kind = TlsHelloKind.ServerHello };
+            var reader = new Reader(body);
+            if (!reader.TryReadUInt16(out ushort legacyVersion)
+                || !reader.TryRead(RandomLength, out ReadOnlySpan<byte> random)
+                || !reader.TryReadVector8(out _)
+                || !reader.TryReadUInt16(out ushort cipher)
+                || !reader.TrySkip(1)) {
+                return TlsParseStatus.Malformed;
+            }
+            hello.LegacyVersion = legacyVersion;
+            hello.Version = legacyVersion;
+            hello.CipherSuite = cipher;
+            hello.CipherCount = 1;
+            hello.IsHelloRetryRequest = random.SequenceEqual(HelloRetryRandom);
+
+            ReadOnlySpan<byte> extensions = default;
+            if (!reader.IsEmpty && !reader.TryReadVector16(out extensions)) {
+                return TlsParseStatus.Malformed;
+            }
+            hello.Extensions = extensions;
+
+            int extensionCount = 0;
+            var walker = new Reader(extensions);
+            while (!walker.IsEmpty) {
+                if (!walker.TryReadUInt16(out ushort extType) || !walker.TryReadVector16(out ReadOnlySpan<byte> data)) {
+                    return TlsParseStatus.Malformed;
+                }
+                extensionCount++;
+                var ext = new Reader(data);
+                switch (extType) {
+                    case ExtSupportedVersions:
+                        if (ext.TryReadUInt16(out ushort selected)) {
+                            hello.Version = selected;
+                        }
+                        break;
+                    case ExtAlpn:
+                        if (ext.TryReadVector16(out ReadOnlySpan<byte> protocols)) {
+                            var alpn = new Reader(protocols);
+                            if (alpn.TryReadVector8(out ReadOnlySpan<byte> chosen)) {
+                                hello.Alpn = chosen;
+                            }
+                        }
+                        break;
+                }
+            }
+            hello.ExtensionCount = extensionCount;
+            hello.Ja3 = ComputeJa3S(legacyVersion, cipher, extensions, extensionCount);
+            return TlsParseStatus.Ok;
+        }
+
+        // JA3: "version,ciphers,extensions,groups,point formats" in decimal, GREASE removed, MD5
+        private static UInt128 ComputeJa3(ushort version, ReadOnlySpan<byte> ciphers, ReadOnlySpan<byte> extensions,
+            ReadOnlySpan<byte> groups, ReadOnlySpan<byte> pointFormats) {
+            // Every value prints as at most five digits plus a separator
+            int bound = 6 * (1 + (ciphers.Length / 2) + (extensions.Length / 4) + (groups.Length / 2) + pointFormats.Length) + 8;
+            byte[]? rented = null;
+            Span<byte> buffer = bound <= StackLimit
+                ? stackalloc byte[StackLimit]
+                : (rented = ArrayPool<byte>.Shared.Rent(bound));
+            try {
+                var text = new AsciiWriter(buffer);
+                text.WriteDecimal(version);
+                text.Write(',');
+                WriteUInt16List(ref text, ciphers, 2);
+                text.Write(',');
+                WriteExtensionTypes(ref text, extensions);
+                text.Write(',');
+                WriteUInt16List(ref text, groups, 2);
+                text.Write(',');
+                WriteUInt16List(ref text, pointFormats, 1);
+                return Md5(text.Written);
+            } finally {
+                if (rented != null) {
+                    ArrayPool<byte>.Shared.Return(rented);
+                }
+            }
+        }
+
+        // JA3S: "version,cipher,extensions" in decimal, MD5
+        private static UInt128 ComputeJa3S(ushort version, ushort cipher, ReadOnlySpan<byte> extensions, int extensionCount) {
+            int bound = 6 * (2 + extensionCount) + 8;
+            byte[]? rented = null;
+            Span<byte> buffer = bound <= StackLimit
+                ? stackalloc byte[StackLimit]
+                : (rented = ArrayPool<byte>.Shared.Rent(bound));
+            try {
+                var text = new AsciiWriter(buffer);
+                text.WriteDecimal(version);
+                text.Write(',');
+                text.WriteDecimal(cipher);
+                text.Write(',');
+                WriteExtensionTypes(ref text, extensions);
+                return Md5(text.Written);
+            } finally {
+                if (rented != null) {
+                    ArrayPool<byte>.Shared.Return(rented);
+                }
+            }
+        }
+
+        private static void WriteUInt16List(ref AsciiWriter text, ReadOnlySpan<byte> values, int width) {
+            bool first = true;
+            for (int i = 0; i + width <= values.Length; i += width) {
+                ushort value = width == 2 ? BinaryPrimitives.ReadUInt16BigEndian(values[i..]) : values[i];
+                if (width == 2 && IsGrease(value)) {
+                    continue;
+                }
+                if (!first) {
+                    text.Write('-');
+                }
+                text.WriteDecimal(value);
+                first = false;
+            }
+        }
+
+        private static void WriteExtensionTypes(ref AsciiWriter text, ReadOnlySpan<byte> extensions) {
+            bool first = true;
+            var walker = new Reader(extensions);
+            while (walker.TryReadUInt16(out ushort extType) && walker.TryReadVector16(out _)) {
+                if (IsGrease(extType)) {
+                    continue;
+                }
+                if (!first) {
+                    text.Write('-');
+                }
+                text.WriteDecimal(extType);
+                first = false;
+            }
+        }
+
+        // JA4 part b: sorted suites as 4-digit hex, comma separated, truncated SHA-256
+        private static ulong HashSortedCiphers(ReadOnlySpan<byte> ciphers, int count) {
+            if (count == 0) {
+                return 0;
+            }
+            ushort[]? rentedValues = null;
+            Span<ushort> values = count <= StackLimit / 4
+                ? stackalloc ushort[count]
+                : (rentedValues = ArrayPool<ushort>.Shared.Rent(count)).AsSpan(0, count);
+            try {
+                int n = 0;
+                for (int i = 0; i + 1 < ciphers.Length; i += 2) {
+                    ushort value = BinaryPrimitives.ReadUInt16BigEndian(ciphers[i..]);
+                    if (!IsGrease(value)) {
+                        values[n++] = value;
+                    }
+                }
+                values.Sort();
+                return HashHexList(values, default);
+            } finally {
+                if (rentedValues != null) {
+                    ArrayPool<ushort>.Shared.Return(rentedValues);
+                }
+            }
+        }
+
+        // JA4 part c: sorted extension types without SNI and ALPN, then "_" and signature algorithms in offered order
+        private static ulong HashSortedExtensions(ReadOnlySpan<byte> extensions, int count,
+            ReadOnlySpan<byte> signatureAlgorithms) {
+            if (count == 0) {
+                return 0;
+            }
+            ushort[]? rentedValues = null;
+            Span<ushort> values = count <= StackLimit / 4
+                ? stackalloc ushort[count]
+                : (rentedValues = ArrayPool<ushort>.Shared.Rent(count)).AsSpan(0, count);
+            try {
+                int n = 0;
+                var walker = new Reader(extensions);
+                while (walker.TryReadUInt16(out ushort extType) && walker.TryReadVector16(out _)) {
+                    if (!IsGrease(extType) && extType != ExtServerName && extType != ExtAlpn) {
+                        values[n++] = extType;
+                    }
+                }
+                Span<ushort> sorted = values[..n];
+                sorted.Sort();
+                return HashHexList(sorted, signatureAlgorithms);
+            } finally {
+                if (rentedValues != null) {
+                    ArrayPool<ushort>.Shared.Return(rentedValues);
+                }
+            }
+        }
+
+        private static ulong HashHexList(ReadOnlySpan<ushort> values, ReadOnlySpan<byte> suffix) {
+            int bound = (5 * values.Length) + 1 + (5 * (suffix.Length / 2));
+            byte[]? rented = null;
+            Span<byte> buffer = bound <= StackLimit
+                ? stackalloc byte[StackLimit]
+                : (rented = ArrayPool<byte>.Shared.Rent(bound));
+            try {
+                var text = new AsciiWriter(buffer);
+                for (int i = 0; i < values.Length; i++) {
+                    if (i > 0) {
+                        text.Write(',');
+                    }
+                    text.WriteHex4(values[i]);
+                }
+                if (suffix.Length >= 2) {
+                    text.Write('_');
+                    for (int i = 0; i + 1 < suffix.Length; i += 2) {
+                        if (i > 0) {
+                            text.Write(',');
+                        }
+                        text.WriteHex4(BinaryPrimitives.ReadUInt16BigEndian(suffix[i..]));
+                    }
+                }
+                Span<byte> hash = stackalloc byte[SHA256.HashSizeInBytes];
+                SHA256.HashData(text.Written, hash);
+                return (ulong)BinaryPrimitives.ReadUInt64BigEndian(hash) >> 16;
+            } finally {
+                if (rented != null) {
+                    ArrayPool<byte>.Shared.Return(rented);
+                }
+            }
+        }
+
+        private static UInt128 Md5(ReadOnlySpan<byte> text) {
+            Span<byte> hash = stackalloc byte[MD5.HashSizeInBytes];
+            MD5.HashData(text, hash);
+            return BinaryPrimitives.ReadUInt128BigEndian(hash);
+        }
+
+        // First and last character of the first ALPN value; non-alphanumeric values fall back to hex
+        private static (char, char) AlpnChars(ReadOnlySpan<byte> alpn) {
+            if (alpn.IsEmpty) {
+                return ('0', '0');
+            }
+            byte first = alpn[0];
+            byte last = alpn[^1];
+            if (char.IsAsciiLetterOrDigit((char)first) && char.IsAsciiLetterOrDigit((char)last)) {
+                return ((char)first, (char)last);
+            }
+            return ("0123456789abcdef"[first >> 4], "0123456789abcdef"[last & 0xF]);
+        }
+
+        private static int CountNonGrease(ReadOnlySpan<byte> values) {
+            int count = 0;
+            for (int i = 0; i + 1 < values.Length; i += 2) {
+                if (!IsGrease(BinaryPrimitives.ReadUInt16BigEndian(values[i..]))) {
+                    count++;
+                }
+            }
+            return count;
+        }
+
+        // RFC 8701 reserved values 0x0A0A, 0x1A1A, ... 0xFAFA
+        private static bool IsGrease(ushort value) {
+            return (value & 0x0F0F) == 0x0A0A && (value >> 8) == (value & 0xFF);
+        }
+
+        private ref struct Reader {
+            private ReadOnlySpan<byte> _data;
+
+            public Reader(ReadOnlySpan<byte> data) {
+                _data = data;
+            }
+
+            public readonly bool IsEmpty => _data.IsEmpty;
+
+            public bool TryRead(int count, out ReadOnlySpan<byte> value) {
+                if (_data.Length < count) {
+                    value = default;
+                    return false;
+                }
+                value = _data[..count];
+                _data = _data[count..];
+                return true;
+            }
+
+            public bool TrySkip(int count) {
+                return TryRead(count, out _);
+            }
+
+            public bool TryReadUInt16(out ushort value) {
+                if (!TryRead(2, out ReadOnlySpan<byte> bytes)) {
+                    value = 0;
+                    return false;
+                }
+                value = BinaryPrimitives.ReadUInt16BigEndian(bytes);
+                return true;
+            }
+
+            public bool TryReadVector8(out ReadOnlySpan<byte> value) {
+                if (_data.IsEmpty) {
+                    value = default;
+                    return false;
+                }
+                int length = _data[0];
+                _data = _data[1..];
+                return TryRead(length, out value);
+            }
+
+            public bool TryReadVector16(out ReadOnlySpan<byte> value) {
+                if (!TryReadUInt16(out ushort length)) {
+                    value = default;
+                    return false;
+                }
+                return TryRead(length, out value);
+            }
+        }
+
+        private ref struct AsciiWriter {
+            private readonly Span<byte> _buffer;
+            private int _length;
+
+            public AsciiWriter(Span<byte> buffer) {
+                _buffer = buffer;
+                _length = 0;
+            }
+
+            public readonly ReadOnlySpan<byte> Written => _buffer[.._length];
+
+            public void Write(char c) {
+                _buffer[_length++] = (byte)c;
+            }
+
+            public void WriteDecimal(ushort value) {
+                value.TryFormat(_buffer[_length..], out int written);
+                _length += written;
+            }
+
+            public void WriteHex4(ushort value) {
+                value.TryFormat(_buffer[_length..], out int written, "x4");
+                _length += written;
+            }
+        }
+    }
+}
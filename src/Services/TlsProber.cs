@@ -0,0 +1,341 @@
+// Active TLS probing for devices passive capture has no handshakes for: SslStream handshakes to a few ports
+// under a global concurrency cap, a per-host limit and short timeouts. Certificates are interned by thumbprint,
+// and an endpoint whose certificate did not change is probed again only after the long recheck interval
+
+using System.Collections.Concurrent;
+using System.Diagnostics;
+using System.Net;
+using System.Net.Security;
+using System.Net.Sockets;
+using System.Security.Authentication;
+using System.Security.Cryptography;
+using System.Security.Cryptography.X509Certificates;
+
+using TLScope.src.Data;
+using TLScope.src.Debugging;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Services {
+    public sealed class TlsProber {
+        private readonly record struct Endpoint(uint IP, ushort Port);
+
+        private sealed class EndpointState {
+            public int Certificate; // interned leaf and chain; 0 until a handshake succeeded
+            public int Chain;
+            public SslProtocols Protocol;
+            public TlsCipherSuite CipherSuite;
+            public long NextProbeTicks;
+            public ushort LocalPort; // of the last successful probe, for the graph edge
+            public uint LocalIP;
+
+            public void ReleaseInterned() {
+                Interned.Certificates.Release(Certificate);
+                Interned.Chains.Release(Chain);
+                Certificate = Chain = 0;
+            }
+        }
+
+        private readonly DeviceStore _devices;
+        private readonly Action<List<FlowDelta>> _connected;
+        private readonly SemaphoreSlim _slots = new(Settings.TlsProbeConcurrency);
+        private readonly object _lock = new();
+        private readonly Dictionary<Endpoint, EndpointState> _endpoints = [];
+        private readonly ConcurrentDictionary<Endpoint, long> _passive = new(); // last ServerHello captured
+        private readonly ConcurrentDictionary<FlowKey, long> _own = new(); // recent probe connections, canonical
+
+        /// <param name="devices">Devices to probe.</param>
+        /// <param name="connected">Receives each cycle's results: an opened session per successful handshake, and
+        /// a refresh for endpoints whose certificate is cached, so their edges stay in the graph.</param>
+        public TlsProber(DeviceStore devices, Action<List<FlowDelta>> connected) {
+            _devices = devices;
+            _connected = connected;
+        }
+
+        /// <summary>
+        /// Distinct certificates currently presented by probed endpoints.
+        /// </summary>
+        public IReadOnlyList<TlsCertificateInfo> Certificates {
+            get {
+                var certificates = new List<TlsCertificateInfo>();
+                lock (_lock) {
+                    foreach (int id in _endpoints.Values.Select(state => state.Certificate).Distinct()) {
+                        if (Interned.Certificates.TryGet(id, out TlsCertificateInfo? info)) {
+                            certificates.Add(info);
+                        }
+                    }
+                }
+                return certificates;
+            }
+        }
+
+        /// <summary>
+        /// Whether the connection, in either direction, is one of the prober's own. Capture leaves these out: the
+        /// prober reports its sessions itself, so capturing them too would count each one twice. Thread-safe.
+        /// </summary>
+        public bool IsOwnConnection(in FlowKey flow) {
+            return _own.TryGetValue(FlowTable.Canonical(flow, out _), out long until) && until > DateTime.UtcNow.Ticks;
+        }
+
+        /// <summary>
+        /// Tells the prober a ServerHello was captured passively, so the endpoint needs no active probe.
+        /// Handshakes of the prober's own connections are ignored. Safe to call from capture workers.
+        /// </summary>
+        public void ObserveServerHello(in FlowKey flow, long timestampTicks) {
+            // flow runs server to client; only IPv4 devices are probed
+            if (flow.SourceAddress >> 32 != 0xFFFF || IsOwnConnection(flow)) {
+                return;
+            }
+            _passive[new Endpoint((uint)flow.SourceAddress, flow.SourcePort)] = timestampTicks;
+        }
+
+        public async Task RunAsync(CancellationToken cancellationToken) {
+            if (Settings.TlsProbePorts.Count == 0) {
+                return;
+            }
+            Logging.Write($"Active TLS probing on port(s) {string.Join(", ", Settings.TlsProbePorts)}, "
+                + $"{Settings.TlsProbeConcurrency} at a time.");
+            var hosts = new List<uint>();
+            try {
+                while (!cancellationToken.IsCancellationRequested) {
+                    hosts.Clear();
+                    _devices.CopyIPs(hosts);
+                    await ProbeCycleAsync(hosts, cancellationToken);
+                    await Task.Delay(Settings.TlsProbeInterval, cancellationToken);
+                }
+            } catch (OperationCanceledException) {
+                // shutting down
+            } finally {
+                Logging.Write("Active TLS probing stopped.");
+            }
+        }
+
+        // Forgets endpoints of devices that have left the store, releasing their certificates, and passive sightings
+        // that are too old to matter or belong to hosts that are not devices (capture reports every server)
+        private void Prune(List<uint> hosts, long passiveSince) {
+            var current = new HashSet<uint>(hosts);
+            int removed = 0;
+            lock (_lock) {
+                foreach (var (endpoint, state) in _endpoints) {
+                    if (!current.Contains(endpoint.IP)) {
+                        state.ReleaseInterned();
+                        _endpoints.Remove(endpoint);
+                        removed++;
+                    }
+                }
+            }
+            foreach (var (endpoint, seen) in _passive) {
+                if (seen < passiveSince || !current.Contains(endpoint.IP)) {
+                    _passive.TryRemove(KeyValuePair.Create(endpoint, seen)); // unless a capture worker just refreshed it
+                }
+            }
+            if (removed > 0) {
+                Logging.Write($"Dropped probe state for {removed} endpoint(s) of departed devices.");
+            }
+        }
+
+        private async Task ProbeCycleAsync(List<uint> hosts, CancellationToken cancellationToken) {
+            long started = Stopwatch.GetTimestamp();
+            long now = DateTime.UtcNow.Ticks;
+            long passiveSince = now - Settings.TlsProbeRecheckInterval.Ticks;
+            foreach (var (flow, until) in _own) {
+                if (until <= now) {
+                    _own.TryRemove(flow, out _);
+                }
+            }
+            Prune(hosts, passiveSince);
+
+            var due = new Dictionary<uint, List<ushort>>();
+            var results = new List<FlowDelta>();
+            int cached = 0, passive = 0;
+            lock (_lock) {
+                foreach (uint ip in hosts) {
+                    foreach (ushort port in Settings.TlsProbePorts) {
+                        var endpoint = new Endpoint(ip, port);
+                        if (_passive.TryGetValue(endpoint, out long seen) && seen >= passiveSince) {
+                            passive++;
+                            continue;
+                        }
+                        if (_endpoints.TryGetValue(endpoint, out EndpointState? state) && state.NextProbeTicks > now) {
+                            if (state.Certificate != 0) {
+                                cached++;
+                                results.Add(new FlowDelta(Flow(state, endpoint), false, 0, now,
+                                    Certificate: Interned.Certificates.AddRef(state.Certificate)));
+                            }
+                            continue;
+                        }
+                        if (!due.TryGetValue(ip, out List<ushort>? ports)) {
+                            due[ip] = ports = [];
+                        }
+                        ports.Add(port);
+                    }
+                }
+            }
+
+            // Hosts run in parallel under the global cap; each host gets at most TlsProbePerHost connections at once
+            var tasks = new List<Task<int>>(due.Count);
+            foreach (var (ip, ports) in due) {
+                tasks.Add(ProbeHostAsync(ip, ports, results, cancellationToken));
+            }
+            int handshakes = (await Task.WhenAll(tasks)).Sum();
+            if (results.Count > 0) {
+                _connected(results);
+            }
+            if (tasks.Count > 0) {
+                Logging.Write($"TLS probe cycle: {due.Values.Sum(ports => ports.Count)} endpoint(s) on {due.Count} host(s) "
+                    + $"in {Telemetry.ElapsedMilliseconds(started):F0} ms, {handshakes} handshake(s); "
+                    + $"{cached} skipped with an unchanged certificate, {passive} seen passively.");
+            }
+        }
+
+        private async Task<int> ProbeHostAsync(uint ip, List<ushort> ports, List<FlowDelta> results,
+            CancellationToken cancellationToken) {
+            int handshakes = 0;
+            using var perHost = new SemaphoreSlim(Settings.TlsProbePerHost);
+            await Task.WhenAll(ports.Select(async port => {
+                await perHost.WaitAsync(cancellationToken);
+                try {
+                    await _slots.WaitAsync(cancellationToken);
+                    try {
+                        if (await ProbeAsync(new Endpoint(ip, port), results, cancellationToken)) {
+                            Interlocked.Increment(ref handshakes);
+                        }
+                    } finally {
+                        _slots.Release();
+                    }
+                } finally {
+                    perHost.Release();
+                }
+            }));
+            return handshakes;
+        }
+
+        // Adds the opened session to results (under the lock) when the handshake succeeds
+        private async Task<bool> ProbeAsync(Endpoint endpoint, List<FlowDelta> results, CancellationToken cancellationToken) {
+            var target = new IPEndPoint(NetData.FromUInt32(endpoint.IP), endpoint.Port);
+            using var socket = new Socket(AddressFamily.InterNetwork, SocketType.Stream, ProtocolType.Tcp) { NoDelay = true };
+            using var timeout = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
+            string result;
+            int certificate = 0, chain = 0; // references taken in the validation callback
+            SslProtocols protocol = SslProtocols.None;
+            TlsCipherSuite cipher = default;
+            ushort localPort = 0;
+            uint localIP = 0;
+            double handshakeMs = 0;
+            try {
+                timeout.CancelAfter(Settings.TlsProbeConnectTimeout);
+                await socket.ConnectAsync(target, timeout.Token);
+                var local = (IPEndPoint)socket.LocalEndPoint!;
+                localPort = (ushort)local.Port;
+                localIP = NetData.ToUInt32(local.Address);
+                // Registered before the ClientHello goes out, so capture never starts tracking the connection
+                _own[FlowTable.Canonical(new FlowKey(FlowKey.MapIPv4(localIP), FlowKey.MapIPv4(endpoint.IP), localPort,
+                    endpoint.Port), out _)] = DateTime.UtcNow.Ticks + Settings.TlsProbeHandshakeTimeout.Ticks
+                    + TimeSpan.TicksPerSecond * 5;
+
+                timeout.CancelAfter(Settings.TlsProbeHandshakeTimeout);
+                await using var tls = new SslStream(new NetworkStream(socket, ownsSocket: false));
+                var options = new SslClientAuthenticationOptions {
+                    TargetHost = target.Address.ToString(),
+                    // Observing, not trusting: every certificate is accepted and recorded
+                    RemoteCertificateValidationCallback = (_, cert, presented, _) => {
+                        if (cert != null && certificate == 0) {
+                            (certificate, chain) = Intern(cert, presented);
+                        }
+                        return true;
+                    },
+                    CertificateRevocationCheckMode = X509RevocationMode.NoCheck
+                };
+                long handshakeStarted = Stopwatch.GetTimestamp();
+                await tls.AuthenticateAsClientAsync(options, timeout.Token);
+                handshakeMs = Telemetry.ElapsedMilliseconds(handshakeStarted);
+                protocol = tls.SslProtocol;
+                cipher = tls.NegotiatedCipherSuite;
+                result = "handshake";
+            } catch (OperationCanceledException) when (!cancellationToken.IsCancellationRequested) {
+                result = "timeout";
+            } catch (SocketException ex) when (ex.SocketErrorCode == SocketError.ConnectionRefused) {
+                result = "refused";
+            } catch (Exception ex) when (ex is SocketException or IOException or AuthenticationException) {
+                result = "failed"; // not TLS, or no protocol in common
+            }
+
+            Telemetry.TlsProbes.Add(1, new KeyValuePair<string, object?>("result", result));
+            long now = DateTime.UtcNow.Ticks;
+            if (result != "handshake" || certificate == 0) {
+                Interned.Certificates.Release(certificate);
+                Interned.Chains.Release(chain);
+                lock (_lock) {
+                    EndpointState failed = StateOf(endpoint);
+                    failed.ReleaseInterned();
+                    failed.NextProbeTicks = now + Settings.TlsProbeHostInterval.Ticks;
+                }
+                return false;
+            }
+
+            Telemetry.TlsHandshakeDuration.Record(handshakeMs);
+            bool changed;
+            lock (_lock) {
+                EndpointState state = StateOf(endpoint);
+                changed = state.Certificate != certificate;
+                if (changed) {
+                    state.ReleaseInterned();
+                    state.Certificate = certificate;
+                    state.Chain = chain;
+                } else {
+                    Interned.Certificates.Release(certificate); // the state holds these already
+                    Interned.Chains.Release(chain);
+                }
+                state.Protocol = protocol;
+                state.CipherSuite = cipher;
+                state.LocalIP = localIP;
+                state.LocalPort = localPort;
+                // An unchanged certificate is left alone for the long interval; a new one is checked again soon
+                state.NextProbeTicks = now + (changed ? Settings.TlsProbeHostInterval : Settings.TlsProbeRecheckInterval).Ticks;
+                results.Add(new FlowDelta(Flow(state, endpoint), true, 0, now,
+                    Certificate: Interned.Certificates.AddRef(certificate)));
+            }
+            if (changed) {
+                NetworkService.SetDeviceCertificate(_devices, endpoint.IP, certificate);
+                if (Interned.Certificates.TryGet(certificate, out TlsCertificateInfo? info)) {
+                    Logging.Write(LogLevel.Debug, $"TLS {target}: {protocol} {cipher}, certificate {info.Subject} "
+                        + $"({info.Thumbprint[..16]}), handshake {handshakeMs:F1} ms");
+                }
+            }
+            return true;
+        }
+
+        // Parses each certificate only the first time its thumbprint shows up anywhere on the network
+        private static (int Certificate, int Chain) Intern(X509Certificate leaf, X509Chain? presented) {
+            string thumbprint = leaf.GetCertHashString(HashAlgorithmName.SHA256);
+            int certificate = Interned.Certificates.Acquire(thumbprint, key => Describe(key, leaf));
+
+            var elements = new List<(string Thumbprint, X509Certificate Certificate)>();
+            foreach (X509ChainElement element in presented?.ChainElements ?? (IEnumerable<X509ChainElement>)[]) {
+                elements.Add((element.Certificate.GetCertHashString(HashAlgorithmName.SHA256), element.Certificate));
+            }
+            if (elements.Count == 0) {
+                elements.Add((thumbprint, leaf));
+            }
+            int chain = Interned.Chains.Acquire(string.Join(',', elements.Select(e => e.Thumbprint)),
+                _ => elements.Select(e => Interned.Certificates.Acquire(e.Thumbprint, key => Describe(key, e.Certificate))).ToArray());
+            return (certificate, chain);
+        }
+
+        private static TlsCertificateInfo Describe(string thumbprint, X509Certificate certificate) {
+            DateTime notAfter = certificate is X509Certificate2 parsed ? parsed.NotAfter.ToUniversalTime() : DateTime.MinValue;
+            return new TlsCertificateInfo(thumbprint, certificate.Subject, certificate.Issuer, notAfter, DateTime.UtcNow.Ticks);
+        }
+
+        // Callers hold the lock
+        private EndpointState StateOf(Endpoint endpoint) {
+            if (!_endpoints.TryGetValue(endpoint, out EndpointState? state)) {
+                _endpoints[endpoint] = state = new EndpointState();
+            }
+            return state;
+        }
+
+        private static FlowKey Flow(EndpointState state, Endpoint endpoint) {
+            return new FlowKey(FlowKey.MapIPv4(state.LocalIP), FlowKey.MapIPv4(endpoint.IP), state.LocalPort, endpoint.Port);
+        }
+    }
+}
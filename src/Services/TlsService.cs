@@ -0,0 +1,452 @@
+// Passive TLS capture: frames come off a TPACKET_V3 ring (or a replayed capture file), TCP segments are partitioned
+// by connection onto worker threads, and each worker parses handshake records in place into its shard of the flow table
+
+using System.Diagnostics;
+using System.Net.NetworkInformation;
+using System.Threading.Channels;
+using TLScope.src.Data;
+using TLScope.src.Utilities;
+using TLScope.src.Debugging;
+
+namespace TLScope.src.Services {
+    /// <summary>
+    /// Receives each parsed hello on a capture worker thread, with the flow in the direction the hello was sent.
+    /// The hello's spans are only valid for the duration of the call.
+    /// </summary>
+    public delegate void TlsHelloHandler(in FlowKey flow, long timestampTicks, in TlsHello hello);
+
+    public sealed class TlsService : IDisposable {
+        internal const byte ContentChangeCipherSpec = 20;
+        internal const byte ContentHandshake = 22;
+        internal const byte ContentApplicationData = 23;
+        internal const int RecordHeaderLength = 5;
+        private const int MaxRecordLength = (1 << 14) + 2048; // TLSCiphertext limit
+        private const int MaxBuffered = 4 * MaxRecordLength;
+
+        private readonly IPacketSource _source;
+        private readonly TlsHelloHandler? _handler;
+        private readonly Func<FlowKey, bool>? _excluded;
+        private readonly OsFingerprinter? _fingerprinter;
+        private readonly CaptureWorker[] _workers;
+        private readonly int[] _blockRefs; // dispatcher + queued segments per block; 0 = owned by the kernel
+        private readonly Func<int, bool> _isHeld;
+        // Dispatcher only: connections whose first TLS record was queued, by canonical key, with their latest
+        // segment's capture time. Registered before queueing, so a continuation never overtakes its registration
+        private readonly Dictionary<FlowKey, long> _tracked = [];
+        private long _trackedClock;
+
+        private long _packets;
+        private long _drops;
+        private long _queueDrops;
+        private long _reportedQueueDrops;
+        private long _records;
+        private long _segments;
+        private long _dispatchTicks; // Stopwatch ticks spent decoding and queueing, excluding waits for blocks
+
+        public long PacketsCaptured => Interlocked.Read(ref _packets);
+        public long PacketsDropped => Interlocked.Read(ref _drops);
+
+        /// <summary>
+        /// Segments a live capture dropped because their worker's queue was full.
+        /// </summary>
+        public long SegmentsDropped => Interlocked.Read(ref _queueDrops);
+        public long HandshakeRecords => Interlocked.Read(ref _records);
+        public long SegmentsDispatched => Interlocked.Read(ref _segments);
+
+        /// <summary>
+        /// Time spent per pipeline stage: the dispatcher decoding frames, the workers handling segments (flow
+        /// table and reassembly, parsing included), and the parser alone. Worker times add up across threads.
+        /// </summary>
+        public TimeSpan DispatchTime => Stopwatch.GetElapsedTime(0, Interlocked.Read(ref _dispatchTicks));
+        public TimeSpan WorkerTime => Stopwatch.GetElapsedTime(0, _workers.Sum(worker => worker.HandleTicks));
+        public TimeSpan ParseTime => Stopwatch.GetElapsedTime(0, _workers.Sum(worker => worker.ParseTicks));
+
+        /// <summary>
+        /// Connection state, one shard per worker. Feed the graph from it with <see cref="FlowTable.Collect"/>.
+        /// </summary>
+        public FlowTable Flows { get; }
+
+        private TlsService(IPacketSource source, TlsHelloHandler? handler, OsFingerprinter? fingerprinter, int workers,
+            Func<FlowKey, bool>? excluded = null) {
+            _source = source;
+            _handler = handler;
+            _excluded = excluded;
+            _fingerprinter = fingerprinter;
+            _blockRefs = new int[source.BlockCount];
+            _isHeld = block => Volatile.Read(ref _blockRefs[block]) != 0;
+            Flows = FlowTable.FromSettings(workers);
+            _workers = new CaptureWorker[workers];
+            for (int i = 0; i < workers; i++) {
+                _workers[i] = new CaptureWorker(this, Flows[i]);
+            }
+        }
+
+        /// <summary>
+        /// Maps a capture ring on the interface, or returns null when packet capture is unavailable. The
+        /// fingerprinter, if given, sees every TCP segment on the dispatcher thread. Connections excluded returns
+        /// true for (this host's own probes) are never tracked; it runs on the dispatcher thread too.
+        /// </summary>
+        public static TlsService? TryCreate(NetworkInterface networkInterface, TlsHelloHandler? handler = null,
+            OsFingerprinter? fingerprinter = null, Func<FlowKey, bool>? excluded = null) {
+            PacketRing? ring = PacketRing.TryOpen(networkInterface.Name, Settings.CaptureBlockSizeKB * 1024,
+                Settings.CaptureBlockCount, Settings.CaptureBlockTimeoutMs);
+            if (ring == null) {
+                return null;
+            }
+            var service = new TlsService(ring, handler, fingerprinter, Settings.CaptureWorkers, excluded);
+            Logging.Write($"Capturing on {networkInterface.Name}: {ring.BlockCount} x {ring.BlockSize / 1024} KiB ring, "
+                + $"{Settings.CaptureWorkers} worker(s), room for {service.Flows.Capacity} flows.");
+            return service;
+        }
+
+        /// <summary>
+        /// Feeds a capture file through the same dispatcher and workers as live capture. RunAsync returns once the
+        /// file is exhausted and every segment has been handled. The service owns the file from here on.
+        /// </summary>
+        internal static TlsService FromCapture(CaptureFile capture, TlsHelloHandler? handler = null,
+            OsFingerprinter? fingerprinter = null) {
+            var service = new TlsService(capture, handler, fingerprinter, Settings.CaptureWorkers);
+            Logging.Write($"Replaying {capture.Format} ({capture.Length / 1024} KiB) through {Settings.CaptureWorkers} "
+                + $"worker(s), room for {service.Flows.Capacity} flows.");
+            return service;
+        }
+
+        /// <summary>
+        /// Captures until cancelled, or until a replayed file is exhausted. Handlers run on the worker threads, one connection always on the same worker.
+        /// </summary>
+        public async Task RunAsync(CancellationToken cancellationToken = default) {
+            var workers = new Task[_workers.Length];
+            for (int i = 0; i < _workers.Length; i++) {
+                workers[i] = _workers[i].RunAsync();
+            }
+
+            try {
+                await Task.Factory.StartNew(() => Dispatch(cancellationToken), CancellationToken.None,
+                    TaskCreationOptions.LongRunning, TaskScheduler.Default);
+            } finally {
+                foreach (var worker in _workers) {
+                    worker.Complete();
+                }
+                await Task.WhenAll(workers);
+                LogStatistics();
+                Logging.Write("TLS capture stopped.");
+            }
+        }
+
+        // Single reader of the source: decodes headers in place and queues segment descriptors to the owning worker
+        private void Dispatch(CancellationToken cancellationToken) {
+            var frames = new List<RingFrame>(512);
+            long nextStatistics = System.Environment.TickCount64 + 30_000;
+
+            while (!cancellationToken.IsCancellationRequested) {
+                if (System.Environment.TickCount64 >= nextStatistics) {
+                    LogStatistics();
+                    ExpireTracked();
+                    nextStatistics = System.Environment.TickCount64 + 30_000;
+                }
+                if (!_source.TryTake(100, _isHeld, out int block)) {
+                    if (_source.Completed) {
+                        break;
+                    }
+                    continue;
+                }
+
+                long started = Stopwatch.GetTimestamp();
+                Volatile.Write(ref _blockRefs[block], 1);
+                ReadOnlySpan<byte> data = _source.GetBlock(block);
+                frames.Clear();
+                _source.ReadFrames(block, frames);
+
+                foreach (RingFrame frame in frames) {
+                    ReadOnlySpan<byte> bytes = data.Slice(frame.Offset, frame.Length);
+                    if (!PacketDecoder.TryDecodeTcp(bytes, out TcpSegment segment)) {
+                        continue;
+                    }
+                    _fingerprinter?.Observe(bytes, segment);
+                    // Bare ACKs and SYNs carry nothing a worker needs
+                    if (segment.PayloadLength == 0 && (segment.Flags & (TcpFlags.Fin | TcpFlags.Rst)) == 0) {
+                        continue;
+                    }
+                    if (!Track(segment, bytes.Slice(segment.PayloadOffset, segment.PayloadLength), frame.TimestampTicks)) {
+                        continue;
+                    }
+                    Interlocked.Increment(ref _blockRefs[block]);
+                    _workers[Flows.ShardOf(segment.Flow)]
+                        .Post(new CapturedSegment(block, frame.Offset, segment, frame.TimestampTicks));
+                    _segments++;
+                }
+                ReleaseBlock(block);
+                _dispatchTicks += Stopwatch.GetTimestamp() - started;
+            }
+        }
+
+        // Bulk traffic stays on the dispatcher: only segments of tracked connections, and those that could start one,
+        // reach a worker. A connection starts with a plaintext record other than application data, the same rule
+        // the worker applies before giving it a flow table slot
+        private bool Track(in TcpSegment segment, ReadOnlySpan<byte> payload, long timestampTicks) {
+            FlowKey key = FlowTable.Canonical(segment.Flow, out _);
+            _trackedClock = Math.Max(_trackedClock, timestampTicks);
+            if (_tracked.ContainsKey(key)) {
+                if ((segment.Flags & TcpFlags.Rst) != 0) {
+                    _tracked.Remove(key);
+                } else {
+                    _tracked[key] = timestampTicks;
+                }
+                return true;
+            }
+            if (!LooksLikeRecord(payload) || payload[0] == ContentApplicationData
+                || _excluded?.Invoke(segment.Flow) == true) {
+                return false;
+            }
+            // Past the table's capacity the worker evicts anyway; the connection is still worth a look
+            if (_tracked.Count < Flows.Capacity) {
+                _tracked[key] = timestampTicks;
+            }
+            return true;
+        }
+
+        // Forgets connections idle for as long as the flow table keeps them; runs with the statistics
+        private void ExpireTracked() {
+            long idleBefore = _trackedClock - Settings.FlowIdleTimeout.Ticks;
+            var idle = new List<FlowKey>();
+            foreach ((FlowKey key, long lastSeen) in _tracked) {
+                if (lastSeen < idleBefore) {
+                    idle.Add(key);
+                }
+            }
+            foreach (FlowKey key in idle) {
+                _tracked.Remove(key);
+            }
+        }
+
+        internal static bool LooksLikeRecord(ReadOnlySpan<byte> data) {
+            return data.Length >= RecordHeaderLength
+                && data[0] is >= ContentChangeCipherSpec and <= ContentApplicationData
+                && data[1] == 3 && data[2] <= 4
+                && ((data[3] << 8) | data[4]) is > 0 and <= MaxRecordLength;
+        }
+
+        private void ReleaseBlock(int block) {
+            if (Interlocked.Decrement(ref _blockRefs[block]) == 0) {
+                _source.Release(block);
+            }
+        }
+
+        private void LogStatistics() {
+            LibC.TPacketStatsV3 stats = _source.ReadStatistics();
+            long packets = Interlocked.Add(ref _packets, stats.Packets);
+            long drops = Interlocked.Add(ref _drops, stats.Drops);
+            Telemetry.CapturePackets.Add(stats.Packets);
+            Telemetry.CaptureDrops.Add(stats.Drops);
+            if (stats.Drops > 0) {
+                Logging.Write($"Capture ring dropped {stats.Drops} of {stats.Packets} packet(s); "
+                    + "consider a larger TLSCOPE_CAPTURE_BLOCKS or more TLSCOPE_CAPTURE_WORKERS.");
+            }
+            long queueDrops = Interlocked.Read(ref _queueDrops);
+            if (queueDrops > _reportedQueueDrops) {
+                Telemetry.CaptureQueueDrops.Add(queueDrops - _reportedQueueDrops);
+                Logging.Write($"Capture workers fell behind and dropped {queueDrops - _reportedQueueDrops} segment(s); "
+                    + "consider more TLSCOPE_CAPTURE_WORKERS.");
+                _reportedQueueDrops = queueDrops;
+            }
+            Logging.Write($"Capture: {packets} packet(s), {drops} dropped, {HandshakeRecords} handshake record(s), "
+                + $"{Flows.Count} active flow(s).");
+        }
+
+        public void Dispose() {
+            _source.Dispose();
+        }
+
+        private readonly record struct CapturedSegment(int Block, int FrameOffset, TcpSegment Segment, long TimestampTicks);
+
+        private sealed class CaptureWorker {
+            private readonly TlsService _owner;
+            private readonly FlowTable.Shard _flows;
+            // Each queued segment holds its ring block, so the queue is bounded to keep slow workers from stalling the ring
+            private readonly Channel<CapturedSegment> _queue = Channel.CreateBounded<CapturedSegment>(
+                new BoundedChannelOptions(Settings.CaptureQueueCapacity) {
+                    SingleReader = true,
+                    SingleWriter = true,
+                    FullMode = BoundedChannelFullMode.Wait
+                });
+            private long _handleTicks;
+            private long _parseTicks;
+
+            public long HandleTicks => Interlocked.Read(ref _handleTicks);
+            public long ParseTicks => Interlocked.Read(ref _parseTicks);
+
+            public CaptureWorker(TlsService owner, FlowTable.Shard flows) {
+                _owner = owner;
+                _flows = flows;
+            }
+
+            public void Post(CapturedSegment segment) {
+                ChannelWriter<CapturedSegment> writer = _queue.Writer;
+                while (!writer.TryWrite(segment)) {
+                    if (_owner._source.Live) {
+                        Interlocked.Increment(ref _owner._queueDrops);
+                        _owner.ReleaseBlock(segment.Block);
+                        return;
+                    }
+                    // Replay has no kernel to drop for it, so it waits on the worker; the dispatcher has its own thread
+                    if (!writer.WaitToWriteAsync().AsTask().GetAwaiter().GetResult()) {
+                        _owner.ReleaseBlock(segment.Block);
+                        return;
+                    }
+                }
+            }
+
+            public void Complete() {
+                _queue.Writer.TryComplete();
+            }
+
+            public async Task RunAsync() {
+                var reader = _queue.Reader;
+                while (await reader.WaitToReadAsync()) {
+                    while (reader.TryRead(out CapturedSegment segment)) {
+                        long started = Stopwatch.GetTimestamp();
+                        try {
+                            Handle(segment);
+                        } catch (Exception ex) {
+                            Logging.Error($"TLS capture worker failed on {segment.Segment.Flow}.", ex);
+                        } finally {
+                            _owner.ReleaseBlock(segment.Block);
+                        }
+                        Volatile.Write(ref _handleTicks, _handleTicks + Stopwatch.GetTimestamp() - started);
+                    }
+                }
+            }
+
+            private void Handle(in CapturedSegment captured) {
+                TcpSegment segment = captured.Segment;
+                ReadOnlySpan<byte> payload = _owner._source.GetBlock(captured.Block)
+                    .Slice(captured.FrameOffset + segment.PayloadOffset, segment.PayloadLength);
+                long now = captured.TimestampTicks;
+
+                lock (_flows.Sync) {
+                    int index = _flows.Find(segment.Flow, out bool forward);
+                    if (index < 0) {
+                        // Only connections that show a plaintext TLS record get a slot; scans and non-TLS storms never do
+                        if (!LooksLikeRecord(payload) || payload[0] == ContentApplicationData) {
+                            return;
+                        }
+                        index = _flows.Add(segment.Flow, now, out forward);
+                    }
+                    _flows.Touch(index, now, payload.Length);
+
+                    if ((segment.Flags & TcpFlags.Rst) != 0) {
+                        _flows.Remove(index);
+                        return;
+                    }
+                    if (!payload.IsEmpty && !HandshakeDone(_flows[index])) {
+                        ReadRecords(index, forward, segment, now, payload);
+                    }
+                    if ((segment.Flags & TcpFlags.Fin) != 0) {
+                        ref FlowSlot slot = ref _flows[index];
+                        slot.Flags |= forward ? FlowFlags.SourceFin : FlowFlags.DestinationFin;
+                        if ((slot.Flags & (FlowFlags.SourceFin | FlowFlags.DestinationFin))
+                            == (FlowFlags.SourceFin | FlowFlags.DestinationFin)) {
+                            _flows.Remove(index);
+                        }
+                    }
+                }
+            }
+
+            private static bool HandshakeDone(in FlowSlot slot) {
+                return (slot.Flags & (FlowFlags.ClientHello | FlowFlags.ServerHello))
+                    == (FlowFlags.ClientHello | FlowFlags.ServerHello);
+            }
+
+            private void ReadRecords(int index, bool forward, in TcpSegment segment, long now, ReadOnlySpan<byte> payload) {
+                ref FlowSlot slot = ref _flows[index];
+                if (slot.Partial != null && slot.PartialForward == forward) {
+                    int behind = (int)(slot.PartialNextSequence - segment.Sequence);
+                    if (behind < 0) {
+                        // A segment went missing; this record cannot be completed
+                        _flows.DropPartial(index);
+                    } else {
+                        if (behind < payload.Length && _flows.AppendPartial(index, payload[behind..], MaxBuffered)) {
+                            int consumed = Deliver(index, forward, now, slot.Partial.AsSpan(0, slot.PartialLength),
+                                out bool valid);
+                            _flows.ConsumePartial(index, consumed);
+                            if (!valid || (slot.Partial != null && slot.Partial[0] != ContentHandshake)) {
+                                _flows.DropPartial(index);
+                            }
+                        }
+                        return; // retransmissions of bytes already buffered fall through to here as well
+                    }
+                }
+
+                if (!LooksLikeRecord(payload)) {
+                    return;
+                }
+                int used = Deliver(index, forward, now, payload, out bool ok);
+                if (ok && used < payload.Length && payload[used] == ContentHandshake && !HandshakeDone(slot)) {
+                    // Only the tail of a split handshake record is copied; everything else was read from the ring
+                    _flows.StartPartial(index, forward, segment.Sequence + (uint)payload.Length, payload[used..]);
+                }
+            }
+
+            // Parses every complete handshake record in data; returns the bytes consumed.
+            // valid is false when the data stops looking like TLS.
+            private int Deliver(int index, bool forward, long now, ReadOnlySpan<byte> data, out bool valid) {
+                int offset = 0;
+                valid = true;
+                while (data.Length - offset >= RecordHeaderLength) {
+                    ReadOnlySpan<byte> rest = data[offset..];
+                    if (!LooksLikeRecord(rest)) {
+                        valid = false;
+                        break;
+                    }
+                    int length = RecordHeaderLength + ((rest[3] << 8) | rest[4]);
+                    if (rest.Length < length) {
+                        break;
+                    }
+                    if (rest[0] == ContentHandshake) {
+                        Interlocked.Increment(ref _owner._records);
+                        long started = Stopwatch.GetTimestamp();
+                        TlsParseStatus status = TlsParser.TryParse(rest[..length], out TlsHello hello);
+                        long elapsed = Stopwatch.GetTimestamp() - started;
+                        Volatile.Write(ref _parseTicks, _parseTicks + elapsed);
+                        Telemetry.ParseDuration.Record(Stopwatch.GetElapsedTime(0, elapsed).TotalMicroseconds);
+                        if (status == TlsParseStatus.Ok) {
+                            Record(index, forward, now, hello);
+                        }
+                    }
+                    offset += length;
+                }
+                return offset;
+            }
+
+            private void Record(int index, bool forward, long now, in TlsHello hello) {
+                ref FlowSlot slot = ref _flows[index];
+                if (hello.Kind == TlsHelloKind.ClientHello) {
+                    slot.Flags |= FlowFlags.ClientHello;
+                    slot.ClientIsSource = forward;
+                    slot.Version = hello.Version;
+                    slot.Ja3 = hello.Ja3;
+                    slot.Ja4 = hello.Ja4;
+                    _flows.SetServerName(index, hello.ServerName);
+                    if ((slot.Flags & FlowFlags.Announced) == 0) {
+                        slot.Flags |= FlowFlags.Announced;
+                        // Looked up from the record's bytes; only a name not yet interned is decoded into a string
+                        int serverName = hello.ServerName.IsEmpty ? 0 : Interned.ServerNames.Acquire(hello.ServerName);
+                        _flows.Report(new FlowDelta(slot.ClientToServer, true, 0, now,
+                            serverName, Interned.Ja3.Acquire(hello.Ja3), Interned.Ja4.Acquire(hello.Ja4)));
+                    }
+                } else if (hello.IsHelloRetryRequest) {
+                    slot.Flags |= FlowFlags.HelloRetry; // a second ClientHello and the real ServerHello follow
+                } else {
+                    slot.Flags |= FlowFlags.ServerHello;
+                    slot.Version = hello.Version;
+                    slot.CipherSuite = hello.CipherSuite;
+                }
+
+                if (_owner._handler != null) {
+                    FlowKey sent = forward ? slot.Key : slot.Key.Reverse();
+                    _owner._handler(sent, now, hello);
+                }
+            }
+        }
+    }
+}
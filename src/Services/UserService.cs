@@ -29,7 +29,7 @@ public class UserService {
         }
 
         // Check if password is correct
-        if (!Crypto.VerifyPasswordHash(password, user.PasswordHash, user.PasswordSalt)) {
+        if (!await Crypto.VerifyPasswordHashAsync(password, user.PasswordHash, user.PasswordSalt)) {
             return null;
         }
 
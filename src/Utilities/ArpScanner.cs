@@ -0,0 +1,184 @@
+// In-process ARP sweeper over an AF_PACKET socket, replacing the arp-scan subprocess on Linux
+// Sends and receives are pipelined: replies are yielded while requests are still going out
+
+using System.Buffers.Binary;
+using System.Net;
+using System.Net.NetworkInformation;
+using System.Runtime.CompilerServices;
+using System.Runtime.InteropServices;
+using System.Threading.Channels;
+
+using TLScope.src.Debugging;
+
+namespace TLScope.src.Utilities {
+    public sealed class ArpScanner : IDisposable {
+        private const int FrameLength = 42; // Ethernet (14) + ARP for IPv4 over Ethernet (28)
+
+        private readonly int _fd;
+        private readonly byte[] _localMac;
+        private readonly uint _localIP;
+        private int _disposed;
+
+        public int Retries { get; init; } = 2;
+        public TimeSpan ReplyTimeout { get; init; } = TimeSpan.FromMilliseconds(300);
+
+        // Hook for pacing sends; by default frames go out as fast as the socket accepts them
+        public Func<CancellationToken, ValueTask>? Pacer { get; init; }
+
+        private ArpScanner(int fd, byte[] localMac, uint localIP) {
+            _fd = fd;
+            _localMac = localMac;
+            _localIP = localIP;
+        }
+
+        /// <summary>
+        /// Opens a raw ARP socket on the interface. Returns null when raw sockets are unavailable
+        /// (non-Linux, missing CAP_NET_RAW), in which case callers should use NetData.ARPCommand.
+        /// </summary>
+        public static ArpScanner? TryOpen(NetworkInterface ni, Func<CancellationToken, ValueTask>? pacer = null) {
+            string? ip = NetData.GetLocalIPAddress(ni);
+            byte[] mac = ni.GetPhysicalAddress().GetAddressBytes();
+            if (ip == null || mac.Length != 6) {
+                return null;
+            }
+
+            int fd = LibC.OpenPacketSocket(ni.Name, LibC.ETH_P_ARP);
+            if (fd < 0) {
+                Logging.Write($"Raw ARP socket unavailable on {ni.Name} (errno {Marshal.GetLastPInvokeError()}).");
+                return null;
+            }
+            return new ArpScanner(fd, mac, NetData.ToUInt32(IPAddress.Parse(ip))) { Pacer = pacer };
+        }
+
+        /// <summary>
+        /// Sweeps the given IPv4 targets (host byte order) and yields each (IP, MAC) the first time it answers.
+        /// </summary>
+        public async IAsyncEnumerable<(string IP, string MACAddress)> SweepAsync(IReadOnlyList<uint> targets,
+            [EnumeratorCancellation] CancellationToken cancellationToken = default) {
+            await foreach (var (ip, mac) in SweepRawAsync(targets, cancellationToken)) {
+                yield return (NetData.FromUInt32(ip).ToString(), NetData.FormatMac(mac));
+            }
+        }
+
+        /// <summary>
+        /// Same as SweepAsync but yields packed values, avoiding any string work per reply.
+        /// </summary>
+        public async IAsyncEnumerable<(uint IP, ulong MAC)> SweepRawAsync(IReadOnlyList<uint> targets,
+            [EnumeratorCancellation] CancellationToken cancellationToken = default) {
+            var results = Channel.CreateUnbounded<(uint IP, ulong MAC)>(new UnboundedChannelOptions {
+                SingleReader = true,
+                SingleWriter = true
+            });
+            // Replies are only accepted for this sweep's targets, so concurrent sweeps on other sockets don't overlap
+            var pending = new HashSet<uint>(targets);
+            using var sweepCts = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
+
+            var receiveTask = Task.Factory.StartNew(
+                () => ReceiveLoop(pending, results.Writer, sweepCts.Token),
+                CancellationToken.None, TaskCreationOptions.LongRunning, TaskScheduler.Default);
+
+            var sendTask = Task.Run(async () => {
+                try {
+                    byte[] frame = BuildRequestTemplate();
+                    for (int pass = 0; pass <= Retries && !sweepCts.IsCancellationRequested; pass++) {
+                        for (int i = 0; i < targets.Count; i++) {
+                            uint target = targets[i];
+                            if (target == _localIP || !IsPending(pending, target)) {
+                                continue;
+                            }
+                            await BeforeSendAsync(sweepCts.Token);
+                            BinaryPrimitives.WriteUInt32BigEndian(frame.AsSpan(38, 4), target);
+                            LibC.send(_fd, frame, FrameLength, 0);
+                        }
+                        await Task.Delay(ReplyTimeout, sweepCts.Token);
+                    }
+                } finally {
+                    sweepCts.Cancel();
+                }
+            }, CancellationToken.None);
+
+            try {
+                await foreach (var result in results.Reader.ReadAllAsync(cancellationToken)) {
+                    yield return result;
+                }
+            } finally {
+                // Also reached when the consumer stops early; the sender cancels itself after the last pass
+                sweepCts.Cancel();
+                try {
+                    await Task.WhenAll(sendTask, receiveTask);
+                } catch (OperationCanceledException) {
+                }
+            }
+        }
+
+        private ValueTask BeforeSendAsync(CancellationToken cancellationToken) {
+            return Pacer?.Invoke(cancellationToken) ?? ValueTask.CompletedTask;
+        }
+
+        private static bool IsPending(HashSet<uint> pending, uint ip) {
+            lock (pending) {
+                return pending.Contains(ip);
+            }
+        }
+
+        private void ReceiveLoop(HashSet<uint> pending, ChannelWriter<(uint IP, ulong MAC)> writer, CancellationToken cancellationToken) {
+            byte[] buffer = new byte[1514];
+            try {
+                while (!cancellationToken.IsCancellationRequested) {
+                    if (!LibC.WaitReadable(_fd, 50)) {
+                        continue;
+                    }
+                    int length = (int)LibC.recv(_fd, buffer, buffer.Length, 0);
+                    if (length < FrameLength || !TryParseReply(buffer.AsSpan(0, length), out uint ip, out ulong mac)) {
+                        continue;
+                    }
+                    bool isNew;
+                    lock (pending) {
+                        isNew = pending.Remove(ip);
+                    }
+                    if (isNew) {
+                        writer.TryWrite((ip, mac));
+                    }
+                }
+            } finally {
+                writer.TryComplete();
+            }
+        }
+
+        private bool TryParseReply(ReadOnlySpan<byte> frame, out uint ip, out ulong mac) {
+            ip = 0;
+            mac = 0;
+            if (BinaryPrimitives.ReadUInt16BigEndian(frame[12..]) != LibC.ETH_P_ARP
+                || BinaryPrimitives.ReadUInt16BigEndian(frame[20..]) != 2 // ARP reply
+                || BinaryPrimitives.ReadUInt32BigEndian(frame[38..]) != _localIP) {
+                return false;
+            }
+            mac = NetData.PackMac(frame.Slice(22, 6));
+            ip = BinaryPrimitives.ReadUInt32BigEndian(frame[28..]);
+            return true;
+        }
+
+        private byte[] BuildRequestTemplate() {
+            var frame = new byte[FrameLength];
+            Span<byte> f = frame;
+            f[..6].Fill(0xFF);                                   // broadcast destination
+            _localMac.CopyTo(f[6..]);                            // source MAC
+            BinaryPrimitives.WriteUInt16BigEndian(f[12..], LibC.ETH_P_ARP);
+            BinaryPrimitives.WriteUInt16BigEndian(f[14..], 1);   // hardware type: Ethernet
+            BinaryPrimitives.WriteUInt16BigEndian(f[16..], 0x0800); // protocol type: IPv4
+            f[18] = 6;                                           // hardware address length
+            f[19] = 4;                                           // protocol address length
+            BinaryPrimitives.WriteUInt16BigEndian(f[20..], 1);   // ARP request
+            _localMac.CopyTo(f[22..]);                           // sender MAC
+            BinaryPrimitives.WriteUInt32BigEndian(f[28..], _localIP);
+            // target MAC stays zeroed, target IP is patched per send
+            return frame;
+        }
+
+        public void Dispose() {
+            if (Interlocked.Exchange(ref _disposed, 1) == 0) {
+                LibC.close(_fd);
+            }
+        }
+    }
+}
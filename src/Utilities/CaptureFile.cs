@@ -0,0 +1,430 @@
+// Offline packet source for --replay: a pcap or pcapng file, memory-mapped read-only and handed to the capture
+// dispatcher in ring-sized windows, so replayed frames are decoded and parsed in place just like live ones
+
+using System.Buffers.Binary;
+using System.Diagnostics;
+using System.IO.MemoryMappedFiles;
+
+namespace TLScope.src.Utilities {
+    /*
+     * pcap:   24-byte file header, then per packet a 16-byte record header (seconds, micro- or nanoseconds,
+     *         captured length, wire length) and the frame.
+     * pcapng: blocks of (u32 type, u32 total length, body, u32 total length). Section headers set the byte order
+     *         and reset the interface list; interface descriptions carry the link type and timestamp resolution;
+     *         enhanced and simple packet blocks carry frames.
+     * Only Ethernet frames are replayed, which is what the live ring delivers; other link types are counted as skipped.
+     */
+    internal sealed unsafe class CaptureFile : IPacketSource {
+        private const uint PcapMagic = 0xA1B2C3D4;
+        private const uint PcapNanoMagic = 0xA1B23C4D;
+        private const int PcapHeaderLength = 24;
+        private const int PcapRecordHeaderLength = 16;
+        private const uint SectionHeaderBlock = 0x0A0D0D0A;
+        private const uint ByteOrderMagic = 0x1A2B3C4D;
+        private const uint InterfaceDescriptionBlock = 1;
+        private const uint SimplePacketBlock = 3;
+        private const uint EnhancedPacketBlock = 6;
+        private const ushort OptionTimestampResolution = 9;
+        private const uint LinkTypeEthernet = 1;
+        private const int MaxRecordLength = 16 << 20; // anything larger is corruption, not a packet
+        private const long GrantLeadTicks = TimeSpan.TicksPerSecond;
+
+        private readonly MemoryMappedFile _map;
+        private readonly MemoryMappedViewAccessor _accessor;
+        private readonly byte* _data;
+        private readonly long _length;
+        private readonly bool _pcapng;
+        private readonly double _speed;
+        private readonly int _windowSize;
+        private readonly long[] _windowStarts;
+        private readonly int[] _windowLengths;
+        private readonly long[] _windowLastTicks;
+        private readonly List<RingFrame>[] _windowFrames;
+        private readonly SemaphoreSlim _released = new(0);
+        private readonly SemaphoreSlim _progress = new(0); // the clock moved, or the dispatcher waits for a grant
+        private readonly List<(uint LinkType, ulong UnitsPerSecond)> _interfaces = [];
+        private readonly Stopwatch _wallClock = new();
+
+        private bool _swapped;
+        private uint _linkType; // pcap only; pcapng keeps one per interface
+        private ulong _unitsPerSecond;
+        private long _offset;
+        private int _next;
+        private bool _pending; // the window for _next is read but not yet due
+        private long _firstTicks = -1;
+        private long _clockTicks;
+        private long _grantedTicks = long.MaxValue; // ungated until Grant is first called
+        private long _takenTicks;
+        private long _waitingTicks;
+        private volatile bool _starved;
+        private long _lastTicks;
+        private long _delivered;
+        private long _reported;
+        private long _skipped;
+        private bool _disposed;
+
+        public string Format => _pcapng ? "pcapng" : "pcap";
+        public long Length => _length;
+        public int BlockCount => _windowStarts.Length;
+        public bool Completed { get; private set; }
+        public bool Live => false;
+
+        /// <summary>
+        /// True when the file ended inside a record or a record was malformed; replay stops there.
+        /// </summary>
+        public bool Truncated { get; private set; }
+
+        public long FramesDelivered => Interlocked.Read(ref _delivered);
+
+        /// <summary>
+        /// Frames on link types other than Ethernet, which the decoder does not handle.
+        /// </summary>
+        public long FramesSkipped => Interlocked.Read(ref _skipped);
+
+        /// <summary>
+        /// Capture timestamp of the first frame, and of the last frame in any window the pipeline has finished
+        /// with: the replay's clock, which lags behind what the dispatcher has already queued.
+        /// </summary>
+        public long FirstTicks => Interlocked.Read(ref _firstTicks);
+        public long ClockTicks => Interlocked.Read(ref _clockTicks);
+
+        /// <summary>
+        /// True while the dispatcher waits for a grant and the pipeline has finished with everything handed out,
+        /// so nothing will move the clock until the consumer grants again.
+        /// </summary>
+        public bool Starved => _starved && ClockTicks >= Interlocked.Read(ref _takenTicks);
+
+        /// <summary>
+        /// Capture timestamp of the first frame in the window the dispatcher waits to be granted. After a quiet gap
+        /// it can lie further past the clock than the lead a grant allows, so a starved consumer grants up to it.
+        /// </summary>
+        public long WaitingTicks => Interlocked.Read(ref _waitingTicks);
+
+        private CaptureFile(MemoryMappedFile map, MemoryMappedViewAccessor accessor, byte* data, long length,
+            bool pcapng, double speed, int windowSize, int windows) {
+            _map = map;
+            _accessor = accessor;
+            _data = data;
+            _length = length;
+            _pcapng = pcapng;
+            _speed = speed;
+            _windowSize = windowSize;
+            _windowStarts = new long[windows];
+            _windowLengths = new int[windows];
+            _windowLastTicks = new long[windows];
+            _windowFrames = new List<RingFrame>[windows];
+            for (int i = 0; i < windows; i++) {
+                _windowFrames[i] = new List<RingFrame>(1024);
+            }
+        }
+
+        /// <summary>
+        /// Maps a capture file for replay. A speed of 0 replays as fast as the pipeline takes frames; otherwise
+        /// frames are released at their capture timestamps divided by speed. Windows are sized like the live ring
+        /// (TLSCOPE_CAPTURE_BLOCK_KB, TLSCOPE_CAPTURE_BLOCKS). Throws InvalidDataException for other file types.
+        /// </summary>
+        public static CaptureFile Open(string path, double speed = 0) {
+            var stream = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.Read);
+            long length = stream.Length;
+            if (length < PcapHeaderLength) {
+                stream.Dispose();
+                throw new InvalidDataException($"{path} is too short to be a capture file.");
+            }
+            var map = MemoryMappedFile.CreateFromFile(stream, null, length, MemoryMappedFileAccess.Read,
+                HandleInheritability.None, false);
+            var accessor = map.CreateViewAccessor(0, length, MemoryMappedFileAccess.Read);
+            byte* pointer = null;
+            accessor.SafeMemoryMappedViewHandle.AcquirePointer(ref pointer);
+            pointer += accessor.PointerOffset;
+
+            var capture = new CaptureFile(map, accessor, pointer, length, BinaryPrimitives.ReadUInt32LittleEndian(
+                new ReadOnlySpan<byte>(pointer, 4)) == SectionHeaderBlock, speed, Settings.CaptureBlockSizeKB * 1024,
+                Settings.CaptureBlockCount);
+            if (!capture.ReadFileHeader()) {
+                capture.Dispose();
+                throw new InvalidDataException($"{path} is neither a pcap nor a pcapng file.");
+            }
+            return capture;
+        }
+
+        private bool ReadFileHeader() {
+            if (_pcapng) {
+                return true; // the section header is read as the first block
+            }
+            uint magic = BinaryPrimitives.ReadUInt32LittleEndian(new ReadOnlySpan<byte>(_data, 4));
+            _swapped = magic is not (PcapMagic or PcapNanoMagic);
+            magic = _swapped ? BinaryPrimitives.ReverseEndianness(magic) : magic;
+            if (magic is not (PcapMagic or PcapNanoMagic)) {
+                return false;
+            }
+            _unitsPerSecond = magic == PcapNanoMagic ? 1_000_000_000UL : 1_000_000UL;
+            _linkType = ReadUInt32(PcapHeaderLength - 4) & 0xFFFF; // upper bits carry FCS information
+            _offset = PcapHeaderLength;
+            return true;
+        }
+
+        /// <summary>
+        /// Hands out the next window once its slot is free and, when paced, once its first frame is due.
+        /// </summary>
+        public bool TryTake(int timeoutMs, Func<int, bool> isHeld, out int block) {
+            block = _next;
+            if (!_pending) {
+                if (isHeld(block)) {
+                    // Replay outran the workers by a whole ring; wait for a release like the live ring waits for the kernel
+                    _released.Wait(timeoutMs);
+                    if (isHeld(block)) {
+                        return false;
+                    }
+                }
+                if (!ReadWindow(block)) {
+                    Completed = true;
+                    return false;
+                }
+                _pending = true;
+            }
+
+            List<RingFrame> frames = _windowFrames[block];
+            long granted = Math.Max(Interlocked.Read(ref _grantedTicks), _firstTicks);
+            if (frames.Count > 0 && granted != long.MaxValue && frames[0].TimestampTicks - granted > GrantLeadTicks) {
+                Interlocked.Exchange(ref _waitingTicks, frames[0].TimestampTicks);
+                _starved = true;
+                _progress.Release();
+                _released.Wait(timeoutMs);
+                return false;
+            }
+            _starved = false;
+            if (_speed > 0 && frames.Count > 0) {
+                if (!_wallClock.IsRunning) {
+                    _wallClock.Start();
+                }
+                long due = (long)((frames[0].TimestampTicks - _firstTicks) / _speed);
+                long wait = (due - _wallClock.Elapsed.Ticks) / TimeSpan.TicksPerMillisecond;
+                if (wait > 0) {
+                    Thread.Sleep((int)Math.Min(wait, timeoutMs));
+                    if (due > _wallClock.Elapsed.Ticks) {
+                        return false;
+                    }
+                }
+            }
+
+            _pending = false;
+            _next = (_next + 1) % BlockCount;
+            Interlocked.Add(ref _delivered, frames.Count);
+            if (frames.Count > 0) {
+                Interlocked.Exchange(ref _takenTicks, frames[^1].TimestampTicks);
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// Lets the pipeline run at most a second of capture time past the given time, for a consumer that must
+        /// keep up: the replay's graph stage grants each time it has collected, so full speed never overruns it.
+        /// </summary>
+        public void Grant(long clockTicks) {
+            Interlocked.Exchange(ref _grantedTicks, clockTicks);
+            _released.Release();
+        }
+
+        /// <summary>
+        /// Waits until the clock moves or the dispatcher starts waiting for a grant, or the timeout passes.
+        /// </summary>
+        public bool WaitForProgress(int timeoutMs) {
+            return _progress.Wait(timeoutMs);
+        }
+
+        public void Release(int block) {
+            long ticks = _windowLastTicks[block];
+            long clock = Interlocked.Read(ref _clockTicks);
+            while (ticks > clock) {
+                long seen = Interlocked.CompareExchange(ref _clockTicks, ticks, clock);
+                if (seen == clock) {
+                    break;
+                }
+                clock = seen;
+            }
+            _released.Release();
+            if (ticks > clock) {
+                _progress.Release();
+            }
+        }
+
+        public ReadOnlySpan<byte> GetBlock(int block) {
+            return new ReadOnlySpan<byte>(_data + _windowStarts[block], _windowLengths[block]);
+        }
+
+        public void ReadFrames(int block, List<RingFrame> output) {
+            output.AddRange(_windowFrames[block]);
+        }
+
+        /// <summary>
+        /// Frames handed out since the previous call. A file has nothing to drop.
+        /// </summary>
+        public LibC.TPacketStatsV3 ReadStatistics() {
+            long delivered = Interlocked.Read(ref _delivered);
+            var stats = new LibC.TPacketStatsV3 { Packets = (uint)(delivered - _reported) };
+            _reported = delivered;
+            return stats;
+        }
+
+        // Reads whole records from the cursor into the slot until the window is full or spans a granted lead of
+        // capture time; when paced, until it spans 10 ms of replay time, so frames are released close to when they
+        // are due. False at the end of the file
+        private bool ReadWindow(int block) {
+            List<RingFrame> frames = _windowFrames[block];
+            frames.Clear();
+            long start = _offset;
+            long span = _speed > 0 ? (long)(TimeSpan.TicksPerMillisecond * 10 * _speed) : GrantLeadTicks;
+            while (!Truncated && _offset < _length
+                && (frames.Count == 0 || frames[^1].TimestampTicks - frames[0].TimestampTicks < span)) {
+                long record = _pcapng ? ReadBlock(start, frames) : ReadRecord(start, frames);
+                if (record < 0) {
+                    break; // does not fit; it starts the next window
+                }
+                _offset += record;
+            }
+            _windowStarts[block] = start;
+            _windowLengths[block] = (int)(_offset - start);
+            _windowLastTicks[block] = frames.Count > 0 ? frames[^1].TimestampTicks : 0;
+            return _offset > start;
+        }
+
+        // Returns the record's length, or -1 when it would overflow the window (only if the window is not empty)
+        private long ReadRecord(long windowStart, List<RingFrame> frames) {
+            if (_length - _offset < PcapRecordHeaderLength) {
+                return Truncate();
+            }
+            uint seconds = ReadUInt32(_offset);
+            uint fraction = ReadUInt32(_offset + 4);
+            uint captured = ReadUInt32(_offset + 8);
+            uint wire = ReadUInt32(_offset + 12);
+            long length = PcapRecordHeaderLength + (long)captured;
+            if (captured > MaxRecordLength || _offset + length > _length) {
+                return Truncate();
+            }
+            if (_offset + length - windowStart > _windowSize && _offset > windowStart) {
+                return -1;
+            }
+            AddFrame(frames, windowStart, _offset + PcapRecordHeaderLength, (int)captured, wire, _linkType,
+                ((ulong)seconds * _unitsPerSecond) + fraction, _unitsPerSecond);
+            return length;
+        }
+
+        private long ReadBlock(long windowStart, List<RingFrame> frames) {
+            if (_length - _offset < 12) {
+                return Truncate();
+            }
+            uint type = BinaryPrimitives.ReadUInt32LittleEndian(Span(_offset, 4));
+            if (type == SectionHeaderBlock) {
+                uint order = BinaryPrimitives.ReadUInt32LittleEndian(Span(_offset + 8, 4));
+                if (order != ByteOrderMagic && order != BinaryPrimitives.ReverseEndianness(ByteOrderMagic)) {
+                    return Truncate();
+                }
+                _swapped = order != ByteOrderMagic;
+            }
+            uint length = ReadUInt32(_offset + 4);
+            if (length < 12 || length % 4 != 0 || length > MaxRecordLength || _offset + length > _length) {
+                return Truncate();
+            }
+            if (_offset + length - windowStart > _windowSize && _offset > windowStart) {
+                return -1;
+            }
+
+            switch (type) {
+                case SectionHeaderBlock:
+                    _interfaces.Clear();
+                    break;
+                case InterfaceDescriptionBlock when length >= 20:
+                    _interfaces.Add((ReadUInt16(_offset + 8), ReadResolution(_offset + 16, _offset + length - 4)));
+                    break;
+                case EnhancedPacketBlock when length >= 32: {
+                    uint captured = ReadUInt32(_offset + 20);
+                    if (captured > length - 32) {
+                        return Truncate();
+                    }
+                    int index = (int)Math.Min(ReadUInt32(_offset + 8), int.MaxValue);
+                    (uint linkType, ulong units) = index < _interfaces.Count ? _interfaces[index] : (0u, 1_000_000ul);
+                    ulong timestamp = ((ulong)ReadUInt32(_offset + 12) << 32) | ReadUInt32(_offset + 16);
+                    AddFrame(frames, windowStart, _offset + 28, (int)captured, ReadUInt32(_offset + 24), linkType,
+                        timestamp, units);
+                    break;
+                }
+                case SimplePacketBlock when length >= 16 && _interfaces.Count > 0: {
+                    uint wire = ReadUInt32(_offset + 8);
+                    int captured = (int)Math.Min(wire, length - 16);
+                    // Simple packets carry no timestamp; they are stamped with the previous frame's
+                    AddFrame(frames, windowStart, _offset + 12, captured, wire, _interfaces[0].LinkType, 0, 0);
+                    break;
+                }
+            }
+            return length;
+        }
+
+        private void AddFrame(List<RingFrame> frames, long windowStart, long offset, int captured, uint wire,
+            uint linkType, ulong timestamp, ulong unitsPerSecond) {
+            if (linkType != LinkTypeEthernet) {
+                Interlocked.Increment(ref _skipped);
+                return;
+            }
+            long ticks = unitsPerSecond == 0 ? _lastTicks
+                : unitsPerSecond == 1_000_000 ? DateTime.UnixEpoch.Ticks + (long)(timestamp * 10)
+                : DateTime.UnixEpoch.Ticks + (long)((UInt128)timestamp * TimeSpan.TicksPerSecond / unitsPerSecond);
+            _lastTicks = ticks;
+            if (_firstTicks < 0) {
+                Interlocked.Exchange(ref _firstTicks, ticks);
+            }
+            frames.Add(new RingFrame((int)(offset - windowStart), captured, (int)Math.Min(wire, int.MaxValue), ticks));
+        }
+
+        // if_tsresol: 10^-n seconds, or 2^-n with the high bit set; microseconds when absent
+        private ulong ReadResolution(long options, long end) {
+            while (options + 4 <= end) {
+                ushort code = ReadUInt16(options);
+                ushort length = ReadUInt16(options + 2);
+                if (code == 0) {
+                    break;
+                }
+                if (code == OptionTimestampResolution && length >= 1 && options + 5 <= end) {
+                    byte resolution = _data[options + 4];
+                    int exponent = resolution & 0x7F;
+                    return (resolution & 0x80) != 0
+                        ? 1UL << Math.Min(exponent, 63)
+                        : (ulong)Math.Pow(10, Math.Min(exponent, 19));
+                }
+                options += 4 + ((length + 3) & ~3);
+            }
+            return 1_000_000;
+        }
+
+        // Replay ends at the first record that cannot be read; everything before it has been handed out
+        private long Truncate() {
+            Truncated = true;
+            return 0;
+        }
+
+        private ReadOnlySpan<byte> Span(long offset, int length) {
+            return new ReadOnlySpan<byte>(_data + offset, length);
+        }
+
+        private uint ReadUInt32(long offset) {
+            uint value = BinaryPrimitives.ReadUInt32LittleEndian(Span(offset, 4));
+            return _swapped ? BinaryPrimitives.ReverseEndianness(value) : value;
+        }
+
+        private ushort ReadUInt16(long offset) {
+            ushort value = BinaryPrimitives.ReadUInt16LittleEndian(Span(offset, 2));
+            return _swapped ? BinaryPrimitives.ReverseEndianness(value) : value;
+        }
+
+        public void Dispose() {
+            if (_disposed) {
+                return;
+            }
+            _disposed = true;
+            _accessor.SafeMemoryMappedViewHandle.ReleasePointer();
+            _accessor.Dispose();
+            _map.Dispose();
+            _released.Dispose();
+            _progress.Dispose();
+        }
+    }
+}
@@ -53,6 +53,11 @@ namespace TLScope.src.Utilities {
         public static readonly string LogPath = Path.Combine(AppDataPath, "logs");
         public static readonly string DatabasePath = Path.Combine(AppDataPath, "tlscope.db");
         public static readonly string LogFile = Path.Combine(LogPath, "tlscope.log");
+        public static readonly string HistoryPath = Path.Combine(AppDataPath, "history");
+        public static readonly string HashParametersPath = Path.Combine(AppDataPath, "argon2.conf");
+        public static readonly string OuiTablePath = Path.Combine(AppDataPath, "oui.bin");
+        public static readonly string DaemonKeyPath = Path.Combine(AppDataPath, "daemon.key");
+        public static readonly string AggregatorAgentsPath = Path.Combine(AppDataPath, "agents");
 
         public static void SetEnvironmentVariables() {
             // Set the environment variables
@@ -75,4 +80,139 @@ namespace TLScope.src.Utilities {
                 + $"\nLogFile: {LogFile}");
         }
     }
+
+    /// <summary>
+    /// Runtime tunables. Each value can be overridden with the matching TLSCOPE_* environment variable.
+    /// </summary>
+    public static class Settings {
+        // Interfaces to discover on, comma-separated; unset picks every LAN-facing interface that is up
+        public static readonly IReadOnlyList<string> Interfaces = ReadList("TLSCOPE_INTERFACES");
+
+        // ARP budget per interface, shared by all of its concurrently swept shards
+        public static readonly int ScanPacketsPerSecond = ReadInt("TLSCOPE_SCAN_PPS", 1000);
+        // Addresses per shard; a /24 is one shard, a /16 is 256
+        public static readonly int ScanShardSize = ReadInt("TLSCOPE_SCAN_SHARD_SIZE", 256);
+        public static readonly int ScanConcurrency = ReadInt("TLSCOPE_SCAN_CONCURRENCY", 4);
+        // Upper bound on time spent sweeping per cycle; larger ranges resume from where the last cycle stopped
+        public static readonly TimeSpan ScanCycleBudget = TimeSpan.FromSeconds(ReadInt("TLSCOPE_SCAN_CYCLE_SECONDS", 10));
+        // Pause between sweep cycles, stretched towards the maximum while sweeps keep finding nothing new
+        public static readonly TimeSpan ScanMinInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_SCAN_MIN_SECONDS", 5));
+        public static readonly TimeSpan ScanMaxInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_SCAN_MAX_SECONDS", 120));
+
+        // Hosts seen (passively or by a probe) within this window are left out of sweeps and probes
+        public static readonly TimeSpan PassiveFreshness = TimeSpan.FromSeconds(ReadInt("TLSCOPE_PASSIVE_FRESH_SECONDS", 30));
+
+        // IPv6 discovery: one all-nodes echo and neighbor cache read per interface and interval
+        public static readonly TimeSpan IPv6DiscoveryInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_IPV6_INTERVAL_SECONDS", 60));
+        public static readonly TimeSpan IPv6EchoWindow = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_IPV6_ECHO_WINDOW_MS", 1000));
+
+        // Adaptive per-device liveness probing
+        public static readonly TimeSpan ProbeMinInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_PROBE_MIN_SECONDS", 2));
+        public static readonly TimeSpan ProbeMaxInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_PROBE_MAX_SECONDS", 60));
+        public static readonly TimeSpan ProbeTimeout = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_PROBE_TIMEOUT_MS", 1500));
+        // A device is evicted once N of its last M probes have failed
+        public static readonly int ProbeFailureThreshold = ReadInt("TLSCOPE_PROBE_FAILURES", 3);
+        public static readonly int ProbeFailureWindow = ReadInt("TLSCOPE_PROBE_WINDOW", 5);
+
+        // Device changes are coalesced over this window before DeviceListUpdate fires
+        public static readonly TimeSpan DeviceUpdateWindow = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_UPDATE_WINDOW_MS", 250));
+        // Cap on how often the device tree is redrawn
+        public static readonly int UiMaxFramesPerSecond = ReadInt("TLSCOPE_UI_FPS", 10);
+
+        // Active TLS probing of devices passive capture has no handshakes for. It connects to every device, so it is
+        // off unless asked for by listing ports, e.g. TLSCOPE_TLS_PROBE_PORTS=443,8443
+        public static readonly IReadOnlyList<ushort> TlsProbePorts = ReadPorts("TLSCOPE_TLS_PROBE_PORTS", []);
+        public static readonly int TlsProbeConcurrency = ReadInt("TLSCOPE_TLS_PROBE_CONCURRENCY", 128);
+        public static readonly int TlsProbePerHost = ReadInt("TLSCOPE_TLS_PROBE_PER_HOST", 2);
+        public static readonly TimeSpan TlsProbeConnectTimeout = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_TLS_PROBE_CONNECT_MS", 300));
+        public static readonly TimeSpan TlsProbeHandshakeTimeout = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_TLS_PROBE_HANDSHAKE_MS", 1500));
+        public static readonly TimeSpan TlsProbeInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_TLS_PROBE_INTERVAL_SECONDS", 30));
+        // Earliest re-probe of one endpoint after a failure or a new certificate, and after an unchanged one
+        public static readonly TimeSpan TlsProbeHostInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_TLS_PROBE_HOST_SECONDS", 300));
+        public static readonly TimeSpan TlsProbeRecheckInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_TLS_PROBE_RECHECK_SECONDS", 3600));
+
+        // Passive capture ring: BlockCount blocks of BlockSize KiB (64 MiB is ~0.5 s of a saturated 1 Gbps link)
+        public static readonly int CaptureBlockSizeKB = ReadInt("TLSCOPE_CAPTURE_BLOCK_KB", 1024);
+        public static readonly int CaptureBlockCount = ReadInt("TLSCOPE_CAPTURE_BLOCKS", 64);
+        // A partially filled block is handed over after this long, bounding latency on quiet links
+        public static readonly int CaptureBlockTimeoutMs = ReadInt("TLSCOPE_CAPTURE_BLOCK_TIMEOUT_MS", 50);
+        public static readonly int CaptureWorkers = ReadInt("TLSCOPE_CAPTURE_WORKERS",
+            Math.Clamp(System.Environment.ProcessorCount - 1, 1, 4));
+        // Segments queued per worker; past that, live capture drops segments rather than hold ring blocks
+        public static readonly int CaptureQueueCapacity = ReadInt("TLSCOPE_CAPTURE_QUEUE", 16384);
+
+        // Flow table memory: fixed slots for connection state, plus a cap on buffered split handshake records
+        public static readonly int FlowTableMemoryMB = ReadInt("TLSCOPE_FLOW_TABLE_MB", 32);
+        public static readonly int FlowReassemblyMemoryMB = ReadInt("TLSCOPE_FLOW_REASSEMBLY_MB", 16);
+        // Flows with no packets for this long are evicted and summarised into the graph
+        public static readonly TimeSpan FlowIdleTimeout = TimeSpan.FromSeconds(ReadInt("TLSCOPE_FLOW_IDLE_SECONDS", 120));
+
+        // Connection graph edges with no traffic for this long are dropped
+        public static readonly TimeSpan GraphEdgeIdleTimeout = TimeSpan.FromSeconds(ReadInt("TLSCOPE_GRAPH_IDLE_SECONDS", 300));
+        // Graph view layout: changes are gathered this long before a pass, which runs at most this many force iterations
+        public static readonly TimeSpan GraphLayoutDebounce = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_GRAPH_LAYOUT_MS", 250));
+        public static readonly int GraphLayoutIterations = ReadInt("TLSCOPE_GRAPH_LAYOUT_ITERATIONS", 50);
+
+        // Write-behind persistence: deltas queued beyond the capacity are dropped rather than blocking the producer
+        public static readonly int PersistQueueCapacity = ReadInt("TLSCOPE_PERSIST_QUEUE", 65536);
+        public static readonly int PersistBatchSize = ReadInt("TLSCOPE_PERSIST_BATCH", 1024);
+        public static readonly TimeSpan PersistFlushInterval = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_PERSIST_FLUSH_MS", 1000));
+
+        // Presence and session history: pending samples are appended to the hourly segment this often,
+        // and segments older than the retention are deleted whole
+        public static readonly TimeSpan HistoryFlushInterval = TimeSpan.FromSeconds(ReadInt("TLSCOPE_HISTORY_FLUSH_SECONDS", 5));
+        public static readonly int HistoryRetentionHours = ReadInt("TLSCOPE_HISTORY_RETENTION_HOURS", 24 * 30);
+        public static readonly int HistoryMaxPendingRows = ReadInt("TLSCOPE_HISTORY_MAX_PENDING", 262144);
+
+        // Time one password hash should take when --calibrate picks the Argon2 parameters
+        public static readonly int HashTargetMilliseconds = ReadInt("TLSCOPE_HASH_TARGET_MS", 500);
+
+        // Name resolution: new hosts are looked up in batches, one batch in flight, under a packet budget.
+        // Answers are cached for their TTL within the bounds below; hosts without a name are retried after NameNegativeTtl
+        public static readonly int NameQueriesPerSecond = ReadInt("TLSCOPE_NAME_PPS", 100);
+        public static readonly int NameQueueCapacity = ReadInt("TLSCOPE_NAME_QUEUE", 4096);
+        public static readonly int NameBatchSize = ReadInt("TLSCOPE_NAME_BATCH", 64);
+        public static readonly TimeSpan NameBatchWindow = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_NAME_BATCH_WINDOW_MS", 1000));
+        public static readonly TimeSpan NameTimeout = TimeSpan.FromMilliseconds(ReadInt("TLSCOPE_NAME_TIMEOUT_MS", 1500));
+        public static readonly TimeSpan NameMinTtl = TimeSpan.FromSeconds(ReadInt("TLSCOPE_NAME_MIN_TTL_SECONDS", 300));
+        public static readonly TimeSpan NameMaxTtl = TimeSpan.FromSeconds(ReadInt("TLSCOPE_NAME_MAX_TTL_SECONDS", 86400));
+        public static readonly TimeSpan NameNegativeTtl = TimeSpan.FromSeconds(ReadInt("TLSCOPE_NAME_NEGATIVE_TTL_SECONDS", 900));
+        public static readonly int NameCacheTrimThreshold = ReadInt("TLSCOPE_NAME_CACHE_TRIM", 16384);
+
+        // --daemon export: encoded batches queued for the sink before producers wait, and how long one write may take
+        // before a socket sink is dropped and reconnected
+        public static readonly int ExportQueueBatches = ReadInt("TLSCOPE_EXPORT_QUEUE", 1024);
+        public static readonly TimeSpan ExportWriteTimeout = TimeSpan.FromSeconds(ReadInt("TLSCOPE_EXPORT_WRITE_TIMEOUT_SECONDS", 10));
+
+        // Aggregation: agents stream to tls://host:port and pin a self-signed aggregator by SHA-256 thumbprint;
+        // the aggregator listens on AggregatorPort and forgets a site's devices once it has been gone this long
+        public static readonly string? AggregatorPin = System.Environment.GetEnvironmentVariable("TLSCOPE_AGGREGATOR_PIN");
+        public static readonly int AggregatorPort = ReadInt("TLSCOPE_AGGREGATOR_PORT", 7443);
+        public static readonly int AggregatorMaxAgents = ReadInt("TLSCOPE_AGGREGATOR_MAX_AGENTS", 256);
+        public static readonly TimeSpan AggregatorSiteRetention = TimeSpan.FromSeconds(ReadInt("TLSCOPE_AGGREGATOR_RETENTION_SECONDS", 3600));
+
+        // Port for the Prometheus /metrics endpoint on localhost; unset leaves it off
+        public static readonly int MetricsPort = ReadInt("TLSCOPE_METRICS_PORT", 0);
+
+        private static string[] ReadList(string name) {
+            string? value = System.Environment.GetEnvironmentVariable(name);
+            return value?.Split(',', StringSplitOptions.RemoveEmptyEntries | StringSplitOptions.TrimEntries) ?? [];
+        }
+
+        private static ushort[] ReadPorts(string name, ushort[] fallback) {
+            if (System.Environment.GetEnvironmentVariable(name) == null) {
+                return fallback;
+            }
+            return ReadList(name)
+                .Select(item => ushort.TryParse(item, out ushort port) ? port : (ushort)0)
+                .Where(port => port != 0)
+                .Distinct()
+                .ToArray();
+        }
+
+        private static int ReadInt(string name, int fallback) {
+            string? value = System.Environment.GetEnvironmentVariable(name);
+            return int.TryParse(value, out int parsed) && parsed > 0 ? parsed : fallback;
+        }
+    }
 }
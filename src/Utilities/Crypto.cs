@@ -1,5 +1,8 @@
 // Cryptography utility functions for security in the project
 
+using System.Buffers.Binary;
+using System.Diagnostics;
+using System.Globalization;
 using System.Security.Cryptography;
 using System.Text;
 
@@ -7,46 +10,190 @@ using Konscious.Security.Cryptography;
 using TLScope.src.Debugging;
 
 namespace TLScope.src.Utilities {
+    /// <summary>
+    /// Argon2id cost parameters. Every stored hash carries the ones it was made with.
+    /// </summary>
+    public readonly record struct Argon2Parameters(int Parallelism, int MemoryKB, int Iterations) {
+        // What hashes were made with before parameters were stored; bare 32-byte hashes verify with these
+        public static readonly Argon2Parameters Legacy = new(8, 65536, 4);
+
+        public override string ToString() {
+            return $"parallelism {Parallelism}, memory {MemoryKB / 1024} MiB, iterations {Iterations}";
+        }
+    }
+
     public static class Crypto {
+        private const int HashLength = 32;
+        private const int SaltLength = 16;
+
+        // Stored hash: marker, format version, parallelism, reserved, memory KiB (u32 LE), iterations (u32 LE), digest
+        private const byte HashMarker = 0xA2;
+        private const byte HashVersion = 1;
+        private const int HeaderLength = 12;
+
+        // Calibration floor (the OWASP minimum for Argon2id) and ceilings
+        private const int MinMemoryKB = 19 * 1024;
+        private const int MaxMemoryKB = 256 * 1024;
+        private const int MinIterations = 2;
+        private const int MaxIterations = 10;
+
+        private static readonly Lazy<Argon2Parameters> current = new(LoadParameters);
+
+        /// <summary>
+        /// Parameters for new hashes: the calibrated ones from --calibrate if present, otherwise the legacy cost
+        /// with one lane per core.
+        /// </summary>
+        public static Argon2Parameters Current => current.Value;
+
         /// <summary>
-        /// Creates a password hash and salt using Argon2id.
+        /// Creates a password hash and salt using Argon2id with the current parameters.
         /// </summary>
         public static void CreatePasswordHash(string password, out byte[] passwordHash, out byte[] passwordSalt) {
             // Generate a random salt
-            passwordSalt = new byte[16];
+            passwordSalt = new byte[SaltLength];
             RandomNumberGenerator.Fill(passwordSalt);
 
-            // Use Argon2id for password hashing
-            using (var argon2 = new Argon2id(Encoding.UTF8.GetBytes(password))) {
-                argon2.Salt = passwordSalt;
-                argon2.DegreeOfParallelism = 8; // Number of threads to use
-                argon2.MemorySize = 65536; // Amount of memory to use (in KB)
-                argon2.Iterations = 4; // Number of iterations
-
-                passwordHash = argon2.GetBytes(32); // Generate a 32-byte hash
-            } // argon2.Dispose() is called automatically here
+            Argon2Parameters parameters = Current;
+            passwordHash = new byte[HeaderLength + HashLength];
+            passwordHash[0] = HashMarker;
+            passwordHash[1] = HashVersion;
+            passwordHash[2] = (byte)parameters.Parallelism;
+            BinaryPrimitives.WriteInt32LittleEndian(passwordHash.AsSpan(4), parameters.MemoryKB);
+            BinaryPrimitives.WriteInt32LittleEndian(passwordHash.AsSpan(8), parameters.Iterations);
+            Hash(password, passwordSalt, parameters).CopyTo(passwordHash, HeaderLength);
 
-            Logging.Write($"Password hash: {BitConverter.ToString(passwordHash)}");
+            Logging.Write(LogLevel.Trace, $"Password hash: {BitConverter.ToString(passwordHash)}");
         }
 
         /// <summary>
-        /// Verifies a password hash using Argon2id.
+        /// Verifies a password hash using Argon2id, with the parameters stored in the hash.
         /// </summary>
         public static bool VerifyPasswordHash(string password, byte[] storedHash, byte[] storedSalt) {
-            byte[] computedHash;
-            using (var argon2 = new Argon2id(Encoding.UTF8.GetBytes(password))) {
-                argon2.Salt = storedSalt;
-                argon2.DegreeOfParallelism = 8;
-                argon2.MemorySize = 65536;
-                argon2.Iterations = 4;
-
-                computedHash = argon2.GetBytes(32);
-            } // argon2.Dispose() is called automatically here
+            if (!TryReadParameters(storedHash, out Argon2Parameters parameters, out int digestOffset)) {
+                Logging.Write(LogLevel.Warning, "Stored password hash is in an unknown format.");
+                return false;
+            }
+            byte[] computedHash = Hash(password, storedSalt, parameters);
 
-            Logging.Write("Computed hash: " + BitConverter.ToString(computedHash));
+            Logging.Write(LogLevel.Trace, $"Computed hash: {BitConverter.ToString(computedHash)}");
 
             // Compare the computed hash with the stored hash using constant-time comparison
-            return CryptographicOperations.FixedTimeEquals(computedHash, storedHash);
+            return CryptographicOperations.FixedTimeEquals(computedHash, storedHash.AsSpan(digestOffset));
+        }
+
+        /// <summary>
+        /// Runs the verification on the thread pool so the caller can carry on with startup meanwhile.
+        /// </summary>
+        public static Task<bool> VerifyPasswordHashAsync(string password, byte[] storedHash, byte[] storedSalt) {
+            return Task.Run(() => VerifyPasswordHash(password, storedHash, storedSalt));
+        }
+
+        /// <summary>
+        /// True when the hash was made with other parameters than Current and should be replaced after a
+        /// successful login.
+        /// </summary>
+        public static bool NeedsRehash(byte[] storedHash) {
+            return !TryReadParameters(storedHash, out Argon2Parameters parameters, out _) || parameters != Current;
+        }
+
+        /// <summary>
+        /// Picks parameters that take about the target time on this machine. Memory starts at a sixteenth of what
+        /// the process may use (within 19..256 MiB) and halves until the minimum number of passes fits the target;
+        /// iterations then fill the budget.
+        /// </summary>
+        public static Argon2Parameters Calibrate(TimeSpan target) {
+            int parallelism = Math.Clamp(System.Environment.ProcessorCount, 1, 8);
+            long available = GC.GetGCMemoryInfo().TotalAvailableMemoryBytes;
+            int memoryKB = (int)Math.Clamp(available / 16 / 1024, MinMemoryKB, MaxMemoryKB);
+
+            double onePass;
+            while (true) {
+                onePass = Measure(new Argon2Parameters(parallelism, memoryKB, 1));
+                if (onePass * MinIterations <= target.TotalMilliseconds || memoryKB <= MinMemoryKB) {
+                    break;
+                }
+                memoryKB = Math.Max(MinMemoryKB, memoryKB / 2);
+            }
+            int iterations = Math.Clamp((int)(target.TotalMilliseconds / Math.Max(onePass, 1)), MinIterations, MaxIterations);
+
+            var parameters = new Argon2Parameters(parallelism, memoryKB, iterations);
+            Logging.Write($"Argon2 calibrated for {target.TotalMilliseconds} ms: {parameters} "
+                + $"(one pass took {onePass:F0} ms).");
+            return parameters;
+        }
+
+        /// <summary>
+        /// Stores calibrated parameters for new hashes. Existing hashes keep verifying with their own.
+        /// </summary>
+        public static void SaveParameters(Argon2Parameters parameters) {
+            File.WriteAllLines(Environment.HashParametersPath, [
+                "# Argon2id parameters for new password hashes, written by --calibrate",
+                $"parallelism={parameters.Parallelism}",
+                $"memory_kb={parameters.MemoryKB}",
+                $"iterations={parameters.Iterations}"
+            ]);
+        }
+
+        private static Argon2Parameters LoadParameters() {
+            var fallback = Argon2Parameters.Legacy with { Parallelism = Math.Clamp(System.Environment.ProcessorCount, 1, 8) };
+            if (!File.Exists(Environment.HashParametersPath)) {
+                return fallback;
+            }
+            int parallelism = 0, memoryKB = 0, iterations = 0;
+            foreach (string line in File.ReadLines(Environment.HashParametersPath)) {
+                string[] pair = line.Split('=', 2, StringSplitOptions.TrimEntries);
+                if (pair.Length != 2 || !int.TryParse(pair[1], NumberStyles.Integer, CultureInfo.InvariantCulture, out int value)) {
+                    continue;
+                }
+                switch (pair[0]) {
+                    case "parallelism": parallelism = value; break;
+                    case "memory_kb": memoryKB = value; break;
+                    case "iterations": iterations = value; break;
+                }
+            }
+            if (parallelism is < 1 or > 255 || memoryKB < 8 * parallelism || iterations < 1) {
+                Logging.Write(LogLevel.Warning, $"Ignoring invalid Argon2 parameters in {Environment.HashParametersPath}.");
+                return fallback;
+            }
+            return new Argon2Parameters(parallelism, memoryKB, iterations);
+        }
+
+        private static bool TryReadParameters(byte[] storedHash, out Argon2Parameters parameters, out int digestOffset) {
+            if (storedHash.Length == HashLength) {
+                parameters = Argon2Parameters.Legacy;
+                digestOffset = 0;
+                return true;
+            }
+            parameters = default;
+            digestOffset = HeaderLength;
+            if (storedHash.Length != HeaderLength + HashLength || storedHash[0] != HashMarker || storedHash[1] != HashVersion) {
+                return false;
+            }
+            parameters = new Argon2Parameters(storedHash[2],
+                BinaryPrimitives.ReadInt32LittleEndian(storedHash.AsSpan(4)),
+                BinaryPrimitives.ReadInt32LittleEndian(storedHash.AsSpan(8)));
+            return parameters.Parallelism > 0 && parameters.MemoryKB > 0 && parameters.Iterations > 0;
+        }
+
+        private static byte[] Hash(string password, byte[] salt, Argon2Parameters parameters) {
+            using var argon2 = new Argon2id(Encoding.UTF8.GetBytes(password));
+            argon2.Salt = salt;
+            argon2.DegreeOfParallelism = parameters.Parallelism;
+            argon2.MemorySize = parameters.MemoryKB;
+            argon2.Iterations = parameters.Iterations;
+            return argon2.GetBytes(HashLength);
+        }
+
+        // Best of two runs, in milliseconds
+        private static double Measure(Argon2Parameters parameters) {
+            byte[] salt = new byte[SaltLength];
+            double best = double.MaxValue;
+            for (int i = 0; i < 2; i++) {
+                long started = Stopwatch.GetTimestamp();
+                Hash("calibration", salt, parameters);
+                best = Math.Min(best, Stopwatch.GetElapsedTime(started).TotalMilliseconds);
+            }
+            return best;
         }
     }
 }
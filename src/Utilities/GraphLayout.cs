@@ -0,0 +1,354 @@
+// Node positions for drawing the connection graph, computed off the UI thread from graph snapshots
+// Placed nodes stay pinned; only the neighbourhood of added or removed vertices is relaid with MSAGL
+
+using System.Diagnostics;
+using Microsoft.Msagl.Core.Geometry;
+using Microsoft.Msagl.Core.Geometry.Curves;
+using Microsoft.Msagl.Core.Layout;
+using Microsoft.Msagl.Layout.Incremental;
+using TLScope.src.Debugging;
+
+namespace TLScope.src.Utilities {
+    /// <summary>
+    /// One placed vertex. Coordinates are in layout units: one unit is a terminal column, two are a row.
+    /// </summary>
+    public readonly record struct LayoutNode(UInt128 Address, double X, double Y, string Label, bool Local);
+
+    /// <summary>
+    /// Immutable layout of one graph version. Edges index into Nodes. Safe to hold from any thread.
+    /// </summary>
+    public sealed class LayoutSnapshot {
+        public static readonly LayoutSnapshot Empty = new(0, [], [], 0, 0, 0, 0);
+
+        public long Version { get; }
+        public IReadOnlyList<LayoutNode> Nodes { get; }
+        public IReadOnlyList<(int From, int To)> Edges { get; }
+        public double Left { get; }
+        public double Top { get; }
+        public double Right { get; }
+        public double Bottom { get; }
+
+        internal LayoutSnapshot(long version, LayoutNode[] nodes, (int, int)[] edges,
+            double left, double top, double right, double bottom) {
+            Version = version;
+            Nodes = nodes;
+            Edges = edges;
+            Left = left;
+            Top = top;
+            Right = right;
+            Bottom = bottom;
+        }
+    }
+
+    public sealed class GraphLayout {
+        public const double NodeWidth = 14;
+        public const double NodeHeight = 4;
+        private const double NodeSeparation = 2;
+
+        private readonly SemaphoreSlim _signal = new(0, 1);
+        private GraphSnapshot? _pending;
+        private LayoutSnapshot _current = LayoutSnapshot.Empty;
+
+        // Owned by the worker: positions survive across snapshots, which is what keeps the picture stable
+        private readonly Dictionary<UInt128, Placement> _placed = [];
+        private readonly HashSet<HostPair> _edges = [];
+
+        /// <summary>
+        /// Raised on the worker after each published layout.
+        /// </summary>
+        public event EventHandler<LayoutSnapshot>? Updated;
+
+        public LayoutSnapshot Current => Volatile.Read(ref _current);
+
+        /// <summary>
+        /// Hands the worker a newer snapshot. Only the latest one posted before the worker wakes is laid out.
+        /// </summary>
+        public void Post(GraphSnapshot snapshot) {
+            if (Interlocked.Exchange(ref _pending, snapshot) == null) {
+                _signal.Release();
+            }
+        }
+
+        /// <summary>
+        /// Lays out posted snapshots until cancelled, after a short debounce so a burst of deltas costs one pass.
+        /// </summary>
+        public async Task RunAsync(CancellationToken cancTok) {
+            try {
+                while (true) {
+                    await _signal.WaitAsync(cancTok).ConfigureAwait(false);
+                    await Task.Delay(Settings.GraphLayoutDebounce, cancTok).ConfigureAwait(false);
+                    GraphSnapshot? snapshot = Interlocked.Exchange(ref _pending, null);
+                    if (snapshot != null) {
+                        Update(snapshot);
+                    }
+                }
+            } catch (OperationCanceledException) {
+                Logging.Write("Graph layout stopped.");
+            }
+        }
+
+        /// <summary>
+        /// Brings the layout up to date with the snapshot and publishes it when anything visible changed.
+        /// Runs on the worker; called directly by the benchmarks.
+        /// </summary>
+        internal LayoutSnapshot Update(GraphSnapshot snapshot) {
+            long started = Stopwatch.GetTimestamp();
+            var loose = new HashSet<UInt128>(); // vertices the relayout may move
+            bool changed = false;
+
+            // Neighbours of a removed vertex close the gap it leaves; its edges are still in _edges here
+            var removed = new HashSet<UInt128>();
+            foreach (UInt128 address in _placed.Keys) {
+                if (!snapshot.Vertices.ContainsKey(address)) {
+                    removed.Add(address);
+                }
+            }
+            foreach (HostPair pair in _edges) {
+                if (removed.Contains(pair.Low) && !removed.Contains(pair.High)) {
+                    loose.Add(pair.High);
+                } else if (removed.Contains(pair.High) && !removed.Contains(pair.Low)) {
+                    loose.Add(pair.Low);
+                }
+            }
+            foreach (UInt128 address in removed) {
+                _placed.Remove(address);
+            }
+            changed |= removed.Count > 0;
+            changed |= _edges.RemoveWhere(pair => !snapshot.Edges.ContainsKey(pair)) > 0;
+            foreach (HostPair pair in snapshot.Edges.Keys) {
+                changed |= _edges.Add(pair);
+            }
+
+            // Labels and device state change without moving anything; an unchanged vertex keeps its record
+            var added = new List<UInt128>();
+            foreach (GraphVertex vertex in snapshot.Vertices.Values) {
+                if (!_placed.TryGetValue(vertex.Address, out Placement? placement)) {
+                    _placed[vertex.Address] = new Placement { Vertex = vertex, Label = vertex.ToString(), Local = vertex.Device != null };
+                    added.Add(vertex.Address);
+                } else if (!ReferenceEquals(placement.Vertex, vertex)) {
+                    placement.Vertex = vertex;
+                    string label = vertex.ToString();
+                    bool local = vertex.Device != null;
+                    if (placement.Label != label || placement.Local != local) {
+                        placement.Label = label;
+                        placement.Local = local;
+                        changed = true;
+                    }
+                }
+            }
+
+            if (added.Count > 0) {
+                Seed(added, snapshot);
+                loose.UnionWith(added);
+            }
+            if (loose.Count > 0) {
+                try {
+                    Relax(loose, snapshot);
+                } catch (Exception ex) {
+                    // The seeded positions are kept; the next change gets another go
+                    Logging.Error("Graph layout failed; keeping the seeded positions.", ex);
+                }
+                changed = true;
+            }
+            if (!changed) {
+                return Current;
+            }
+
+            LayoutSnapshot layout = Publish(snapshot.Version);
+            Telemetry.LayoutDuration.Record(Telemetry.ElapsedMilliseconds(started));
+            Updated?.Invoke(this, layout);
+            return layout;
+        }
+
+        // Starting positions for new vertices: next to the placed neighbours they are linked to, or on a spiral
+        // just outside the drawing for those that are not linked to anything placed yet
+        private void Seed(List<UInt128> added, GraphSnapshot snapshot) {
+            var neighbours = new Dictionary<UInt128, List<UInt128>>();
+            var pending = new HashSet<UInt128>(added);
+            foreach (HostPair pair in snapshot.Edges.Keys) {
+                if (pending.Contains(pair.Low)) {
+                    Neighbours(neighbours, pair.Low).Add(pair.High);
+                }
+                if (pending.Contains(pair.High)) {
+                    Neighbours(neighbours, pair.High).Add(pair.Low);
+                }
+            }
+
+            GetBounds(out double left, out double top, out double right, out double bottom, pending);
+            double centerX = (left + right) / 2, centerY = (top + bottom) / 2;
+            double radius = _placed.Count > pending.Count ? Math.Max(right - left, bottom - top) / 2 + NodeWidth : 0;
+            int outside = 0;
+
+            var frontier = new Queue<UInt128>();
+            foreach (UInt128 address in added) {
+                if (!pending.Contains(address)) {
+                    continue;
+                }
+                // Lone vertex or the first of a new component; anything linked to it is seeded from here on
+                if (!TryAnchor(address, neighbours, pending)) {
+                    double angle = outside * 2.399963; // golden angle keeps successive spots apart
+                    double r = radius + NodeWidth * Math.Sqrt(outside);
+                    outside++;
+                    Place(address, centerX + r * Math.Cos(angle), centerY + r * Math.Sin(angle));
+                    pending.Remove(address);
+                }
+                frontier.Enqueue(address);
+                while (frontier.TryDequeue(out UInt128 seeded)) {
+                    if (!neighbours.TryGetValue(seeded, out List<UInt128>? next)) {
+                        continue;
+                    }
+                    foreach (UInt128 neighbour in next) {
+                        if (pending.Contains(neighbour) && TryAnchor(neighbour, neighbours, pending)) {
+                            frontier.Enqueue(neighbour);
+                        }
+                    }
+                }
+            }
+        }
+
+        // Places a pending vertex at the centroid of its placed neighbours, nudged off it so siblings do not stack
+        private bool TryAnchor(UInt128 address, Dictionary<UInt128, List<UInt128>> neighbours, HashSet<UInt128> pending) {
+            if (!neighbours.TryGetValue(address, out List<UInt128>? linked)) {
+                return false;
+            }
+            double x = 0, y = 0;
+            int count = 0;
+            foreach (UInt128 neighbour in linked) {
+                if (!pending.Contains(neighbour) && _placed.TryGetValue(neighbour, out Placement? placement)) {
+                    x += placement.X;
+                    y += placement.Y;
+                    count++;
+                }
+            }
+            if (count == 0) {
+                return false;
+            }
+            ulong hash = ((ulong)address ^ (ulong)(address >> 64)) * 0x9E3779B97F4A7C15;
+            double angle = (hash >> 11) * (2 * Math.PI / (1ul << 53));
+            Place(address, x / count + NodeWidth * Math.Cos(angle), y / count + NodeWidth * Math.Sin(angle));
+            pending.Remove(address);
+            return true;
+        }
+
+        private static List<UInt128> Neighbours(Dictionary<UInt128, List<UInt128>> neighbours, UInt128 address) {
+            if (!neighbours.TryGetValue(address, out List<UInt128>? list)) {
+                list = [];
+                neighbours[address] = list;
+            }
+            return list;
+        }
+
+        private void Place(UInt128 address, double x, double y) {
+            Placement placement = _placed[address];
+            placement.X = x;
+            placement.Y = y;
+        }
+
+        /// <summary>
+        /// Runs MSAGL's incremental force layout over the loose vertices and what surrounds them. Their placed
+        /// neighbours, and placed vertices in the same area, take part locked in place so the rest of the drawing
+        /// does not move and the loose ones settle around it without overlapping.
+        /// </summary>
+        private void Relax(HashSet<UInt128> loose, GraphSnapshot snapshot) {
+            var nodes = new Dictionary<UInt128, Node>();
+            var geometry = new GeometryGraph();
+            foreach (UInt128 address in loose) {
+                AddNode(geometry, nodes, address);
+            }
+            foreach (HostPair pair in snapshot.Edges.Keys) {
+                if (pair.Low != pair.High && (loose.Contains(pair.Low) || loose.Contains(pair.High))) {
+                    geometry.Edges.Add(new Edge(AddNode(geometry, nodes, pair.Low), AddNode(geometry, nodes, pair.High)));
+                }
+            }
+            GetBounds(out double left, out double top, out double right, out double bottom, null, loose);
+            left -= NodeWidth;
+            right += NodeWidth;
+            top -= NodeHeight;
+            bottom += NodeHeight;
+            foreach ((UInt128 address, Placement placement) in _placed) {
+                if (placement.X >= left && placement.X <= right && placement.Y >= top && placement.Y <= bottom) {
+                    AddNode(geometry, nodes, address);
+                }
+            }
+
+            var settings = new FastIncrementalLayoutSettings {
+                AvoidOverlaps = true,
+                NodeSeparation = NodeSeparation,
+            };
+            foreach ((UInt128 address, Node node) in nodes) {
+                if (!loose.Contains(address)) {
+                    settings.CreateLock(node, node.BoundingBox);
+                }
+            }
+            for (int i = 0; i < Settings.GraphLayoutIterations; i++) {
+                settings.IncrementalRun(geometry);
+                if (settings.Converged) {
+                    break;
+                }
+            }
+
+            foreach (UInt128 address in loose) {
+                Point center = nodes[address].Center;
+                Place(address, center.X, center.Y);
+            }
+        }
+
+        private Node AddNode(GeometryGraph geometry, Dictionary<UInt128, Node> nodes, UInt128 address) {
+            if (!nodes.TryGetValue(address, out Node? node)) {
+                Placement placement = _placed[address];
+                node = new Node(CurveFactory.CreateRectangle(NodeWidth, NodeHeight, new Point(placement.X, placement.Y)), address);
+                nodes[address] = node;
+                geometry.Nodes.Add(node);
+            }
+            return node;
+        }
+
+        // Bounds of the placed vertices, skipping those in exclude, or only those in include when it is given
+        private void GetBounds(out double left, out double top, out double right, out double bottom,
+            HashSet<UInt128>? exclude, HashSet<UInt128>? include = null) {
+            left = top = double.MaxValue;
+            right = bottom = double.MinValue;
+            foreach ((UInt128 address, Placement placement) in _placed) {
+                if (exclude?.Contains(address) == true || include?.Contains(address) == false) {
+                    continue;
+                }
+                left = Math.Min(left, placement.X);
+                right = Math.Max(right, placement.X);
+                top = Math.Min(top, placement.Y);
+                bottom = Math.Max(bottom, placement.Y);
+            }
+            if (left > right) {
+                left = top = right = bottom = 0;
+            }
+        }
+
+        private LayoutSnapshot Publish(long version) {
+            var nodes = new LayoutNode[_placed.Count];
+            var index = new Dictionary<UInt128, int>(_placed.Count);
+            int i = 0;
+            foreach ((UInt128 address, Placement placement) in _placed) {
+                index[address] = i;
+                nodes[i++] = new LayoutNode(address, placement.X, placement.Y, placement.Label, placement.Local);
+            }
+            var edges = new List<(int, int)>(_edges.Count);
+            foreach (HostPair pair in _edges) {
+                if (index.TryGetValue(pair.Low, out int from) && index.TryGetValue(pair.High, out int to)) {
+                    edges.Add((from, to));
+                }
+            }
+            GetBounds(out double left, out double top, out double right, out double bottom, null);
+            var layout = new LayoutSnapshot(version, nodes, [.. edges], left - NodeWidth / 2, top - NodeHeight / 2,
+                right + NodeWidth / 2, bottom + NodeHeight / 2);
+            Volatile.Write(ref _current, layout);
+            return layout;
+        }
+
+        private sealed class Placement {
+            public GraphVertex? Vertex;
+            public double X;
+            public double Y;
+            public string Label = "";
+            public bool Local;
+        }
+    }
+}
@@ -0,0 +1,283 @@
+// Connection graph: hosts are vertices and all TLS sessions between two hosts fold into one weighted edge
+// Writers apply deltas to persistent collections and publish a new snapshot; readers keep whichever one they hold
+
+using System.Collections.Immutable;
+using QuikGraph;
+using TLScope.src.Data;
+using TLScope.src.Services;
+
+namespace TLScope.src.Utilities {
+    /// <summary>
+    /// Unordered pair of host addresses, the key that parallel sessions are folded under.
+    /// </summary>
+    public readonly record struct HostPair {
+        public UInt128 Low { get; }
+        public UInt128 High { get; }
+
+        public HostPair(UInt128 a, UInt128 b) {
+            (Low, High) = a <= b ? (a, b) : (b, a);
+        }
+    }
+
+    /// <summary>
+    /// Session event for the graph. The interned IDs (see <see cref="Interned"/>) are references owned by the
+    /// delta; <see cref="ConnectionGraph.Apply(IReadOnlyList{FlowDelta})"/> takes them over.
+    /// </summary>
+    public readonly record struct FlowDelta(FlowKey Flow, bool Opened, long Bytes, long TimestampTicks,
+        int ServerName = 0, int Ja3 = 0, int Ja4 = 0, int Certificate = 0);
+
+    /// <summary>
+    /// Host vertex. Device is set while the host is in the local device table; remote peers only have an address.
+    /// </summary>
+    public sealed record GraphVertex(UInt128 Address, DeviceRecord? Device, int Degree) {
+        public override string ToString() {
+            return Device?.Name ?? FlowKey.ToIPAddress(Address).ToString();
+        }
+    }
+
+    /// <summary>
+    /// All sessions seen between two hosts. Source is the side that opened the first of them. The interned
+    /// IDs are those of the latest session that carried one, held by the edge until it expires.
+    /// </summary>
+    public sealed record ConnectionEdge(UInt128 Source, UInt128 Target, long Sessions, long Bytes,
+        long FirstSeenTicks, long LastSeenTicks) : IEdge<UInt128> {
+
+        public int ServerName { get; init; }
+        public int Ja3 { get; init; }
+        public int Ja4 { get; init; }
+        public int Certificate { get; init; }
+
+        public HostPair Pair => new(Source, Target);
+
+        internal void ReleaseInterned() {
+            Interned.ServerNames.Release(ServerName);
+            Interned.Ja3.Release(Ja3);
+            Interned.Ja4.Release(Ja4);
+            Interned.Certificates.Release(Certificate);
+        }
+    }
+
+    /// <summary>
+    /// Immutable view of the graph at one version. Safe to hold and enumerate from any thread.
+    /// </summary>
+    public sealed class GraphSnapshot {
+        public static readonly GraphSnapshot Empty = new(0,
+            ImmutableDictionary<UInt128, GraphVertex>.Empty, ImmutableDictionary<HostPair, ConnectionEdge>.Empty);
+
+        private UndirectedGraph<UInt128, ConnectionEdge>? _graph;
+
+        public long Version { get; }
+        public ImmutableDictionary<UInt128, GraphVertex> Vertices { get; }
+        public ImmutableDictionary<HostPair, ConnectionEdge> Edges { get; }
+
+        internal GraphSnapshot(long version, ImmutableDictionary<UInt128, GraphVertex> vertices,
+            ImmutableDictionary<HostPair, ConnectionEdge> edges) {
+            Version = version;
+            Vertices = vertices;
+            Edges = edges;
+        }
+
+        /// <summary>
+        /// QuikGraph view for running graph algorithms, built on first use and cached with the snapshot.
+        /// </summary>
+        public IUndirectedGraph<UInt128, ConnectionEdge> AsGraph() {
+            return LazyInitializer.EnsureInitialized(ref _graph, () => {
+                var graph = new UndirectedGraph<UInt128, ConnectionEdge>(false);
+                graph.AddVertexRange(Vertices.Keys);
+                graph.AddEdgeRange(Edges.Values);
+                return graph;
+            });
+        }
+    }
+
+    public sealed class ConnectionGraph {
+        private readonly object _writeLock = new(); // writers are serialised; readers never take it
+        private GraphSnapshot _current = GraphSnapshot.Empty;
+
+        /// <summary>
+        /// Raised after each published change, on the writer's thread.
+        /// </summary>
+        public event EventHandler<GraphSnapshot>? Changed;
+
+        public GraphSnapshot Snapshot => Volatile.Read(ref _current);
+
+        /// <summary>
+        /// Mirrors device table changes onto vertices. Removed devices keep their vertex while edges still reference it.
+        /// </summary>
+        public void Apply(DeviceDeltaEventArgs delta) {
+            Publish(current => {
+                var vertices = current.Vertices.ToBuilder();
+                foreach (var change in delta.Changes) {
+                    UInt128 address = FlowKey.MapIPv4(change.Device.IP);
+                    vertices.TryGetValue(address, out GraphVertex? vertex);
+                    if (change.Kind == DeviceChangeKind.Removed) {
+                        if (vertex == null) {
+                            continue;
+                        }
+                        if (vertex.Degree == 0) {
+                            vertices.Remove(address);
+                        } else {
+                            vertices[address] = vertex with { Device = null };
+                        }
+                    } else {
+                        vertices[address] = vertex == null
+                            ? new GraphVertex(address, change.Device, 0)
+                            : vertex with { Device = change.Device };
+                    }
+                }
+                return (vertices.ToImmutable(), current.Edges);
+            });
+        }
+
+        public void Apply(in FlowDelta delta) {
+            var single = delta;
+            Publish(current => ApplyFlows(current, new ReadOnlySpan<FlowDelta>(in single)));
+        }
+
+        /// <summary>
+        /// Folds a batch of session events into edges, adding endpoint vertices as needed. One snapshot per batch.
+        /// </summary>
+        public void Apply(IReadOnlyList<FlowDelta> deltas) {
+            if (deltas.Count == 0) {
+                return;
+            }
+            FlowDelta[] batch = [.. deltas];
+            Publish(current => ApplyFlows(current, batch));
+        }
+
+        /// <summary>
+        /// Replaces every edge with the given ones, e.g. the totals an agent resends after a reconnect. The new edges
+        /// hand over their interned references; vertices keep their devices.
+        /// </summary>
+        public void Replace(IReadOnlyList<ConnectionEdge> edges) {
+            ConnectionEdge[] replacement = [.. edges];
+            Publish(current => {
+                var vertices = current.Vertices.ToBuilder();
+                foreach (ConnectionEdge edge in current.Edges.Values) {
+                    edge.ReleaseInterned();
+                    Detach(vertices, edge.Source);
+                    Detach(vertices, edge.Target);
+                }
+                var next = ImmutableDictionary.CreateBuilder<HostPair, ConnectionEdge>();
+                foreach (ConnectionEdge edge in replacement) {
+                    if (edge.Source == edge.Target || !next.TryAdd(edge.Pair, edge)) {
+                        edge.ReleaseInterned();
+                        continue;
+                    }
+                    Attach(vertices, edge.Source);
+                    Attach(vertices, edge.Target);
+                }
+                return (vertices.ToImmutable(), next.ToImmutable());
+            });
+        }
+
+        /// <summary>
+        /// Drops edges with no traffic since the given time, and vertices left with neither edges nor a device.
+        /// Returns the number of edges removed.
+        /// </summary>
+        public int ExpireIdle(long idleBeforeTicks) {
+            int expired = 0;
+            Publish(current => {
+                ImmutableDictionary<UInt128, GraphVertex>.Builder? vertices = null;
+                ImmutableDictionary<HostPair, ConnectionEdge>.Builder? edges = null;
+                foreach (var pair in current.Edges) {
+                    if (pair.Value.LastSeenTicks >= idleBeforeTicks) {
+                        continue;
+                    }
+                    vertices ??= current.Vertices.ToBuilder();
+                    edges ??= current.Edges.ToBuilder();
+                    edges.Remove(pair.Key);
+                    pair.Value.ReleaseInterned();
+                    Detach(vertices, pair.Key.Low);
+                    Detach(vertices, pair.Key.High);
+                    expired++;
+                }
+                return vertices == null || edges == null
+                    ? (current.Vertices, current.Edges)
+                    : (vertices.ToImmutable(), edges.ToImmutable());
+            });
+            return expired;
+        }
+
+        private static (ImmutableDictionary<UInt128, GraphVertex>, ImmutableDictionary<HostPair, ConnectionEdge>) ApplyFlows(
+            GraphSnapshot current, ReadOnlySpan<FlowDelta> deltas) {
+            var vertices = current.Vertices.ToBuilder();
+            var edges = current.Edges.ToBuilder();
+            foreach (ref readonly FlowDelta delta in deltas) {
+                FlowKey flow = delta.Flow;
+                var key = new HostPair(flow.SourceAddress, flow.DestinationAddress);
+                // Publish runs this exactly once per batch under the write lock, so reference handover is safe here
+                if (edges.TryGetValue(key, out ConnectionEdge? edge)) {
+                    edges[key] = edge with {
+                        Sessions = edge.Sessions + (delta.Opened ? 1 : 0),
+                        Bytes = edge.Bytes + delta.Bytes,
+                        LastSeenTicks = Math.Max(edge.LastSeenTicks, delta.TimestampTicks),
+                        ServerName = Adopt(Interned.ServerNames, edge.ServerName, delta.ServerName),
+                        Ja3 = Adopt(Interned.Ja3, edge.Ja3, delta.Ja3),
+                        Ja4 = Adopt(Interned.Ja4, edge.Ja4, delta.Ja4),
+                        Certificate = Adopt(Interned.Certificates, edge.Certificate, delta.Certificate)
+                    };
+                    continue;
+                }
+                if (flow.SourceAddress == flow.DestinationAddress) {
+                    Interned.ServerNames.Release(delta.ServerName);
+                    Interned.Ja3.Release(delta.Ja3);
+                    Interned.Ja4.Release(delta.Ja4);
+                    Interned.Certificates.Release(delta.Certificate);
+                    continue;
+                }
+                edges[key] = new ConnectionEdge(flow.SourceAddress, flow.DestinationAddress,
+                    delta.Opened ? 1 : 0, delta.Bytes, delta.TimestampTicks, delta.TimestampTicks) {
+                    ServerName = delta.ServerName,
+                    Ja3 = delta.Ja3,
+                    Ja4 = delta.Ja4,
+                    Certificate = delta.Certificate
+                };
+                Attach(vertices, flow.SourceAddress);
+                Attach(vertices, flow.DestinationAddress);
+            }
+            return (vertices.ToImmutable(), edges.ToImmutable());
+        }
+
+        // The edge keeps one reference per ID: a new ID replaces the held one, a repeat gives its reference back
+        private static int Adopt<TKey, TValue>(InternPool<TKey, TValue> pool, int held, int incoming) where TKey : notnull {
+            if (incoming == 0) {
+                return held;
+            }
+            pool.Release(incoming == held ? incoming : held);
+            return incoming;
+        }
+
+        private static void Attach(ImmutableDictionary<UInt128, GraphVertex>.Builder vertices, UInt128 address) {
+            vertices[address] = vertices.TryGetValue(address, out GraphVertex? vertex)
+                ? vertex with { Degree = vertex.Degree + 1 }
+                : new GraphVertex(address, null, 1);
+        }
+
+        private static void Detach(ImmutableDictionary<UInt128, GraphVertex>.Builder vertices, UInt128 address) {
+            if (!vertices.TryGetValue(address, out GraphVertex? vertex)) {
+                return;
+            }
+            if (vertex.Degree <= 1 && vertex.Device == null) {
+                vertices.Remove(address);
+            } else {
+                vertices[address] = vertex with { Degree = Math.Max(0, vertex.Degree - 1) };
+            }
+        }
+
+        private void Publish(Func<GraphSnapshot, (ImmutableDictionary<UInt128, GraphVertex> Vertices,
+            ImmutableDictionary<HostPair, ConnectionEdge> Edges)> update) {
+            GraphSnapshot next;
+            lock (_writeLock) {
+                GraphSnapshot current = _current;
+                var (vertices, edges) = update(current);
+                if (ReferenceEquals(vertices, current.Vertices) && ReferenceEquals(edges, current.Edges)) {
+                    return;
+                }
+                next = new GraphSnapshot(current.Version + 1, vertices, edges);
+                Volatile.Write(ref _current, next);
+            }
+            Changed?.Invoke(this, next);
+        }
+    }
+}
@@ -0,0 +1,203 @@
+// ICMP echo engine sharing one socket across all probed hosts
+// Replies are matched by identifier/sequence on a single receive loop, timeouts expire in send order
+
+using System.Buffers.Binary;
+using System.Diagnostics;
+using System.Net;
+using System.Net.Sockets;
+
+using TLScope.src.Debugging;
+
+namespace TLScope.src.Utilities {
+    public sealed class IcmpEngine : IDisposable {
+        private const int EchoLength = 16; // ICMP header (8) + send timestamp (8)
+        private const int SOL_SOCKET = 1;
+        private const int SO_BINDTODEVICE = 25;
+
+        private static int opened; // engines opened so far, so concurrent raw engines use distinct identifiers
+
+        private readonly Socket _socket;
+        private readonly bool _isRaw;
+        private readonly ushort _identifier;
+        private readonly long _timeoutTicks;
+        private readonly SocketAddress _sendAddress;
+        private readonly byte[] _sendBuffer = new byte[EchoLength];
+        private readonly object _lock = new();
+        private readonly Dictionary<ushort, (uint IP, long SentAt)> _pending = [];
+        private readonly Queue<(ushort Sequence, long Deadline)> _deadlines = new();
+        private readonly CancellationTokenSource _cts = new();
+        private readonly Thread _receiver;
+        private ushort _sequence;
+
+        /// <summary>
+        /// Raised from the receive thread with the probed IPv4 (host byte order) and its RTT in ms, or null on timeout.
+        /// </summary>
+        public event Action<uint, double?>? Completed;
+
+        public int PendingCount {
+            get {
+                lock (_lock) {
+                    return _pending.Count;
+                }
+            }
+        }
+
+        private IcmpEngine(Socket socket, bool isRaw, TimeSpan timeout) {
+            _socket = socket;
+            _isRaw = isRaw;
+            _identifier = (ushort)(System.Environment.ProcessId + (Interlocked.Increment(ref opened) - 1) * 0x1000);
+            _timeoutTicks = (long)(timeout.TotalSeconds * Stopwatch.Frequency);
+            _sendAddress = new IPEndPoint(IPAddress.Any, 0).Serialize();
+            _socket.ReceiveTimeout = 100;
+            _receiver = new Thread(ReceiveLoop) { IsBackground = true, Name = "TLScope ICMP" };
+            _receiver.Start();
+        }
+
+        /// <summary>
+        /// Opens a raw ICMP socket, or an unprivileged ping socket where the kernel allows one.
+        /// Returns null if neither is available, in which case callers should fall back to Ping.
+        /// With an interface name, probes leave (and on Linux, replies are taken) only through that interface.
+        /// </summary>
+        public static IcmpEngine? TryOpen(TimeSpan timeout, string? interfaceName = null) {
+            foreach (var type in new[] { SocketType.Raw, SocketType.Dgram }) {
+                try {
+                    var socket = new Socket(AddressFamily.InterNetwork, type, ProtocolType.Icmp);
+                    if (interfaceName != null && OperatingSystem.IsLinux()) {
+                        BindToDevice(socket, interfaceName);
+                    }
+                    return new IcmpEngine(socket, type == SocketType.Raw, timeout);
+                } catch (SocketException ex) {
+                    Logging.Write($"ICMP {type} socket unavailable: {ex.SocketErrorCode}");
+                }
+            }
+            return null;
+        }
+
+        private static void BindToDevice(Socket socket, string interfaceName) {
+            byte[] name = new byte[interfaceName.Length + 1];
+            System.Text.Encoding.ASCII.GetBytes(interfaceName, name);
+            try {
+                socket.SetRawSocketOption(SOL_SOCKET, SO_BINDTODEVICE, name);
+            } catch (SocketException ex) {
+                // Unbound probes still follow the routing table, which is right for directly attached subnets
+                Logging.Write(LogLevel.Debug, $"Could not bind ICMP socket to {interfaceName}: {ex.SocketErrorCode}");
+            }
+        }
+
+        /// <summary>
+        /// Sends one echo request without waiting; the outcome arrives through Completed.
+        /// </summary>
+        public void Send(uint ip) {
+            lock (_lock) {
+                ushort sequence = ++_sequence;
+                long now = Stopwatch.GetTimestamp();
+                _pending[sequence] = (ip, now);
+                _deadlines.Enqueue((sequence, now + _timeoutTicks));
+
+                Span<byte> packet = _sendBuffer;
+                packet.Clear();
+                packet[0] = 8; // echo request
+                BinaryPrimitives.WriteUInt16BigEndian(packet[4..], _identifier);
+                BinaryPrimitives.WriteUInt16BigEndian(packet[6..], sequence);
+                BinaryPrimitives.WriteInt64BigEndian(packet[8..], now);
+                BinaryPrimitives.WriteUInt16BigEndian(packet[2..], Checksum(packet));
+
+                BinaryPrimitives.WriteUInt32BigEndian(_sendAddress.Buffer.Span[4..], ip);
+                try {
+                    _socket.SendTo(packet, SocketFlags.None, _sendAddress);
+                } catch (SocketException) {
+                    // unreachable routes surface as a timeout like any other silent host
+                }
+            }
+        }
+
+        private void ReceiveLoop() {
+            byte[] buffer = new byte[1500];
+            var from = new IPEndPoint(IPAddress.Any, 0).Serialize();
+            while (!_cts.IsCancellationRequested) {
+                int length = 0;
+                try {
+                    length = _socket.ReceiveFrom(buffer, SocketFlags.None, from);
+                } catch (SocketException ex) when (ex.SocketErrorCode == SocketError.TimedOut) {
+                } catch (Exception) when (_cts.IsCancellationRequested) {
+                    return;
+                } catch (SocketException ex) {
+                    Logging.Write(LogLevel.Warning, $"ICMP receive failed: {ex.SocketErrorCode}");
+                }
+
+                if (length > 0) {
+                    HandleReply(buffer.AsSpan(0, length), BinaryPrimitives.ReadUInt32BigEndian(from.Buffer.Span[4..]));
+                }
+                ExpireTimeouts();
+            }
+        }
+
+        private void HandleReply(ReadOnlySpan<byte> packet, uint source) {
+            if (_isRaw) {
+                // raw sockets deliver the IP header as well
+                int headerLength = (packet[0] & 0x0F) * 4;
+                if (packet.Length < headerLength + 8) {
+                    return;
+                }
+                packet = packet[headerLength..];
+                if (BinaryPrimitives.ReadUInt16BigEndian(packet[4..]) != _identifier) {
+                    return;
+                }
+            }
+            // ping sockets rewrite the identifier themselves and only deliver our own replies
+            if (packet.Length < 8 || packet[0] != 0) {
+                return;
+            }
+
+            ushort sequence = BinaryPrimitives.ReadUInt16BigEndian(packet[6..]);
+            (uint IP, long SentAt) probe;
+            lock (_lock) {
+                if (!_pending.TryGetValue(sequence, out probe) || probe.IP != source) {
+                    return;
+                }
+                _pending.Remove(sequence);
+            }
+            double rtt = (Stopwatch.GetTimestamp() - probe.SentAt) * 1000.0 / Stopwatch.Frequency;
+            Completed?.Invoke(probe.IP, rtt);
+        }
+
+        private void ExpireTimeouts() {
+            long now = Stopwatch.GetTimestamp();
+            while (true) {
+                uint expired;
+                lock (_lock) {
+                    if (!_deadlines.TryPeek(out var next) || next.Deadline > now) {
+                        return;
+                    }
+                    _deadlines.Dequeue();
+                    if (!_pending.Remove(next.Sequence, out var probe)) {
+                        continue; // already answered
+                    }
+                    expired = probe.IP;
+                }
+                Completed?.Invoke(expired, null);
+            }
+        }
+
+        private static ushort Checksum(ReadOnlySpan<byte> data) {
+            uint sum = 0;
+            for (int i = 0; i + 1 < data.Length; i += 2) {
+                sum += BinaryPrimitives.ReadUInt16BigEndian(data[i..]);
+            }
+            if ((data.Length & 1) != 0) {
+                sum += (uint)(data[^1] << 8);
+            }
+            while ((sum >> 16) != 0) {
+                sum = (sum & 0xFFFF) + (sum >> 16);
+            }
+            return (ushort)~sum;
+        }
+
+        public void Dispose() {
+            _cts.Cancel();
+            _socket.Dispose();
+            _receiver.Join(500);
+            _cts.Dispose();
+        }
+    }
+}
@@ -0,0 +1,209 @@
+// Wire format for the reverse lookups the name resolver sends: DNS/mDNS PTR queries and NetBIOS node status
+// Builders write into caller buffers; readers only accept answers for IPv4 reverse names
+
+using System.Buffers.Binary;
+using System.Text;
+
+namespace TLScope.src.Utilities {
+    /// <summary>
+    /// One reverse lookup answer. Name is null for a definite negative (NXDOMAIN or no usable record).
+    /// </summary>
+    public readonly record struct NameAnswer(uint IP, string? Name, uint TtlSeconds);
+
+    public static class NameQuery {
+        public const int DnsPort = 53;
+        public const int MdnsPort = 5353;
+        public const int NbnsPort = 137;
+
+        private const ushort TypePtr = 12;
+        private const ushort TypeNbstat = 0x21;
+        private const ushort ClassIn = 1;
+        private const int HeaderLength = 12;
+        private const int MaxNameLength = 255;
+
+        /// <summary>
+        /// Writes a recursive PTR query for d.c.b.a.in-addr.arpa. The same message serves as a legacy unicast
+        /// mDNS query when sent to 224.0.0.251:5353 from an ephemeral port.
+        /// </summary>
+        public static int WritePtrQuery(Span<byte> buffer, ushort id, uint ip, bool recursive) {
+            BinaryPrimitives.WriteUInt16BigEndian(buffer, id);
+            BinaryPrimitives.WriteUInt16BigEndian(buffer[2..], (ushort)(recursive ? 0x0100 : 0));
+            BinaryPrimitives.WriteUInt16BigEndian(buffer[4..], 1);
+            buffer[6..HeaderLength].Clear();
+            int offset = HeaderLength;
+            for (int shift = 0; shift < 32; shift += 8) {
+                offset += WriteLabel(buffer[offset..], ((ip >> shift) & 0xFF).ToString());
+            }
+            offset += WriteLabel(buffer[offset..], "in-addr");
+            offset += WriteLabel(buffer[offset..], "arpa");
+            buffer[offset++] = 0;
+            BinaryPrimitives.WriteUInt16BigEndian(buffer[offset..], TypePtr);
+            BinaryPrimitives.WriteUInt16BigEndian(buffer[(offset + 2)..], ClassIn);
+            return offset + 4;
+        }
+
+        /// <summary>
+        /// Writes a NetBIOS node status request for the wildcard name, sent unicast to port 137 of the host.
+        /// </summary>
+        public static int WriteNodeStatusQuery(Span<byte> buffer, ushort id) {
+            BinaryPrimitives.WriteUInt16BigEndian(buffer, id);
+            buffer[2..HeaderLength].Clear();
+            BinaryPrimitives.WriteUInt16BigEndian(buffer[4..], 1);
+            int offset = HeaderLength;
+            buffer[offset++] = 32;
+            // "*" followed by 15 NULs, first-level encoded as two 'A'-based nibbles per byte
+            buffer[offset++] = (byte)('A' + ('*' >> 4));
+            buffer[offset++] = (byte)('A' + ('*' & 0xF));
+            buffer.Slice(offset, 30).Fill((byte)'A');
+            offset += 30;
+            buffer[offset++] = 0;
+            BinaryPrimitives.WriteUInt16BigEndian(buffer[offset..], TypeNbstat);
+            BinaryPrimitives.WriteUInt16BigEndian(buffer[(offset + 2)..], ClassIn);
+            return offset + 4;
+        }
+
+        /// <summary>
+        /// Reads the PTR answer for the IPv4 reverse name in a DNS or mDNS response. NXDOMAIN and empty answers
+        /// become negatives for the name in the question; messages about anything else are rejected.
+        /// </summary>
+        public static bool TryReadPtrResponse(ReadOnlySpan<byte> message, out NameAnswer answer) {
+            answer = default;
+            if (message.Length < HeaderLength || (message[2] & 0x80) == 0) {
+                return false; // not a response
+            }
+            int rcode = message[3] & 0x0F;
+            int questions = BinaryPrimitives.ReadUInt16BigEndian(message[4..]);
+            int answers = BinaryPrimitives.ReadUInt16BigEndian(message[6..]);
+            int offset = HeaderLength;
+            uint? asked = null;
+            for (int i = 0; i < questions; i++) {
+                if (!TryReadName(message, ref offset, out string? name) || offset + 4 > message.Length) {
+                    return false;
+                }
+                asked ??= ParseReverseName(name);
+                offset += 4;
+            }
+
+            uint minTtl = uint.MaxValue;
+            for (int i = 0; i < answers; i++) {
+                if (!TryReadName(message, ref offset, out string? owner) || offset + 10 > message.Length) {
+                    return false;
+                }
+                ushort type = BinaryPrimitives.ReadUInt16BigEndian(message[offset..]);
+                uint ttl = BinaryPrimitives.ReadUInt32BigEndian(message[(offset + 4)..]);
+                int length = BinaryPrimitives.ReadUInt16BigEndian(message[(offset + 8)..]);
+                int rdata = offset + 10;
+                offset = rdata + length;
+                if (offset > message.Length) {
+                    return false;
+                }
+                minTtl = Math.Min(minTtl, ttl);
+                if (type == TypePtr && ParseReverseName(owner) is uint ip) {
+                    int target = rdata;
+                    if (TryReadName(message, ref target, out string? host) && host.Length > 0) {
+                        answer = new NameAnswer(ip, host, ttl);
+                        return true;
+                    }
+                }
+            }
+
+            // mDNS responders stay silent rather than deny, so only unicast DNS yields negatives
+            if (asked is uint question && (rcode == 3 || (rcode == 0 && answers == 0))) {
+                answer = new NameAnswer(question, null, minTtl == uint.MaxValue ? 0 : minTtl);
+                return true;
+            }
+            return false;
+        }
+
+        /// <summary>
+        /// Reads the workstation name (suffix 0x00, unique) from a node status response.
+        /// </summary>
+        public static bool TryReadNodeStatusResponse(ReadOnlySpan<byte> message, out string? name) {
+            name = null;
+            // header, 34-byte encoded name, type, class, TTL, RDLENGTH, name count
+            const int NamesOffset = HeaderLength + 34 + 10 + 1;
+            if (message.Length < NamesOffset || (message[2] & 0x80) == 0
+                || BinaryPrimitives.ReadUInt16BigEndian(message[6..]) == 0
+                || BinaryPrimitives.ReadUInt16BigEndian(message[(HeaderLength + 34)..]) != TypeNbstat) {
+                return false;
+            }
+            int count = message[NamesOffset - 1];
+            for (int i = 0; i < count; i++) {
+                int entry = NamesOffset + (i * 18);
+                if (entry + 18 > message.Length) {
+                    break;
+                }
+                bool group = (message[entry + 16] & 0x80) != 0;
+                if (message[entry + 15] == 0x00 && !group) {
+                    name = Encoding.ASCII.GetString(message.Slice(entry, 15)).TrimEnd(' ', '\0');
+                    return name.Length > 0;
+                }
+            }
+            return true; // answered, but without a workstation name
+        }
+
+        private static int WriteLabel(Span<byte> buffer, string label) {
+            buffer[0] = (byte)label.Length;
+            return Encoding.ASCII.GetBytes(label, buffer[1..]) + 1;
+        }
+
+        // Follows compression pointers; the offset advances past the name as it appears at its original position
+        private static bool TryReadName(ReadOnlySpan<byte> message, ref int offset, out string name) {
+            var text = new StringBuilder();
+            int position = offset;
+            int end = -1;
+            for (int hops = 0; hops < 32; hops++) {
+                if (position >= message.Length) {
+                    break;
+                }
+                int length = message[position];
+                if (length == 0) {
+                    offset = end >= 0 ? end : position + 1;
+                    name = text.ToString();
+                    return true;
+                }
+                if ((length & 0xC0) == 0xC0) {
+                    if (position + 1 >= message.Length) {
+                        break;
+                    }
+                    if (end < 0) {
+                        end = position + 2;
+                    }
+                    position = ((length & 0x3F) << 8) | message[position + 1];
+                    continue;
+                }
+                if (position + 1 + length > message.Length || text.Length + length + 1 > MaxNameLength) {
+                    break;
+                }
+                if (text.Length > 0) {
+                    text.Append('.');
+                }
+                text.Append(Encoding.ASCII.GetString(message.Slice(position + 1, length)));
+                position += 1 + length;
+                hops--; // only pointers count towards the loop guard
+            }
+            name = string.Empty;
+            return false;
+        }
+
+        // "d.c.b.a.in-addr.arpa" to a.b.c.d in host order
+        private static uint? ParseReverseName(string name) {
+            const string Suffix = ".in-addr.arpa";
+            if (!name.EndsWith(Suffix, StringComparison.OrdinalIgnoreCase)) {
+                return null;
+            }
+            string[] octets = name[..^Suffix.Length].Split('.');
+            if (octets.Length != 4) {
+                return null;
+            }
+            uint ip = 0;
+            for (int i = 3; i >= 0; i--) {
+                if (!byte.TryParse(octets[i], out byte octet)) {
+                    return null;
+                }
+                ip = (ip << 8) | octet;
+            }
+            return ip;
+        }
+    }
+}
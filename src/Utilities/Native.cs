@@ -0,0 +1,180 @@
+// Thin libc bindings for the raw-socket paths (Linux only); callers fall back when these are unavailable
+
+using System.Buffers.Binary;
+using System.Runtime.InteropServices;
+
+namespace TLScope.src.Utilities {
+    internal static class LibC {
+        public const int AF_PACKET = 17;
+        public const int SOCK_RAW = 3;
+        public const ushort ETH_P_ALL = 0x0003;
+        public const ushort ETH_P_ARP = 0x0806;
+        public const short POLLIN = 0x0001;
+
+        // Routing netlink (linux/netlink.h, linux/rtnetlink.h, linux/neighbour.h)
+        public const byte AF_INET6 = 10;
+        public const int AF_NETLINK = 16;
+        public const int NETLINK_ROUTE = 0;
+        public const ushort NLMSG_ERROR = 2;
+        public const ushort NLMSG_DONE = 3;
+        public const ushort NLM_F_REQUEST = 0x001;
+        public const ushort NLM_F_DUMP = 0x300;
+        public const ushort RTM_NEWNEIGH = 28;
+        public const ushort RTM_GETNEIGH = 30;
+        public const ushort NDA_DST = 1;
+        public const ushort NDA_LLADDR = 2;
+        public const ushort NUD_INCOMPLETE = 0x01;
+        public const ushort NUD_REACHABLE = 0x02;
+        public const ushort NUD_FAILED = 0x20;
+        public const ushort NUD_NOARP = 0x40;
+
+        // Packet ring (linux/if_packet.h, sys/mman.h)
+        public const int SOL_SOCKET = 1;
+        public const int SO_ATTACH_FILTER = 26;
+        public const int SOL_PACKET = 263;
+        public const int PACKET_RX_RING = 5;
+        public const int PACKET_STATISTICS = 6;
+        public const int PACKET_VERSION = 10;
+        public const int TPACKET_V3 = 2;
+        public const uint TP_STATUS_KERNEL = 0;
+        public const uint TP_STATUS_USER = 1;
+        public const int PROT_READ = 0x1;
+        public const int PROT_WRITE = 0x2;
+        public const int MAP_SHARED = 0x01;
+        public static readonly nint MAP_FAILED = -1;
+
+        [StructLayout(LayoutKind.Sequential)]
+        public struct SockAddrLl {
+            public ushort Family;
+            public ushort Protocol; // network byte order
+            public int IfIndex;
+            public ushort HaType;
+            public byte PktType;
+            public byte HaLen;
+            public ulong Addr;
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        public struct PollFd {
+            public int Fd;
+            public short Events;
+            public short REvents;
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        public struct TPacketReq3 {
+            public uint BlockSize;
+            public uint BlockCount;
+            public uint FrameSize;
+            public uint FrameCount;
+            public uint RetireTimeoutMs;
+            public uint SizeofPriv;
+            public uint FeatureReqWord;
+        }
+
+        // struct sock_filter: one classic BPF instruction
+        [StructLayout(LayoutKind.Sequential)]
+        public struct SockFilter {
+            public ushort Code;
+            public byte JumpTrue;
+            public byte JumpFalse;
+            public uint K;
+
+            public SockFilter(ushort code, byte jumpTrue, byte jumpFalse, uint k) {
+                Code = code;
+                JumpTrue = jumpTrue;
+                JumpFalse = jumpFalse;
+                K = k;
+            }
+        }
+
+        // struct sock_fprog
+        [StructLayout(LayoutKind.Sequential)]
+        public struct SockFprog {
+            public ushort Length;
+            public nint Filter;
+        }
+
+        // struct tpacket_stats_v3
+        [StructLayout(LayoutKind.Sequential)]
+        public struct TPacketStatsV3 {
+            public uint Packets;
+            public uint Drops;
+            public uint FreezeQueueCount;
+        }
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int socket(int domain, int type, int protocol);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int bind(int sockfd, ref SockAddrLl addr, int addrlen);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern nint send(int sockfd, byte[] buf, nint len, int flags);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern nint recv(int sockfd, byte[] buf, nint len, int flags);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int poll(ref PollFd fds, nuint nfds, int timeout);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int close(int fd);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int setsockopt(int sockfd, int level, int optname, ref int optval, uint optlen);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int setsockopt(int sockfd, int level, int optname, ref TPacketReq3 optval, uint optlen);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int setsockopt(int sockfd, int level, int optname, ref SockFprog optval, uint optlen);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int getsockopt(int sockfd, int level, int optname, ref TPacketStatsV3 optval, ref uint optlen);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern nint mmap(nint addr, nuint length, int prot, int flags, int fd, nint offset);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern int munmap(nint addr, nuint length);
+
+        [DllImport("libc", SetLastError = true)]
+        public static extern uint if_nametoindex(string ifname);
+
+        public static ushort HostToNetwork(ushort value) {
+            return BitConverter.IsLittleEndian ? BinaryPrimitives.ReverseEndianness(value) : value;
+        }
+
+        /// <summary>
+        /// Opens an AF_PACKET socket bound to the given interface, or returns -1 with errno set.
+        /// </summary>
+        public static int OpenPacketSocket(string ifName, ushort ethertype) {
+            if (!OperatingSystem.IsLinux()) {
+                return -1;
+            }
+            int fd = socket(AF_PACKET, SOCK_RAW, HostToNetwork(ethertype));
+            if (fd < 0) {
+                return -1;
+            }
+            var addr = new SockAddrLl {
+                Family = AF_PACKET,
+                Protocol = HostToNetwork(ethertype),
+                IfIndex = (int)if_nametoindex(ifName)
+            };
+            if (addr.IfIndex == 0 || bind(fd, ref addr, Marshal.SizeOf<SockAddrLl>()) < 0) {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        /// <summary>
+        /// Waits up to timeoutMs for the descriptor to become readable.
+        /// </summary>
+        public static bool WaitReadable(int fd, int timeoutMs) {
+            var pfd = new PollFd { Fd = fd, Events = POLLIN };
+            return poll(ref pfd, 1, timeoutMs) > 0 && (pfd.REvents & POLLIN) != 0;
+        }
+    }
+}
@@ -0,0 +1,243 @@
+// IPv6 host discovery at a fixed cost per cycle, since a /64 cannot be swept. One echo request to the
+// all-nodes group reaches every responsive host on the link, the kernel neighbor cache (read over netlink)
+// maps the addresses it learned to MACs, and EUI-64 interface identifiers give the MAC away on their own
+
+using System.Buffers.Binary;
+using System.Net;
+using System.Net.NetworkInformation;
+using System.Net.Sockets;
+using System.Runtime.InteropServices;
+
+using TLScope.src.Debugging;
+
+namespace TLScope.src.Utilities {
+    public sealed class NeighborDiscovery : IDisposable {
+        private const byte EchoRequest = 128;
+        private const byte EchoReply = 129;
+        private const int EchoLength = 16; // ICMPv6 header (8) + 8 bytes of payload
+
+        private static readonly UInt128 allNodes = (UInt128)0xFF02 << 112 | 1;
+
+        private readonly Socket _socket;
+        private readonly bool _raw; // raw sockets see every echo reply, ping sockets only their own
+        private readonly IPEndPoint _group;
+        private readonly HashSet<UInt128> _local = [];
+        private readonly ushort _identifier = (ushort)System.Environment.ProcessId;
+        private ushort _sequence;
+
+        /// <summary>
+        /// Kernel index of the interface, for reading its neighbors.
+        /// </summary>
+        public int InterfaceIndex { get; }
+
+        private NeighborDiscovery(Socket socket, bool raw, int interfaceIndex, IEnumerable<IPAddress> local) {
+            _socket = socket;
+            _raw = raw;
+            InterfaceIndex = interfaceIndex;
+            _group = new IPEndPoint(NetData.FromUInt128(allNodes, interfaceIndex), 0);
+            foreach (var address in local) {
+                _local.Add(NetData.ToUInt128(address));
+            }
+        }
+
+        /// <summary>
+        /// Opens an ICMPv6 socket on the interface. Returns null when the interface has no IPv6 address or no
+        /// ICMPv6 socket can be opened; neighbor cache harvesting still works without one.
+        /// </summary>
+        public static NeighborDiscovery? TryOpen(NetworkInterface ni) {
+            if (!TryGetInterfaceIndex(ni, out int index)) {
+                return null;
+            }
+            var local = ni.GetIPProperties().UnicastAddresses
+                .Where(ua => ua.Address.AddressFamily == AddressFamily.InterNetworkV6)
+                .Select(ua => ua.Address)
+                .ToList();
+            if (local.Count == 0) {
+                return null;
+            }
+            foreach (var type in new[] { SocketType.Raw, SocketType.Dgram }) {
+                try {
+                    var socket = new Socket(AddressFamily.InterNetworkV6, type, ProtocolType.IcmpV6);
+                    socket.SetSocketOption(SocketOptionLevel.IPv6, SocketOptionName.MulticastInterface, index);
+                    socket.SetSocketOption(SocketOptionLevel.IPv6, SocketOptionName.MulticastTimeToLive, 1);
+                    return new NeighborDiscovery(socket, type == SocketType.Raw, index, local);
+                } catch (SocketException ex) {
+                    Logging.Write($"ICMPv6 {type} socket unavailable on {ni.Name}: {ex.SocketErrorCode}");
+                }
+            }
+            return null;
+        }
+
+        public static bool TryGetInterfaceIndex(NetworkInterface ni, out int index) {
+            index = 0;
+            try {
+                index = ni.GetIPProperties().GetIPv6Properties()?.Index ?? 0;
+            } catch (NetworkInformationException) {
+                // IPv6 disabled on this interface
+            }
+            return index > 0;
+        }
+
+        /// <summary>
+        /// Sends one echo request to ff02::1 and returns the addresses that answered within the window,
+        /// without this host's own.
+        /// </summary>
+        public async Task<List<UInt128>> EchoAllNodesAsync(TimeSpan window, CancellationToken cancellationToken) {
+            byte[] packet = new byte[EchoLength];
+            packet[0] = EchoRequest;
+            BinaryPrimitives.WriteUInt16BigEndian(packet.AsSpan(4), _identifier);
+            BinaryPrimitives.WriteUInt16BigEndian(packet.AsSpan(6), ++_sequence);
+            BinaryPrimitives.WriteInt64BigEndian(packet.AsSpan(8), DateTime.UtcNow.Ticks);
+            // The kernel fills in the checksum for ICMPv6 sockets
+
+            var responders = new List<UInt128>();
+            try {
+                _socket.SendTo(packet, SocketFlags.None, _group);
+            } catch (SocketException ex) {
+                Logging.Write(LogLevel.Debug, $"All-nodes echo failed: {ex.SocketErrorCode}");
+                return responders;
+            }
+
+            using var timeout = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
+            timeout.CancelAfter(window);
+            byte[] buffer = new byte[1500];
+            var from = new SocketAddress(AddressFamily.InterNetworkV6);
+            var seen = new HashSet<UInt128>();
+            while (true) {
+                int length;
+                try {
+                    length = await _socket.ReceiveFromAsync(buffer, SocketFlags.None, from, timeout.Token);
+                } catch (OperationCanceledException) when (!cancellationToken.IsCancellationRequested) {
+                    break; // window over
+                } catch (SocketException ex) {
+                    Logging.Write(LogLevel.Debug, $"ICMPv6 receive failed: {ex.SocketErrorCode}");
+                    break;
+                }
+                if (length < 8 || buffer[0] != EchoReply
+                    || (_raw && BinaryPrimitives.ReadUInt16BigEndian(buffer.AsSpan(4)) != _identifier)) {
+                    continue;
+                }
+                var source = (IPEndPoint)new IPEndPoint(IPAddress.IPv6Any, 0).Create(from);
+                UInt128 address = NetData.ToUInt128(source.Address);
+                if (!_local.Contains(address) && seen.Add(address)) {
+                    responders.Add(address);
+                }
+            }
+            return responders;
+        }
+
+        /// <summary>
+        /// Appends the kernel's usable IPv6 neighbor entries for one interface (as `ip -6 neigh show dev` lists
+        /// them) to output. Reachable is set only for entries the kernel confirmed recently; STALE, DELAY and PROBE
+        /// entries outlive the host they describe. Returns false when the routing netlink socket is unavailable.
+        /// </summary>
+        public static bool ReadNeighbors(int interfaceIndex, List<(UInt128 Address, ulong Mac, bool Reachable)> output) {
+            if (!OperatingSystem.IsLinux()) {
+                return false;
+            }
+            int fd = LibC.socket(LibC.AF_NETLINK, LibC.SOCK_RAW, LibC.NETLINK_ROUTE);
+            if (fd < 0) {
+                Logging.Write(LogLevel.Debug, $"Netlink unavailable (errno {Marshal.GetLastPInvokeError()}).");
+                return false;
+            }
+            try {
+                // nlmsghdr (16 bytes) followed by ndmsg (12 bytes) selecting IPv6 entries on the interface;
+                // netlink is in host byte order, little-endian on every platform the raw paths run on
+                byte[] request = new byte[28];
+                uint sequence = (uint)System.Environment.TickCount;
+                BinaryPrimitives.WriteUInt32LittleEndian(request, (uint)request.Length);
+                BinaryPrimitives.WriteUInt16LittleEndian(request.AsSpan(4), LibC.RTM_GETNEIGH);
+                BinaryPrimitives.WriteUInt16LittleEndian(request.AsSpan(6), LibC.NLM_F_REQUEST | LibC.NLM_F_DUMP);
+                BinaryPrimitives.WriteUInt32LittleEndian(request.AsSpan(8), sequence);
+                request[16] = LibC.AF_INET6;
+                BinaryPrimitives.WriteInt32LittleEndian(request.AsSpan(20), interfaceIndex);
+                if (LibC.send(fd, request, request.Length, 0) != request.Length) {
+                    return false;
+                }
+
+                byte[] buffer = new byte[32768];
+                while (LibC.WaitReadable(fd, 1000)) {
+                    int length = (int)LibC.recv(fd, buffer, buffer.Length, 0);
+                    if (length <= 0) {
+                        return false;
+                    }
+                    for (int offset = 0; offset + 16 <= length;) {
+                        ReadOnlySpan<byte> message = buffer.AsSpan(offset, length - offset);
+                        int size = (int)BinaryPrimitives.ReadUInt32LittleEndian(message);
+                        ushort type = BinaryPrimitives.ReadUInt16LittleEndian(message[4..]);
+                        if (size < 16 || size > message.Length) {
+                            return false;
+                        }
+                        if (type == LibC.NLMSG_DONE || type == LibC.NLMSG_ERROR) {
+                            return type == LibC.NLMSG_DONE;
+                        }
+                        if (type == LibC.RTM_NEWNEIGH
+                            && BinaryPrimitives.ReadUInt32LittleEndian(message[8..]) == sequence
+                            && TryReadNeighbor(message[16..size], interfaceIndex, out var entry)) {
+                            output.Add(entry);
+                        }
+                        offset += (size + 3) & ~3;
+                    }
+                }
+                return false;
+            } finally {
+                LibC.close(fd);
+            }
+        }
+
+        // ndmsg: family, pad, pad, ifindex (s32), state (u16), flags, type; then 4-aligned rtattrs
+        private static bool TryReadNeighbor(ReadOnlySpan<byte> body, int interfaceIndex, out (UInt128, ulong, bool) entry) {
+            entry = default;
+            if (body.Length < 12 || BinaryPrimitives.ReadInt32LittleEndian(body[4..]) != interfaceIndex) {
+                return false;
+            }
+            ushort state = BinaryPrimitives.ReadUInt16LittleEndian(body[8..]);
+            if ((state & (LibC.NUD_INCOMPLETE | LibC.NUD_FAILED | LibC.NUD_NOARP)) != 0 || state == 0) {
+                return false;
+            }
+            UInt128 address = 0;
+            ulong mac = 0;
+            for (int offset = 12; offset + 4 <= body.Length;) {
+                int length = BinaryPrimitives.ReadUInt16LittleEndian(body[offset..]);
+                ushort type = BinaryPrimitives.ReadUInt16LittleEndian(body[(offset + 2)..]);
+                if (length < 4 || offset + length > body.Length) {
+                    break;
+                }
+                ReadOnlySpan<byte> value = body.Slice(offset + 4, length - 4);
+                if (type == LibC.NDA_DST && value.Length == 16) {
+                    address = BinaryPrimitives.ReadUInt128BigEndian(value);
+                } else if (type == LibC.NDA_LLADDR && value.Length == 6) {
+                    mac = NetData.PackMac(value);
+                }
+                offset += (length + 3) & ~3;
+            }
+            if (address == 0 || mac == 0 || address >> 120 == 0xFF) {
+                return false; // multicast entries map to derived, not real, MACs
+            }
+            entry = (address, mac, (state & LibC.NUD_REACHABLE) != 0);
+            return true;
+        }
+
+        /// <summary>
+        /// Recovers the MAC from a modified EUI-64 interface identifier (SLAAC without privacy extensions):
+        /// xx:xx:xx:ff:fe:xx:xx:xx with the universal/local bit inverted.
+        /// </summary>
+        public static bool TryGetEui64Mac(UInt128 address, out ulong mac) {
+            ulong iid = (ulong)address;
+            if (((iid >> 24) & 0xFFFF) != 0xFFFE) {
+                mac = 0;
+                return false;
+            }
+            mac = ((((iid >> 40) & 0xFFFFFF) ^ 0x020000) << 24) | (iid & 0xFFFFFF);
+            return mac != 0;
+        }
+
+        public static bool IsLinkLocal(UInt128 address) {
+            return address >> 118 == 0x3FA; // fe80::/10
+        }
+
+        public void Dispose() {
+            _socket.Dispose();
+        }
+    }
+}
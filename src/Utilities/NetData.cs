@@ -1,5 +1,6 @@
 // functions to read and write network data (depending on OS)
 using System;
+using System.Buffers.Binary;
 using System.Net;
 using System.Net.Sockets;
 using System.Net.NetworkInformation;
@@ -16,19 +17,40 @@ namespace TLScope.src.Utilities {
             .FirstOrDefault();
         }
 
-        public static string? GetLocalMacAddress(NetworkInterface ni) {
-            return ni.GetPhysicalAddress().ToString();
+        // Container and VM bridges; only scanned when named in TLSCOPE_INTERFACES
+        private static readonly string[] virtualPrefixes = ["docker", "br-", "veth", "virbr", "vmnet", "lxcbr", "cni", "podman"];
+
+        /// <summary>
+        /// Interfaces to run discovery on: the ones named in Settings.Interfaces, otherwise every interface that is
+        /// up, has an IPv4 address and is not loopback, a tunnel or a container bridge.
+        /// </summary>
+        public static List<NetworkInterface> SelectInterfaces() {
+            var all = NetworkInterface.GetAllNetworkInterfaces();
+            var selected = new List<NetworkInterface>();
+            if (Settings.Interfaces.Count > 0) {
+                foreach (string name in Settings.Interfaces) {
+                    var ni = all.FirstOrDefault(n => n.Name == name);
+                    if (ni == null || ni.OperationalStatus == OperationalStatus.Down || GetLocalIPAddress(ni) == null) {
+                        Logging.Write(LogLevel.Warning, $"Interface {name} is missing, down or has no IPv4 address; skipping it.");
+                    } else {
+                        selected.Add(ni);
+                    }
+                }
+                return selected;
+            }
+            foreach (var ni in all) {
+                if (ni.OperationalStatus == OperationalStatus.Up
+                    && ni.NetworkInterfaceType is not (NetworkInterfaceType.Loopback or NetworkInterfaceType.Tunnel)
+                    && !virtualPrefixes.Any(prefix => ni.Name.StartsWith(prefix, StringComparison.Ordinal))
+                    && GetLocalIPAddress(ni) != null) {
+                    selected.Add(ni);
+                }
+            }
+            return selected;
         }
 
-        public static async Task<string> GetDeviceNameAsync(string ipAddress) {
-            try {
-                Logging.Write($"Resolving DNS for {ipAddress}..");
-                var hostEntry = await Dns.GetHostEntryAsync(ipAddress);
-                Logging.Write($"Found {hostEntry.HostName}");
-                return hostEntry.HostName;
-            } catch (Exception) {
-                return $"Device_{ipAddress}";
-            }
+        public static string? GetLocalMacAddress(NetworkInterface ni) {
+            return ni.GetPhysicalAddress().ToString();
         }
 
         public static string GetSubnetMask(NetworkInterface ni, string ipAddress) {
@@ -60,6 +82,103 @@ namespace TLScope.src.Utilities {
             return [new IPAddress(startIP).ToString(), new IPAddress(endIP).ToString()];
         }
 
+        /// <summary>
+        /// Enumerates the usable host addresses (host byte order) of the subnet, excluding network and broadcast.
+        /// </summary>
+        public static List<uint> GetHostAddresses(string ipAddress, string subnetMask) {
+            uint mask = ToUInt32(IPAddress.Parse(subnetMask));
+            uint network = ToUInt32(IPAddress.Parse(ipAddress)) & mask;
+            uint broadcast = network | ~mask;
+
+            var hosts = new List<uint>();
+            if (broadcast - network < 2) {
+                hosts.Add(network);
+                return hosts;
+            }
+            for (uint host = network + 1; host < broadcast; host++) {
+                hosts.Add(host);
+            }
+            return hosts;
+        }
+
+        public static uint ToUInt32(IPAddress address) {
+            Span<byte> bytes = stackalloc byte[4];
+            if (!address.TryWriteBytes(bytes, out int written) || written != 4) {
+                throw new ArgumentException($"{address} is not an IPv4 address.", nameof(address));
+            }
+            return BinaryPrimitives.ReadUInt32BigEndian(bytes);
+        }
+
+        public static IPAddress FromUInt32(uint address) {
+            Span<byte> bytes = stackalloc byte[4];
+            BinaryPrimitives.WriteUInt32BigEndian(bytes, address);
+            return new IPAddress(bytes);
+        }
+
+        public static UInt128 ToUInt128(IPAddress address) {
+            Span<byte> bytes = stackalloc byte[16];
+            if (!address.TryWriteBytes(bytes, out int written) || written != 16) {
+                throw new ArgumentException($"{address} is not an IPv6 address.", nameof(address));
+            }
+            return BinaryPrimitives.ReadUInt128BigEndian(bytes);
+        }
+
+        public static IPAddress FromUInt128(UInt128 address, long scopeId = 0) {
+            Span<byte> bytes = stackalloc byte[16];
+            BinaryPrimitives.WriteUInt128BigEndian(bytes, address);
+            return new IPAddress(bytes, scopeId);
+        }
+
+        public static ulong PackMac(ReadOnlySpan<byte> mac) {
+            ulong packed = 0;
+            for (int i = 0; i < 6; i++) {
+                packed = (packed << 8) | mac[i];
+            }
+            return packed;
+        }
+
+        /// <summary>
+        /// Parses six hex octets separated by ':' or '-' (or not at all), without allocating.
+        /// </summary>
+        public static bool TryParseMac(ReadOnlySpan<char> text, out ulong mac) {
+            mac = 0;
+            int digits = 0;
+            foreach (char c in text) {
+                int value = HexDigit(c);
+                if (value >= 0) {
+                    mac = (mac << 4) | (uint)value;
+                    digits++;
+                } else if (c != ':' && c != '-') {
+                    return false;
+                }
+            }
+            return digits == 12;
+        }
+
+        private static int HexDigit(char c) {
+            return c switch {
+                >= '0' and <= '9' => c - '0',
+                >= 'a' and <= 'f' => c - 'a' + 10,
+                >= 'A' and <= 'F' => c - 'A' + 10,
+                _ => -1
+            };
+        }
+
+        // Same textual form arp-scan prints, so devices look identical whichever path found them
+        public static string FormatMac(ulong mac) {
+            return string.Create(17, mac, static (chars, value) => {
+                const string hex = "0123456789abcdef";
+                for (int i = 0; i < 6; i++) {
+                    byte b = (byte)(value >> (40 - (8 * i)));
+                    chars[i * 3] = hex[b >> 4];
+                    chars[(i * 3) + 1] = hex[b & 0xF];
+                    if (i < 5) {
+                        chars[(i * 3) + 2] = ':';
+                    }
+                }
+            });
+        }
+
         public static bool IsDeviceActive(string ipAddress) {
             try {
                 using var ping = new Ping();
@@ -71,12 +190,20 @@ namespace TLScope.src.Utilities {
             }
         }
 
-        public static List<(string IP, string MACAddress)> ARPCommand(int limit = 0) {
+        public static List<(string IP, string MACAddress)> ARPCommand(string? interfaceName = null, int limit = 0) {
             var arpOutput = string.Empty;
 
             arpOutput = ConsoleHelper.ExecuteCommand("arp-scan",
-                $"--limit={limit}"+" --localnet --quiet --retry=3 --ignoredups --timeout=1000");
+                $"--limit={limit}"+" --localnet --quiet --retry=3 --ignoredups --timeout=1000"
+                + (interfaceName != null ? $" --interface={interfaceName}" : ""));
+
+            return ParseArpScan(arpOutput);
+        }
 
+        /// <summary>
+        /// Extracts IP/MAC pairs from arp-scan output.
+        /// </summary>
+        public static List<(string IP, string MACAddress)> ParseArpScan(string arpOutput) {
             var arpEntries = new List<(string IP, string MACAddress)>();
 
             foreach (Match match in arpReg.Matches(arpOutput)) {
@@ -0,0 +1,116 @@
+// Passive OS signatures in the style of p0f: initial TTL, TCP option layout, window scale and window size of
+// a host's SYN. The table is compiled into frozen dictionaries once, so matching a packet is two lookups
+
+using System.Buffers.Binary;
+using System.Collections.Frozen;
+
+namespace TLScope.src.Utilities {
+    public enum OsConfidence : byte {
+        None = 0,
+        Ttl,       // initial TTL only; a family, not a version
+        Signature  // SYN matched the table
+    }
+
+    public readonly record struct OsVerdict(string Name, OsConfidence Confidence);
+
+    public static class OsSignatures {
+        private const int MaxOptions = 10; // 4 bits each; longer layouts never match
+        private const byte AnyWindowScale = 15;
+
+        // Layout letters: M=MSS, N=NOP, W=window scale, S=SACK permitted, T=timestamps, E=end of list
+        private static readonly (byte Ttl, string Layout, int WindowScale, int Window, string Name)[] table = [
+            (64, "MSTNW", -1, -1, "Linux"),
+            (64, "MSTNW", 7, 64240, "Linux 5.x+"),
+            (64, "MSTNW", 7, 29200, "Linux 3.x/4.x"),
+            (64, "MNNSNW", -1, -1, "Linux"),
+            (64, "MNWNNTSEE", -1, -1, "macOS/iOS"),
+            (64, "MNWSTE", -1, -1, "macOS/iOS"),
+            (64, "MNWST", -1, -1, "FreeBSD"),
+            (64, "MNNSNWNNT", -1, -1, "OpenBSD"),
+            (128, "MNWNNS", -1, -1, "Windows"),
+            (128, "MNWNNS", 8, 64240, "Windows 10/11"),
+            (128, "MNWNNS", 8, 65535, "Windows 10/11"),
+            (128, "MNWNNS", 8, 8192, "Windows 7/8"),
+            (128, "MNWNNS", 2, 8192, "Windows Vista/7"),
+            (128, "MNNS", -1, -1, "Windows XP"),
+            (128, "MNWNNTNNS", -1, -1, "Windows Server"),
+            (255, "MNWNNTNNS", -1, -1, "Solaris"),
+        ];
+
+        // Exact entries carry window scale and size; generic ones match on TTL and layout alone
+        private static readonly FrozenDictionary<ulong, string> exact = table
+            .Where(entry => entry.Window >= 0)
+            .ToFrozenDictionary(entry => Key(entry.Ttl, Pack(entry.Layout), (byte)entry.WindowScale, (ushort)entry.Window),
+                entry => entry.Name);
+        private static readonly FrozenDictionary<ulong, string> generic = table
+            .Where(entry => entry.Window < 0)
+            .ToFrozenDictionary(entry => Key(entry.Ttl, Pack(entry.Layout), AnyWindowScale, 0), entry => entry.Name);
+
+        /// <summary>
+        /// True for TTLs a host starts with. A packet still carrying one came from this link, so the frame's
+        /// source MAC really is the sender's and not a router's.
+        /// </summary>
+        public static bool IsInitialTtl(byte ttl) {
+            return ttl is 32 or 64 or 128 or 255;
+        }
+
+        public static OsVerdict ClassifyTtl(byte ttl) {
+            return ttl switch {
+                64 => new OsVerdict("Linux/Unix", OsConfidence.Ttl),
+                128 => new OsVerdict("Windows", OsConfidence.Ttl),
+                255 => new OsVerdict("Network device", OsConfidence.Ttl),
+                32 => new OsVerdict("Embedded device", OsConfidence.Ttl),
+                _ => default
+            };
+        }
+
+        /// <summary>
+        /// Classifies a SYN from its TCP header (at least 20 bytes, options included) and IP TTL. Falls back to
+        /// the TTL verdict when the layout is not in the table.
+        /// </summary>
+        public static OsVerdict ClassifySyn(ReadOnlySpan<byte> tcp, byte ttl) {
+            int headerLength = (tcp[12] >> 4) * 4;
+            ushort window = BinaryPrimitives.ReadUInt16BigEndian(tcp[14..]);
+            ulong layout = 0;
+            byte windowScale = AnyWindowScale;
+            int count = 0;
+            ReadOnlySpan<byte> options = tcp[20..Math.Min(headerLength, tcp.Length)];
+            for (int i = 0; i < options.Length && count < MaxOptions; count++) {
+                byte kind = options[i];
+                ulong code = kind switch { 0 => 1, 1 => 2, 2 => 3, 3 => 4, 4 => 5, 8 => 6, _ => 7 };
+                layout = (layout << 4) | code;
+                if (kind <= 1) {
+                    i++;
+                    continue;
+                }
+                if (i + 1 >= options.Length || options[i + 1] < 2) {
+                    break;
+                }
+                if (kind == 3 && options[i + 1] == 3 && i + 2 < options.Length) {
+                    windowScale = Math.Min(options[i + 2], (byte)14);
+                }
+                i += options[i + 1];
+            }
+
+            if (exact.TryGetValue(Key(ttl, layout, windowScale, window), out string? name)
+                || generic.TryGetValue(Key(ttl, layout, AnyWindowScale, 0), out name)) {
+                return new OsVerdict(name, OsConfidence.Signature);
+            }
+            return ClassifyTtl(ttl);
+        }
+
+        private static ulong Pack(string layout) {
+            ulong packed = 0;
+            foreach (char option in layout) {
+                packed = (packed << 4) | option switch { 'E' => 1UL, 'N' => 2, 'M' => 3, 'W' => 4, 'S' => 5, 'T' => 6, _ => 7 };
+            }
+            return packed;
+        }
+
+        // layout (40 bits) | window scale (4) | TTL class (2) | window (16)
+        private static ulong Key(byte ttl, ulong layout, byte windowScale, ushort window) {
+            ulong ttlClass = ttl switch { 64 => 0, 128 => 1, 255 => 2, _ => 3 };
+            return (layout << 22) | ((ulong)windowScale << 18) | (ttlClass << 16) | window;
+        }
+    }
+}
@@ -0,0 +1,344 @@
+// NIC vendor lookup from the IEEE MA-L/MA-M/MA-S registries, compiled by --build-oui into one sorted table
+// The table is memory-mapped read-only, so opening it costs a mapping and a lookup is a search over the mapped pages
+
+using System.Buffers.Binary;
+using System.Collections.Concurrent;
+using System.IO.MemoryMappedFiles;
+using System.Text;
+
+using TLScope.src.Debugging;
+
+namespace TLScope.src.Utilities {
+    /*
+     * File layout, little endian:
+     *   0  u32 magic    4  u32 version    8  i32 range count    12  i32 vendor count    16  i32 name bytes    20  u32 flags
+     *  24  u64 range start (MAC prefix, left-aligned in 48 bits) per range, ascending
+     *      i32 vendor index per range (0: unassigned)
+     *      u32 name offset per vendor, plus one past the end
+     *      UTF-8 vendor names
+     *
+     * Registry blocks nest (MA-M and MA-S blocks are carved out of MA-L blocks); the compiler flattens them into
+     * disjoint ranges, each extending to the next range's start, so the most specific block wins with one search.
+     * Flag 1 marks a sample table compiled from a subset of the registries, like the one shipped in data/.
+     */
+    public sealed unsafe class OuiTable : IDisposable {
+        private const uint Magic = 0x5449554F; // "OUIT"
+        private const uint Version = 1;
+        private const int HeaderSize = 24;
+        private const uint SampleFlag = 1;
+        private const long AddressSpace = 1L << 48;
+
+        private readonly MemoryMappedFile _map;
+        private readonly MemoryMappedViewAccessor _accessor;
+        private readonly ulong* _starts;
+        private readonly int* _vendors;
+        private readonly uint* _nameOffsets;
+        private readonly byte* _names;
+        private readonly int _ranges;
+        private readonly int _vendorCount;
+        private readonly uint _flags;
+        private readonly ConcurrentDictionary<int, string> _decoded = new(); // only vendors actually looked up
+        private bool _disposed;
+
+        /// <summary>
+        /// The registry table from the app data directory (written by --build-oui) or, failing that, the one
+        /// shipped next to the executable. Null when neither exists; lookups then find nothing.
+        /// </summary>
+        public static OuiTable? Shared { get; } = TryOpen(Environment.OuiTablePath)
+            ?? TryOpen(Path.Combine(AppContext.BaseDirectory, Path.GetFileName(Environment.OuiTablePath)));
+
+        private OuiTable(MemoryMappedFile map, MemoryMappedViewAccessor accessor, byte* pointer, int ranges, int vendors, uint flags) {
+            _map = map;
+            _accessor = accessor;
+            _ranges = ranges;
+            _vendorCount = vendors;
+            _flags = flags;
+            _starts = (ulong*)(pointer + HeaderSize);
+            _vendors = (int*)(_starts + ranges);
+            _nameOffsets = (uint*)(_vendors + ranges);
+            _names = (byte*)(_nameOffsets + vendors + 1);
+        }
+
+        public int RangeCount => _ranges;
+        public int VendorCount => _vendorCount;
+
+        /// <summary>
+        /// True when the table was compiled from a partial sample of the registries, so most vendors are missing.
+        /// </summary>
+        public bool IsSample => (_flags & SampleFlag) != 0;
+
+        /// <summary>
+        /// True when the shared table is a partial sample, so unknown vendors are expected.
+        /// </summary>
+        public static bool SharedIsSample => Shared?.IsSample == true;
+
+        public static OuiTable? TryOpen(string path) {
+            FileStream stream;
+            try {
+                stream = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.Read | FileShare.Delete);
+            } catch (FileNotFoundException) {
+                return null;
+            } catch (DirectoryNotFoundException) {
+                return null;
+            } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                Logging.Error($"Could not open OUI table {path}.", ex);
+                return null;
+            }
+            long length = stream.Length;
+            if (length < HeaderSize || !BitConverter.IsLittleEndian) {
+                stream.Dispose();
+                return null;
+            }
+            // Until the map exists the stream is ours to close; after that the map owns it (leaveOpen false)
+            MemoryMappedFile map;
+            try {
+                map = MemoryMappedFile.CreateFromFile(stream, null, length, MemoryMappedFileAccess.Read,
+                    HandleInheritability.None, false);
+            } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                stream.Dispose();
+                Logging.Error($"Could not map OUI table {path}.", ex);
+                return null;
+            }
+            MemoryMappedViewAccessor accessor;
+            try {
+                accessor = map.CreateViewAccessor(0, length, MemoryMappedFileAccess.Read);
+            } catch (Exception ex) when (ex is IOException or UnauthorizedAccessException) {
+                map.Dispose();
+                Logging.Error($"Could not map OUI table {path}.", ex);
+                return null;
+            }
+            byte* pointer = null;
+            accessor.SafeMemoryMappedViewHandle.AcquirePointer(ref pointer);
+            pointer += accessor.PointerOffset;
+
+            var header = new ReadOnlySpan<byte>(pointer, HeaderSize);
+            int ranges = BinaryPrimitives.ReadInt32LittleEndian(header[8..]);
+            int vendors = BinaryPrimitives.ReadInt32LittleEndian(header[12..]);
+            int nameBytes = BinaryPrimitives.ReadInt32LittleEndian(header[16..]);
+            uint flags = BinaryPrimitives.ReadUInt32LittleEndian(header[20..]);
+            if (BinaryPrimitives.ReadUInt32LittleEndian(header) != Magic
+                || BinaryPrimitives.ReadUInt32LittleEndian(header[4..]) != Version
+                || ranges <= 0 || vendors < 0 || nameBytes < 0
+                || length != TableSize(ranges, vendors, nameBytes)) {
+                Logging.Write(LogLevel.Warning, $"Ignoring malformed OUI table {path}; rebuild it with --build-oui.");
+                accessor.SafeMemoryMappedViewHandle.ReleasePointer();
+                accessor.Dispose();
+                map.Dispose();
+                return null;
+            }
+            Logging.Write($"OUI table mapped from {path}: {ranges} ranges, {vendors} vendors"
+                + ((flags & SampleFlag) != 0 ? " (partial sample; build the full table with --build-oui)." : "."));
+            return new OuiTable(map, accessor, pointer, ranges, vendors, flags);
+        }
+
+        /// <summary>
+        /// Vendor index for the MAC's registered prefix, 0 when unassigned. Locally administered (randomized)
+        /// addresses belong to no vendor. Allocation-free.
+        /// </summary>
+        public int LookupIndex(ulong mac) {
+            if ((mac & 0x0200_0000_0000) != 0) {
+                return 0;
+            }
+            // Last range starting at or before the MAC; the loop body compiles to a conditional move
+            ulong* starts = _starts;
+            int low = 0;
+            for (int length = _ranges; length > 1;) {
+                int half = length >> 1;
+                low = starts[low + half] <= mac ? low + half : low;
+                length -= half;
+            }
+            return _vendors[low];
+        }
+
+        /// <summary>
+        /// The vendor's name as stored in the table, without decoding it.
+        /// </summary>
+        public ReadOnlySpan<byte> GetNameUtf8(int vendor) {
+            if (vendor <= 0 || vendor >= _vendorCount) {
+                return [];
+            }
+            uint start = _nameOffsets[vendor];
+            return new ReadOnlySpan<byte>(_names + start, (int)(_nameOffsets[vendor + 1] - start));
+        }
+
+        /// <summary>
+        /// The vendor name for the MAC, or null. Each vendor's string is decoded once and reused after that.
+        /// </summary>
+        public string? Lookup(ulong mac) {
+            int vendor = LookupIndex(mac);
+            if (vendor == 0) {
+                return null;
+            }
+            return _decoded.TryGetValue(vendor, out string? name)
+                ? name
+                : _decoded.GetOrAdd(vendor, Encoding.UTF8.GetString(GetNameUtf8(vendor)));
+        }
+
+        /// <summary>
+        /// Vendor lookup through the shared table; null when the table is not installed.
+        /// </summary>
+        public static string? GetVendor(ulong mac) {
+            return Shared?.Lookup(mac);
+        }
+
+        public void Dispose() {
+            if (_disposed) {
+                return;
+            }
+            _disposed = true;
+            _accessor.SafeMemoryMappedViewHandle.ReleasePointer();
+            _accessor.Dispose();
+            _map.Dispose();
+        }
+
+        private static long TableSize(int ranges, int vendors, int nameBytes) {
+            return HeaderSize + (12L * ranges) + (4L * (vendors + 1)) + nameBytes;
+        }
+
+        /// <summary>
+        /// Compiles IEEE registry CSV exports (oui.csv, mam.csv, oui36.csv: Registry, Assignment, Organization
+        /// Name, Organization Address) into a table at outputPath. Returns the number of registry blocks read.
+        /// Sample marks the table as built from a partial extract rather than the full registries.
+        /// </summary>
+        public static int Compile(IEnumerable<string> csvPaths, string outputPath, bool sample = false) {
+            var vendorIndex = new Dictionary<string, int>(StringComparer.Ordinal) { [string.Empty] = 0 };
+            var vendorNames = new List<string> { string.Empty };
+            var blocks = new List<(ulong Start, ulong End, int Vendor)>();
+            foreach (string path in csvPaths) {
+                foreach (string line in File.ReadLines(path).Skip(1)) {
+                    if (!TryParseAssignment(line, out ulong start, out int bits, out string organization)) {
+                        continue;
+                    }
+                    if (!vendorIndex.TryGetValue(organization, out int vendor)) {
+                        vendor = vendorNames.Count;
+                        vendorIndex[organization] = vendor;
+                        vendorNames.Add(organization);
+                    }
+                    blocks.Add((start, start + (1UL << (48 - bits)), vendor));
+                }
+            }
+
+            // Outer blocks before the blocks nested in them, then a sweep that emits a range wherever the innermost
+            // block covering the address space changes
+            blocks.Sort((a, b) => a.Start != b.Start ? a.Start.CompareTo(b.Start) : b.End.CompareTo(a.End));
+            var ranges = new List<(ulong Start, int Vendor)>(blocks.Count * 2);
+            var open = new Stack<(ulong End, int Vendor)>();
+            ulong position = 0;
+            void Emit(ulong start, int vendor) {
+                if (ranges.Count == 0 || ranges[^1].Vendor != vendor) {
+                    ranges.Add((start, vendor));
+                }
+            }
+            void CloseBefore(ulong limit) {
+                while (open.Count > 0 && open.Peek().End <= limit) {
+                    var (end, vendor) = open.Pop();
+                    if (position < end) {
+                        Emit(position, vendor);
+                        position = end;
+                    }
+                }
+                if (position < limit) {
+                    Emit(position, open.Count > 0 ? open.Peek().Vendor : 0);
+                    position = limit;
+                }
+            }
+            foreach (var (start, end, vendor) in blocks) {
+                CloseBefore(start);
+                open.Push((end, vendor));
+            }
+            CloseBefore((ulong)AddressSpace);
+
+            var names = new List<byte[]>(vendorNames.Count);
+            int nameBytes = 0;
+            foreach (string name in vendorNames) {
+                byte[] bytes = Encoding.UTF8.GetBytes(name);
+                names.Add(bytes);
+                nameBytes += bytes.Length;
+            }
+            byte[] table = new byte[TableSize(ranges.Count, names.Count, nameBytes)];
+            Span<byte> output = table;
+            BinaryPrimitives.WriteUInt32LittleEndian(output, Magic);
+            BinaryPrimitives.WriteUInt32LittleEndian(output[4..], Version);
+            BinaryPrimitives.WriteInt32LittleEndian(output[8..], ranges.Count);
+            BinaryPrimitives.WriteInt32LittleEndian(output[12..], names.Count);
+            BinaryPrimitives.WriteInt32LittleEndian(output[16..], nameBytes);
+            BinaryPrimitives.WriteUInt32LittleEndian(output[20..], sample ? SampleFlag : 0);
+            int offset = HeaderSize;
+            foreach (var (start, _) in ranges) {
+                BinaryPrimitives.WriteUInt64LittleEndian(output[offset..], start);
+                offset += 8;
+            }
+            foreach (var (_, vendor) in ranges) {
+                BinaryPrimitives.WriteInt32LittleEndian(output[offset..], vendor);
+                offset += 4;
+            }
+            uint nameOffset = 0;
+            foreach (byte[] name in names) {
+                BinaryPrimitives.WriteUInt32LittleEndian(output[offset..], nameOffset);
+                offset += 4;
+                nameOffset += (uint)name.Length;
+            }
+            BinaryPrimitives.WriteUInt32LittleEndian(output[offset..], nameOffset);
+            offset += 4;
+            foreach (byte[] name in names) {
+                name.CopyTo(output[offset..]);
+                offset += name.Length;
+            }
+
+            // Replace rather than overwrite, so a running instance keeps its mapping of the old file
+            string? directory = Path.GetDirectoryName(Path.GetFullPath(outputPath));
+            if (directory != null) {
+                Directory.CreateDirectory(directory);
+            }
+            string temporary = outputPath + ".tmp";
+            File.WriteAllBytes(temporary, table);
+            File.Move(temporary, outputPath, true);
+            return blocks.Count;
+        }
+
+        // "MA-L,00000C,Cisco Systems, Inc,..." with RFC 4180 quoting; the assignment's length gives the prefix bits
+        private static bool TryParseAssignment(string line, out ulong start, out int bits, out string organization) {
+            start = 0;
+            bits = 0;
+            organization = string.Empty;
+            var fields = new List<string>(4);
+            var field = new StringBuilder();
+            bool quoted = false;
+            for (int i = 0; i < line.Length && fields.Count < 3; i++) {
+                char c = line[i];
+                if (quoted) {
+                    if (c == '"' && i + 1 < line.Length && line[i + 1] == '"') {
+                        field.Append('"');
+                        i++;
+                    } else if (c == '"') {
+                        quoted = false;
+                    } else {
+                        field.Append(c);
+                    }
+                } else if (c == '"') {
+                    quoted = true;
+                } else if (c == ',') {
+                    fields.Add(field.ToString());
+                    field.Clear();
+                } else {
+                    field.Append(c);
+                }
+            }
+            if (fields.Count < 3) {
+                fields.Add(field.ToString());
+            }
+            if (fields.Count < 3) {
+                return false;
+            }
+            string assignment = fields[1].Trim();
+            bits = assignment.Length * 4;
+            if (bits is not (24 or 28 or 36) || !ulong.TryParse(assignment, System.Globalization.NumberStyles.HexNumber,
+                    null, out ulong prefix)) {
+                return false;
+            }
+            start = prefix << (48 - bits);
+            organization = fields[2].Trim();
+            return organization.Length > 0;
+        }
+    }
+}
@@ -0,0 +1,161 @@
+// Allocation-free Ethernet/IP/TCP header decoding for captured frames
+// Offsets returned here index into the frame span, so payloads can be read in place
+
+using System.Buffers.Binary;
+using System.Net;
+
+namespace TLScope.src.Utilities {
+    /// <summary>
+    /// TCP 4-tuple. IPv4 addresses are stored IPv4-mapped (::ffff:a.b.c.d) so both families share one key type.
+    /// </summary>
+    public readonly record struct FlowKey(UInt128 SourceAddress, UInt128 DestinationAddress,
+        ushort SourcePort, ushort DestinationPort) {
+
+        private static readonly UInt128 MappedPrefix = (UInt128)0xFFFF << 32;
+
+        public static UInt128 MapIPv4(uint ip) {
+            return MappedPrefix | ip;
+        }
+
+        public FlowKey Reverse() {
+            return new FlowKey(DestinationAddress, SourceAddress, DestinationPort, SourcePort);
+        }
+
+        /// <summary>
+        /// Same value for both directions of a connection, for partitioning work by connection.
+        /// </summary>
+        public int ConnectionHash() {
+            int a = HashCode.Combine(SourceAddress, SourcePort);
+            int b = HashCode.Combine(DestinationAddress, DestinationPort);
+            return a ^ b;
+        }
+
+        public static IPAddress ToIPAddress(UInt128 address) {
+            if (address >> 32 == 0xFFFF) {
+                return NetData.FromUInt32((uint)address);
+            }
+            Span<byte> bytes = stackalloc byte[16];
+            BinaryPrimitives.WriteUInt128BigEndian(bytes, address);
+            return new IPAddress(bytes);
+        }
+
+        public override string ToString() {
+            return $"{ToIPAddress(SourceAddress)}:{SourcePort} -> {ToIPAddress(DestinationAddress)}:{DestinationPort}";
+        }
+    }
+
+    [Flags]
+    public enum TcpFlags : byte {
+        None = 0,
+        Fin = 0x01,
+        Syn = 0x02,
+        Rst = 0x04,
+        Psh = 0x08,
+        Ack = 0x10
+    }
+
+    /// <summary>
+    /// Decoded TCP segment. Offsets are into the frame; Ttl is the IPv4 TTL or IPv6 hop limit.
+    /// </summary>
+    public readonly record struct TcpSegment(FlowKey Flow, uint Sequence, TcpFlags Flags,
+        int PayloadOffset, int PayloadLength, byte Ttl = 0, int HeaderOffset = 0);
+
+    public static class PacketDecoder {
+        private const ushort EtherTypeIPv4 = 0x0800;
+        private const ushort EtherTypeIPv6 = 0x86DD;
+        private const ushort EtherTypeVlan = 0x8100;
+        private const ushort EtherTypeQinQ = 0x88A8;
+        private const byte ProtocolTcp = 6;
+
+        /// <summary>
+        /// Decodes an Ethernet frame carrying TCP over IPv4 or IPv6. Fragments and other protocols return false.
+        /// </summary>
+        public static bool TryDecodeTcp(ReadOnlySpan<byte> frame, out TcpSegment segment) {
+            segment = default;
+            if (frame.Length < 14) {
+                return false;
+            }
+
+            int offset = 12;
+            ushort etherType = BinaryPrimitives.ReadUInt16BigEndian(frame[offset..]);
+            // The ring usually strips the outer tag into the frame header, but stacked or untouched tags stay inline
+            while ((etherType == EtherTypeVlan || etherType == EtherTypeQinQ) && frame.Length >= offset + 6) {
+                offset += 4;
+                etherType = BinaryPrimitives.ReadUInt16BigEndian(frame[offset..]);
+            }
+            offset += 2;
+
+            UInt128 source, destination;
+            int end;
+            byte ttl;
+            switch (etherType) {
+                case EtherTypeIPv4: {
+                    if (frame.Length < offset + 20) {
+                        return false;
+                    }
+                    ReadOnlySpan<byte> ip = frame[offset..];
+                    int headerLength = (ip[0] & 0x0F) * 4;
+                    int totalLength = BinaryPrimitives.ReadUInt16BigEndian(ip[2..]);
+                    bool fragmented = (BinaryPrimitives.ReadUInt16BigEndian(ip[6..]) & 0x3FFF) != 0;
+                    if (ip[0] >> 4 != 4 || headerLength < 20 || fragmented || ip[9] != ProtocolTcp
+                        || totalLength < headerLength || frame.Length < offset + headerLength) {
+                        return false;
+                    }
+                    ttl = ip[8];
+                    source = FlowKey.MapIPv4(BinaryPrimitives.ReadUInt32BigEndian(ip[12..]));
+                    destination = FlowKey.MapIPv4(BinaryPrimitives.ReadUInt32BigEndian(ip[16..]));
+                    end = Math.Min(frame.Length, offset + totalLength); // drops Ethernet padding
+                    offset += headerLength;
+                    break;
+                }
+                case EtherTypeIPv6: {
+                    if (frame.Length < offset + 40) {
+                        return false;
+                    }
+                    ReadOnlySpan<byte> ip = frame[offset..];
+                    byte next = ip[6];
+                    ttl = ip[7];
+                    source = BinaryPrimitives.ReadUInt128BigEndian(ip[8..]);
+                    destination = BinaryPrimitives.ReadUInt128BigEndian(ip[24..]);
+                    end = Math.Min(frame.Length, offset + 40 + BinaryPrimitives.ReadUInt16BigEndian(ip[4..]));
+                    offset += 40;
+                    // Hop-by-hop, routing and destination options; fragments (44) are not reassembled
+                    while (next is 0 or 43 or 60) {
+                        if (end < offset + 8) {
+                            return false;
+                        }
+                        next = frame[offset];
+                        offset += (frame[offset + 1] + 1) * 8;
+                    }
+                    if (next != ProtocolTcp) {
+                        return false;
+                    }
+                    break;
+                }
+                default:
+                    return false;
+            }
+
+            if (end < offset + 20) {
+                return false;
+            }
+            ReadOnlySpan<byte> tcp = frame[offset..end];
+            int dataOffset = (tcp[12] >> 4) * 4;
+            if (dataOffset < 20 || dataOffset > tcp.Length) {
+                return false;
+            }
+
+            segment = new TcpSegment(
+                new FlowKey(source, destination,
+                    BinaryPrimitives.ReadUInt16BigEndian(tcp),
+                    BinaryPrimitives.ReadUInt16BigEndian(tcp[2..])),
+                BinaryPrimitives.ReadUInt32BigEndian(tcp[4..]),
+                (TcpFlags)(tcp[13] & 0x1F),
+                offset + dataOffset,
+                tcp.Length - dataOffset,
+                ttl,
+                offset);
+            return true;
+        }
+    }
+}
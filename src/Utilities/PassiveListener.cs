@@ -0,0 +1,202 @@
+// Passive discovery from traffic hosts send on their own: ARP (including gratuitous ARP), DHCP and IPv6
+// Neighbor Discovery. A classic BPF filter drops everything else in the kernel, so the listener wakes only for these
+
+using System.Buffers.Binary;
+using System.Net.NetworkInformation;
+using System.Runtime.InteropServices;
+using System.Text;
+
+using TLScope.src.Debugging;
+
+namespace TLScope.src.Utilities {
+    public enum SightingSource {
+        Arp,
+        Dhcp,
+        Ndp
+    }
+
+    /// <summary>
+    /// A host seen on the wire. IP is 0 when no IPv4 address is known (NDP, DHCP discovers before an address
+    /// is assigned). HostName comes from the DHCP host name option, IPv6 from neighbor discovery.
+    /// </summary>
+    public readonly record struct Sighting(SightingSource Source, uint IP, ulong MAC, string? HostName, UInt128 IPv6 = default);
+
+    public sealed unsafe class PassiveListener : IDisposable {
+        private const ushort EtherTypeIPv4 = 0x0800;
+        private const ushort EtherTypeIPv6 = 0x86DD;
+        private const int EthernetLength = 14;
+        private const uint DhcpMagicCookie = 0x63825363;
+
+        // Accepts ARP, unfragmented IPv4 UDP to or from ports 67/68, and ICMPv6 router solicitation through
+        // neighbor advertisement (types 133-136) without extension headers
+        private static readonly LibC.SockFilter[] filter = [
+            new(0x28, 0, 0, 12),          // 0  ldh [12]               ethertype
+            new(0x15, 18, 0, 0x0806),     // 1  jeq ARP              -> accept
+            new(0x15, 0, 11, EtherTypeIPv4), // 2  jeq IPv4, else    -> 14
+            new(0x30, 0, 0, 23),          // 3  ldb [23]               IP protocol
+            new(0x15, 0, 16, 17),         // 4  jeq UDP, else        -> reject
+            new(0x28, 0, 0, 20),          // 5  ldh [20]               flags and fragment offset
+            new(0x45, 14, 0, 0x1FFF),     // 6  jset fragment        -> reject
+            new(0xB1, 0, 0, 14),          // 7  ldxb 4*([14]&0xf)      IP header length
+            new(0x48, 0, 0, 14),          // 8  ldh [x+14]             source port
+            new(0x15, 10, 0, 67),         // 9  jeq 67               -> accept
+            new(0x15, 9, 0, 68),          // 10 jeq 68               -> accept
+            new(0x48, 0, 0, 16),          // 11 ldh [x+16]             destination port
+            new(0x15, 7, 0, 67),          // 12 jeq 67               -> accept
+            new(0x15, 6, 7, 68),          // 13 jeq 68               -> accept, else reject
+            new(0x15, 0, 6, EtherTypeIPv6), // 14 jeq IPv6, else     -> reject
+            new(0x30, 0, 0, 20),          // 15 ldb [20]               next header
+            new(0x15, 0, 4, 58),          // 16 jeq ICMPv6, else     -> reject
+            new(0x30, 0, 0, 54),          // 17 ldb [54]               ICMPv6 type
+            new(0x35, 0, 2, 133),         // 18 jge 133, else        -> reject
+            new(0x25, 1, 0, 136),         // 19 jgt 136              -> reject
+            new(0x06, 0, 0, 0xFFFF),      // 20 accept
+            new(0x06, 0, 0, 0),           // 21 reject
+        ];
+
+        private readonly int _fd;
+        private readonly ulong _localMac;
+        private int _disposed;
+
+        private PassiveListener(int fd, ulong localMac) {
+            _fd = fd;
+            _localMac = localMac;
+        }
+
+        /// <summary>
+        /// Opens a filtered packet socket on the interface. Returns null when raw sockets are unavailable
+        /// (non-Linux, missing CAP_NET_RAW); discovery then relies on active sweeps alone.
+        /// </summary>
+        public static PassiveListener? TryOpen(NetworkInterface ni) {
+            byte[] mac = ni.GetPhysicalAddress().GetAddressBytes();
+            if (mac.Length != 6) {
+                return null;
+            }
+            int fd = LibC.OpenPacketSocket(ni.Name, LibC.ETH_P_ALL);
+            if (fd < 0) {
+                Logging.Write($"Passive listener unavailable on {ni.Name} (errno {Marshal.GetLastPInvokeError()}).");
+                return null;
+            }
+            fixed (LibC.SockFilter* instructions = filter) {
+                var program = new LibC.SockFprog { Length = (ushort)filter.Length, Filter = (nint)instructions };
+                if (LibC.setsockopt(fd, LibC.SOL_SOCKET, LibC.SO_ATTACH_FILTER, ref program, (uint)sizeof(LibC.SockFprog)) < 0) {
+                    Logging.Write($"Could not attach the passive discovery filter on {ni.Name} (errno {Marshal.GetLastPInvokeError()}).");
+                    LibC.close(fd);
+                    return null;
+                }
+            }
+            return new PassiveListener(fd, NetData.PackMac(mac));
+        }
+
+        /// <summary>
+        /// Reports sightings on the calling thread until cancelled. Meant to run on a dedicated thread.
+        /// </summary>
+        public void Run(Action<Sighting> onSighting, CancellationToken cancellationToken) {
+            byte[] buffer = new byte[1514];
+            while (!cancellationToken.IsCancellationRequested && Volatile.Read(ref _disposed) == 0) {
+                if (!LibC.WaitReadable(_fd, 100)) {
+                    continue;
+                }
+                int length = (int)LibC.recv(_fd, buffer, buffer.Length, 0);
+                if (length > EthernetLength && TryParse(buffer.AsSpan(0, length), _localMac, out Sighting sighting)) {
+                    onSighting(sighting);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Extracts a sighting from an Ethernet frame. Frames sent by this host are ignored.
+        /// </summary>
+        public static bool TryParse(ReadOnlySpan<byte> frame, ulong localMac, out Sighting sighting) {
+            sighting = default;
+            ulong source = NetData.PackMac(frame.Slice(6, 6));
+            if (source == localMac) {
+                return false;
+            }
+            return BinaryPrimitives.ReadUInt16BigEndian(frame[12..]) switch {
+                LibC.ETH_P_ARP => TryParseArp(frame[EthernetLength..], out sighting),
+                EtherTypeIPv4 => TryParseDhcp(frame[EthernetLength..], out sighting),
+                EtherTypeIPv6 => TryParseNdp(frame[EthernetLength..], source, out sighting),
+                _ => false
+            };
+        }
+
+        // Requests, replies and gratuitous announcements all carry the sender's own binding
+        private static bool TryParseArp(ReadOnlySpan<byte> arp, out Sighting sighting) {
+            sighting = default;
+            if (arp.Length < 28 || BinaryPrimitives.ReadUInt16BigEndian(arp) != 1
+                || BinaryPrimitives.ReadUInt16BigEndian(arp[2..]) != EtherTypeIPv4 || arp[4] != 6 || arp[5] != 4) {
+                return false;
+            }
+            uint ip = BinaryPrimitives.ReadUInt32BigEndian(arp[14..]);
+            if (ip == 0) {
+                return false; // address conflict probe, the sender has no address yet
+            }
+            sighting = new Sighting(SightingSource.Arp, ip, NetData.PackMac(arp.Slice(8, 6)), null);
+            return true;
+        }
+
+        private static bool TryParseDhcp(ReadOnlySpan<byte> ip, out Sighting sighting) {
+            sighting = default;
+            int headerLength = (ip[0] & 0x0F) * 4;
+            ReadOnlySpan<byte> bootp = ip.Length > headerLength + 8 ? ip[(headerLength + 8)..] : default;
+            if (bootp.Length < 240 || bootp[1] != 1 || bootp[2] != 6
+                || BinaryPrimitives.ReadUInt32BigEndian(bootp[236..]) != DhcpMagicCookie) {
+                return false;
+            }
+
+            int messageType = 0;
+            uint requested = 0;
+            string? hostName = null;
+            ReadOnlySpan<byte> options = bootp[240..];
+            for (int i = 0; i < options.Length && options[i] != 255;) {
+                if (options[i] == 0) {
+                    i++;
+                    continue;
+                }
+                if (i + 1 >= options.Length || i + 2 + options[i + 1] > options.Length) {
+                    break;
+                }
+                ReadOnlySpan<byte> value = options.Slice(i + 2, options[i + 1]);
+                switch (options[i]) {
+                    case 53 when value.Length == 1: messageType = value[0]; break;
+                    case 50 when value.Length == 4: requested = BinaryPrimitives.ReadUInt32BigEndian(value); break;
+                    case 12 when value.Length > 0: hostName = Encoding.ASCII.GetString(value).TrimEnd('\0'); break;
+                }
+                i += 2 + value.Length;
+            }
+
+            uint address = messageType switch {
+                5 => BinaryPrimitives.ReadUInt32BigEndian(bootp[16..]),   // ACK: yiaddr
+                3 => requested != 0 ? requested : BinaryPrimitives.ReadUInt32BigEndian(bootp[12..]), // REQUEST
+                _ => BinaryPrimitives.ReadUInt32BigEndian(bootp[12..])    // DISCOVER, INFORM, RELEASE: ciaddr
+            };
+            if (messageType == 0) {
+                return false; // plain BOOTP
+            }
+            // Server messages (op 2) only ever name the client; its host name option belongs to the server
+            sighting = new Sighting(SightingSource.Dhcp, address, NetData.PackMac(bootp.Slice(28, 6)),
+                bootp[0] == 1 ? hostName : null);
+            return true;
+        }
+
+        private static bool TryParseNdp(ReadOnlySpan<byte> ip, ulong source, out Sighting sighting) {
+            sighting = default;
+            if (ip.Length < 41 || ip[6] != 58 || ip[40] is < 133 or > 136) {
+                return false;
+            }
+            UInt128 address = BinaryPrimitives.ReadUInt128BigEndian(ip[8..]);
+            if (address == 0 && ip[40] == 135 && ip.Length >= 64) {
+                address = BinaryPrimitives.ReadUInt128BigEndian(ip[48..]); // duplicate address detection: the tentative target
+            }
+            sighting = new Sighting(SightingSource.Ndp, 0, source, null, address);
+            return true;
+        }
+
+        public void Dispose() {
+            if (Interlocked.Exchange(ref _disposed, 1) == 0) {
+                LibC.close(_fd);
+            }
+        }
+    }
+}
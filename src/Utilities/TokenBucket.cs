@@ -0,0 +1,61 @@
+// Token bucket used to keep outgoing probes under a packets-per-second budget
+
+using System.Diagnostics;
+
+namespace TLScope.src.Utilities {
+    public sealed class TokenBucket {
+        private readonly double _ratePerTick;
+        private readonly double _capacity;
+        private readonly object _lock = new();
+        private double _tokens;
+        private long _lastRefill;
+
+        /// <param name="ratePerSecond">Sustained permits per second.</param>
+        /// <param name="burst">Permits that may be spent at once after an idle period.</param>
+        public TokenBucket(int ratePerSecond, int burst = 0) {
+            if (ratePerSecond <= 0) {
+                throw new ArgumentOutOfRangeException(nameof(ratePerSecond));
+            }
+            _ratePerTick = (double)ratePerSecond / Stopwatch.Frequency;
+            _capacity = burst > 0 ? burst : Math.Max(1, ratePerSecond / 10);
+            _tokens = _capacity;
+            _lastRefill = Stopwatch.GetTimestamp();
+        }
+
+        public bool TryAcquire() {
+            lock (_lock) {
+                Refill();
+                if (_tokens >= 1) {
+                    _tokens -= 1;
+                    return true;
+                }
+                return false;
+            }
+        }
+
+        /// <summary>
+        /// Waits until a permit is available. Completes synchronously while the bucket has tokens.
+        /// </summary>
+        public async ValueTask WaitAsync(CancellationToken cancellationToken = default) {
+            while (true) {
+                TimeSpan wait;
+                lock (_lock) {
+                    Refill();
+                    if (_tokens >= 1) {
+                        _tokens -= 1;
+                        return;
+                    }
+                    wait = TimeSpan.FromSeconds((1 - _tokens) / (_ratePerTick * Stopwatch.Frequency));
+                }
+                // Timer resolution is ~1 ms, so sleeping for less just spins through the bucket refill
+                await Task.Delay(wait < TimeSpan.FromMilliseconds(1) ? TimeSpan.FromMilliseconds(1) : wait, cancellationToken);
+            }
+        }
+
+        private void Refill() {
+            long now = Stopwatch.GetTimestamp();
+            _tokens = Math.Min(_capacity, _tokens + ((now - _lastRefill) * _ratePerTick));
+            _lastRefill = now;
+        }
+    }
+}
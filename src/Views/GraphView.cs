@@ -0,0 +1,257 @@
+// Window drawing the connection graph from the background layout
+// The layout is rasterized into cached rows only when it, the size or the viewport changed; other redraws copy rows
+
+using System.Diagnostics;
+using Terminal.Gui;
+
+using TLScope.src.Controllers;
+using TLScope.src.Debugging;
+using TLScope.src.Utilities;
+
+namespace TLScope.src.Views {
+    public class GraphView : Window {
+        private readonly GraphLayout _layout = new();
+        private readonly GraphCanvas _canvas;
+        private readonly TimeSpan _frameInterval = TimeSpan.FromMilliseconds(1000.0 / Settings.UiMaxFramesPerSecond);
+        private int _frameScheduled;
+        private long _lastFrame;
+
+        public GraphView(ref NetworkController nc) : this(nc.GetConnectionGraph()) { }
+
+        internal GraphView(ConnectionGraph graph) : base("Connection Graph") {
+            ColorScheme = Constants.TLSColorScheme;
+
+            _canvas = new GraphCanvas {
+                X = 0,
+                Y = 0,
+                Width = Dim.Fill(),
+                Height = Dim.Fill(),
+                CanFocus = true,
+            };
+            Add(_canvas);
+
+            _layout.Updated += OnLayoutUpdated;
+            graph.Changed += (sender, snapshot) => _layout.Post(snapshot);
+            _layout.Post(graph.Snapshot);
+        }
+
+        /// <summary>
+        /// Runs the layout worker until cancelled. The view shows nothing but its frame until this is started.
+        /// </summary>
+        public Task RunLayoutAsync(CancellationToken cancTok) {
+            return _layout.RunAsync(cancTok);
+        }
+
+        // Raised on the layout worker; the canvas picks up the latest layout on the next frame
+        private void OnLayoutUpdated(object? sender, LayoutSnapshot layout) {
+            if (Interlocked.Exchange(ref _frameScheduled, 1) == 0) {
+                ScheduleFrame();
+            }
+        }
+
+        private void ScheduleFrame() {
+            var mainLoop = Application.MainLoop;
+            if (mainLoop == null) {
+                // UI not running yet; the next layout retries
+                Volatile.Write(ref _frameScheduled, 0);
+                return;
+            }
+
+            long sinceLast = System.Environment.TickCount64 - Interlocked.Read(ref _lastFrame);
+            TimeSpan delay = _frameInterval - TimeSpan.FromMilliseconds(sinceLast);
+            if (delay < TimeSpan.Zero) {
+                delay = TimeSpan.Zero;
+            }
+            mainLoop.Invoke(() => mainLoop.AddTimeout(delay, _ => {
+                Volatile.Write(ref _frameScheduled, 0);
+                Interlocked.Exchange(ref _lastFrame, System.Environment.TickCount64);
+                _canvas.Show(_layout.Current);
+                return false;
+            }));
+        }
+
+        /// <summary>
+        /// Draws a layout scaled into its bounds. Arrow keys pan, + and - zoom, 0 fits the whole graph again.
+        /// </summary>
+        private sealed class GraphCanvas : View {
+            private const double MaxScale = 2; // columns per layout unit
+            private const double MinScale = 0.02;
+            private const double LabelScale = 0.5; // labels are left out below this, they would cover everything
+            private const int PanStep = 8; // columns
+
+            private LayoutSnapshot _layout = LayoutSnapshot.Empty;
+            private string[] _rows = [];
+            private int _rasterWidth;
+            private bool _dirty = true;
+
+            // Viewport: layout coordinates of the top-left cell, and columns per unit. Fit recomputes both per raster
+            private bool _fit = true;
+            private double _originX;
+            private double _originY;
+            private double _scale = 1;
+
+            public void Show(LayoutSnapshot layout) {
+                _layout = layout;
+                Invalidate();
+            }
+
+            public override void Redraw(Rect bounds) {
+                if (_dirty || bounds.Width != _rasterWidth || bounds.Height != _rows.Length) {
+                    Rasterize(bounds.Width, bounds.Height);
+                }
+                Driver.SetAttribute(ColorScheme.Normal);
+                for (int row = 0; row < _rows.Length; row++) {
+                    Move(0, row);
+                    Driver.AddStr(_rows[row]);
+                }
+            }
+
+            public override bool ProcessKey(KeyEvent keyEvent) {
+                double step = PanStep / _scale;
+                switch (keyEvent.Key) {
+                    case Key.CursorLeft:
+                        Pan(-step, 0);
+                        return true;
+                    case Key.CursorRight:
+                        Pan(step, 0);
+                        return true;
+                    case Key.CursorUp:
+                        Pan(0, -step);
+                        return true;
+                    case Key.CursorDown:
+                        Pan(0, step);
+                        return true;
+                    case (Key)'+':
+                    case (Key)'=':
+                        Zoom(1.5);
+                        return true;
+                    case (Key)'-':
+                        Zoom(1 / 1.5);
+                        return true;
+                    case (Key)'0':
+                        _fit = true;
+                        Invalidate();
+                        return true;
+                    default:
+                        return base.ProcessKey(keyEvent);
+                }
+            }
+
+            private void Pan(double dx, double dy) {
+                _fit = false;
+                _originX += dx;
+                _originY += dy;
+                Invalidate();
+            }
+
+            // Keeps the centre of the view where it is
+            private void Zoom(double factor) {
+                Rect bounds = Bounds;
+                double scale = Math.Clamp(_scale * factor, MinScale, MaxScale);
+                double centerX = _originX + bounds.Width / 2.0 / _scale;
+                double centerY = _originY + bounds.Height / _scale;
+                _fit = false;
+                _scale = scale;
+                _originX = centerX - bounds.Width / 2.0 / scale;
+                _originY = centerY - bounds.Height / scale;
+                Invalidate();
+            }
+
+            private void Invalidate() {
+                _dirty = true;
+                SetNeedsDisplay();
+            }
+
+            private void Rasterize(int width, int height) {
+                long started = Stopwatch.GetTimestamp();
+                _dirty = false;
+                _rasterWidth = width;
+                width = Math.Max(width, 0);
+                height = Math.Max(height, 0);
+                LayoutSnapshot layout = _layout;
+                if (_fit) {
+                    Fit(layout, width, height);
+                }
+
+                var cells = new char[height][];
+                for (int row = 0; row < height; row++) {
+                    cells[row] = new char[width];
+                    Array.Fill(cells[row], ' ');
+                }
+
+                // Edges first so nodes and labels are drawn over them
+                foreach ((int from, int to) in layout.Edges) {
+                    LayoutNode a = layout.Nodes[from], b = layout.Nodes[to];
+                    Line(cells, Column(a.X), Row(a.Y), Column(b.X), Row(b.Y));
+                }
+                bool labels = _scale >= LabelScale;
+                foreach (LayoutNode node in layout.Nodes) {
+                    int col = Column(node.X), row = Row(node.Y);
+                    if (row < 0 || row >= height || col < 0 || col >= width) {
+                        continue;
+                    }
+                    cells[row][col] = node.Local ? 'O' : 'o';
+                    if (labels) {
+                        int length = Math.Min(node.Label.Length, Math.Min((int)GraphLayout.NodeWidth - 2, width - col - 2));
+                        if (length > 0) {
+                            node.Label.CopyTo(0, cells[row], col + 2, length);
+                        }
+                    }
+                }
+
+                var status = $" {layout.Nodes.Count} hosts, {layout.Edges.Count} links, zoom {_scale:0.##}{(_fit ? " (fit)" : "")} ";
+                if (height > 0 && status.Length <= width) {
+                    status.CopyTo(0, cells[height - 1], width - status.Length, status.Length);
+                }
+
+                _rows = Array.ConvertAll(cells, row => new string(row));
+                Telemetry.RasterDuration.Record(Telemetry.ElapsedMilliseconds(started));
+            }
+
+            private void Fit(LayoutSnapshot layout, int width, int height) {
+                double spanX = Math.Max(layout.Right - layout.Left, 1);
+                double spanY = Math.Max(layout.Bottom - layout.Top, 1);
+                // Two layout units per row, so height counts double against the vertical span
+                _scale = Math.Clamp(Math.Min(width / spanX, 2.0 * height / spanY), MinScale, 1);
+                _originX = (layout.Left + layout.Right) / 2 - width / 2.0 / _scale;
+                _originY = (layout.Top + layout.Bottom) / 2 - height / _scale;
+            }
+
+            private int Column(double x) {
+                return (int)Math.Round((x - _originX) * _scale);
+            }
+
+            private int Row(double y) {
+                return (int)Math.Round((y - _originY) * _scale / 2);
+            }
+
+            // Bresenham, skipping segments that lie wholly to one side of the view
+            private static void Line(char[][] cells, int x0, int y0, int x1, int y1) {
+                int height = cells.Length, width = height > 0 ? cells[0].Length : 0;
+                if ((x0 < 0 && x1 < 0) || (y0 < 0 && y1 < 0) || (x0 >= width && x1 >= width) || (y0 >= height && y1 >= height)) {
+                    return;
+                }
+                int dx = Math.Abs(x1 - x0), dy = -Math.Abs(y1 - y0);
+                int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+                int error = dx + dy;
+                while (true) {
+                    if (x0 >= 0 && x0 < width && y0 >= 0 && y0 < height) {
+                        cells[y0][x0] = '.';
+                    }
+                    if (x0 == x1 && y0 == y1) {
+                        break;
+                    }
+                    int doubled = 2 * error;
+                    if (doubled >= dy) {
+                        error += dy;
+                        x0 += sx;
+                    }
+                    if (doubled <= dx) {
+                        error += dx;
+                        y0 += sy;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -1,4 +1,5 @@
 using System.Collections.Concurrent;
+using System.Diagnostics;
 using System.Linq;
 using Terminal.Gui;
 using Terminal.Gui.Trees;
@@ -6,16 +7,24 @@ using Terminal.Gui.Trees;
 using TLScope.src.Utilities;
 using TLScope.src.Services;
 using TLScope.src.Controllers;
-using TLScope.src.Models;
+using TLScope.src.Data;
+using TLScope.src.Debugging;
 
 namespace TLScope.src.Views {
     public class NetView : Window {
         private readonly TreeView _deviceTreeView;
-        private readonly ConcurrentDictionary<string, Device> _devices;
         private readonly TreeNode _rootNode = new("Listening for Devices...");
 
-        public NetView(ref NetworkController nc) : base("Network Information") {
-            _devices = nc.GetActiveDevices();
+        // Owned by the UI thread: one row per device, detail rows are built only when a row is expanded
+        private readonly Dictionary<uint, TreeNode> _deviceNodes = [];
+        private readonly ConcurrentQueue<DeviceDeltaEventArgs> _pendingDeltas = new();
+        private readonly TimeSpan _frameInterval = TimeSpan.FromMilliseconds(1000.0 / Settings.UiMaxFramesPerSecond);
+        private int _frameScheduled;
+        private long _lastFrame;
+
+        public NetView(ref NetworkController nc) : this(nc.GetActiveDevices()) { }
+
+        internal NetView(DeviceStore devices) : base("Network Information") {
             ColorScheme = Constants.TLSColorScheme;
 
             _deviceTreeView = new TreeView {
@@ -24,68 +33,134 @@ namespace TLScope.src.Views {
                 Width = Dim.Fill() - 2,
                 Height = Dim.Fill() - 2,
                 CanFocus = true,
+                TreeBuilder = new DelegateTreeBuilder<ITreeNode>(GetChildren, CanExpand)
             };
 
+            // Seed with anything discovered before the view subscribed
+            var seed = new List<DeviceRecord>();
+            devices.CopyTo(seed);
+            foreach (var device in seed) {
+                ApplyChange(new DeviceChange(DeviceChangeKind.Added, device, DeviceFields.All));
+            }
+
             Add(_deviceTreeView);
             _deviceTreeView.AddObject(_rootNode);
+            _deviceTreeView.Expand(_rootNode);
 
-            NetworkService.DeviceListUpdate += (sender, e) => PopulateTreeView();
+            NetworkService.DeviceListUpdate += OnDeviceListUpdate;
         }
 
+        // Raised on a background thread; queue the delta and let the main loop pick it up on its next frame
+        private void OnDeviceListUpdate(object? sender, DeviceDeltaEventArgs delta) {
+            _pendingDeltas.Enqueue(delta);
+            if (Interlocked.Exchange(ref _frameScheduled, 1) == 0) {
+                ScheduleFrame();
+            }
+        }
+
+        private void ScheduleFrame() {
+            var mainLoop = Application.MainLoop;
+            if (mainLoop == null) {
+                // UI not running yet; deltas stay queued and the next one retries
+                Volatile.Write(ref _frameScheduled, 0);
+                return;
+            }
+
+            long sinceLast = System.Environment.TickCount64 - Interlocked.Read(ref _lastFrame);
+            TimeSpan delay = _frameInterval - TimeSpan.FromMilliseconds(sinceLast);
+            if (delay < TimeSpan.Zero) {
+                delay = TimeSpan.Zero;
+            }
+            mainLoop.Invoke(() => mainLoop.AddTimeout(delay, _ => {
+                PopulateTreeView();
+                return false;
+            }));
+        }
+
+        // Queues a delta and renders it right away, bypassing frame scheduling; used by the benchmarks
+        internal void Render(DeviceDeltaEventArgs delta) {
+            _pendingDeltas.Enqueue(delta);
+            PopulateTreeView();
+        }
+
+        /// <summary>
+        /// Applies every queued delta to the tree. Runs on the main loop, at most once per frame.
+        /// </summary>
         private void PopulateTreeView() {
-            // Update root node text
-            _rootNode.Text = $"Number of Devices: {_devices.Count}";
-        
-            // Create a dictionary to map device IP addresses to tree nodes
-            var nodeMap = new Dictionary<string, TreeNode>();
-            foreach (var node in _rootNode.Children.OfType<TreeNode>()) {
-                if (node.Tag is Device device) {
-                    nodeMap[device.IPAddress] = node;
+            // Cleared before draining so a delta arriving mid-frame schedules the next one
+            Volatile.Write(ref _frameScheduled, 0);
+            Interlocked.Exchange(ref _lastFrame, System.Environment.TickCount64);
+            long started = Stopwatch.GetTimestamp();
+
+            bool rowsChanged = false;
+            while (_pendingDeltas.TryDequeue(out var delta)) {
+                foreach (var change in delta.Changes) {
+                    rowsChanged |= ApplyChange(change);
                 }
             }
-        
-            // Create a hash set of the device values
-            var devices = new HashSet<Device>(_devices.Values);
-        
-            // Stack to manage tree nodes
-            var nodeStack = new Stack<TreeNode>();
-        
-            // Compare the existing tree nodes with the devices
-            foreach (var device in devices) {
-                if (device == null) { continue; }
-        
-                if (nodeMap.TryGetValue(device.IPAddress, out var node)) {
-                    // Update the existing node in the tree
-                    node.Tag = device;
-                    node.Children.Clear();
-                    node.Children.Add(new TreeNode($"IP Address: {device.IPAddress}"));
-                    node.Children.Add(new TreeNode($"MAC Address: {device.MACAddress}"));
-                    node.Children.Add(new TreeNode($"Operating System: {device.OperatingSystem ?? "Unknown"}"));
-                    node.Children.Add(new TreeNode($"Last Seen: {device.LastSeen}"));
-                } else {
-                    // Add new node for the device
-                    var newNode = new TreeNode(device.DeviceName) { Tag = device };
-                    newNode.Children.Add(new TreeNode($"IP Address: {device.IPAddress}"));
-                    newNode.Children.Add(new TreeNode($"MAC Address: {device.MACAddress}"));
-                    newNode.Children.Add(new TreeNode($"Operating System: {device.OperatingSystem ?? "Unknown"}"));
-                    newNode.Children.Add(new TreeNode($"Last Seen: {device.LastSeen}"));
-        
-                    _rootNode.Children.Add(newNode);
-                    nodeStack.Push(newNode);
-                }
+
+            _rootNode.Text = $"Number of Devices: {_deviceNodes.Count}";
+            if (rowsChanged) {
+                _deviceTreeView.RefreshObject(_rootNode);
             }
-        
-            // Remove nodes that are no longer in the devices list
-            foreach (var node in _rootNode.Children.OfType<TreeNode>().ToList()) {
-                if (node.Tag is Device device && !devices.Contains(device)) {
-                    _rootNode.Children.Remove(node);
-                }
+            _deviceTreeView.SetNeedsDisplay();
+            Telemetry.RenderDuration.Record(Telemetry.ElapsedMilliseconds(started));
+        }
+
+        // Returns true when a row was added or removed under the root
+        private bool ApplyChange(DeviceChange change) {
+            uint key = change.Device.IP;
+            switch (change.Kind) {
+                case DeviceChangeKind.Added when !_deviceNodes.ContainsKey(key):
+                    var node = new TreeNode(change.Device.Name) { Tag = change.Device };
+                    _deviceNodes[key] = node;
+                    _rootNode.Children.Add(node);
+                    return true;
+
+                case DeviceChangeKind.Removed:
+                    if (_deviceNodes.Remove(key, out var removed)) {
+                        _rootNode.Children.Remove(removed);
+                        return true;
+                    }
+                    return false;
+
+                default:
+                    if (_deviceNodes.TryGetValue(key, out var existing)) {
+                        existing.Tag = change.Device;
+                        existing.Text = change.Device.State == DeviceState.Suspect
+                            ? $"{change.Device.Name} (no reply)"
+                            : change.Device.Name;
+                        // Collapsed rows have no detail nodes to refresh; they are rebuilt on expand
+                        if (_deviceTreeView.IsExpanded(existing)) {
+                            _deviceTreeView.RefreshObject(existing);
+                        }
+                    }
+                    return false;
             }
-        
-            // Refresh the TreeView
-            _deviceTreeView.ClearObjects();
-            _deviceTreeView.AddObject(_rootNode);
-            _deviceTreeView.ExpandAll();
+        }
+
+        private bool CanExpand(ITreeNode node) {
+            return node == _rootNode || node.Tag is DeviceRecord;
+        }
+
+        private IEnumerable<ITreeNode> GetChildren(ITreeNode node) {
+            if (node == _rootNode) {
+                return _rootNode.Children;
+            }
+            if (node.Tag is DeviceRecord device) {
+                return [
+                    new TreeNode($"IP Address: {device.IPAddress}"),
+                    .. device.IPv6Addresses.Select(address => new TreeNode($"IPv6 Address: {address}")),
+                    new TreeNode($"MAC Address: {device.MACAddress}"),
+                    new TreeNode($"Vendor: {device.Vendor ?? "Unknown"}{(OuiTable.SharedIsSample ? " (partial sample table)" : "")}"),
+                    new TreeNode($"Interface: {device.Interface ?? "Unknown"}"),
+                    new TreeNode($"Operating System: {device.OperatingSystem ?? "Unknown"}"),
+                    new TreeNode($"Certificate: {device.CertificateInfo?.Subject ?? "n/a"}"),
+                    new TreeNode($"Last Seen: {device.LastSeen}"),
+                    new TreeNode($"Round Trip: {(device.RoundTripMs is double rtt ? $"{rtt:F1} ms" : "n/a")}")
+                ];
+            }
+            return [];
         }
     }
 }
@@ -12,7 +12,6 @@ namespace TLScope.src.Views {
         private readonly TreeView _userTreeView;
 
         public UserView(ref NetworkController nc) : base("Client Information") {
-            var ni = nc._networkInterface ?? throw new InvalidOperationException("Network interface is null");
             CanFocus = false;
             ColorScheme = Constants.TLSColorScheme;
 
@@ -25,18 +24,18 @@ namespace TLScope.src.Views {
             };
 
             var root = new TreeNode($"This Device ({System.Environment.MachineName})");
-            var interfaceNode = new TreeNode($"Operational Status: {ni.OperationalStatus}") {
-                Children = {
-                    new TreeNode($"Interface Name:.....{ni.Name}"),
-                    new TreeNode($"Interface Type:.....{ni.NetworkInterfaceType}"),
-                    new TreeNode($"MAC Address:........{ni.GetPhysicalAddress()}"),
-                    new TreeNode($"IPv4:...............{NetData.GetLocalIPAddress(ni)}"),   
-                    new TreeNode($"Speed:..............{ni.Speed}"),
-                    new TreeNode($"Multicast Support:..{ni.SupportsMulticast}")
-                }
-            };
+            foreach (var ni in nc.Interfaces) {
+                root.Children.Add(new TreeNode($"{ni.Name} ({ni.OperationalStatus})") {
+                    Children = {
+                        new TreeNode($"Interface Type:.....{ni.NetworkInterfaceType}"),
+                        new TreeNode($"MAC Address:........{ni.GetPhysicalAddress()}"),
+                        new TreeNode($"IPv4:...............{NetData.GetLocalIPAddress(ni)}"),
+                        new TreeNode($"Speed:..............{ni.Speed}"),
+                        new TreeNode($"Multicast Support:..{ni.SupportsMulticast}")
+                    }
+                });
+            }
 
-            root.Children.Add(interfaceNode);
             _userTreeView.AddObject(root);
             _userTreeView.ExpandAll();
             Add(_userTreeView);